@@ -4,6 +4,7 @@
 
 // Lokale Bibliotheks-Includes
 #include "RS485SecureStack.h"
+#include "RS485BusCapture.h"
 #include "credentials.h" // Enthält MASTER_KEY
 
 // WICHTIG: Wählen Sie EINE der folgenden Zeilen, je nach Ihrem RS485-Modul:
@@ -19,6 +20,19 @@
 #define MY_ADDRESS 254 // Eine Adresse, die nicht mit anderen Nodes kollidiert
 #define INITIAL_KEY_ID 0 // Startet mit Key ID 0
 
+// Mitschnitt-Modus: 1 = alle Frames (auch fremde und fehlerhafte) als pcap-Binärstrom über die
+// USB-Schnittstelle ausgeben, Auswertung mit tools/capture_decode. Der Mitschnitt beginnt, sobald
+// der PC ein beliebiges Byte sendet. In diesem Modus gibt der Monitor keinen Text aus.
+// 0 = lesbare Ausgabe der an den Monitor adressierten Pakete und Broadcasts.
+#define CAPTURE_MODE 0
+#define CAPTURE_SERIAL_BAUD 921600
+
+#if CAPTURE_MODE
+#define MONITOR_PRINTF(...) do {} while (0)
+#else
+#define MONITOR_PRINTF(...) Serial.printf(__VA_ARGS__)
+#endif
+
 // Definition der UART für RS485
 HardwareSerial& rs485Serial = Serial1; // Beispiel: UART1 des ESP32
 
@@ -41,6 +55,7 @@ AutomaticDirectionControl myDirectionControl;
 // Globales Objekt für den Stack - ÜBERGABE DES DIRECTIONCONTROL-OBJEKTS
 // ==============================================================================
 RS485SecureStack rs485Stack(&myDirectionControl);
+RS485BusCapture busCapture;
 
 // ==============================================================================
 // Funktionsprototypen
@@ -48,22 +63,38 @@ RS485SecureStack rs485Stack(&myDirectionControl);
 void onPacketReceived(RS485SecureStack::Packet_t packet);
 
 void setup() {
+#if CAPTURE_MODE
+    Serial.begin(CAPTURE_SERIAL_BAUD);
+#else
     Serial.begin(115200);
+#endif
     delay(1000);
-    Serial.printf("\n--- RS485SecureStack Bus Monitor (Address %d) ---\n", MY_ADDRESS);
+    MONITOR_PRINTF("\n--- RS485SecureStack Bus Monitor (Address %d) ---\n", MY_ADDRESS);
 
     // Initialisiere RS485SecureStack
     // Der Monitor hört nur zu, sendet aber nichts aktiv, muss aber trotzdem die Baudrate kennen.
     // Die myDirectionControl.begin() wird nun automatisch in rs485Stack.begin() aufgerufen
     rs485Stack.begin(MY_ADDRESS, MASTER_KEY, INITIAL_KEY_ID, rs485Serial);
     rs485Stack.registerReceiveCallback(onPacketReceived);
+#if CAPTURE_MODE
+    busCapture.begin(&rs485Stack, Serial); // Debug-Ausgaben bleiben aus, sie würden den Binärstrom stören
+#else
     rs485Stack.setDebug(true); // Debug-Ausgaben aktivieren
+#endif
 
-    Serial.println("Monitor: Initialisierung abgeschlossen. Warte auf Bus-Verkehr...");
+    MONITOR_PRINTF("Monitor: Initialisierung abgeschlossen. Warte auf Bus-Verkehr...\n");
 }
 
 void loop() {
     rs485Stack.loop(); // Empfängt Pakete und verarbeitet sie über den Callback
+#if CAPTURE_MODE
+    // Ein Byte vom PC startet einen neuen Mitschnitt (mit pcap-Dateikopf)
+    if (Serial.available()) {
+        while (Serial.available()) Serial.read();
+        busCapture.start();
+    }
+    busCapture.update();
+#endif
     // Der Monitor hat keine eigene Logik, außer zu lauschen.
 }
 
@@ -74,30 +105,30 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
     // Dieser Callback wird für jedes empfangene und (wenn möglich) entschlüsselte/authentifizierte Paket aufgerufen.
     // Der Monitor loggt einfach alles, was er sieht.
 
-    Serial.println("\n--- Paket Empfangen ---");
-    Serial.printf("  Nachrichtentyp: '%c'\n", packet.messageType);
-    Serial.printf("  Zieladresse:     %d\n", packet.destinationAddress);
-    Serial.printf("  Absenderadresse: %d\n", packet.senderAddress);
-    Serial.printf("  Key ID:          %d\n", packet.keyId);
-    Serial.printf("  Payload Länge:   %d\n", packet.payload.length());
-    Serial.printf("  Payload (klar):  '%s'\n", packet.payload.c_str());
-    Serial.printf("  HMAC geprüft:    %s\n", packet.hmacVerified ? "OK" : "FEHLER!");
-    Serial.printf("  CRC geprüft:     %s\n", packet.crcVerified ? "OK" : "FEHLER!");
-    Serial.printf("  Ist ACK/NACK:    %s\n", packet.isAck ? "Ja" : "Nein");
-    Serial.println("-----------------------\n");
+    MONITOR_PRINTF("\n--- Paket Empfangen ---\n");
+    MONITOR_PRINTF("  Nachrichtentyp: '%c'\n", packet.messageType);
+    MONITOR_PRINTF("  Zieladresse:     %d\n", packet.destinationAddress);
+    MONITOR_PRINTF("  Absenderadresse: %d\n", packet.senderAddress);
+    MONITOR_PRINTF("  Key ID:          %d\n", packet.keyId);
+    MONITOR_PRINTF("  Payload Länge:   %d\n", packet.payload.length());
+    MONITOR_PRINTF("  Payload (klar):  '%s'\n", packet.payload.c_str());
+    MONITOR_PRINTF("  HMAC geprüft:    %s\n", packet.hmacVerified ? "OK" : "FEHLER!");
+    MONITOR_PRINTF("  CRC geprüft:     %s\n", packet.crcVerified ? "OK" : "FEHLER!");
+    MONITOR_PRINTF("  Ist ACK/NACK:    %s\n", packet.isAck ? "Ja" : "Nein");
+    MONITOR_PRINTF("-----------------------\n\n");
 
     // Wenn der Monitor die Baudrate ändern soll, wenn der Master dies tut:
     if (packet.messageType == MSG_TYPE_BAUD_RATE_SET && packet.senderAddress == 0) { // Master ist Adresse 0
         long newBaudRate = packet.payload.toInt();
         if (newBaudRate > 0) {
-            Serial.printf("Monitor: Baudrate-Set vom Master empfangen. Passe eigene Baudrate auf %ld an.\n", newBaudRate);
+            MONITOR_PRINTF("Monitor: Baudrate-Set vom Master empfangen. Passe eigene Baudrate auf %ld an.\n", newBaudRate);
             rs485Stack.setBaudRate(newBaudRate);
         }
     }
     // Wenn der Monitor den Schlüssel synchronisieren soll, wenn der Master dies tut:
     else if (packet.messageType == MSG_TYPE_KEY_UPDATE && packet.senderAddress == 0) {
         // Der Monitor muss den Master Key haben, um den neuen Session Key zu entschlüsseln.
-        Serial.println("Monitor: Key-Update vom Master empfangen.");
+        MONITOR_PRINTF("Monitor: Key-Update vom Master empfangen.\n");
         
         // Der hier implementierte `processKeyUpdate` ist nur ein Platzhalter.
         // In einer echten Anwendung müsste der Monitor die gleiche Logik wie Submaster/Client implementieren,
@@ -139,15 +170,15 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
 
                 if (rs485Stack.setSessionKey(newKeyId, encryptedSessionKey, sizeof(encryptedSessionKey))) {
                     rs485Stack.setCurrentKeyId(newKeyId);
-                    Serial.printf("Monitor: Erfolgreich neuen Session Key (ID %d) gesetzt, um weiter mithören zu können.\n", newKeyId);
+                    MONITOR_PRINTF("Monitor: Erfolgreich neuen Session Key (ID %d) gesetzt, um weiter mithören zu können.\n", newKeyId);
                 } else {
-                    Serial.println("ERR: Monitor konnte neuen Session Key nicht setzen.");
+                    MONITOR_PRINTF("ERR: Monitor konnte neuen Session Key nicht setzen.\n");
                 }
             } else {
-                Serial.println("ERR: Key Update Payload: Hex-Länge ungültig für Monitor.");
+                MONITOR_PRINTF("ERR: Key Update Payload: Hex-Länge ungültig für Monitor.\n");
             }
         } else {
-            Serial.println("ERR: Key Update Payload ungültig (JSON-Fehler) für Monitor.");
+            MONITOR_PRINTF("ERR: Key Update Payload ungültig (JSON-Fehler) für Monitor.\n");
         }
     }
 }
@@ -5,7 +5,10 @@
 
 // Lokale Bibliotheks-Includes
 #include "RS485SecureStack.h"
+#include "SubmasterRelay.h" // Für die Antwort-Zeitschlitze bei Multicast-Abfragen
 #include "credentials.h" // Enthält MASTER_KEY
+#include "NvsSessionStore.h" // Sitzungszustand für den Warmstart
+#include "RS485Telemetry.h" // Abonnierte Messwerte mit Deadband
 
 // WICHTIG: Wählen Sie EINE der folgenden Zeilen, je nach Ihrem RS485-Modul:
 // Option 1: Für Module MIT einem DE/RE-Pin, der manuell gesteuert werden muss (z.B. einfache MAX485-Module)
@@ -20,10 +23,16 @@
 #define MY_ADDRESS 11 // ANPASSEN: Eindeutige Adresse für diesen Client (z.B. 11, 12, etc.)
 #define SUBMASTER_ADDRESS 1 // ANPASSEN: Adresse des Submasters, dem dieser Client zugeordnet ist
 #define INITIAL_KEY_ID 0 // Startet mit Key ID 0
+#define CLIENT_GROUP_ADDRESS (RS485_GROUP_ADDRESS_FIRST + SUBMASTER_ADDRESS) // Multicast-Gruppe aller Clients des Submasters
 
 #define SUBMASTER_POLL_TIMEOUT_MS 10000 // Wenn länger kein Poll vom Submaster, gehe in Wartezustand
 #define STATUS_REPORT_INTERVAL_MS 3000 // Alle 3 Sekunden eigenen Status an Submaster melden
 
+// Datenpunkte für Abonnenten (Master/Submaster per TelemetrySubscriber)
+#define POINT_TEMPERATURE 1 // 0,1 °C
+#define POINT_HUMIDITY    2 // 0,1 %
+#define SENSOR_SAMPLE_INTERVAL_MS 500
+
 // ==============================================================================
 // STATE MACHINE FÜR CLIENT
 // ==============================================================================
@@ -40,6 +49,9 @@ ClientState currentClientState = STATE_WAITING_FOR_SUBMASTER;
 // ==============================================================================
 unsigned long lastSubmasterPollMillis = 0;
 unsigned long lastStatusReportMillis = 0;
+unsigned long lastSensorSampleMillis = 0;
+bool statusReplyPending = false;          // Antwort auf eine Multicast-Abfrage steht aus
+unsigned long statusReplyDueMillis = 0;   // Zeitpunkt des eigenen Antwort-Zeitschlitzes
 long currentBaudRate = RS485_INITIAL_BAUD_RATE;
 uint8_t currentKeyId = INITIAL_KEY_ID;
 
@@ -65,6 +77,12 @@ AutomaticDirectionControl myDirectionControl;
 // ==============================================================================
 RS485SecureStack rs485Stack(&myDirectionControl);
 
+// Sitzungszustand (Baudrate, Schlüssel-IDs, Sequenz) im NVS für den Warmstart
+NvsSessionStore sessionStore;
+
+// Sendet abonnierte Messwerte nur bei Änderung über das Deadband oder nach dem maximalen Intervall
+TelemetryPublisher telemetry;
+
 // ==============================================================================
 // Funktionsprototypen
 // ==============================================================================
@@ -84,9 +102,25 @@ void setup() {
     // Initialisiere RS485SecureStack
     // Die myDirectionControl.begin() wird nun automatisch in rs485Stack.begin() aufgerufen
     rs485Stack.begin(MY_ADDRESS, MASTER_KEY, INITIAL_KEY_ID, rs485Serial);
+    rs485Stack.setSessionStore(&sessionStore);
+    if (rs485Stack.restoreSession()) {
+        // Warmstart: ausgehandelte Baudrate und Session Key direkt übernehmen
+        currentBaudRate = rs485Stack.getBaudRate();
+        currentKeyId = rs485Stack.getCurrentKeyId();
+        Serial.printf("Client: Sitzung wiederhergestellt (Baudrate %ld, Key ID %d).\n", currentBaudRate, currentKeyId);
+    }
+    // Zyklische Statusmeldungen gehen erst auf einen freien Bus (Carrier Sense mit Backoff)
+    rs485Stack.enableCarrierSense(true);
     rs485Stack.registerReceiveCallback(onPacketReceived);
     rs485Stack.setDebug(true); // Debug-Ausgaben aktivieren
 
+    // Der Submaster fragt alle seine Clients mit einem Multicast-Frame ab
+    rs485Stack.joinGroup(CLIENT_GROUP_ADDRESS);
+
+    telemetry.begin(&rs485Stack, MY_ADDRESS);
+    telemetry.addPoint(POINT_TEMPERATURE, TELEMETRY_TYPE_INT);
+    telemetry.addPoint(POINT_HUMIDITY, TELEMETRY_TYPE_INT);
+
     lastSubmasterPollMillis = millis();
     lastStatusReportMillis = millis();
     Serial.println("Client: Initialisierung abgeschlossen. Warte auf Submaster.");
@@ -95,6 +129,20 @@ void setup() {
 void loop() {
     rs485Stack.loop(); // Empfängt Pakete
 
+    // Messwerte laufend aktualisieren, gesendet wird nur an Abonnenten und nur bei Bedarf
+    if (millis() - lastSensorSampleMillis >= SENSOR_SAMPLE_INTERVAL_MS) {
+        lastSensorSampleMillis = millis();
+        telemetry.setValue(POINT_TEMPERATURE, (int32_t)(215 + random(-2, 3))); // Beispiel: 21,5 °C mit Rauschen
+        telemetry.setValue(POINT_HUMIDITY, (int32_t)(480 + random(-5, 6)));
+    }
+    telemetry.update();
+
+    // Antwort auf eine Multicast-Abfrage im eigenen Zeitschlitz senden
+    if (statusReplyPending && (long)(millis() - statusReplyDueMillis) >= 0) {
+        statusReplyPending = false;
+        reportStatusToSubmaster();
+    }
+
     // Submaster-Präsenz überprüfen
     if (currentClientState == STATE_ONLINE && millis() - lastSubmasterPollMillis > SUBMASTER_POLL_TIMEOUT_MS) {
         Serial.println("ERR: Submaster-Poll Timeout. Gehe in Wartezustand.");
@@ -151,6 +199,11 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
         return;
     }
 
+    // Abonnements (MSG_TYPE_TELEMETRY) verwaltet der TelemetryPublisher
+    if (telemetry.handlePacket(packet)) {
+        return;
+    }
+
     // Behandlung anderer Nachrichtentypen
     switch (packet.messageType) {
         case MSG_TYPE_MASTER_HEARTBEAT: // Clients ignorieren Master-Heartbeats
@@ -180,8 +233,14 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
                 lastSubmasterPollMillis = millis(); // Submaster ist aktiv
                 currentClientState = STATE_ONLINE; // Client ist online und bereit
 
-                // Sende sofort eine Antwort auf die Statusanfrage
-                reportStatusToSubmaster();
+                if (packet.isMulticast) {
+                    // Multicast-Abfrage: im eigenen Zeitschlitz antworten, damit sich die Clients nicht überlagern
+                    statusReplyDueMillis = millis() + SubmasterRelay::replyDelayMillis(rs485Stack, CLIENT_GROUP_ADDRESS, MY_ADDRESS);
+                    statusReplyPending = true;
+                } else {
+                    // Sende sofort eine Antwort auf die Statusanfrage
+                    reportStatusToSubmaster();
+                }
             } else {
                 Serial.println("Client: Unbekannte Daten-Nachricht.");
             }
@@ -0,0 +1,9 @@
+#pragma once
+
+// Der Pre-Shared Master Key für den PoC (MUSS AUF ALLEN DEVICES IDENTISCH SEIN!)
+const byte MASTER_KEY[32] = {
+    0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+    0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C,
+    0xA7, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF, 0x01, 0x02,
+    0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x10
+};
\ No newline at end of file
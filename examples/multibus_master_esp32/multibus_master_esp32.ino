@@ -0,0 +1,135 @@
+#include <Arduino.h>
+#include <HardwareSerial.h>
+
+// Lokale Bibliotheks-Includes
+#include "RS485SecureStack.h"
+#include "RS485KeyStore.h"
+#include "RS485BusTask.h"
+#include "credentials.h" // Enthält MASTER_KEY
+
+// Für Module OHNE externen DE/RE-Pin (mit automatischer Flussrichtung).
+// Für Module mit DE/RE-Pin: ManualDE_REDirectionControl mit je einem eigenen Pin pro Bus.
+#include "AutomaticDirectionControl.h"
+
+
+// ==============================================================================
+// GLOBAL KONFIGURATION (Multi-Bus-Master)
+// ==============================================================================
+// Ein Master betreibt zwei RS485-Segmente über zwei UARTs. Jeder Bus läuft in einer
+// eigenen FreeRTOS-Task auf einem eigenen Kern. Nachrichten zwischen den Segmenten
+// werden über die thread-sichere Weiterleitungs-Warteschlange von RS485BusTask übergeben.
+#define MY_ADDRESS 0 // Master ist auf beiden Segmenten Adresse 0
+#define CURRENT_KEY_ID 0
+
+#define MASTER_HEARTBEAT_INTERVAL_MS 5000
+#define STATS_INTERVAL_MS 10000
+
+// Weiterleitung: Ein Node bittet den Master mit "FWD:<zieladresse>:<daten>" (MSG_TYPE_DATA),
+// <daten> an <zieladresse> auf dem jeweils anderen Segment zu senden.
+#define FORWARD_PREFIX "FWD:"
+
+// UARTs der beiden Segmente
+HardwareSerial& segmentASerial = Serial1;
+HardwareSerial& segmentBSerial = Serial2;
+
+AutomaticDirectionControl segmentADirectionControl;
+AutomaticDirectionControl segmentBDirectionControl;
+
+// Gemeinsamer Schlüsselspeicher: wird einmal befüllt, beide Stacks lesen ihn nur
+RS485KeyStore sharedKeys;
+
+RS485SecureStack segmentAStack(&segmentADirectionControl, &sharedKeys);
+RS485SecureStack segmentBStack(&segmentBDirectionControl, &sharedKeys);
+
+RS485BusTask segmentA(segmentAStack);
+RS485BusTask segmentB(segmentBStack);
+
+unsigned long lastHeartbeatMillis = 0;
+unsigned long lastStatsMillis = 0;
+
+// ==============================================================================
+// Funktionsprototypen
+// ==============================================================================
+void onPacketReceived(void* context, RS485SecureStack::Packet_t packet);
+void printBusStats(const char* name, RS485BusTask& bus);
+
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+    Serial.println("\n--- RS485SecureStack Multi-Bus-Master ---");
+
+    randomSeed(analogRead(0));
+
+    sharedKeys.setMasterKey(MASTER_KEY);
+
+    // Bei gemeinsamem Schlüsselspeicher wird der Master Key in begin() nicht benötigt
+    segmentAStack.begin(MY_ADDRESS, nullptr, CURRENT_KEY_ID, segmentASerial);
+    segmentBStack.begin(MY_ADDRESS, nullptr, CURRENT_KEY_ID, segmentBSerial);
+    segmentAStack.setDebug(true, "A");
+    segmentBStack.setDebug(true, "B");
+
+    // Der Kontext ist der jeweils ANDERE Bus: dorthin wird weitergeleitet
+    segmentAStack.registerReceiveCallback(onPacketReceived, &segmentB);
+    segmentBStack.registerReceiveCallback(onPacketReceived, &segmentA);
+
+    // Ab hier werden die Stacks nur noch aus ihrer eigenen Task benutzt
+    if (!segmentA.start("rs485_a", 0) || !segmentB.start("rs485_b", 1)) {
+        Serial.println("Multi-Bus-Master: Bus-Tasks konnten nicht gestartet werden.");
+    }
+
+    lastHeartbeatMillis = millis();
+    lastStatsMillis = millis();
+    Serial.println("Multi-Bus-Master: Initialisierung abgeschlossen.");
+}
+
+void loop() {
+    // Die Bus-Tasks empfangen und senden selbst. Die Arduino-loop() gibt nur Aufträge über post() ab.
+    if (millis() - lastHeartbeatMillis > MASTER_HEARTBEAT_INTERVAL_MS) {
+        segmentA.post(RS485_BROADCAST_ADDRESS, MSG_TYPE_MASTER_HEARTBEAT, "H", false, RS485_TX_CLASS_HEARTBEAT);
+        segmentB.post(RS485_BROADCAST_ADDRESS, MSG_TYPE_MASTER_HEARTBEAT, "H", false, RS485_TX_CLASS_HEARTBEAT);
+        lastHeartbeatMillis = millis();
+    }
+
+    if (millis() - lastStatsMillis > STATS_INTERVAL_MS) {
+        printBusStats("A", segmentA);
+        printBusStats("B", segmentB);
+        lastStatsMillis = millis();
+    }
+    delay(10);
+}
+
+// ==============================================================================
+// Callback-Funktion (läuft in der Task des empfangenden Busses)
+// ==============================================================================
+void onPacketReceived(void* context, RS485SecureStack::Packet_t packet) {
+    RS485BusTask* otherSegment = static_cast<RS485BusTask*>(context);
+
+    if (!packet.hmacVerified || !packet.crcVerified || packet.messageType != MSG_TYPE_DATA) {
+        return;
+    }
+    if (!packet.payload.startsWith(FORWARD_PREFIX)) {
+        return;
+    }
+
+    // "FWD:<zieladresse>:<daten>"
+    int separator = packet.payload.indexOf(':', strlen(FORWARD_PREFIX));
+    if (separator < 0) {
+        return;
+    }
+    uint8_t targetAddress = packet.payload.substring(strlen(FORWARD_PREFIX), separator).toInt();
+    String data = packet.payload.substring(separator + 1);
+
+    // Kurz warten statt sofort zu verwerfen: Gegendruck, wenn das Zielsegment ausgelastet ist
+    if (!otherSegment->post(targetAddress, MSG_TYPE_DATA, data, false, RS485_TX_CLASS_BULK, pdMS_TO_TICKS(5))) {
+        Serial.printf("Multi-Bus-Master: Weiterleitung von %d an %d verworfen (Zielsegment voll).\n",
+                      packet.senderAddress, targetAddress);
+    }
+}
+
+void printBusStats(const char* name, RS485BusTask& bus) {
+    RS485BusTask::ForwardStats_t stats = bus.getStats();
+    Serial.printf("Segment %s: %lu Durchläufe, %lu angenommen, %lu übernommen, %lu verworfen\n", name,
+                  (unsigned long)stats.loops, (unsigned long)stats.posted,
+                  (unsigned long)stats.queued, (unsigned long)stats.dropped);
+}
@@ -7,6 +7,8 @@
 
 // Lokale Bibliotheks-Includes
 #include "RS485SecureStack.h"
+#include "BaudRateNegotiator.h"
+#include "RS485TimeSync.h"
 #include "credentials.h" // Enthält MASTER_KEY, MY_ADDRESS etc.
 
 // WICHTIG: Wählen Sie EINE der folgenden Zeilen, je nach Ihrem RS485-Modul:
@@ -24,11 +26,11 @@
 #define CURRENT_KEY_ID 0 // Startet mit Key ID 0
 
 #define MASTER_HEARTBEAT_INTERVAL_MS 5000 // Alle 5 Sekunden einen Heartbeat senden
-#define BAUD_RATE_MEASUREMENT_INTERVAL_MS 60000 // Alle 60 Sekunden Baudrate einmessen (nur PoC)
 #define REKEYING_INTERVAL_MS 300000 // Alle 5 Minuten Rekeying starten (nur PoC)
 #define NODE_TIMEOUT_MS 15000 // Wenn keine Kommunikation von Node in dieser Zeit, als offline markieren
+#define RX_BUDGET_MICROS 2000 // Höchstens so lange Empfang je loop(), damit der Heartbeat pünktlich bleibt
 
-// Liste der zu testenden Baudraten für die Einmessung
+// Kandidaten für die Baudraten-Aushandlung (schnellste zuerst)
 const long TEST_BAUD_RATES[] = {115200L, 57600L, 38400L, 19200L, 9600L};
 const int NUM_BAUD_RATES = sizeof(TEST_BAUD_RATES) / sizeof(TEST_BAUD_RATES[0]);
 
@@ -49,11 +51,8 @@ SchedulerState currentSchedulerState = STATE_INIT_BUS;
 // Globale Variablen für den Scheduler
 // ==============================================================================
 unsigned long lastHeartbeatMillis = 0;
-unsigned long lastBaudRateMeasurementMillis = 0;
 unsigned long lastRekeyingMillis = 0;
 unsigned long rekeyingStartTime = 0;
-int currentBaudRateIndex = 0;
-bool baudRateSetAckReceived = false;
 uint8_t nextKeyId = 1; // Startet mit Key ID 1 für das erste Rekeying
 
 // Node-Zustandsverwaltung
@@ -67,7 +66,6 @@ std::map<uint8_t, NodeStatus> connectedNodes; // Key: Node-Adresse
 
 // Baudrate-Management für Rekeying
 long rekeyingBaudRate = 0;
-unsigned long rekeyingAckCount = 0; // Anzahl der ACKs für Rekeying
 
 // Zähler für Statistiken
 unsigned long packetsSent = 0;
@@ -98,6 +96,12 @@ AutomaticDirectionControl myDirectionControl;
 // ==============================================================================
 RS485SecureStack rs485Stack(&myDirectionControl); 
 
+// Baudraten-Aushandlung: Probe-Bursts je Kandidat, danach nur noch Überwachung der Fehlerstatistik
+BaudRateNegotiator baudNegotiator;
+
+// Zeitsynchronisation: Der Master gibt die Buszeit vor und stempelt seine Heartbeats
+RS485TimeSync timeSync;
+
 // ==============================================================================
 // Funktionsprototypen
 // ==============================================================================
@@ -131,14 +135,21 @@ void setup() {
     connectedNodes[11] = {0, false, false, false}; // Client 11 (zugeordnet zu Submaster 1)
     connectedNodes[12] = {0, false, false, false}; // Client 12 (zugeordnet zu Submaster 2)
 
+    // Alle erwarteten Nodes müssen die gewählte Baudrate im Fehlerbudget bestehen
+    baudNegotiator.begin(&rs485Stack, MY_ADDRESS, TEST_BAUD_RATES, NUM_BAUD_RATES);
+    for (auto const& [address, status] : connectedNodes) {
+        baudNegotiator.addNode(address);
+    }
+
+    timeSync.begin(&rs485Stack, true);
+
     lastHeartbeatMillis = millis();
-    lastBaudRateMeasurementMillis = millis();
     lastRekeyingMillis = millis();
     Serial.println("Scheduler: Initialisierung abgeschlossen.");
 }
 
 void loop() {
-    rs485Stack.loop(); // Empfängt Pakete
+    rs485Stack.loop(RX_BUDGET_MICROS); // Empfängt Pakete (Rest beim nächsten Durchlauf)
 
     switch (currentSchedulerState) {
         case STATE_INIT_BUS:
@@ -150,16 +161,14 @@ void loop() {
                 sendHeartbeat();
                 lastHeartbeatMillis = millis();
             }
-            if (millis() - lastBaudRateMeasurementMillis > BAUD_RATE_MEASUREMENT_INTERVAL_MS) {
-                currentSchedulerState = STATE_INIT_BUS; // Erneut Baudrate einmessen
-                Serial.println("Scheduler: Starte erneute Baudraten-Einmessung.");
-                lastBaudRateMeasurementMillis = millis();
+            if (baudNegotiator.update()) {
+                currentSchedulerState = STATE_INIT_BUS; // Verbindung verschlechtert: neu aushandeln
+                Serial.println("Scheduler: Starte erneute Baudraten-Aushandlung.");
             }
             if (millis() - lastRekeyingMillis > REKEYING_INTERVAL_MS) {
                 currentSchedulerState = STATE_REKEYING;
                 Serial.println("Scheduler: Starte Rekeying-Prozess.");
                 rekeyingStartTime = millis();
-                rekeyingAckCount = 0;
                 generateAndSendNewKey();
                 lastRekeyingMillis = millis(); // Reset für nächsten Rekeying-Intervall
             }
@@ -212,31 +221,9 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
     // Aktualisiere den Last-Seen-Status für den Absender
     updateNodeStatus(packet.senderAddress);
 
-    // Spezialbehandlung für ACKs/NACKs
+    // ACKs/NACKs wertet der Stack selbst aus (kompakte ACKs erreichen den Callback nicht)
     if (packet.isAck) {
         Serial.printf("RCV ACK/NACK von %d: %s\n", packet.senderAddress, packet.payload.c_str());
-        if (packet.payload.startsWith("ACK")) {
-            // Je nach Kontext des wartenden ACK:
-            if (currentSchedulerState == STATE_INIT_BUS) {
-                // Bestätigung für Baudrate-Set
-                // Wir zählen ACKs und gehen erst weiter, wenn alle erwarteten Nodes geantwortet haben
-                baudRateSetAckReceived = true; // Setzt für den Master, dass er geantwortet hat
-                Serial.printf("ACK für Baudrate von Node %d erhalten.\n", packet.senderAddress);
-                // Hier müsste man tracken, welche Nodes geantwortet haben
-            } else if (currentSchedulerState == STATE_REKEYING && packet.messageType == MSG_TYPE_ACK_NACK) {
-                // Bestätigung für Key Update
-                rekeyingAckCount++;
-                Serial.printf("ACK für Rekeying von Node %d erhalten. Zähler: %lu/%lu\n", packet.senderAddress, rekeyingAckCount, connectedNodes.size());
-            }
-        } else if (packet.payload.startsWith("NACK")) {
-            Serial.printf("NACK von %d erhalten: %s\n", packet.senderAddress, packet.payload.c_str());
-            // Fehlerbehandlung für NACK
-            if (currentSchedulerState == STATE_REKEYING) {
-                Serial.printf("Rekeying fehlgeschlagen für Node %d: %s. Bleibe bei alter Key ID.\n", packet.senderAddress, packet.payload.c_str());
-                // Hier müsste man ggf. ein Rollback initiieren oder den Node isolieren
-                currentSchedulerState = STATE_NORMAL_OPERATION; // Abbruch des Rekeyings
-            }
-        }
         return; // ACK/NACK wurde verarbeitet, keine weitere Behandlung
     }
 
@@ -265,6 +252,31 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
                     connectedNodes[packet.senderAddress].permissionToSend = false; // Permission verbraucht
                 }
             }
+            // Aggregierter Bericht eines Submasters: "AGG:<F|D>|<adresse>=<messwert>|<adresse>=!"
+            if (connectedNodes.count(packet.senderAddress) && packet.payload.startsWith("AGG:")) {
+                Serial.printf("Submaster %d Client-Bericht (%s):\n", packet.senderAddress,
+                              packet.payload.charAt(4) == 'F' ? "voll" : "Änderungen");
+                int entryStart = packet.payload.indexOf('|');
+                while (entryStart != -1) {
+                    int entryEnd = packet.payload.indexOf('|', entryStart + 1);
+                    String entry = entryEnd == -1 ? packet.payload.substring(entryStart + 1) : packet.payload.substring(entryStart + 1, entryEnd);
+                    int separator = entry.indexOf('=');
+                    if (separator > 0) {
+                        uint8_t clientAddress = entry.substring(0, separator).toInt();
+                        String reading = entry.substring(separator + 1);
+                        if (reading.equals("!")) {
+                            Serial.printf("  Client %d: offline\n", clientAddress);
+                        } else {
+                            updateNodeStatus(clientAddress); // Client ist über den Submaster erreichbar
+                            Serial.printf("  Client %d: %s\n", clientAddress, reading.c_str());
+                        }
+                    }
+                    entryStart = entryEnd;
+                }
+                if (connectedNodes[packet.senderAddress].permissionToSend) {
+                    connectedNodes[packet.senderAddress].permissionToSend = false; // Permission verbraucht
+                }
+            }
             // Beispiel: Client meldet Status
             if (connectedNodes.count(packet.senderAddress) && packet.payload.startsWith("STATUS_OK")) {
                  Serial.printf("Client %d Status: %s\n", packet.senderAddress, packet.payload.c_str());
@@ -279,40 +291,18 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
 }
 
 // ==============================================================================
-// Baudraten-Einmessung
+// Baudraten-Aushandlung
 // ==============================================================================
 void manageBaudRateMeasurement() {
-    // Sende die aktuelle Test-Baudrate als Broadcast
-    if (millis() - lastBaudRateMeasurementMillis > 2000) { // Genug Zeit für Antworten
-        if (currentBaudRateIndex < NUM_BAUD_RATES) {
-            long testBaud = TEST_BAUD_RATES[currentBaudRateIndex];
-            Serial.printf("Scheduler: Teste Baudrate: %ld\n", testBaud);
-            rs485Stack.setBaudRate(testBaud); // Setze eigene Baudrate
-
-            StreamString payload;
-            payload.printf("%ld", testBaud);
-
-            // Sende die Baudrate als Broadcast. Erfordert ACK.
-            if (rs485Stack.sendMessage(255, MY_ADDRESS, MSG_TYPE_BAUD_RATE_SET, payload.c_str(), true)) {
-                // Erfolg bedeutet, dass das Senden und das Warten auf ACKs erfolgreich waren.
-                // ACHTUNG: sendMessage(..., true) wartet nur auf EIN ACK. Für alle Nodes müsste man eigene Logik implementieren.
-                // Für dieses PoC gehen wir davon aus, dass ein ACK für Broadcasts reicht oder wir prüfen die individuellen Nodes später.
-                Serial.printf("Scheduler: Baudrate %ld gesendet und ACK erhalten (mind. einer).\n", testBaud);
-                currentSchedulerState = STATE_NORMAL_OPERATION;
-                lastBaudRateMeasurementMillis = millis(); // Setze Zeit für nächste Einmessung
-                Serial.printf("Scheduler: Erfolgreich auf Baudrate %ld eingestellt. Normaler Betrieb.\n", testBaud);
-                return;
-            } else {
-                Serial.printf("Scheduler: Baudrate %ld konnte nicht gesetzt werden (kein ACK).\n", testBaud);
-                currentBaudRateIndex++; // Versuche nächste Baudrate
-            }
-        } else {
-            Serial.println("Scheduler: Alle Baudraten getestet, keine stabile Rate gefunden. Bleibe bei initialer Baudrate.");
-            currentBaudRateIndex = 0; // Reset für den nächsten Zyklus
-            currentSchedulerState = STATE_ERROR; // Kann keine Kommunikation aufbauen
-            // Optional: Hard-Reset oder Default-Baudrate erzwingen
-        }
-        lastBaudRateMeasurementMillis = millis(); // Wartezeit für nächsten Versuch
+    // Prüft die Kandidaten mit Testframe-Bursts (blockierend) und schaltet alle Nodes
+    // auf die schnellste Rate, die jeder Node im Fehlerbudget besteht.
+    long selectedBaud = baudNegotiator.negotiate();
+    if (selectedBaud > 0) {
+        Serial.printf("Scheduler: Baudrate %ld ausgehandelt. Normaler Betrieb.\n", selectedBaud);
+        currentSchedulerState = STATE_NORMAL_OPERATION;
+    } else {
+        Serial.println("Scheduler: Keine Baudrate hält das Fehlerbudget ein.");
+        currentSchedulerState = STATE_ERROR; // Kann keine Kommunikation aufbauen
     }
 }
 
@@ -369,33 +359,24 @@ void generateAndSendNewKey() {
     payload.printf("\"}");
 
     Serial.printf("Scheduler: Sende neuen Key (ID %d) an alle Nodes...\n", nextKeyId);
-    // Sende den Key-Update als Broadcast. Erfordert ACK.
-    // Jeder Node muss mit ACK antworten
-    rs485Stack.sendMessage(255, MY_ADDRESS, MSG_TYPE_KEY_UPDATE, payload.c_str(), true);
-    // ACHTUNG: Die sendMessage Funktion wartet nur auf das ERSTE ACK.
-    // Für einen robusten Rekeying-Prozess müsste hier eine Logik mit individuellen ACKs
-    // von jeder erwarteten Node implementiert werden, um sicherzustellen, dass alle Nodes den Key erhalten haben.
+    // Sende den Key-Update als Broadcast in der Steuerklasse: Er überholt wartende Telemetrie.
+    // Broadcasts werden nicht bestätigt, daher ohne ACK.
+    if (!rs485Stack.queueMessage(255, MSG_TYPE_KEY_UPDATE, payload.c_str(), false, RS485_TX_CLASS_CONTROL)) {
+        Serial.println("Scheduler: Key-Update konnte nicht eingereiht werden (Steuerklasse voll).");
+    }
+    // ACHTUNG: Ohne ACKs weiß der Scheduler nicht, welche Nodes den Key erhalten haben.
+    // Für einen robusten Rekeying-Prozess müsste der Key je Node (bzw. per Multicast mit
+    // collectAcks) gesendet und die Bestätigung über das Ergebnis des Stacks ausgewertet werden.
     // Für dieses PoC ist dies eine Vereinfachung.
 }
 
 void manageRekeying() {
-    // Im PoC wartet der Scheduler nicht auf alle ACKs, sondern geht davon aus,
-    // dass das erste ACK genügt, um das Rekeying als initiiert zu betrachten.
-    // Eine robustere Implementierung würde hier eine Schleife haben, die auf alle
-    // erwarteten ACKs wartet oder nach einer gewissen Zeit einen Timeout hat.
-    
-    // Nach dem Senden des Keys wird auf die ACKs gewartet. Wenn die Zeit abgelaufen ist
-    // oder genügend ACKs gesammelt wurden, wird in den Normalbetrieb zurückgekehrt.
-    if (millis() - rekeyingStartTime > 5000) { // 5 Sekunden für alle ACKs
-        if (rekeyingAckCount >= connectedNodes.size()) { // Alle haben geantwortet (Idealfall)
-            Serial.println("Scheduler: Rekeying erfolgreich abgeschlossen. Alle Nodes haben geantwortet.");
-            currentSchedulerState = STATE_NORMAL_OPERATION;
-        } else {
-            Serial.printf("Scheduler: Rekeying abgeschlossen, aber nicht alle Nodes (%lu/%lu) haben geantwortet.\n", rekeyingAckCount, connectedNodes.size());
-            Serial.println("Scheduler: Kehre zum Normalbetrieb zurück. Überprüfe Nodes manuell.");
-            currentSchedulerState = STATE_NORMAL_OPERATION;
-            // Hier könnte man versuchen, die fehlenden Nodes erneut zu rekeyen oder sie als offline zu markieren
-        }
+    // Der Key-Update-Broadcast wird nicht bestätigt. Der Scheduler gibt den Nodes eine
+    // Übergangszeit zum Umschalten und kehrt danach in den Normalbetrieb zurück. Nodes, die
+    // den Key verpasst haben, fallen durch HMAC-Fehler bzw. den Node-Timeout auf.
+    if (millis() - rekeyingStartTime > 5000) { // 5 Sekunden Übergangszeit
+        Serial.println("Scheduler: Rekeying abgeschlossen, kehre zum Normalbetrieb zurück.");
+        currentSchedulerState = STATE_NORMAL_OPERATION;
     }
 }
 
@@ -409,9 +390,11 @@ void sendHeartbeat() {
         return;
     }
     Serial.println("Scheduler: Sende Master Heartbeat.");
-    // Heartbeat als Broadcast senden, kein ACK erforderlich
-    // Die sendMessage-Methode des Stacks kümmert sich jetzt intern um die Flussrichtung
-    if (rs485Stack.sendMessage(255, MY_ADDRESS, MSG_TYPE_MASTER_HEARTBEAT, "H", false)) {
+    // Heartbeat als Broadcast in der Heartbeat-Klasse, kein ACK erforderlich.
+    // Der Stack sendet ihn vor wartenden Daten (ein noch nicht gesendeter älterer Heartbeat wird ersetzt).
+    // Geht innerhalb von RS485_PIGGYBACK_HEARTBEAT_DELAY_MS ein anderer Frame hinaus, nimmt dieser
+    // den Heartbeat als Header-Erweiterung mit, ein eigener Frame entfällt.
+    if (rs485Stack.queueMessage(255, MSG_TYPE_MASTER_HEARTBEAT, "H", false, RS485_TX_CLASS_HEARTBEAT)) {
         packetsSent++;
         // Serial.println("Master Heartbeat gesendet.");
     } else {
@@ -6,7 +6,10 @@
 
 // Lokale Bibliotheks-Includes
 #include "RS485SecureStack.h"
+#include "SubmasterRelay.h"
+#include "RS485TimeSync.h"
 #include "credentials.h" // Enthält MASTER_KEY
+#include "NvsSessionStore.h" // Sitzungszustand für den Warmstart
 
 // WICHTIG: Wählen Sie EINE der folgenden Zeilen, je nach Ihrem RS485-Modul:
 // Option 1: Für Module MIT einem DE/RE-Pin, der manuell gesteuert werden muss (z.B. einfache MAX485-Module)
@@ -26,6 +29,7 @@
 #define MASTER_HEARTBEAT_TIMEOUT_MS 10000 // Wenn länger kein Master-Heartbeat, gehe in Wartezustand
 #define CLIENT_POLL_INTERVAL_MS 2000 // Alle 2 Sekunden Clients abfragen, wenn Sendeerlaubnis vorhanden
 #define SUBMASTER_STATUS_REPORT_INTERVAL_MS 5000 // Alle 5 Sekunden eigenen Status an Master melden
+#define CLIENT_GROUP_ADDRESS (RS485_GROUP_ADDRESS_FIRST + MY_ADDRESS) // Multicast-Gruppe der eigenen Clients
 
 // ==============================================================================
 // STATE MACHINE FÜR SUBMASTER
@@ -43,7 +47,6 @@ SubmasterState currentSubmasterState = STATE_WAITING_FOR_MASTER;
 // Globale Variablen für den Submaster
 // ==============================================================================
 unsigned long lastMasterHeartbeatMillis = 0;
-unsigned long lastClientPollMillis = 0;
 unsigned long lastStatusReportMillis = 0;
 long currentBaudRate = RS485_INITIAL_BAUD_RATE;
 uint8_t currentKeyId = INITIAL_KEY_ID;
@@ -51,7 +54,9 @@ uint8_t currentKeyId = INITIAL_KEY_ID;
 // Clients, die dieser Submaster verwaltet (Beispiel)
 const uint8_t MANAGED_CLIENTS[] = {11}; // ANPASSEN: Clients, die von diesem Submaster verwaltet werden
 const int NUM_MANAGED_CLIENTS = sizeof(MANAGED_CLIENTS) / sizeof(MANAGED_CLIENTS[0]);
-int currentClientIndex = 0; // Welcher Client als Nächstes abgefragt wird
+
+// Fragt die Clients ab, speichert ihre Messwerte und meldet sie aggregiert an den Master
+SubmasterRelay clientRelay;
 
 // Definition der UART für RS485
 HardwareSerial& rs485Serial = Serial1; // Beispiel: UART1 des ESP32
@@ -75,12 +80,17 @@ AutomaticDirectionControl myDirectionControl;
 // ==============================================================================
 RS485SecureStack rs485Stack(&myDirectionControl);
 
+// Sitzungszustand (Baudrate, Schlüssel-IDs, Sequenz) im NVS für den Warmstart
+NvsSessionStore sessionStore;
+
+// Buszeit des Masters (aus den gestempelten Heartbeats), z.B. für zeitrichtige Messwerte
+RS485TimeSync timeSync;
+
 // ==============================================================================
 // Funktionsprototypen
 // ==============================================================================
 void onPacketReceived(RS485SecureStack::Packet_t packet);
 void reportStatusToMaster();
-void pollClient();
 void processBaudRateSet(const String& payload);
 void processKeyUpdate(const String& payload);
 
@@ -95,17 +105,36 @@ void setup() {
     // Initialisiere RS485SecureStack
     // Die myDirectionControl.begin() wird nun automatisch in rs485Stack.begin() aufgerufen
     rs485Stack.begin(MY_ADDRESS, MASTER_KEY, INITIAL_KEY_ID, rs485Serial);
+    rs485Stack.setSessionStore(&sessionStore);
+    if (rs485Stack.restoreSession()) {
+        // Warmstart: ausgehandelte Baudrate und Session Key direkt übernehmen
+        currentBaudRate = rs485Stack.getBaudRate();
+        currentKeyId = rs485Stack.getCurrentKeyId();
+        Serial.printf("Submaster: Sitzung wiederhergestellt (Baudrate %ld, Key ID %d).\n", currentBaudRate, currentKeyId);
+    }
+    // Zyklische Statusmeldungen gehen erst auf einen freien Bus (Carrier Sense mit Backoff)
+    rs485Stack.enableCarrierSense(true);
+    // Der aggregierte Bericht an den Master ist lang und gleichförmig: komprimiert senden
+    rs485Stack.enableCompression(true);
     rs485Stack.registerReceiveCallback(onPacketReceived);
     rs485Stack.setDebug(true); // Debug-Ausgaben aktivieren
 
+    // Client-Abfrage über die Multicast-Gruppe der Clients (ein Frame für alle Clients)
+    clientRelay.begin(&rs485Stack, MY_ADDRESS, MASTER_ADDRESS, CLIENT_GROUP_ADDRESS);
+    clientRelay.setPollInterval(CLIENT_POLL_INTERVAL_MS);
+    for (int i = 0; i < NUM_MANAGED_CLIENTS; ++i) {
+        clientRelay.addClient(MANAGED_CLIENTS[i]);
+    }
+    timeSync.begin(&rs485Stack, false);
+
     lastMasterHeartbeatMillis = millis();
-    lastClientPollMillis = millis();
     lastStatusReportMillis = millis();
     Serial.println("Submaster: Initialisierung abgeschlossen. Warte auf Master.");
 }
 
 void loop() {
     rs485Stack.loop(); // Empfängt Pakete
+    timeSync.update();
 
     // Master-Präsenz überprüfen
     if (millis() - lastMasterHeartbeatMillis > MASTER_HEARTBEAT_TIMEOUT_MS) {
@@ -131,14 +160,8 @@ void loop() {
             break;
 
         case STATE_COMMUNICATING_WITH_CLIENTS:
-            if (millis() - lastClientPollMillis > CLIENT_POLL_INTERVAL_MS) {
-                pollClient();
-                lastClientPollMillis = millis();
-            }
-            if (millis() - lastStatusReportMillis > SUBMASTER_STATUS_REPORT_INTERVAL_MS) {
-                reportStatusToMaster();
-                lastStatusReportMillis = millis();
-            }
+            // Abfrage der Clients und aggregierter Bericht an den Master (bei PERMISSION_TO_SEND)
+            clientRelay.update();
             break;
 
         case STATE_ERROR:
@@ -177,11 +200,17 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
         return; 
     }
 
+    // Antworten der eigenen Clients werden vom Relay zwischengespeichert
+    if (clientRelay.handlePacket(packet)) {
+        return;
+    }
+
     // Behandlung anderer Nachrichtentypen
     switch (packet.messageType) {
         case MSG_TYPE_MASTER_HEARTBEAT:
             Serial.println("RCV: Master Heartbeat.");
             lastMasterHeartbeatMillis = millis();
+            timeSync.handlePacket(packet);
             if (currentSubmasterState == STATE_WAITING_FOR_MASTER) {
                 currentSubmasterState = STATE_WAITING_FOR_PERMISSION; // Master ist da
                 Serial.println("Submaster: Master gefunden. Warte auf Sendeerlaubnis.");
@@ -210,13 +239,10 @@ void onPacketReceived(RS485SecureStack::Packet_t packet) {
                 if (packet.senderAddress == MASTER_ADDRESS) {
                     Serial.println("Submaster: Sendeerlaubnis vom Master erhalten!");
                     currentSubmasterState = STATE_COMMUNICATING_WITH_CLIENTS;
-                    lastClientPollMillis = millis(); // Starte sofort mit Client-Kommunikation
+                    clientRelay.requestReport(); // Aggregierten Bericht im Zeitplan des Masters senden
                 } else {
                     Serial.println("ERR: Unerwartete Sendeerlaubnis von Nicht-Master-Adresse.");
                 }
-            } else if (packet.payload.startsWith("STATUS_OK") || packet.payload.startsWith("TEMP_HUMID:")) {
-                // Antwort von einem Client
-                Serial.printf("Submaster: Antwort von Client %d: %s\n", packet.senderAddress, packet.payload.c_str());
             } else {
                 Serial.println("Submaster: Unbekannte Daten-Nachricht.");
             }
@@ -242,24 +268,6 @@ void reportStatusToMaster() {
     }
 }
 
-void pollClient() {
-    if (NUM_MANAGED_CLIENTS == 0) return;
-
-    uint8_t targetClient = MANAGED_CLIENTS[currentClientIndex];
-    Serial.printf("Submaster: Frage Client %d ab.\n", targetClient);
-
-    // Sende "GET_STATUS" an den Client, erfordert ACK
-    if (rs485Stack.sendMessage(targetClient, MY_ADDRESS, MSG_TYPE_DATA, "GET_STATUS", true)) {
-        Serial.printf("Submaster: Anfrage an Client %d erfolgreich gesendet und ACK erhalten.\n", targetClient);
-    } else {
-        Serial.printf("ERR: Fehler oder Timeout bei Anfrage an Client %d.\n", targetClient);
-        // Hier könnte man den Client als offline markieren oder einen Fehler zählen
-    }
-
-    // Nächsten Client für die nächste Abfrage auswählen
-    currentClientIndex = (currentClientIndex + 1) % NUM_MANAGED_CLIENTS;
-}
-
 void processBaudRateSet(const String& payload) {
     long newBaudRate = payload.toInt();
     if (newBaudRate > 0 && newBaudRate != currentBaudRate) {
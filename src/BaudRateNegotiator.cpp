@@ -0,0 +1,230 @@
+#include "BaudRateNegotiator.h"
+
+// Default-Werte
+#define DEFAULT_CHECK_INTERVAL_MS 10000UL   // Intervall der Live-Prüfung der Fehlerstatistik
+#define PROBE_REPLY_TIMEOUT_MS 30UL         // Zeit, die ein Knoten für seine "LQ:"-Rückmeldung hat (zzgl. Sendezeit)
+
+BaudRateNegotiator::BaudRateNegotiator()
+    : _secureStack(nullptr),
+      _myAddress(0),
+      _numRates(0),
+      _nodeCount(0),
+      _probeFrames(BAUD_NEGOTIATOR_DEFAULT_PROBE_FRAMES),
+      _errorBudgetPermille(BAUD_NEGOTIATOR_DEFAULT_ERROR_BUDGET_PERMILLE),
+      _degradedPermille(BAUD_NEGOTIATOR_DEFAULT_DEGRADED_PERMILLE),
+      _checkIntervalMs(DEFAULT_CHECK_INTERVAL_MS),
+      _lastCheckMillis(0),
+      _selectedBaudRate(0),
+      _renegotiationNeeded(false)
+{
+    memset(_candidateRates, 0, sizeof(_candidateRates));
+    memset(_nodes, 0, sizeof(_nodes));
+    memset(&_statsAtLastCheck, 0, sizeof(_statsAtLastCheck));
+}
+
+void BaudRateNegotiator::begin(RS485SecureStack* secureStackInstance, uint8_t myAddress, const long* candidateRates, size_t numRates) {
+    _secureStack = secureStackInstance;
+    _myAddress = myAddress;
+    _numRates = numRates > BAUD_NEGOTIATOR_MAX_RATES ? BAUD_NEGOTIATOR_MAX_RATES : numRates;
+    for (size_t i = 0; i < _numRates; ++i) {
+        _candidateRates[i] = candidateRates[i];
+    }
+
+    if (!_secureStack) {
+        Serial.println("Warnung: BaudRateNegotiator::begin - secureStack ist nullptr!");
+    }
+}
+
+bool BaudRateNegotiator::addNode(uint8_t nodeAddress) {
+    if (getNode(nodeAddress) != nullptr) {
+        return true;
+    }
+    if (_nodeCount >= BAUD_NEGOTIATOR_MAX_NODES) {
+        Serial.printf("BaudRateNegotiator: Knoten-Tabelle voll, Knoten %d nicht aufgenommen.\n", nodeAddress);
+        return false;
+    }
+    NodeQuality_t& node = _nodes[_nodeCount++];
+    memset(&node, 0, sizeof(node));
+    node.address = nodeAddress;
+    return true;
+}
+
+long BaudRateNegotiator::negotiate() {
+    if (!_secureStack || _numRates == 0) {
+        return 0;
+    }
+
+    long baseBaudRate = _secureStack->getBaudRate();
+    long selected = 0;
+    // Schnellste Rate zuerst: Die erste Rate, die alle Knoten besteht, ist die gewählte
+    for (size_t i = 0; i < _numRates && selected == 0; ++i) {
+        Serial.printf("BaudRateNegotiator: Prüfe %ld Baud mit %d Testframes...\n", _candidateRates[i], _probeFrames);
+        if (_probeRate(_candidateRates[i], baseBaudRate)) {
+            selected = _candidateRates[i];
+        }
+    }
+
+    if (selected == 0) {
+        Serial.println("BaudRateNegotiator: Keine Baudrate hält das Fehlerbudget ein.");
+        return 0;
+    }
+
+    // Gewählte Rate auf der Basisrate ankündigen (alle Knoten sind nach dem Probe-Fenster wieder dort)
+    if (!_secureStack->sendMessage(255, _myAddress, MSG_TYPE_BAUD_RATE_SET, String(selected), false)) {
+        Serial.println("BaudRateNegotiator: Fehler beim Senden der gewählten Baudrate.");
+        return 0;
+    }
+    delay(RS485_PROBE_SETTLE_MS);
+    _secureStack->setBaudRate(selected);
+    _selectedBaudRate = selected;
+    _renegotiationNeeded = false;
+    _resetLiveStatistics();
+    Serial.printf("BaudRateNegotiator: %ld Baud gewählt.\n", selected);
+    return selected;
+}
+
+bool BaudRateNegotiator::update() {
+    if (!_secureStack || _selectedBaudRate == 0 || _renegotiationNeeded) {
+        return _renegotiationNeeded;
+    }
+    if (millis() - _lastCheckMillis < _checkIntervalMs) {
+        return false;
+    }
+    _lastCheckMillis = millis();
+
+    // Empfangsfehler (CRC/HMAC/Framing) seit der letzten Prüfung
+    const RS485SecureStack::LinkStats_t& stats = _secureStack->getLinkStats();
+    uint32_t good = stats.framesReceived - _statsAtLastCheck.framesReceived;
+    uint32_t bad = (stats.crcErrors - _statsAtLastCheck.crcErrors) +
+                   (stats.hmacErrors - _statsAtLastCheck.hmacErrors) +
+                   (stats.framingErrors - _statsAtLastCheck.framingErrors);
+    _statsAtLastCheck = stats;
+    if (good + bad >= BAUD_NEGOTIATOR_MIN_FRAMES_FOR_CHECK &&
+        bad * 1000UL > (good + bad) * (uint32_t)_degradedPermille) {
+        Serial.printf("BaudRateNegotiator: Fehlerquote %lu/%lu über Schwelle, neue Aushandlung nötig.\n",
+                      (unsigned long)bad, (unsigned long)(good + bad));
+        _renegotiationNeeded = true;
+    }
+
+    // Verluste je Knoten: neue ACK-Timeouts seit der letzten Prüfung
+    for (size_t i = 0; i < _nodeCount; ++i) {
+        RS485SecureStack::PeerStats_t peerStats;
+        if (!_secureStack->getPeerStats(_nodes[i].address, peerStats)) {
+            continue;
+        }
+        if (peerStats.ackTimeouts - _nodes[i].lastAckTimeouts >= BAUD_NEGOTIATOR_DEGRADED_ACK_TIMEOUTS) {
+            Serial.printf("BaudRateNegotiator: Knoten %d verliert Frames, neue Aushandlung nötig.\n", _nodes[i].address);
+            _renegotiationNeeded = true;
+        }
+        _nodes[i].lastAckTimeouts = peerStats.ackTimeouts;
+    }
+    return _renegotiationNeeded;
+}
+
+const BaudRateNegotiator::NodeQuality_t* BaudRateNegotiator::getNode(uint8_t nodeAddress) const {
+    for (size_t i = 0; i < _nodeCount; ++i) {
+        if (_nodes[i].address == nodeAddress) {
+            return &_nodes[i];
+        }
+    }
+    return nullptr;
+}
+
+// Private Methoden
+
+bool BaudRateNegotiator::_probeRate(long testBaudRate, long baseBaudRate) {
+    unsigned long windowMs = _probeWindowMillis(testBaudRate);
+
+    // Probe-Ankündigung auf der Basisrate: "PROBE:<baud>:<fensterMs>"
+    String announcement = "PROBE:";
+    announcement += String(testBaudRate);
+    announcement += ':';
+    announcement += windowMs;
+    if (!_secureStack->sendMessage(255, _myAddress, MSG_TYPE_BAUD_RATE_SET, announcement, false)) {
+        Serial.println("BaudRateNegotiator: Fehler beim Senden der Probe-Ankündigung.");
+        return false;
+    }
+    unsigned long windowStart = millis();
+    delay(RS485_PROBE_SETTLE_MS);
+    _secureStack->setBaudRate(testBaudRate);
+
+    for (uint16_t i = 0; i < _probeFrames; ++i) {
+        _secureStack->sendMessage(255, _myAddress, MSG_TYPE_LINK_TEST, "T", false);
+    }
+
+    bool allWithinBudget = true;
+    for (size_t i = 0; i < _nodeCount; ++i) {
+        NodeQuality_t& node = _nodes[i];
+        if (!_queryNode(node, testBaudRate) || !_withinBudget(node)) {
+            allWithinBudget = false;
+        }
+        Serial.printf("BaudRateNegotiator:   Knoten %d: %s, %d/%d empfangen, CRC %d, HMAC %d\n",
+                      node.address, node.replied ? "Antwort" : "keine Antwort",
+                      node.framesReceived, _probeFrames, node.crcErrors, node.hmacErrors);
+    }
+
+    // Erst nach Ablauf des Fensters zurück: dann sind auch alle Knoten wieder auf der Basisrate
+    while (millis() - windowStart < windowMs + RS485_PROBE_SETTLE_MS) {
+        _secureStack->loop();
+    }
+    _secureStack->setBaudRate(baseBaudRate);
+    return allWithinBudget;
+}
+
+bool BaudRateNegotiator::_queryNode(NodeQuality_t& node, long testBaudRate) {
+    RS485SecureStack::LinkReport_t report;
+    node.replied = false;
+    node.framesReceived = 0;
+    node.crcErrors = 0;
+    node.hmacErrors = 0;
+
+    _secureStack->takeLinkReport(node.address, report); // Veraltete Rückmeldung verwerfen
+    if (!_secureStack->sendMessage(node.address, _myAddress, MSG_TYPE_LINK_TEST, "LQ?", false)) {
+        return false;
+    }
+
+    unsigned long timeoutMs = PROBE_REPLY_TIMEOUT_MS + _frameMillis(RS485_MIN_PACKET_LENGTH + RS485_IV_LENGTH, testBaudRate);
+    unsigned long start = millis();
+    while (millis() - start < timeoutMs) {
+        _secureStack->loop();
+        if (_secureStack->takeLinkReport(node.address, report)) {
+            node.replied = true;
+            node.framesReceived = report.testFramesReceived;
+            node.crcErrors = report.crcErrors;
+            node.hmacErrors = report.hmacErrors;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BaudRateNegotiator::_withinBudget(const NodeQuality_t& node) const {
+    if (!node.replied) {
+        return false;
+    }
+    // Verlorene Testframes (nicht empfangen oder mit CRC/HMAC-Fehler verworfen) gegen das Budget
+    uint32_t lost = node.framesReceived >= _probeFrames ? 0 : _probeFrames - node.framesReceived;
+    return lost * 1000UL <= (uint32_t)_probeFrames * _errorBudgetPermille;
+}
+
+unsigned long BaudRateNegotiator::_probeWindowMillis(long testBaudRate) const {
+    // Testframe und "LQ"-Frames passen in einen AES-Block
+    unsigned long frameMs = _frameMillis(RS485_MIN_PACKET_LENGTH + RS485_IV_LENGTH, testBaudRate);
+    unsigned long queryMs = 2 * frameMs + PROBE_REPLY_TIMEOUT_MS + frameMs;
+    return RS485_PROBE_SETTLE_MS + _probeFrames * frameMs + _nodeCount * queryMs + 2 * RS485_PROBE_SETTLE_MS;
+}
+
+unsigned long BaudRateNegotiator::_frameMillis(size_t frameBytes, long baudRate) {
+    if (baudRate <= 0) baudRate = RS485_INITIAL_BAUD_RATE;
+    // 10 Bit pro Byte, 25% Stuffing-Reserve, 1ms Umschaltreserve
+    return ((unsigned long)frameBytes * 5 / 4 * 10UL * 1000UL) / baudRate + 1;
+}
+
+void BaudRateNegotiator::_resetLiveStatistics() {
+    _statsAtLastCheck = _secureStack->getLinkStats();
+    _lastCheckMillis = millis();
+    for (size_t i = 0; i < _nodeCount; ++i) {
+        RS485SecureStack::PeerStats_t peerStats;
+        _nodes[i].lastAckTimeouts = _secureStack->getPeerStats(_nodes[i].address, peerStats) ? peerStats.ackTimeouts : 0;
+    }
+}
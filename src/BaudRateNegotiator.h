@@ -0,0 +1,99 @@
+#ifndef BAUD_RATE_NEGOTIATOR_H
+#define BAUD_RATE_NEGOTIATOR_H
+
+#include <Arduino.h>
+#include "RS485SecureStack.h"
+
+// Maximale Anzahl Kandidaten-Baudraten und zu prüfender Knoten (feste Tabellengröße, kein Heap)
+#ifndef BAUD_NEGOTIATOR_MAX_RATES
+#define BAUD_NEGOTIATOR_MAX_RATES 8
+#endif
+#ifndef BAUD_NEGOTIATOR_MAX_NODES
+#define BAUD_NEGOTIATOR_MAX_NODES 16
+#endif
+
+// Anzahl Testframes pro Kandidaten-Baudrate
+#define BAUD_NEGOTIATOR_DEFAULT_PROBE_FRAMES 50
+
+// Fehlerbudget: maximaler Anteil verlorener/fehlerhafter Testframes je Knoten (in Promille)
+#define BAUD_NEGOTIATOR_DEFAULT_ERROR_BUDGET_PERMILLE 20
+
+// Live-Überwachung: Fehlerquote (Promille), ab der die Verbindung als verschlechtert gilt,
+// und Mindestanzahl Frames im Prüfintervall, damit die Quote aussagekräftig ist
+#define BAUD_NEGOTIATOR_DEFAULT_DEGRADED_PERMILLE 50
+#define BAUD_NEGOTIATOR_MIN_FRAMES_FOR_CHECK 20
+
+// Live-Überwachung: so viele neue ACK-Timeouts eines Knotens im Prüfintervall gelten als Verlust
+#define BAUD_NEGOTIATOR_DEGRADED_ACK_TIMEOUTS 3
+
+// Baudraten-Aushandlung (Masterseite):
+// - prüft jede Kandidaten-Baudrate (schnellste zuerst) mit einem Burst von Testframes,
+// - fragt danach jeden Knoten nach empfangenen Testframes sowie CRC-/HMAC-Fehlern ("LQ?"),
+// - wählt die schnellste Rate, bei der JEDER Knoten im Fehlerbudget bleibt,
+// - prüft anschließend nur noch die laufende Fehlerstatistik und meldet über update(),
+//   wenn eine neue Aushandlung nötig ist.
+// Die Knotenseite (Umschalten, Zählen, Rückmeldung, Rückfall auf die Basisrate nach dem
+// Probe-Fenster) übernimmt RS485SecureStack selbst.
+class BaudRateNegotiator {
+public:
+    struct NodeQuality_t {
+        uint8_t address;
+        bool replied;             // Rückmeldung bei der zuletzt geprüften Rate erhalten
+        uint16_t framesReceived;
+        uint16_t crcErrors;
+        uint16_t hmacErrors;
+        uint32_t lastAckTimeouts; // Stand der ACK-Timeouts bei der letzten Live-Prüfung
+    };
+
+    BaudRateNegotiator();
+
+    // candidateRates: Kandidaten, absteigend sortiert (schnellste zuerst)
+    void begin(RS485SecureStack* secureStackInstance, uint8_t myAddress, const long* candidateRates, size_t numRates);
+
+    // Registriert einen Knoten, der jede Rate bestehen muss. Gibt false zurück, wenn die Tabelle voll ist.
+    bool addNode(uint8_t nodeAddress);
+
+    // Führt die Aushandlung blockierend durch und schaltet den Bus (per MSG_TYPE_BAUD_RATE_SET)
+    // auf die gewählte Rate. Gibt die gewählte Rate zurück oder 0, wenn keine Rate das Budget einhält.
+    long negotiate();
+
+    // Muss regelmäßig im Loop aufgerufen werden. Gibt true zurück, wenn die laufende
+    // Fehlerstatistik eine neue Aushandlung erfordert.
+    bool update();
+
+    void setProbeFrames(uint16_t frames) { _probeFrames = frames > 0 ? frames : 1; }
+    void setErrorBudget(uint16_t permille) { _errorBudgetPermille = permille; }
+    void setDegradedThreshold(uint16_t permille) { _degradedPermille = permille; }
+    void setCheckInterval(unsigned long intervalMs) { _checkIntervalMs = intervalMs; }
+
+    long getSelectedBaudRate() const { return _selectedBaudRate; }
+    const NodeQuality_t* getNode(uint8_t nodeAddress) const;
+
+private:
+    RS485SecureStack* _secureStack;
+    uint8_t _myAddress;
+
+    long _candidateRates[BAUD_NEGOTIATOR_MAX_RATES];
+    size_t _numRates;
+    NodeQuality_t _nodes[BAUD_NEGOTIATOR_MAX_NODES];
+    size_t _nodeCount;
+
+    uint16_t _probeFrames;
+    uint16_t _errorBudgetPermille;
+    uint16_t _degradedPermille;
+    unsigned long _checkIntervalMs;
+    unsigned long _lastCheckMillis;
+
+    long _selectedBaudRate;
+    bool _renegotiationNeeded;
+    RS485SecureStack::LinkStats_t _statsAtLastCheck;
+
+    bool _probeRate(long testBaudRate, long baseBaudRate);
+    bool _queryNode(NodeQuality_t& node, long testBaudRate);
+    bool _withinBudget(const NodeQuality_t& node) const;
+    unsigned long _probeWindowMillis(long testBaudRate) const;
+    static unsigned long _frameMillis(size_t frameBytes, long baudRate);
+    void _resetLiveStatistics();
+};
+
+#endif // BAUD_RATE_NEGOTIATOR_H
@@ -0,0 +1,55 @@
+#ifndef FILE_SESSION_STORE_H
+#define FILE_SESSION_STORE_H
+
+#include "RS485SessionStore.h"
+#include <stdio.h>
+#include <string.h>
+
+// Sitzungszustand in einer Datei (Host, oder ein per VFS eingebundenes Dateisystem des ESP32).
+// Geschrieben wird in "<pfad>.tmp" und anschließend umbenannt, damit ein Abbruch während des
+// Schreibens den zuletzt gültigen Zustand nicht zerstört. Der Pfad muss gültig bleiben.
+class FileSessionStore : public RS485SessionStore {
+public:
+    static const size_t MAX_PATH_LENGTH = 128;
+
+    explicit FileSessionStore(const char* path) : _path(path) {}
+
+    bool load(uint8_t* data, size_t length) override {
+        FILE* file = fopen(_path, "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        size_t read = fread(data, 1, length, file);
+        bool atEnd = fgetc(file) == EOF;
+        fclose(file);
+        return read == length && atEnd;
+    }
+
+    bool save(const uint8_t* data, size_t length) override {
+        char tempPath[MAX_PATH_LENGTH];
+        if (strlen(_path) + 5 > sizeof(tempPath)) {
+            return false;
+        }
+        snprintf(tempPath, sizeof(tempPath), "%s.tmp", _path);
+        FILE* file = fopen(tempPath, "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        bool ok = fwrite(data, 1, length, file) == length;
+        ok = (fclose(file) == 0) && ok;
+        if (!ok) {
+            remove(tempPath);
+            return false;
+        }
+        return rename(tempPath, _path) == 0;
+    }
+
+    void clear() override {
+        remove(_path);
+    }
+
+private:
+    const char* _path;
+};
+
+#endif // FILE_SESSION_STORE_H
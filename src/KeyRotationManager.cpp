@@ -29,7 +29,7 @@ void KeyRotationManager::begin(KeyGenerationAndDistributionCallback keyGenCallba
     // Stelle sicher, dass der KeyRotationManager die gleiche initiale KeyID verwendet
     // wie der RS485SecureStack. Standardmäßig ist das KeyID 0.
     if (_secureStack) {
-        _currentManagedKeyId = _secureStack->_currentSessionKeyId; 
+        _currentManagedKeyId = _secureStack->getCurrentKeyId();
     } else {
         Serial.println("Warnung: KeyRotationManager::begin - secureStack ist nullptr!");
     }
@@ -0,0 +1,50 @@
+#ifndef NVS_SESSION_STORE_H
+#define NVS_SESSION_STORE_H
+
+#include "RS485SessionStore.h"
+
+#if defined(ESP32)
+#include <Preferences.h>
+
+// Sitzungszustand im NVS des ESP32. Bei mehreren Stacks (Multi-Bus) je Bus einen eigenen
+// Schlüssel bzw. Namensraum verwenden. Die Strings müssen gültig bleiben.
+class NvsSessionStore : public RS485SessionStore {
+public:
+    NvsSessionStore(const char* nameSpace = "rs485", const char* key = "session") : _nameSpace(nameSpace), _key(key) {}
+
+    bool load(uint8_t* data, size_t length) override {
+        Preferences preferences;
+        if (!preferences.begin(_nameSpace, true)) {
+            return false;
+        }
+        bool ok = preferences.getBytesLength(_key) == length && preferences.getBytes(_key, data, length) == length;
+        preferences.end();
+        return ok;
+    }
+
+    bool save(const uint8_t* data, size_t length) override {
+        Preferences preferences;
+        if (!preferences.begin(_nameSpace, false)) {
+            return false;
+        }
+        bool ok = preferences.putBytes(_key, data, length) == length;
+        preferences.end();
+        return ok;
+    }
+
+    void clear() override {
+        Preferences preferences;
+        if (preferences.begin(_nameSpace, false)) {
+            preferences.remove(_key);
+            preferences.end();
+        }
+    }
+
+private:
+    const char* _nameSpace;
+    const char* _key;
+};
+
+#endif // ESP32
+
+#endif // NVS_SESSION_STORE_H
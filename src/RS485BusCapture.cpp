@@ -0,0 +1,128 @@
+#include "RS485BusCapture.h"
+
+#define PCAP_MAGIC_MICROS 0xA1B2C3D4UL
+#define PCAP_RECORD_HEADER_LENGTH 16
+
+RS485BusCapture::RS485BusCapture()
+    : _secureStack(nullptr),
+      _output(nullptr),
+      _capturing(false),
+      _head(0),
+      _count(0),
+      _pendingDrops(0),
+      _lastMicros(0),
+      _microsWraps(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void RS485BusCapture::begin(RS485SecureStack* secureStackInstance, Stream& output) {
+    _secureStack = secureStackInstance;
+    _output = &output;
+    if (!_secureStack) {
+        return;
+    }
+    _secureStack->setFrameTap(_onFrame, this);
+}
+
+void RS485BusCapture::start() {
+    _head = 0;
+    _count = 0;
+    _pendingDrops = 0;
+    memset(&_stats, 0, sizeof(_stats));
+
+    // pcap-Dateikopf: Magic, Version 2.4, Zeitzone, Genauigkeit, Snaplen, Linktyp
+    _pushLe32(PCAP_MAGIC_MICROS);
+    uint8_t version[4] = { 2, 0, 4, 0 };
+    _push(version, sizeof(version));
+    _pushLe32(0);
+    _pushLe32(0);
+    _pushLe32(RS485_CAPTURE_PSEUDO_HEADER_LENGTH + MAX_PACKET_SIZE);
+    _pushLe32(RS485_CAPTURE_LINKTYPE);
+    _capturing = true;
+}
+
+void RS485BusCapture::stop() {
+    _capturing = false;
+}
+
+void RS485BusCapture::update() {
+    if (!_output || _count == 0) {
+        return;
+    }
+    int room = _output->availableForWrite();
+    if (room <= 0) {
+        return;
+    }
+    size_t toWrite = (size_t)room < _count ? (size_t)room : _count;
+    // Ein Schreibaufruf je zusammenhängendem Abschnitt des Ringpuffers
+    size_t firstPart = RS485_CAPTURE_BUFFER_SIZE - _head;
+    if (firstPart > toWrite) firstPart = toWrite;
+    size_t written = _output->write(&_buffer[_head], firstPart);
+    if (written == firstPart && toWrite > firstPart) {
+        written += _output->write(_buffer, toWrite - firstPart);
+    }
+    _head = (_head + written) % RS485_CAPTURE_BUFFER_SIZE;
+    _count -= written;
+    _stats.bytesWritten += written;
+}
+
+RS485BusCapture::CaptureStats_t RS485BusCapture::getStats() const {
+    CaptureStats_t stats = _stats;
+    stats.bufferFill = (uint16_t)_count;
+    return stats;
+}
+
+// Private Methoden
+
+void RS485BusCapture::_onFrame(void* context, const uint8_t* frame, size_t length, unsigned long rxMicros, uint8_t status) {
+    static_cast<RS485BusCapture*>(context)->_recordFrame(frame, length, rxMicros, status);
+}
+
+void RS485BusCapture::_recordFrame(const uint8_t* frame, size_t length, unsigned long rxMicros, uint8_t status) {
+    if (!_capturing) {
+        return;
+    }
+    // Zeitbasis auch über den Überlauf von micros() (ca. 71 Minuten) hinweg fortführen
+    if (rxMicros < _lastMicros) {
+        _microsWraps++;
+    }
+    _lastMicros = rxMicros;
+
+    size_t recordLength = PCAP_RECORD_HEADER_LENGTH + RS485_CAPTURE_PSEUDO_HEADER_LENGTH + length;
+    if (recordLength > _freeSpace()) {
+        _pendingDrops++;
+        _stats.framesDropped++;
+        return;
+    }
+
+    uint64_t timestamp = ((uint64_t)_microsWraps << 32) | (uint32_t)rxMicros;
+    uint32_t capturedLength = RS485_CAPTURE_PSEUDO_HEADER_LENGTH + length;
+    _pushLe32((uint32_t)(timestamp / 1000000ULL));
+    _pushLe32((uint32_t)(timestamp % 1000000ULL));
+    _pushLe32(capturedLength);
+    _pushLe32(capturedLength);
+
+    uint16_t drops = _pendingDrops > 0xFFFF ? 0xFFFF : (uint16_t)_pendingDrops;
+    uint8_t pseudoHeader[4] = { RS485_CAPTURE_PSEUDO_HEADER_VERSION, status, (uint8_t)(drops & 0xFF), (uint8_t)(drops >> 8) };
+    _push(pseudoHeader, sizeof(pseudoHeader));
+    _pushLe32((uint32_t)_secureStack->getBaudRate());
+    _push(frame, length);
+
+    _pendingDrops = 0;
+    _stats.framesCaptured++;
+    if (_count > _stats.maxBufferFill) _stats.maxBufferFill = (uint16_t)_count;
+}
+
+// Schreibt in den Ringpuffer, der Aufrufer hat den Platz bereits geprüft
+void RS485BusCapture::_push(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        _buffer[(_head + _count) % RS485_CAPTURE_BUFFER_SIZE] = data[i];
+        _count++;
+    }
+}
+
+void RS485BusCapture::_pushLe32(uint32_t value) {
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    _push(bytes, sizeof(bytes));
+}
@@ -0,0 +1,79 @@
+#ifndef RS485_BUS_CAPTURE_H
+#define RS485_BUS_CAPTURE_H
+
+#include <Arduino.h>
+#include "RS485SecureStack.h"
+
+// Größe des Ringpuffers zwischen Frame-Mitschnitt und Ausgabe (fest reserviert, kein Heap)
+#ifndef RS485_CAPTURE_BUFFER_SIZE
+#define RS485_CAPTURE_BUFFER_SIZE 8192
+#endif
+
+// pcap-Linktyp des Mitschnitts: LINKTYPE_USER0 (für private Formate reserviert)
+#define RS485_CAPTURE_LINKTYPE 147
+
+// Jedem Frame im Mitschnitt geht dieser Pseudo-Header voraus (little endian):
+//   [0]    Version des Pseudo-Headers (RS485_CAPTURE_PSEUDO_HEADER_VERSION)
+//   [1]    Status (RS485FrameTapStatus)
+//   [2..3] Vor diesem Frame verworfene Frames (Puffer voll), bei 0xFFFF gesättigt
+//   [4..7] Baudrate beim Empfang
+// Danach folgt der ent-stuffte Frame ab Startbyte 0xDE.
+#define RS485_CAPTURE_PSEUDO_HEADER_VERSION 1
+#define RS485_CAPTURE_PSEUDO_HEADER_LENGTH 8
+
+// Mitschnitt aller Frames auf dem Bus (vor Adressfilter und HMAC-Prüfung) im pcap-Format
+// über einen Stream, z.B. die USB-Schnittstelle des ESP32. Der Frame-Mitschnitt des Stacks
+// schreibt nur in den Ringpuffer; update() gibt so viel aus, wie der Stream ohne Blockieren
+// annimmt (availableForWrite()). Passt ein Frame nicht mehr in den Puffer, wird er verworfen
+// und im nächsten Frame als Verlust gemeldet. Zeitstempel sind Mikrosekunden seit dem Start
+// des Mikrocontrollers (Empfangsende des Frames).
+//
+// Der Stack, update() und start()/stop() müssen aus derselben Task benutzt werden.
+// Auswertung: tools/capture_decode (Linux).
+class RS485BusCapture {
+public:
+    struct CaptureStats_t {
+        uint32_t framesCaptured; // In den Puffer übernommene Frames
+        uint32_t framesDropped;  // Wegen vollem Puffer verworfene Frames
+        uint32_t bytesWritten;   // An den Stream ausgegebene Bytes
+        uint16_t bufferFill;     // Aktuelle / maximale Belegung des Ringpuffers
+        uint16_t maxBufferFill;
+    };
+
+    RS485BusCapture();
+
+    // Registriert den Frame-Mitschnitt beim Stack. Aufgezeichnet wird erst nach start().
+    void begin(RS485SecureStack* secureStackInstance, Stream& output);
+
+    // Beginnt einen neuen Mitschnitt: verwirft den Pufferinhalt und schreibt den pcap-Dateikopf
+    void start();
+    void stop();
+    bool isCapturing() const { return _capturing; }
+
+    // Muss regelmäßig im Loop aufgerufen werden (gibt gepufferte Daten aus)
+    void update();
+
+    CaptureStats_t getStats() const;
+
+private:
+    RS485SecureStack* _secureStack;
+    Stream* _output;
+    bool _capturing;
+
+    uint8_t _buffer[RS485_CAPTURE_BUFFER_SIZE];
+    size_t _head;   // Nächstes auszugebendes Byte
+    size_t _count;  // Belegte Bytes
+
+    uint32_t _pendingDrops;      // Verluste, die noch keinem Frame mitgegeben wurden
+    unsigned long _lastMicros;   // Für die Erweiterung von micros() auf 64 Bit
+    uint32_t _microsWraps;
+    CaptureStats_t _stats;
+
+    static void _onFrame(void* context, const uint8_t* frame, size_t length, unsigned long rxMicros, uint8_t status);
+    void _recordFrame(const uint8_t* frame, size_t length, unsigned long rxMicros, uint8_t status);
+    void _push(const uint8_t* data, size_t length);
+    void _pushLe32(uint32_t value);
+    size_t _freeSpace() const { return RS485_CAPTURE_BUFFER_SIZE - _count; }
+};
+
+#endif // RS485_BUS_CAPTURE_H
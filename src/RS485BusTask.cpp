@@ -0,0 +1,116 @@
+#include "RS485BusTask.h"
+
+RS485BusTask::RS485BusTask(RS485SecureStack& stack)
+    : _stack(stack),
+      _forwardQueue(nullptr),
+      _task(nullptr),
+      _hasPendingItem(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    memset(&_pendingItem, 0, sizeof(_pendingItem));
+}
+
+bool RS485BusTask::start(const char* taskName, BaseType_t core, UBaseType_t priority, uint32_t stackSize) {
+    if (_task != nullptr) {
+        return true;
+    }
+    _forwardQueue = xQueueCreate(RS485_BUS_FORWARD_QUEUE_LENGTH, sizeof(ForwardItem_t));
+    if (_forwardQueue == nullptr) {
+        Serial.printf("RS485BusTask: Warteschlange für %s konnte nicht angelegt werden.\n", taskName);
+        return false;
+    }
+    if (xTaskCreatePinnedToCore(_taskEntry, taskName, stackSize, this, priority, &_task, core) != pdPASS) {
+        Serial.printf("RS485BusTask: Task %s konnte nicht gestartet werden.\n", taskName);
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool RS485BusTask::post(uint8_t destinationAddress, char messageType, const String& payload, bool requiresAck,
+                        RS485TxClass txClass, TickType_t waitTicks) {
+    bool accepted = false;
+    if (_forwardQueue != nullptr && payload.length() <= RS485_MAX_PAYLOAD_LENGTH && txClass < RS485_TX_CLASS_COUNT) {
+        ForwardItem_t item;
+        item.destinationAddress = destinationAddress;
+        item.messageType = messageType;
+        item.requiresAck = requiresAck;
+        item.txClass = txClass;
+        memcpy(item.payload, payload.c_str(), payload.length());
+        item.payload[payload.length()] = '\0';
+        accepted = xQueueSend(_forwardQueue, &item, waitTicks) == pdTRUE; // Kopiert den Eintrag
+    }
+
+    portENTER_CRITICAL(&_statsLock);
+    if (accepted) {
+        _stats.posted++;
+    } else {
+        _stats.dropped++;
+    }
+    portEXIT_CRITICAL(&_statsLock);
+    return accepted;
+}
+
+bool RS485BusTask::forward(const RS485SecureStack::Packet_t& packet, RS485TxClass txClass, TickType_t waitTicks) {
+    return post(packet.destinationAddress, packet.messageType, packet.payload, packet.requiresAck, txClass, waitTicks);
+}
+
+RS485BusTask::ForwardStats_t RS485BusTask::getStats() const {
+    portENTER_CRITICAL(&_statsLock);
+    ForwardStats_t stats = _stats;
+    portEXIT_CRITICAL(&_statsLock);
+    return stats;
+}
+
+// Private Methoden
+
+void RS485BusTask::_taskEntry(void* parameter) {
+    static_cast<RS485BusTask*>(parameter)->_run();
+}
+
+void RS485BusTask::_run() {
+    for (;;) {
+        _stack.loop();
+        _drainForwardQueue();
+
+        portENTER_CRITICAL(&_statsLock);
+        _stats.loops++;
+        portEXIT_CRITICAL(&_statsLock);
+
+        // Einen Tick abgeben: Die UART puffert eingehende Bytes, andere Tasks auf dem Kern kommen dran
+        vTaskDelay(1);
+    }
+}
+
+// Übernimmt weitergeleitete Nachrichten in die Sendeklassen des Stacks, solange dort Platz ist.
+// Ist eine Klasse voll, bleibt der Eintrag zurückgehalten und die Warteschlange füllt sich:
+// Sender mit waitTicks > 0 werden dadurch gebremst (Gegendruck). Vorher wird mit canQueue()
+// geprüft, damit das Warten nicht bei jedem Durchlauf als verworfene Nachricht zählt.
+// Nimmt die Klasse nie etwas an (Tiefe 0) oder lehnt queueMessage() trotz Platz ab, wird der
+// Eintrag verworfen, sonst stauten sich dahinter alle weiteren Nachrichten für diesen Bus.
+void RS485BusTask::_drainForwardQueue() {
+    for (;;) {
+        if (!_hasPendingItem) {
+            if (xQueueReceive(_forwardQueue, &_pendingItem, 0) != pdTRUE) {
+                return;
+            }
+            _hasPendingItem = true;
+        }
+        bool queued = false;
+        if (_stack.canQueue(_pendingItem.txClass)) {
+            queued = _stack.queueMessage(_pendingItem.destinationAddress, _pendingItem.messageType,
+                                         _pendingItem.payload, _pendingItem.requiresAck, _pendingItem.txClass);
+        } else if (_stack.getTxClassLimit(_pendingItem.txClass) > 0) {
+            return; // Klasse voll: zurückhalten
+        }
+        _hasPendingItem = false;
+
+        portENTER_CRITICAL(&_statsLock);
+        if (queued) {
+            _stats.queued++;
+        } else {
+            _stats.dropped++;
+        }
+        portEXIT_CRITICAL(&_statsLock);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef RS485_BUS_TASK_H
+#define RS485_BUS_TASK_H
+
+#include <Arduino.h>
+#include "RS485SecureStack.h"
+
+// Länge der Weiterleitungs-Warteschlange je Bus (Einträge fester Größe, FreeRTOS-Queue)
+#ifndef RS485_BUS_FORWARD_QUEUE_LENGTH
+#define RS485_BUS_FORWARD_QUEUE_LENGTH 8
+#endif
+
+// Betreibt eine RS485SecureStack-Instanz in einer eigenen FreeRTOS-Task (ESP32), fest an einen Kern
+// gebunden. Jeder Bus hat damit seine eigene UART, seinen eigenen Empfangspfad und seine eigene
+// Schleife; der Durchsatz wächst mit der Anzahl der UARTs statt von einer gemeinsamen loop()
+// begrenzt zu werden.
+//
+// Regeln:
+// - Der Stack wird nach start() nur noch aus seiner Task benutzt (loop(), sendMessage(), Callback).
+// - Andere Tasks (z.B. der Callback eines anderen Busses) senden über post() bzw. forward():
+//   Die Nachricht wird in eine thread-sichere Warteschlange kopiert und von der Bus-Task in die
+//   Sendeklassen ihres Stacks (queueMessage()) übernommen.
+// - Schlüssel liegen in einem gemeinsamen RS485KeyStore, den alle Stacks nur lesen.
+class RS485BusTask {
+public:
+    struct ForwardStats_t {
+        uint32_t posted;   // Angenommene Nachrichten
+        uint32_t dropped;  // Abgelehnt (Warteschlange voll, Payload zu lang, ungültige Sendeklasse) oder vom Stack nicht angenommen (Tiefe 0)
+        uint32_t queued;   // In die Sendeklassen des Stacks übernommen
+        uint32_t loops;    // Durchläufe der Bus-Task
+    };
+
+    RS485BusTask(RS485SecureStack& stack);
+
+    // Startet die Bus-Task auf dem angegebenen Kern (0 oder 1). Der Stack muss bereits mit begin()
+    // initialisiert sein. Gibt false zurück, wenn Warteschlange oder Task nicht angelegt werden konnten.
+    bool start(const char* taskName, BaseType_t core, UBaseType_t priority = 2, uint32_t stackSize = 8192);
+
+    // Thread-sicher, aus jeder Task: Reiht eine Nachricht zum Senden auf diesem Bus ein.
+    // waitTicks > 0 wartet bei voller Warteschlange (Gegendruck), 0 lehnt sofort ab.
+    bool post(uint8_t destinationAddress, char messageType, const String& payload, bool requiresAck,
+              RS485TxClass txClass = RS485_TX_CLASS_BULK, TickType_t waitTicks = 0);
+
+    // Leitet ein empfangenes Paket unverändert (Ziel, Typ, Payload) auf diesen Bus weiter
+    bool forward(const RS485SecureStack::Packet_t& packet, RS485TxClass txClass = RS485_TX_CLASS_BULK, TickType_t waitTicks = 0);
+
+    // Kopie der Zähler (thread-sicher)
+    ForwardStats_t getStats() const;
+
+    RS485SecureStack& getStack() { return _stack; }
+
+private:
+    struct ForwardItem_t {
+        uint8_t destinationAddress;
+        char messageType;
+        bool requiresAck;
+        RS485TxClass txClass;
+        char payload[RS485_MAX_PAYLOAD_LENGTH + 1];
+    };
+
+    RS485SecureStack& _stack;
+    QueueHandle_t _forwardQueue;
+    TaskHandle_t _task;
+    ForwardStats_t _stats;
+    mutable portMUX_TYPE _statsLock = portMUX_INITIALIZER_UNLOCKED;
+    bool _hasPendingItem;      // Aus der Warteschlange entnommen, aber Sendeklasse war voll
+    ForwardItem_t _pendingItem;
+
+    static void _taskEntry(void* parameter);
+    void _run();
+    void _drainForwardQueue();
+};
+
+#endif // RS485_BUS_TASK_H
@@ -0,0 +1,170 @@
+#include "RS485Compression.h"
+#include <string.h>
+
+#define RS485_COMPRESSION_NO_POSITION 0xFFFF
+#define RS485_COMPRESSION_MIN_MATCH 3
+#define RS485_COMPRESSION_MAX_MATCH 264
+#define RS485_COMPRESSION_MAX_LITERALS 32
+#define RS485_COMPRESSION_MAX_OFFSET 8192
+
+static inline uint8_t rs485CompressionHash(const uint8_t* p) {
+    return (uint8_t)(((p[0] << 5) ^ (p[1] << 2) ^ p[2]) * 0x9E) ^ p[1];
+}
+
+// Position in die Hashkette eintragen (nur mit drei folgenden Bytes im Fenster)
+static inline void rs485CompressionInsert(RS485CompressionState_t& state, size_t position, size_t end) {
+    if (position + RS485_COMPRESSION_MIN_MATCH <= end) {
+        uint8_t hash = rs485CompressionHash(&state.window[position]);
+        state.prev[position] = state.head[hash];
+        state.head[hash] = (uint16_t)position;
+    }
+}
+
+// Literale [start, end) des Fensters als Läufe von höchstens 32 Bytes ausgeben
+static bool rs485EmitLiterals(const uint8_t* window, size_t start, size_t end, uint8_t* output, size_t& outPos, size_t outputCapacity) {
+    while (start < end) {
+        size_t run = end - start;
+        if (run > RS485_COMPRESSION_MAX_LITERALS) run = RS485_COMPRESSION_MAX_LITERALS;
+        if (outPos + 1 + run > outputCapacity) {
+            return false;
+        }
+        output[outPos++] = (uint8_t)(run - 1);
+        memcpy(&output[outPos], &window[start], run);
+        outPos += run;
+        start += run;
+    }
+    return true;
+}
+
+size_t rs485Compress(RS485CompressionState_t& state, const uint8_t* input, size_t inputLength,
+                     const uint8_t* dictionary, size_t dictionaryLength, uint8_t* output, size_t outputCapacity) {
+    if (inputLength == 0 || inputLength > RS485_COMPRESSION_MAX_INPUT_LENGTH) {
+        return 0;
+    }
+    if (dictionary == nullptr || dictionaryLength > RS485_COMPRESSION_MAX_DICTIONARY_LENGTH) {
+        dictionaryLength = 0;
+    }
+
+    // Fenster = Wörterbuch + Eingabe, Rückverweise in das Wörterbuch sind so normale Abstände
+    uint8_t* window = state.window;
+    if (dictionaryLength > 0) {
+        memcpy(window, dictionary, dictionaryLength);
+    }
+    memcpy(&window[dictionaryLength], input, inputLength);
+    size_t end = dictionaryLength + inputLength;
+    for (size_t i = 0; i < RS485_COMPRESSION_HASH_SIZE; ++i) {
+        state.head[i] = RS485_COMPRESSION_NO_POSITION;
+    }
+
+    for (size_t position = 0; position < dictionaryLength; ++position) {
+        rs485CompressionInsert(state, position, end);
+    }
+
+    size_t outPos = 0;
+    size_t literalStart = dictionaryLength;
+    size_t position = dictionaryLength;
+    while (position < end) {
+        // Längsten Treffer in der Hashkette suchen
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        if (position + RS485_COMPRESSION_MIN_MATCH <= end) {
+            size_t maxLength = end - position;
+            if (maxLength > RS485_COMPRESSION_MAX_MATCH) maxLength = RS485_COMPRESSION_MAX_MATCH;
+            uint16_t candidate = state.head[rs485CompressionHash(&window[position])];
+            for (uint8_t chain = 0; candidate != RS485_COMPRESSION_NO_POSITION && chain < RS485_COMPRESSION_MAX_CHAIN; ++chain) {
+                size_t offset = position - candidate;
+                if (offset > RS485_COMPRESSION_MAX_OFFSET) {
+                    break;
+                }
+                size_t length = 0;
+                while (length < maxLength && window[candidate + length] == window[position + length]) {
+                    length++;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestOffset = offset;
+                    if (length == maxLength) break;
+                }
+                candidate = state.prev[candidate];
+            }
+        }
+
+        if (bestLength < RS485_COMPRESSION_MIN_MATCH) {
+            rs485CompressionInsert(state, position, end);
+            position++;
+            continue;
+        }
+
+        if (!rs485EmitLiterals(window, literalStart, position, output, outPos, outputCapacity)) {
+            return 0;
+        }
+        size_t lengthCode = bestLength - 2;
+        size_t offsetCode = bestOffset - 1;
+        if (outPos + (lengthCode >= 7 ? 3 : 2) > outputCapacity) {
+            return 0;
+        }
+        if (lengthCode < 7) {
+            output[outPos++] = (uint8_t)((lengthCode << 5) | (offsetCode >> 8));
+        } else {
+            output[outPos++] = (uint8_t)((7 << 5) | (offsetCode >> 8));
+            output[outPos++] = (uint8_t)(lengthCode - 7);
+        }
+        output[outPos++] = (uint8_t)(offsetCode & 0xFF);
+
+        for (size_t i = 0; i < bestLength; ++i) {
+            rs485CompressionInsert(state, position + i, end);
+        }
+        position += bestLength;
+        literalStart = position;
+    }
+    if (!rs485EmitLiterals(window, literalStart, end, output, outPos, outputCapacity)) {
+        return 0;
+    }
+    return outPos;
+}
+
+bool rs485Decompress(const uint8_t* input, size_t inputLength, const uint8_t* dictionary, size_t dictionaryLength,
+                     uint8_t* output, size_t outputLength) {
+    if (dictionary == nullptr) {
+        dictionaryLength = 0;
+    }
+    size_t inPos = 0;
+    size_t outPos = 0;
+    while (outPos < outputLength) {
+        if (inPos >= inputLength) {
+            return false;
+        }
+        uint8_t control = input[inPos++];
+        if (control < RS485_COMPRESSION_MAX_LITERALS) {
+            size_t run = (size_t)control + 1;
+            if (inPos + run > inputLength || outPos + run > outputLength) {
+                return false;
+            }
+            memcpy(&output[outPos], &input[inPos], run);
+            inPos += run;
+            outPos += run;
+            continue;
+        }
+
+        size_t length = control >> 5;
+        if (length == 7) {
+            if (inPos >= inputLength) {
+                return false;
+            }
+            length += input[inPos++];
+        }
+        length += 2;
+        if (inPos >= inputLength) {
+            return false;
+        }
+        size_t offset = ((size_t)(control & 0x1F) << 8 | input[inPos++]) + 1;
+        if (offset > outPos + dictionaryLength || outPos + length > outputLength) {
+            return false;
+        }
+        // Byteweise kopieren: Quelle und Ziel dürfen sich überlappen (Wiederholungen)
+        for (size_t i = 0; i < length; ++i, ++outPos) {
+            output[outPos] = offset > outPos ? dictionary[dictionaryLength - (offset - outPos)] : output[outPos - offset];
+        }
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef RS485_COMPRESSION_H
+#define RS485_COMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ-Kompression für Payloads (Format wie LZF): Der Datenstrom besteht aus Steuerbytes,
+//   0x00-0x1F: (n + 1) Literale folgen (1..32 Bytes)
+//   sonst:     Rückverweis, Länge (ctrl >> 5) + 2, bei 7 plus ein weiteres Längenbyte
+//              (3..264 Bytes), Abstand ((ctrl & 0x1F) << 8 | nächstes Byte) + 1
+// Ein optionales Preset-Wörterbuch steht gedanklich vor den Daten, Rückverweise dürfen bis in
+// das Wörterbuch reichen. Kurze, gleichförmige Nachrichten (Statusmeldungen, Konfiguration)
+// werden damit schon beim ersten Vorkommen eines Schlüsselworts kürzer.
+//
+// Kein Heap: Der Kompressor arbeitet in einem festen Fenster (RS485CompressionState_t),
+// der Dekompressor schreibt nur in den Ausgabepuffer. Die Funktionen hängen nicht von Arduino
+// ab und laufen auch auf dem Host (tools/).
+
+// Größtes Wörterbuch und größte Eingabe, Fenster = Wörterbuch + Eingabe
+#ifndef RS485_COMPRESSION_MAX_DICTIONARY_LENGTH
+#define RS485_COMPRESSION_MAX_DICTIONARY_LENGTH 256
+#endif
+#define RS485_COMPRESSION_MAX_INPUT_LENGTH 256
+#define RS485_COMPRESSION_WINDOW (RS485_COMPRESSION_MAX_DICTIONARY_LENGTH + RS485_COMPRESSION_MAX_INPUT_LENGTH)
+
+// Hashtabelle über je 3 Bytes und Anzahl der Kandidaten, die je Position verglichen werden
+#define RS485_COMPRESSION_HASH_SIZE 256
+#ifndef RS485_COMPRESSION_MAX_CHAIN
+#define RS485_COMPRESSION_MAX_CHAIN 16
+#endif
+
+// Arbeitsspeicher des Kompressors (gut 2 KB). Darf nicht gleichzeitig von zwei Aufrufen genutzt werden.
+struct RS485CompressionState_t {
+    uint8_t window[RS485_COMPRESSION_WINDOW];
+    uint16_t head[RS485_COMPRESSION_HASH_SIZE];
+    uint16_t prev[RS485_COMPRESSION_WINDOW];
+};
+
+// Komprimiert input mit optionalem Wörterbuch (nullptr/0 = keines). Gibt die Länge des Datenstroms
+// zurück, 0 wenn er nicht in outputCapacity passt oder die Eingabe zu lang ist.
+size_t rs485Compress(RS485CompressionState_t& state, const uint8_t* input, size_t inputLength,
+                     const uint8_t* dictionary, size_t dictionaryLength, uint8_t* output, size_t outputCapacity);
+
+// Entpackt genau outputLength Bytes. Gibt false zurück, wenn der Datenstrom vorher endet, ein
+// Rückverweis vor das Wörterbuch zeigt oder über outputLength hinaus schreiben würde.
+bool rs485Decompress(const uint8_t* input, size_t inputLength, const uint8_t* dictionary, size_t dictionaryLength,
+                     uint8_t* output, size_t outputLength);
+
+#endif // RS485_COMPRESSION_H
@@ -0,0 +1,55 @@
+#include "RS485KeyStore.h"
+#include <SHA256.h>
+
+RS485KeyStore::RS485KeyStore() {
+    memset(_masterKey, 0, sizeof(_masterKey));
+    memset(_sessionKeys, 0, sizeof(_sessionKeys));
+}
+
+void RS485KeyStore::setMasterKey(const char* masterKey) {
+    uint8_t hashedKey[KEY_LENGTH];
+    SHA256 sha256;
+    sha256.reset();
+    sha256.update(masterKey, strlen(masterKey));
+    sha256.finalize(hashedKey, sizeof(hashedKey));
+
+    _lockKeys();
+    memcpy(_masterKey, hashedKey, KEY_LENGTH);
+    memcpy(_sessionKeys[0], hashedKey, KEY_LENGTH); // Session Key 0 ist der Master Key
+    _unlockKeys();
+}
+
+bool RS485KeyStore::setSessionKey(uint8_t keyId, const uint8_t* keyData, size_t keyLen) {
+    if (keyLen != KEY_LENGTH) { // Session Keys müssen 32 Bytes für SHA256 HMAC sein
+        return false;
+    }
+    _lockKeys();
+    memcpy(_sessionKeys[keyId], keyData, KEY_LENGTH);
+    _unlockKeys();
+    return true;
+}
+
+void RS485KeyStore::copySessionKey(uint8_t keyId, uint8_t* keyOut) const {
+    _lockKeys();
+    memcpy(keyOut, _sessionKeys[keyId], KEY_LENGTH);
+    _unlockKeys();
+}
+
+void RS485KeyStore::copyMasterKey(uint8_t* keyOut) const {
+    _lockKeys();
+    memcpy(keyOut, _masterKey, KEY_LENGTH);
+    _unlockKeys();
+}
+
+// Kurze Sperre (32-Byte-Kopie), daher Spinlock statt Mutex: auch zwischen den beiden Kernen wirksam
+void RS485KeyStore::_lockKeys() const {
+#if defined(ESP32)
+    portENTER_CRITICAL(&_lock);
+#endif
+}
+
+void RS485KeyStore::_unlockKeys() const {
+#if defined(ESP32)
+    portEXIT_CRITICAL(&_lock);
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef RS485_KEY_STORE_H
+#define RS485_KEY_STORE_H
+
+#include <Arduino.h>
+
+// Schlüsselspeicher für Master Key und Session Keys (Key ID 0-255).
+// Jeder RS485SecureStack hat einen eigenen Speicher. Bei mehreren Bussen kann ein
+// gemeinsamer Speicher an alle Stacks übergeben werden: Die Stacks lesen ihn dann nur
+// (Kopie unter Sperre), Schlüssel werden ausschließlich über den Speicher selbst gesetzt.
+// Lesen und Schreiben sind gegen gleichzeitige Zugriffe aus mehreren FreeRTOS-Tasks geschützt.
+class RS485KeyStore {
+public:
+    static const size_t KEY_LENGTH = 32;
+
+    RS485KeyStore();
+
+    // Setzt den Master Key (SHA256 des übergebenen Schlüssels) und Session Key 0
+    void setMasterKey(const char* masterKey);
+
+    // Setzt einen Session Key. keyLen muss KEY_LENGTH sein.
+    bool setSessionKey(uint8_t keyId, const uint8_t* keyData, size_t keyLen);
+
+    // Kopiert einen Session Key nach keyOut (KEY_LENGTH Bytes)
+    void copySessionKey(uint8_t keyId, uint8_t* keyOut) const;
+
+    // Kopiert den gehashten Master Key nach keyOut (KEY_LENGTH Bytes)
+    void copyMasterKey(uint8_t* keyOut) const;
+
+private:
+    uint8_t _masterKey[KEY_LENGTH];       // SHA256-Hash des Master-Schlüssels
+    uint8_t _sessionKeys[256][KEY_LENGTH]; // 256 mögliche Session Keys (Key ID 0-255)
+#if defined(ESP32)
+    mutable portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+    void _lockKeys() const;
+    void _unlockKeys() const;
+};
+
+#endif // RS485_KEY_STORE_H
@@ -1,4 +1,5 @@
 #include "RS485SecureStack.h"
+#include <new> // std::nothrow für den Pipeline-Empfang
 
 // Konstante für das Escape-Byte im Byte-Stuffing
 const uint8_t RS485_ESCAPE_BYTE = 0x7D; // Beispielwert, kann angepasst werden
@@ -40,386 +41,2010 @@ static const uint16_t crc16_table[256] = {
     0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
 };
 
+static inline uint16_t rs485Crc16Update(uint16_t crc, uint8_t byte) {
+    return (crc >> 8) ^ crc16_table[(crc ^ byte) & 0xFF];
+}
+
+// Wortweise Suche (SWAR) nach den Bytes, die gestufft werden müssen (0xDE, 0xAD, 0x7D):
+// ein Wort ohne Treffer wird ohne Einzelvergleiche kopiert. (x - 0x01..) & ~x & 0x80.. ist
+// genau dann ungleich 0, wenn eines der vier Bytes von x null ist.
+static inline bool rs485HasSpecialByte(const uint8_t* data) {
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+    const uint32_t ones = 0x01010101UL;
+    const uint32_t highs = 0x80808080UL;
+    uint32_t start0 = word ^ (ones * RS485_START_BYTE_0);
+    uint32_t start1 = word ^ (ones * RS485_START_BYTE_1);
+    uint32_t escape = word ^ (ones * RS485_ESCAPE_BYTE);
+    return (((start0 - ones) & ~start0) | ((start1 - ones) & ~start1) | ((escape - ones) & ~escape)) & highs;
+}
+
+// Sendezeitstempel eines Heartbeats (RS485_TIMESTAMP_FIELD_LENGTH Bytes, nie ein Nullbyte)
+static void rs485EncodeTimestamp(uint32_t timestamp, uint8_t* out) {
+    out[0] = RS485_TIMESTAMP_MARKER;
+    for (uint8_t i = 1; i < RS485_TIMESTAMP_FIELD_LENGTH; ++i) {
+        out[i] = 0x80 | (timestamp & 0x3F);
+        timestamp >>= 6;
+    }
+}
+
+// Erkennt einen Zeitstempel am Ende des Payloads und kürzt length um das Feld
+static bool rs485TakeTimestamp(const char* payload, size_t& length, uint32_t& timestamp) {
+    if (length < RS485_TIMESTAMP_FIELD_LENGTH) {
+        return false;
+    }
+    const uint8_t* field = (const uint8_t*)&payload[length - RS485_TIMESTAMP_FIELD_LENGTH];
+    if (field[0] != RS485_TIMESTAMP_MARKER) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (uint8_t i = RS485_TIMESTAMP_FIELD_LENGTH - 1; i >= 1; --i) {
+        if ((field[i] & 0xC0) != 0x80) {
+            return false;
+        }
+        value = (value << 6) | (field[i] & 0x3F);
+    }
+    timestamp = value;
+    length -= RS485_TIMESTAMP_FIELD_LENGTH;
+    return true;
+}
+
+
+// NEU: Konstruktor, der den DirectionControl-Zeiger speichert
+RS485SecureStack::RS485SecureStack(RS485DirectionControl* directionControl, RS485KeyStore* sharedKeyStore) 
+    : _serial(nullptr), _myAddress(0), _ownKeyStore(sharedKeyStore == nullptr ? new RS485KeyStore() : nullptr),
+      _keyStore(sharedKeyStore != nullptr ? sharedKeyStore : _ownKeyStore),
+      _currentKeyId(0), _directionControl(directionControl) {
+    memset(_groupMembership, 0, sizeof(_groupMembership));
+    memset(_knownGroupMembers, 0, sizeof(_knownGroupMembers));
+    memset(&_ackWait, 0, sizeof(_ackWait));
+    memset(_txQueues, 0, sizeof(_txQueues));
+    // Heartbeats: nur der jüngste zählt. ACKs: ein altes ACK hat beim Peer ohnehin schon einen Timeout ausgelöst.
+    setTxClassLimit(RS485_TX_CLASS_CONTROL, RS485_TX_QUEUE_DEPTH, RS485_DROP_NEWEST);
+    setTxClassLimit(RS485_TX_CLASS_HEARTBEAT, 1, RS485_DROP_OLDEST);
+    setTxClassLimit(RS485_TX_CLASS_ACK, RS485_TX_QUEUE_DEPTH, RS485_DROP_OLDEST);
+    setTxClassLimit(RS485_TX_CLASS_BULK, RS485_TX_QUEUE_DEPTH, RS485_DROP_NEWEST);
+    memset(_peers, 0, sizeof(_peers));
+    memset(&_linkStats, 0, sizeof(_linkStats));
+    memset(&_mediumAccessStats, 0, sizeof(_mediumAccessStats));
+    memset(&_loopStats, 0, sizeof(_loopStats));
+    memset(_compressionDictionaries, 0, sizeof(_compressionDictionaries));
+    memset(&_compressionStats, 0, sizeof(_compressionStats));
+    memset(&_probe, 0, sizeof(_probe));
+    memset(&_linkReport, 0, sizeof(_linkReport));
+    memset(_lastTxHmac, 0, sizeof(_lastTxHmac));
+}
+
+RS485SecureStack::~RS485SecureStack() {
+    _stopRxPipeline(false); // Die Crypto-Task darf nicht mit ungültigem owner weiterlaufen
+    delete _compressionState;
+    delete _ownKeyStore;
+}
+
+// Initialisiert den Stack
+void RS485SecureStack::begin(uint8_t myAddress, const char* masterKey, uint8_t initialKeyId, HardwareSerial& serial) {
+    _myAddress = myAddress;
+    _serial = &serial;
+    _serial->begin(RS485_INITIAL_BAUD_RATE); // Startet mit einer bekannten Baudrate
+    _configuredBaudRate = RS485_INITIAL_BAUD_RATE;
+    _serial->setTimeout(SERIAL_TIMEOUT_MS);
+
+    // Initialisiere den Master Key (SHA256 Hash des übergebenen Schlüssels) und Session Key 0.
+    // Ein gemeinsamer Schlüsselspeicher wird von der Anwendung befüllt und hier nur gelesen.
+    if (_keyStore == _ownKeyStore && masterKey != nullptr) {
+        _ownKeyStore->setMasterKey(masterKey);
+    }
+    _currentKeyId = initialKeyId; // Setzt die initial zu verwendende Key ID
+
+    // Wenn ein DirectionControl-Objekt übergeben wurde, initialisiere es
+    if (_directionControl != nullptr) {
+        _directionControl->begin();
+    }
+
+    _resetReceiveBuffer();
+}
+
+// Hauptloop-Funktion zum Empfangen von Paketen
+void RS485SecureStack::loop() {
+    _runLoop(0, 0);
+}
+
+bool RS485SecureStack::loop(unsigned long budgetMicros) {
+    return _runLoop(budgetMicros > 0 ? budgetMicros : 1, 0);
+}
+
+bool RS485SecureStack::poll(uint8_t maxFrames) {
+    return _runLoop(0, maxFrames > 0 ? maxFrames : 1);
+}
+
+bool RS485SecureStack::_runLoop(unsigned long budgetMicros, uint32_t maxFrames) {
+    unsigned long startMicros = micros();
+    _loopStartMicros = startMicros;
+    _loopBudgetMicros = budgetMicros;
+    _loopMaxFrames = maxFrames;
+    _loopFramesAtStart = _framesProcessed;
+    _loopLimitHit = false;
+    _loopReadStarted = false;
+
+    // Im letzten Aufruf zurückgestelltes Senden zuerst, damit es unter Dauerlast nicht verhungert
+    bool txDone = false;
+    if (_loopTxDeferred) {
+        _serviceTxQueue(0xFF, true);
+        _loopTxDeferred = false;
+        txDone = true;
+    }
+    bool limited = budgetMicros > 0 || maxFrames > 0;
+    _receiveAvailable(limited);
+    _serviceRxPipeline(limited);
+    if (!txDone) {
+        if (budgetMicros == 0 || micros() - startMicros < budgetMicros) {
+            _serviceTxQueue(0xFF, true); // Höchstens ein Frame pro Aufruf, höchste Klasse zuerst
+        } else {
+            _loopTxDeferred = true;
+            _loopLimitHit = true;
+        }
+    }
+    _serviceProbeWindow();
+    _serviceSession();
+    _loopBudgetMicros = 0;
+    _loopMaxFrames = 0;
+
+    // Statistik: Dauer und verbleibender Rückstand
+    uint32_t elapsed = micros() - startMicros;
+    size_t backlogBytes = getRxBacklog();
+    uint8_t backlogFrames = _rxPipeline ? _rxPipeline->toCrypto.depth() + _rxPipeline->toApp.depth() : 0;
+    bool backlog = backlogBytes > 0 || backlogFrames > 0;
+    _loopStats.calls++;
+    if (_loopLimitHit) _loopStats.limitedCalls++;
+    _loopStats.lastFrames = _framesProcessed - _loopFramesAtStart;
+    _loopStats.lastCallMicros = elapsed;
+    if (elapsed > _loopStats.maxCallMicros) _loopStats.maxCallMicros = elapsed;
+    _loopStats.backlogBytes = backlogBytes > 0xFFFF ? 0xFFFF : backlogBytes;
+    if (_loopStats.backlogBytes > _loopStats.maxBacklogBytes) _loopStats.maxBacklogBytes = _loopStats.backlogBytes;
+    _loopStats.backlogFrames = backlogFrames;
+    return backlog;
+}
+
+// true, wenn loop()/poll() keinen weiteren Block bzw. Frame mehr beginnen soll. Gezählt wird jeder
+// verbrauchte Frame, auch CRC-/Framing-Fehler und kompakte ACKs. Solange noch kein Frame fertig
+// ist, wird bis zum tatsächlichen Ablauf des Budgets gelesen (Rauschen, langer Frame); der erste
+// Block eines Aufrufs ist immer erlaubt, sonst käme ein zu knappes Budget nie voran.
+bool RS485SecureStack::_loopLimitReached() const {
+    uint32_t frames = _framesProcessed - _loopFramesAtStart;
+    if (_loopMaxFrames > 0 && frames >= _loopMaxFrames) {
+        return true;
+    }
+    if (_loopBudgetMicros == 0 || (frames == 0 && !_loopReadStarted)) {
+        return false;
+    }
+    unsigned long elapsed = micros() - _loopStartMicros;
+    if (frames == 0) {
+        return elapsed > _loopBudgetMicros;
+    }
+    return elapsed + _loopStats.frameMicros > _loopBudgetMicros;
+}
+
+// Mit Zeitbudget: Ein Frame mit ACK wird nur gesendet, wenn das restliche Budget den ACK-Timeout
+// des Ziels abdeckt. Sonst bleibt er eingereiht (bis zu einem Aufruf mit genug Budget bzw. loop()).
+bool RS485SecureStack::_loopAckWaitFits(uint8_t destinationAddress) {
+    if (_loopBudgetMicros == 0 || destinationAddress == RS485_BROADCAST_ADDRESS) {
+        return true;
+    }
+    unsigned long elapsed = micros() - _loopStartMicros;
+    return elapsed < _loopBudgetMicros && getAckTimeoutMicros(destinationAddress) <= _loopBudgetMicros - elapsed;
+}
+
+// Zählt einen authentifizierten und zugestellten Frame und glättet seine Verarbeitungszeit
+void RS485SecureStack::_noteFrameProcessed(unsigned long startMicros) {
+    uint32_t elapsed = micros() - startMicros;
+    _framesProcessed++;
+    _loopStats.frameMicros = _loopStats.frameMicros == 0 ? elapsed : _loopStats.frameMicros - _loopStats.frameMicros / 8 + elapsed / 8;
+    if (elapsed > _loopStats.maxFrameMicros) _loopStats.maxFrameMicros = elapsed;
+}
+
+// Liest alle verfügbaren Bytes blockweise. Gelesen wird nie über das Ende des aktuellen Frames
+// hinaus: ein Empfangs-Callback darf selbst senden und auf ein ACK warten, dessen Bytes dann
+// noch im UART-Puffer stehen müssen. limited: Aufruf aus loop()/poll() mit Budget, dann endet
+// das Lesen an einer Blockgrenze, sobald _loopLimitReached() greift.
+void RS485SecureStack::_receiveAvailable(bool limited) {
+    uint8_t chunk[RS485_RX_CHUNK_SIZE];
+    int available;
+    while ((available = _serial->available()) > 0) {
+        if (limited && _loopLimitReached()) {
+            _loopLimitHit = true;
+            break;
+        }
+        _rxReadMicros = micros();
+        _rxReadAvailable = available;
+        // Solange die Länge unbekannt ist, byteweise, danach höchstens die noch fehlenden Bytes
+        size_t limit = 1;
+        if (_receiveBufferPos > TOTAL_LENGTH_INDEX) {
+            limit = _receiveBuffer[TOTAL_LENGTH_INDEX] - _receiveBufferPos;
+        }
+        if (limit > (size_t)available) limit = available;
+        if (limit > sizeof(chunk)) limit = sizeof(chunk);
+        size_t count = _serial->readBytes(chunk, limit);
+        if (count == 0) {
+            break;
+        }
+        _loopReadStarted = true;
+        _lastRxActivityMicros = micros(); // Für die Ruheerkennung (isBusIdle())
+        _processIncomingBytes(chunk, count);
+    }
+}
+
+// Verarbeitet einen Block empfangener Bytes. Innerhalb eines Frames werden Wörter ohne Start-
+// oder Escape-Byte direkt übernommen (CRC in derselben Schleife), alles andere byteweise.
+void RS485SecureStack::_processIncomingBytes(const uint8_t* data, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        if (!_receiveEscapePending && _receiveBufferPos > TOTAL_LENGTH_INDEX && length - i >= 4 &&
+            _receiveBufferPos + 4 + RS485_CRC_LENGTH <= _receiveBuffer[TOTAL_LENGTH_INDEX] &&
+            !rs485HasSpecialByte(&data[i])) {
+            for (size_t k = 0; k < 4; ++k) {
+                _receiveCrc = rs485Crc16Update(_receiveCrc, data[i + k]);
+            }
+            memcpy(&_receiveBuffer[_receiveBufferPos], &data[i], 4);
+            _receiveBufferPos += 4;
+            i += 4;
+            continue;
+        }
+        _rxChunkIndex = i;
+        _processIncomingByte(data[i++]);
+    }
+}
+
+// Empfangsbeginn des Startbytes: Der Block wurde bei _rxReadMicros gelesen, das Startbyte und alle
+// danach schon verfügbaren Bytes lagen da bereits vollständig vor
+void RS485SecureStack::_captureFrameStart() {
+    size_t bytesSinceStart = _rxReadAvailable > _rxChunkIndex ? _rxReadAvailable - _rxChunkIndex : 1;
+    _rxFrameStartMicros = _rxReadMicros - (unsigned long)(((uint64_t)bytesSinceStart * 10000000ULL) / (uint64_t)_configuredBaudRate);
+}
+
+// Übernimmt ein ent-stufftes Byte in den Empfangspuffer und führt die CRC mit. Das CRC-Feld am
+// Ende des Frames geht nicht in die CRC ein, bis zum Längenbyte ist der Frame immer länger.
+void RS485SecureStack::_storeReceivedByte(uint8_t byte) {
+    if (_receiveBufferPos <= TOTAL_LENGTH_INDEX || _receiveBufferPos + RS485_CRC_LENGTH < _receiveBuffer[TOTAL_LENGTH_INDEX]) {
+        _receiveCrc = rs485Crc16Update(_receiveCrc, byte);
+    }
+    _receiveBuffer[_receiveBufferPos++] = byte;
+}
+
+// Verarbeitet ein empfangenes Byte: Startbyte-Suche, Unstuffing und Längenprüfung.
+// Der Empfangspuffer enthält ausschließlich ent-stuffte Bytes, die Startbytes selbst werden nie gestufft.
+void RS485SecureStack::_processIncomingByte(uint8_t incomingByte) {
+    if (_receiveBufferPos == 0) { // Suchen nach Startbytes
+        if (incomingByte == RS485_START_BYTE_0) {
+            _captureFrameStart();
+            _storeReceivedByte(incomingByte);
+        } else {
+            // Falsches Startbyte, verwerfen
+            if (_debug) _debugPrintf("DBG: Falsches Startbyte 0x%02X\n", incomingByte);
+        }
+        return;
+    }
+    if (_receiveBufferPos == 1) {
+        if (incomingByte == RS485_START_BYTE_1) {
+            _storeReceivedByte(incomingByte);
+        } else {
+            // Falsches zweites Startbyte, Puffer zurücksetzen
+            if (_debug) _debugPrintf("DBG: Falsches zweites Startbyte 0x%02X\n", incomingByte);
+            _resetReceiveBuffer();
+            if (incomingByte == RS485_START_BYTE_0) { // Neuen Start erfassen
+                _captureFrameStart();
+                _storeReceivedByte(incomingByte);
+            }
+        }
+        return;
+    }
+
+    // Normale Daten oder Escape-Sequenz
+    if (_isStartByte(incomingByte)) {
+        // Unerwartetes Startbyte, Puffer zurücksetzen und neu beginnen
+        if (_debug) _debugPrintf("DBG: Unerwartetes Startbyte im Paket, Puffer reset.\n");
+        _linkStats.framingErrors++;
+        _noteFrameConsumed();
+        if (_frameTap) _frameTap(_frameTapContext, _receiveBuffer, _receiveBufferPos, micros(), RS485_TAP_FRAME_ABORTED);
+        _resetReceiveBuffer();
+        if (incomingByte == RS485_START_BYTE_0) { // Neuen Start erfassen
+            _captureFrameStart();
+            _storeReceivedByte(incomingByte);
+        }
+        return;
+    }
+    if (_receiveEscapePending) {
+        incomingByte ^= 0x20;
+        _receiveEscapePending = false;
+    } else if (incomingByte == RS485_ESCAPE_BYTE) {
+        _receiveEscapePending = true;
+        return;
+    }
+
+    _storeReceivedByte(incomingByte);
+
+    // Paketlänge überprüfen, sobald das Längenbyte empfangen wurde
+    if (_receiveBufferPos > TOTAL_LENGTH_INDEX) {
+        uint8_t totalLength = _receiveBuffer[TOTAL_LENGTH_INDEX];
+
+        // Überprüfen, ob die deklarierte Länge im akzeptablen Bereich liegt (oder ein kompaktes ACK ist).
+        // Nach oben begrenzt das Längenbyte selbst, der Puffer fasst MAX_PACKET_SIZE >= 255 Bytes.
+        if (totalLength < RS485_MIN_PACKET_LENGTH && totalLength != RS485_COMPACT_ACK_LENGTH) {
+            if (_debug) _debugPrintf("DBG: Ungültige Paketlänge: %d (Pos: %d). Resetting buffer.\n", totalLength, _receiveBufferPos);
+            _linkStats.framingErrors++;
+            _noteFrameConsumed();
+            if (_frameTap) _frameTap(_frameTapContext, _receiveBuffer, _receiveBufferPos, micros(), RS485_TAP_FRAME_ABORTED);
+            _resetReceiveBuffer();
+            return; // Beginne neu mit der Suche nach Startbytes
+        }
+
+        // totalLength ist die Länge des UNgestufften Pakets inkl. Startbytes,
+        // da der Puffer bereits ent-stufft ist, kann direkt verglichen werden.
+        if (_receiveBufferPos >= totalLength) {
+            // Paket verarbeiten, danach in jedem Fall (Erfolg oder CRC/HMAC-Fehler) Puffer zurücksetzen
+            _extractPacket();
+            _resetReceiveBuffer();
+        }
+    }
+}
+
+// Registriert eine Callback-Funktion
+void RS485SecureStack::registerReceiveCallback(PacketReceivedContextCallback callback, void* context) {
+    _packetReceivedContextCallback = callback;
+    _callbackContext = context;
+}
+
+void RS485SecureStack::registerReceiveCallback(PacketReceivedCallback callback) {
+    _packetReceivedCallback = callback;
+}
+
+// Sendet eine Nachricht
+bool RS485SecureStack::sendMessage(uint8_t destinationAddress, uint8_t senderAddress, char messageType, const String& payload, bool requiresAck) {
+    if (requiresAck && destinationAddress == RS485_BROADCAST_ADDRESS) {
+        // Broadcasts werden nie bestätigt: ohne ACK senden statt die Wiederholungen auszuschöpfen
+        if (_debug) _debugPrintf("DBG: Broadcast ohne ACK gesendet (requiresAck ignoriert).\n");
+        requiresAck = false;
+    }
+    uint8_t sequence = _txSequence++;
+    if (!requiresAck) {
+        return _sendFrame(destinationAddress, senderAddress, messageType, payload, 0, sequence);
+    }
+
+    // Wenn ACK erforderlich: senden, warten und bei Timeout mit verdoppeltem Timeout wiederholen
+    // (exponentieller Backoff). Wiederholungen tragen dieselbe Sequenznummer, damit der Empfänger
+    // Duplikate erkennt, wenn nur das ACK verloren ging.
+    PeerEntry_t* peer = _findPeer(destinationAddress, true);
+    unsigned long timeoutMicros = getAckTimeoutMicros(destinationAddress);
+    for (uint8_t attempt = 0; attempt <= _ackMaxRetries; ++attempt) {
+        uint8_t flags = RS485_FLAG_ACK_REQUESTED;
+        if (attempt > 0) {
+            flags |= RS485_FLAG_RETRANSMISSION;
+            if (peer) peer->stats.retransmissions++;
+            if (_debug) _debugPrintf("DBG: Wiederholung %d an %d (Timeout %lu us).\n", attempt, destinationAddress, timeoutMicros);
+        }
+        if (!_sendFrame(destinationAddress, senderAddress, messageType, payload, flags, sequence)) {
+            return false;
+        }
+        // Sendeende dieses Frames festhalten: _waitForAck() sendet selbst kompakte ACKs und
+        // überschreibt dabei _lastTxDoneMicros
+        unsigned long txDoneMicros = _lastTxDoneMicros;
+
+        _lastAckRxMicros = 0;
+        bool acked = _waitForAck(destinationAddress, timeoutMicros);
+        if (_ackWait.done) {
+            // Karn: Nur Antworten auf den ersten Versuch sind eindeutig einem Frame zuzuordnen
+            if (attempt == 0 && peer && _lastAckRxMicros != 0) {
+                unsigned long elapsed = _lastAckRxMicros - txDoneMicros;
+                unsigned long ackAirtime = frameAirtimeMicros(_lastAckLength);
+                _updateRtt(*peer, elapsed > ackAirtime ? elapsed - ackAirtime : 0);
+            }
+            return acked; // ACK oder NACK (ein NACK wird nicht wiederholt)
+        }
+
+        if (peer) peer->stats.ackTimeouts++;
+        if (_csmaEnabled) {
+            // Ohne ACK ist eine Kollision wahrscheinlich: zufällig warten, damit die Wiederholungen
+            // der beteiligten Sender auseinanderlaufen (Exponent wächst mit jedem Versuch)
+            _mediumAccessStats.suspectedCollisions++;
+            if (attempt < _ackMaxRetries) {
+                uint8_t exponent = _csmaMinExponent + attempt;
+                _csmaBackoff(exponent < _csmaMaxExponent ? exponent : _csmaMaxExponent);
+            }
+        }
+        // Vor der Wiederholung wartende Steuer-/Heartbeat-Frames (ohne ACK) vorziehen,
+        // damit sie nicht hinter der gesamten Wiederholungskette warten
+        while (_serviceTxQueue((1 << RS485_TX_CLASS_CONTROL) | (1 << RS485_TX_CLASS_HEARTBEAT) | (1 << RS485_TX_CLASS_ACK), false)) {
+        }
+        timeoutMicros *= 2;
+        if (timeoutMicros > RS485_ACK_TIMEOUT_MAX_US) timeoutMicros = RS485_ACK_TIMEOUT_MAX_US;
+    }
+    return false;
+}
+
+// Reiht eine Nachricht in die Sendewarteschlange ihrer Klasse ein
+bool RS485SecureStack::queueMessage(uint8_t destinationAddress, char messageType, const String& payload, bool requiresAck, RS485TxClass txClass) {
+    if (txClass >= RS485_TX_CLASS_COUNT) {
+        return false;
+    }
+    unsigned long notBeforeMicros = micros();
+    if (txClass == RS485_TX_CLASS_HEARTBEAT) {
+        notBeforeMicros += _piggybackHeartbeatDelayMicros; // Zeit für einen Frame, der den Heartbeat mitnimmt
+    }
+    return _enqueueTx(txClass, destinationAddress, messageType, payload, requiresAck, notBeforeMicros);
+}
+
+void RS485SecureStack::setTxClassLimit(RS485TxClass txClass, uint8_t depthLimit, RS485DropPolicy dropPolicy) {
+    if (txClass >= RS485_TX_CLASS_COUNT) {
+        return;
+    }
+    TxQueue_t& queue = _txQueues[txClass];
+    queue.depthLimit = depthLimit > RS485_TX_QUEUE_DEPTH ? RS485_TX_QUEUE_DEPTH : depthLimit;
+    queue.dropPolicy = dropPolicy;
+    // Überzählige (älteste) Einträge verwerfen, wenn die Tiefe verkleinert wird
+    while (queue.count > queue.depthLimit) {
+        queue.head = (queue.head + 1) % RS485_TX_QUEUE_DEPTH;
+        queue.count--;
+        queue.stats.dropped++;
+    }
+}
+
+bool RS485SecureStack::canQueue(RS485TxClass txClass) const {
+    if (txClass >= RS485_TX_CLASS_COUNT) {
+        return false;
+    }
+    const TxQueue_t& queue = _txQueues[txClass];
+    return queue.count < queue.depthLimit || (queue.dropPolicy == RS485_DROP_OLDEST && queue.depthLimit > 0);
+}
+
+uint8_t RS485SecureStack::getTxClassLimit(RS485TxClass txClass) const {
+    if (txClass >= RS485_TX_CLASS_COUNT) {
+        return 0;
+    }
+    return _txQueues[txClass].depthLimit;
+}
+
+bool RS485SecureStack::getTxClassStats(RS485TxClass txClass, TxClassStats_t& stats) const {
+    if (txClass >= RS485_TX_CLASS_COUNT) {
+        return false;
+    }
+    stats = _txQueues[txClass].stats;
+    stats.depth = _txQueues[txClass].count;
+    return true;
+}
+
+// Sendet eine Nachricht an eine Multicast-Gruppe
+bool RS485SecureStack::sendMulticast(uint8_t groupAddress, char messageType, const String& payload, bool collectAcks, uint8_t* ackBitmap) {
+    if (!isGroupAddress(groupAddress)) {
+        if (_debug) _debugPrintf("ERR: %d ist keine Gruppenadresse.\n", groupAddress);
+        return false;
+    }
+    if (ackBitmap != nullptr) {
+        memset(ackBitmap, 0, RS485_ADDRESS_BITMAP_SIZE);
+    }
+    if (!_sendFrame(groupAddress, _myAddress, messageType, payload, collectAcks ? RS485_FLAG_ACK_REQUESTED : 0, _txSequence++)) {
+        return false;
+    }
+    if (!collectAcks) {
+        return true;
+    }
+
+    uint8_t expected[RS485_ADDRESS_BITMAP_SIZE];
+    size_t memberCount = getKnownGroupMembers(groupAddress, expected);
+    rs485BitmapClear(expected, _myAddress); // Eigene ACKs gibt es nicht
+    if (isGroupMember(groupAddress) && memberCount > 0) {
+        memberCount--;
+    }
+    if (memberCount == 0) {
+        if (_debug) _debugPrintf("DBG: Keine bekannten Mitglieder in Gruppe %d, keine ACKs erwartet.\n", groupAddress);
+        return true;
+    }
+
+    // Jedes Mitglied antwortet in seinem Zeitschlitz, daher (Mitglieder + 1) Schlitze abwarten
+    _waitForAck(groupAddress, (memberCount + 1) * _multicastAckSlotMicros(), memberCount);
+
+    bool allAcked = true;
+    for (size_t i = 0; i < RS485_ADDRESS_BITMAP_SIZE; ++i) {
+        if ((_ackWait.ackBitmap[i] & expected[i]) != expected[i]) {
+            allAcked = false;
+        }
+    }
+    if (ackBitmap != nullptr) {
+        memcpy(ackBitmap, _ackWait.ackBitmap, RS485_ADDRESS_BITMAP_SIZE);
+    }
+    if (_debug) _debugPrintf("DBG: Multicast an Gruppe %d: %s\n", groupAddress, allAcked ? "alle Mitglieder bestätigt" : "ACKs fehlen");
+    return allAcked;
+}
+
+// Baut ein Paket (Header, IV, verschlüsselter Payload, HMAC, CRC) und sendet es gestufft
+bool RS485SecureStack::_sendFrame(uint8_t destinationAddress, uint8_t senderAddress, char messageType, const String& payload, uint8_t flags, uint8_t sequence) {
+    // Master-Heartbeat: Platz für den Sendezeitstempel, eingetragen wird er erst beim Sendebeginn
+    size_t payloadLength = payload.length();
+    bool stampPayload = _heartbeatTimestamps && messageType == MSG_TYPE_MASTER_HEARTBEAT;
+    if (stampPayload) {
+        payloadLength += RS485_TIMESTAMP_FIELD_LENGTH;
+    }
+
+    // Überprüfen, ob Payload zu lang ist
+    if (payloadLength > RS485_MAX_PAYLOAD_LENGTH) {
+        if (_debug) _debugPrintf("ERR: Payload zu lang.\n");
+        return false;
+    }
+
+    // Optional komprimieren. Heartbeats mit Zeitstempel bleiben roh, der Stempel entsteht erst beim Senden.
+    const uint8_t* payloadData = (const uint8_t*)payload.c_str();
+    size_t dataLength = payload.length();
+    uint8_t compressedPayload[RS485_MAX_PAYLOAD_LENGTH];
+    if (_compressionEnabled && !stampPayload && payloadLength > RS485_IV_LENGTH) {
+        // Wiederholungen komprimieren erneut (gleiches Ergebnis), zählen aber nicht noch einmal
+        size_t compressedLength = _compressPayload(payloadData, payloadLength, compressedPayload, !(flags & RS485_FLAG_RETRANSMISSION));
+        if (compressedLength > 0) {
+            payloadData = compressedPayload;
+            dataLength = payloadLength = compressedLength;
+            flags |= RS485_FLAG_COMPRESSED;
+        }
+    }
+
+    // AES verschlüsselt in 16-Byte-Blöcken
+    size_t paddedPayloadLen = payloadLength;
+    if (paddedPayloadLen % RS485_IV_LENGTH != 0) {
+        paddedPayloadLen = ((paddedPayloadLen / RS485_IV_LENGTH) + 1) * RS485_IV_LENGTH;
+    }
+
+    // Erst auf den freien Bus warten, die Header-Erweiterung nimmt dann auch ACKs mit,
+    // die während des Backoffs eingereiht wurden
+    if (_csmaEnabled && !_acquireBus()) {
+        if (_debug) _debugPrintf("ERR: Bus belegt, Frame an %d nicht gesendet.\n", destinationAddress);
+        return false;
+    }
+
+    // Wartendes ACK an den Empfänger und wartenden Heartbeat als Header-Erweiterung mitnehmen
+    uint8_t extension[RS485_MAX_HEADER_EXTENSION_LENGTH];
+    size_t extensionTimestampOffset = 0;
+    size_t extensionLength = _buildHeaderExtension(destinationAddress, messageType, RS485_MIN_PACKET_LENGTH + paddedPayloadLen, flags, extension, extensionTimestampOffset);
+    size_t ivOffset = RS485_HEADER_LENGTH + extensionLength;
+    size_t payloadOffset = ivOffset + RS485_IV_LENGTH;
+
+    // Frame ohne CRC (unverschlüsselte Teile + IV + verschlüsselter Payload + HMAC),
+    // die CRC entsteht beim Senden in _txStream()
+    size_t totalLength = RS485_MIN_PACKET_LENGTH + extensionLength + paddedPayloadLen;
+    size_t hmacOffset = payloadOffset + paddedPayloadLen;
+    uint8_t rawPacket[MAX_PACKET_SIZE];
+    // _buildHeaderExtension() hält den Frame bei höchstens 255 Bytes, das hier greift also nur bei einem Fehler
+    if (hmacOffset + RS485_HMAC_LENGTH > sizeof(rawPacket)) {
+        if (_debug) _debugPrintf("ERR: Frame zu lang (%d Bytes).\n", (int)(hmacOffset + RS485_HMAC_LENGTH));
+        return false;
+    }
+
+    // Header füllen
+    rawPacket[START_BYTE_0_INDEX] = RS485_START_BYTE_0;
+    rawPacket[START_BYTE_1_INDEX] = RS485_START_BYTE_1;
+    rawPacket[PROTOCOL_VERSION_INDEX] = RS485_PROTOCOL_VERSION;
+    // Gesamtlänge (ab Startbyte 0xDE)
+    rawPacket[TOTAL_LENGTH_INDEX] = (uint8_t)totalLength; // Gesamtlänge des *un-stuffed* Pakets
+    rawPacket[MESSAGE_TYPE_INDEX] = messageType;
+    rawPacket[DEST_ADDRESS_INDEX] = destinationAddress;
+    rawPacket[SENDER_ADDRESS_INDEX] = senderAddress;
+    rawPacket[KEY_ID_INDEX] = _currentKeyId;
+    rawPacket[FLAGS_INDEX] = flags;
+    rawPacket[SEQUENCE_INDEX] = sequence;
+
+    // Header-Erweiterung und IV hinzufügen
+    memcpy(&rawPacket[RS485_HEADER_LENGTH], extension, extensionLength);
+    _generateIV(&rawPacket[ivOffset]);
+
+    // Header, Erweiterung und IV stehen fest: schon senden, während der Payload verschlüsselt wird
+    _txBegin();
+    uint32_t txStartMicros = micros(); // Sendezeitstempel: unmittelbar vor dem ersten Byte an den UART
+    if (extensionTimestampOffset != 0) {
+        rs485EncodeTimestamp(txStartMicros, &rawPacket[RS485_HEADER_LENGTH + extensionTimestampOffset]);
+    }
+    _txStream(&rawPacket[PROTOCOL_VERSION_INDEX], payloadOffset - PROTOCOL_VERSION_INDEX);
+    _txFlushChunk();
+
+    // Payload samt Null-Padding direkt im Frame verschlüsseln (Schlüssel als Kopie, der
+    // Schlüsselspeicher kann geteilt sein)
+    memcpy(&rawPacket[payloadOffset], payloadData, dataLength);
+    if (stampPayload) {
+        rs485EncodeTimestamp(txStartMicros, &rawPacket[payloadOffset + dataLength]);
+    }
+    memset(&rawPacket[payloadOffset + payloadLength], 0, paddedPayloadLen - payloadLength);
+    uint8_t sessionKey[RS485KeyStore::KEY_LENGTH];
+    _keyStore->copySessionKey(_currentKeyId, sessionKey);
+    _encryptAES(&rawPacket[payloadOffset], paddedPayloadLen, sessionKey, &rawPacket[ivOffset]);
+
+    // HMAC über Header, Erweiterung, IV und verschlüsseltem Payload berechnen und hinzufügen
+    _calculateHMAC(sessionKey, rawPacket, hmacOffset, &rawPacket[hmacOffset]);
+
+    // Bezug für das kompakte ACK des Empfängers
+    _lastTxSequence = sequence;
+    _lastTxKeyId = _currentKeyId;
+    memcpy(_lastTxHmac, &rawPacket[hmacOffset], RS485_HMAC_LENGTH);
+
+    _txStream(&rawPacket[payloadOffset], paddedPayloadLen + RS485_HMAC_LENGTH);
+    _txEnd();
+    return true;
+}
+
+// Baut ein kompaktes ACK/NACK (Header, gekürzter MAC) und sendet es gestufft mit CRC
+bool RS485SecureStack::_sendCompactAck(const TxQueueEntry_t& entry) {
+    uint8_t rawPacket[RS485_COMPACT_ACK_LENGTH - RS485_CRC_LENGTH];
+    rawPacket[START_BYTE_0_INDEX] = RS485_START_BYTE_0;
+    rawPacket[START_BYTE_1_INDEX] = RS485_START_BYTE_1;
+    rawPacket[PROTOCOL_VERSION_INDEX] = RS485_PROTOCOL_VERSION;
+    rawPacket[TOTAL_LENGTH_INDEX] = RS485_COMPACT_ACK_LENGTH;
+    rawPacket[MESSAGE_TYPE_INDEX] = MSG_TYPE_ACK_NACK;
+    rawPacket[DEST_ADDRESS_INDEX] = entry.destinationAddress;
+    rawPacket[SENDER_ADDRESS_INDEX] = _myAddress;
+    rawPacket[KEY_ID_INDEX] = entry.ackKeyId;
+    rawPacket[FLAGS_INDEX] = entry.ackStatus;
+    rawPacket[SEQUENCE_INDEX] = entry.ackSequence;
+    _calculateCompactAckMac(rawPacket, (const uint8_t*)entry.payload, &rawPacket[RS485_HEADER_LENGTH]);
+
+    _transmitFrame(rawPacket, sizeof(rawPacket));
+    return true;
+}
+
+// Wartet, bis der Bus frei ist (Carrier Sense mit zufälligem exponentiellem Backoff).
+// Gibt false zurück, wenn er nach _csmaMaxBackoffs Wartezeiten noch belegt ist.
+bool RS485SecureStack::_acquireBus() {
+    unsigned long startMicros = micros();
+    uint8_t exponent = _csmaMinExponent;
+    uint8_t backoffs = 0;
+    while (!isBusIdle()) {
+        if (backoffs >= _csmaMaxBackoffs) {
+            _mediumAccessStats.accessFailures++;
+            return false;
+        }
+        _csmaBackoff(exponent);
+        backoffs++;
+        if (exponent < _csmaMaxExponent) exponent++;
+    }
+
+    if (backoffs == 0) {
+        _mediumAccessStats.immediate++;
+    } else {
+        _mediumAccessStats.deferred++;
+    }
+    unsigned long accessMicros = micros() - startMicros;
+    if (accessMicros > _mediumAccessStats.maxAccessMicros) _mediumAccessStats.maxAccessMicros = accessMicros;
+    return true;
+}
+
+// Wartet zufällig 0 bis 2^exponent-1 Slots. Empfangene Frames werden dabei verarbeitet, damit
+// der Frame auf dem Bus nicht im UART-Puffer überläuft und ACKs für andere rechtzeitig rausgehen.
+void RS485SecureStack::_csmaBackoff(uint8_t exponent) {
+    unsigned long bitMicros = 1000000UL / (unsigned long)_configuredBaudRate + 1;
+    unsigned long slotMicros = RS485_TX_ENABLE_DELAY_US + RS485_CSMA_SLOT_BIT_TIMES * bitMicros;
+    unsigned long waitMicros = (unsigned long)random(1L << exponent) * slotMicros;
+    _mediumAccessStats.backoffs++;
+    _mediumAccessStats.backoffMicrosTotal += waitMicros;
+
+    unsigned long startMicros = micros();
+    while (micros() - startMicros < waitMicros) {
+        _receiveAvailable();
+        _serviceRxPipeline();
+        _serviceTxQueue(1 << RS485_TX_CLASS_ACK, false);
+    }
+}
+
+bool RS485SecureStack::isBusIdle() {
+    if (_serial->available() > 0) {
+        return false;
+    }
+    unsigned long bitMicros = 1000000UL / (unsigned long)_configuredBaudRate + 1;
+    return micros() - _lastRxActivityMicros >= (unsigned long)_csmaIdleBitTimes * bitMicros;
+}
+
+void RS485SecureStack::setCarrierSenseBackoff(uint8_t minExponent, uint8_t maxExponent, uint8_t maxBackoffs) {
+    if (maxExponent > 15) maxExponent = 15;
+    if (minExponent > maxExponent) minExponent = maxExponent;
+    _csmaMinExponent = minExponent;
+    _csmaMaxExponent = maxExponent;
+    _csmaMaxBackoffs = maxBackoffs;
+}
+
+// Sendet einen fertigen Frame (ohne CRC) in einem Durchgang
+void RS485SecureStack::_transmitFrame(const uint8_t* rawPacket, size_t length) {
+    _txBegin();
+    _txStream(&rawPacket[PROTOCOL_VERSION_INDEX], length - PROTOCOL_VERSION_INDEX);
+    _txEnd();
+}
+
+// Schaltet auf Senden und schreibt die Startbytes. Sie bleiben ungestufft, damit der Empfänger
+// den Rahmen erkennt, gehen aber in die CRC ein.
+void RS485SecureStack::_txBegin() {
+    if (_directionControl != nullptr) {
+        _directionControl->setTransmitMode();
+        delayMicroseconds(RS485_TX_ENABLE_DELAY_US);
+    }
+    _txChunk[0] = RS485_START_BYTE_0;
+    _txChunk[1] = RS485_START_BYTE_1;
+    _txChunkPos = 2;
+    _txCrc = rs485Crc16Update(rs485Crc16Update(0x0000, RS485_START_BYTE_0), RS485_START_BYTE_1);
+}
+
+// CRC, Byte-Stuffing und Ausgabe in einer Schleife. Volle Blöcke gehen sofort an den UART.
+void RS485SecureStack::_txStream(const uint8_t* data, size_t length, bool updateCrc) {
+    size_t i = 0;
+    while (i < length) {
+        // Immer Platz für ein ganzes Wort bzw. ein Escape-Paar lassen
+        if (RS485_TX_CHUNK_SIZE - _txChunkPos < 4) {
+            _txFlushChunk();
+        }
+        if (length - i >= 4 && !rs485HasSpecialByte(&data[i])) {
+            if (updateCrc) {
+                for (size_t k = 0; k < 4; ++k) {
+                    _txCrc = rs485Crc16Update(_txCrc, data[i + k]);
+                }
+            }
+            memcpy(&_txChunk[_txChunkPos], &data[i], 4);
+            _txChunkPos += 4;
+            i += 4;
+            continue;
+        }
+        uint8_t byte = data[i++];
+        if (updateCrc) {
+            _txCrc = rs485Crc16Update(_txCrc, byte);
+        }
+        if (byte == RS485_START_BYTE_0 || byte == RS485_START_BYTE_1 || byte == RS485_ESCAPE_BYTE) {
+            _txChunk[_txChunkPos++] = RS485_ESCAPE_BYTE;
+            _txChunk[_txChunkPos++] = byte ^ 0x20; // XOR mit 0x20 zum Escaping
+        } else {
+            _txChunk[_txChunkPos++] = byte;
+        }
+    }
+}
+
+void RS485SecureStack::_txFlushChunk() {
+    if (_txChunkPos > 0) {
+        _serial->write(_txChunk, _txChunkPos);
+        _txChunkPos = 0;
+    }
+}
+
+// Hängt die CRC an, wartet auf das letzte Byte und schaltet zurück auf Empfang
+void RS485SecureStack::_txEnd() {
+    uint8_t crc[RS485_CRC_LENGTH] = { (uint8_t)(_txCrc & 0xFF), (uint8_t)((_txCrc >> 8) & 0xFF) };
+    _txStream(crc, sizeof(crc), false);
+    _txFlushChunk();
+    _serial->flush(); // Warte, bis alle Bytes gesendet wurden
+
+    if (_directionControl != nullptr) {
+        delayMicroseconds(RS485_TX_DISABLE_DELAY_US);
+        _directionControl->setReceiveMode();
+    }
+    _lastTxDoneMicros = micros(); // Referenzzeitpunkt für die RTT-Messung
+}
+
+// Gekürzter MAC eines kompakten ACKs: HMAC-SHA256 über den ACK-Header und den HMAC des
+// bestätigten Frames, mit dem Schlüssel aus KEY_ID_INDEX des ACK-Headers
+void RS485SecureStack::_calculateCompactAckMac(const uint8_t* ackHeader, const uint8_t* ackedFrameHmac, uint8_t* macOut) {
+    uint8_t macInput[RS485_HEADER_LENGTH + RS485_HMAC_LENGTH];
+    memcpy(macInput, ackHeader, RS485_HEADER_LENGTH);
+    memcpy(&macInput[RS485_HEADER_LENGTH], ackedFrameHmac, RS485_HMAC_LENGTH);
+
+    uint8_t sessionKey[RS485KeyStore::KEY_LENGTH];
+    _keyStore->copySessionKey(ackHeader[KEY_ID_INDEX], sessionKey);
+    uint8_t fullMac[RS485_HMAC_LENGTH];
+    _calculateHMAC(sessionKey, macInput, sizeof(macInput), fullMac);
+    memcpy(macOut, fullMac, RS485_COMPACT_ACK_MAC_LENGTH);
+}
+
+// Kompaktes ACK/NACK: Der MAC ist an den bestätigten Frame gebunden und lässt sich daher nur
+// prüfen, solange auf genau dieses ACK gewartet wird. Alle anderen kompakten ACKs werden verworfen.
+void RS485SecureStack::_handleCompactAck(const uint8_t* frame, unsigned long rxMicros) {
+    uint8_t senderAddress = frame[SENDER_ADDRESS_INDEX];
+    uint8_t status = frame[FLAGS_INDEX];
+    if (frame[DEST_ADDRESS_INDEX] != _myAddress || !_ackWait.active || _ackWait.done) {
+        return;
+    }
+    bool multicast = isGroupAddress(_ackWait.peerAddress);
+    if ((!multicast && senderAddress != _ackWait.peerAddress) ||
+        frame[SEQUENCE_INDEX] != _ackWait.sequence || frame[KEY_ID_INDEX] != _ackWait.keyId) {
+        if (_debug) _debugPrintf("DBG: Kompaktes ACK von %d (Seq %d) passt nicht zum wartenden Frame.\n", senderAddress, frame[SEQUENCE_INDEX]);
+        return;
+    }
+
+    uint8_t expectedMac[RS485_COMPACT_ACK_MAC_LENGTH];
+    _calculateCompactAckMac(frame, _ackWait.frameHmac, expectedMac);
+    for (size_t i = 0; i < RS485_COMPACT_ACK_MAC_LENGTH; ++i) {
+        if (frame[RS485_HEADER_LENGTH + i] != expectedMac[i]) {
+            if (_debug) _debugPrintf("ERR: MAC-Fehler im kompakten ACK von %d.\n", senderAddress);
+            return;
+        }
+    }
+
+    _linkStats.framesReceived++; // Erst nach Ziel- und MAC-Prüfung, fremde ACKs zählen nicht
+    _acceptAck(senderAddress, status, rxMicros, RS485_COMPACT_ACK_LENGTH);
+}
+
+// Wertet ein geprüftes ACK/NACK (kompakt oder als Header-Erweiterung) für den wartenden Frame aus
+void RS485SecureStack::_acceptAck(uint8_t senderAddress, uint8_t status, unsigned long rxMicros, uint8_t frameLength) {
+    if (isGroupAddress(_ackWait.peerAddress)) {
+        // Multicast: ACKs aller Mitglieder im Bitmap sammeln
+        if (status == RS485_ACK_OK && !rs485BitmapTest(_ackWait.ackBitmap, senderAddress)) {
+            rs485BitmapSet(_ackWait.ackBitmap, senderAddress);
+            if (++_ackWait.ackCount >= _ackWait.expectedAcks) {
+                _ackWait.done = true; // Alle erwarteten Mitglieder haben bestätigt
+                _ackWait.acked = true;
+                _lastAckStatus = RS485_ACK_OK;
+            }
+        }
+        return;
+    }
+    _lastAckRxMicros = rxMicros;
+    _lastAckLength = frameLength;
+    _lastAckStatus = status;
+    _ackWait.done = true;
+    _ackWait.acked = (status == RS485_ACK_OK);
+    if (_debug) _debugPrintf("DBG: %s von %d empfangen (Status %d).\n", _ackWait.acked ? "ACK" : "NACK", senderAddress, status);
+}
+
+// Länge der Header-Erweiterungen laut Flags, -1 wenn sie nicht in den Frame passen
+int RS485SecureStack::_headerExtensionLength(const uint8_t* frame) const {
+    uint8_t totalLength = frame[TOTAL_LENGTH_INDEX];
+    uint8_t flags = frame[FLAGS_INDEX];
+    size_t length = 0;
+    if (flags & RS485_FLAG_EXT_ACK) {
+        length += RS485_EXT_ACK_LENGTH;
+    }
+    if (flags & RS485_FLAG_EXT_HEARTBEAT) {
+        if (RS485_MIN_PACKET_LENGTH + length + 2 > totalLength) {
+            return -1;
+        }
+        uint8_t heartbeatLength = frame[RS485_HEADER_LENGTH + length + 1];
+        if (heartbeatLength > RS485_EXT_HEARTBEAT_MAX_PAYLOAD) {
+            return -1;
+        }
+        length += 2 + heartbeatLength;
+    }
+    if (RS485_MIN_PACKET_LENGTH + length > totalLength) {
+        return -1;
+    }
+    return (int)length;
+}
+
+// Nimmt ein wartendes eigenes ACK an destinationAddress und einen wartenden Heartbeat als
+// Header-Erweiterung mit, sofern der Frame dadurch nicht zu lang wird. Mitgenommene Einträge
+// werden danach nicht mehr einzeln gesendet. Testframes der Baudraten-Probe nehmen nichts mit.
+size_t RS485SecureStack::_buildHeaderExtension(uint8_t destinationAddress, char messageType, size_t frameLength, uint8_t& flags, uint8_t* extension, size_t& timestampOffset) {
+    size_t length = 0;
+    if (messageType == MSG_TYPE_LINK_TEST) {
+        return 0;
+    }
+
+    // ACK: zuerst das des gerade zugestellten Pakets (Antwort aus dem Callback), sonst ein eingereihtes
+    if (destinationAddress != RS485_BROADCAST_ADDRESS && !isGroupAddress(destinationAddress) &&
+        frameLength + RS485_EXT_ACK_LENGTH <= 255) {
+        if (_rxAck != nullptr && _rxAck->pending && _rxAck->peerAddress == destinationAddress) {
+            extension[0] = _rxAck->sequence;
+            extension[1] = _rxAck->status;
+            memcpy(&extension[2], _rxAck->frameHmac, RS485_EXT_ACK_HMAC_REF_LENGTH);
+            _rxAck->pending = false;
+            _txQueues[RS485_TX_CLASS_ACK].stats.piggybacked++;
+            length = RS485_EXT_ACK_LENGTH;
+        } else {
+            TxQueue_t& queue = _txQueues[RS485_TX_CLASS_ACK];
+            for (uint8_t i = 0; i < queue.count && length == 0; ++i) {
+                TxQueueEntry_t& entry = queue.entries[(queue.head + i) % RS485_TX_QUEUE_DEPTH];
+                if (entry.compactAck && !entry.cancelled && entry.destinationAddress == destinationAddress) {
+                    extension[0] = entry.ackSequence;
+                    extension[1] = entry.ackStatus;
+                    memcpy(&extension[2], entry.payload, RS485_EXT_ACK_HMAC_REF_LENGTH);
+                    entry.cancelled = true;
+                    queue.stats.piggybacked++;
+                    length = RS485_EXT_ACK_LENGTH;
+                }
+            }
+        }
+        if (length > 0) {
+            flags |= RS485_FLAG_EXT_ACK;
+        }
+    }
+
+    // Heartbeat: Jeder Knoten sieht den Frame auf dem Bus, daher unabhängig vom Ziel des Frames
+    TxQueue_t& heartbeats = _txQueues[RS485_TX_CLASS_HEARTBEAT];
+    for (uint8_t i = 0; i < heartbeats.count; ++i) {
+        TxQueueEntry_t& entry = heartbeats.entries[(heartbeats.head + i) % RS485_TX_QUEUE_DEPTH];
+        size_t payloadLength = strlen(entry.payload);
+        size_t stampLength = (_heartbeatTimestamps && entry.messageType == MSG_TYPE_MASTER_HEARTBEAT) ? RS485_TIMESTAMP_FIELD_LENGTH : 0;
+        if (entry.cancelled || entry.requiresAck || entry.destinationAddress != RS485_BROADCAST_ADDRESS ||
+            payloadLength + stampLength > RS485_EXT_HEARTBEAT_MAX_PAYLOAD || frameLength + length + 2 + payloadLength + stampLength > 255) {
+            continue;
+        }
+        extension[length] = (uint8_t)entry.messageType;
+        extension[length + 1] = (uint8_t)(payloadLength + stampLength);
+        memcpy(&extension[length + 2], entry.payload, payloadLength);
+        if (stampLength > 0) {
+            timestampOffset = length + 2 + payloadLength; // Wert folgt beim Sendebeginn
+            rs485EncodeTimestamp(0, &extension[timestampOffset]);
+        }
+        length += 2 + payloadLength + stampLength;
+        entry.cancelled = true;
+        heartbeats.stats.piggybacked++;
+        flags |= RS485_FLAG_EXT_HEARTBEAT;
+        break;
+    }
+    return length;
+}
+// Tritt einer Multicast-Gruppe bei und kündigt das per Broadcast an
+bool RS485SecureStack::joinGroup(uint8_t groupAddress) {
+    if (!isGroupAddress(groupAddress)) {
+        if (_debug) _debugPrintf("ERR: %d ist keine Gruppenadresse.\n", groupAddress);
+        return false;
+    }
+    uint8_t groupIndex = groupAddress - RS485_GROUP_ADDRESS_FIRST;
+    _groupMembership[groupIndex >> 3] |= (1 << (groupIndex & 7));
+    rs485BitmapSet(_knownGroupMembers[groupIndex], _myAddress);
+
+    String payload = "JOIN:";
+    payload += (int)groupAddress;
+    return _sendFrame(RS485_BROADCAST_ADDRESS, _myAddress, MSG_TYPE_GROUP_MGMT, payload, 0, _txSequence++);
+}
+
+// Verlässt eine Multicast-Gruppe und kündigt das per Broadcast an
+bool RS485SecureStack::leaveGroup(uint8_t groupAddress) {
+    if (!isGroupAddress(groupAddress)) {
+        if (_debug) _debugPrintf("ERR: %d ist keine Gruppenadresse.\n", groupAddress);
+        return false;
+    }
+    uint8_t groupIndex = groupAddress - RS485_GROUP_ADDRESS_FIRST;
+    _groupMembership[groupIndex >> 3] &= ~(1 << (groupIndex & 7));
+    rs485BitmapClear(_knownGroupMembers[groupIndex], _myAddress);
+
+    String payload = "LEAVE:";
+    payload += (int)groupAddress;
+    return _sendFrame(RS485_BROADCAST_ADDRESS, _myAddress, MSG_TYPE_GROUP_MGMT, payload, 0, _txSequence++);
+}
+
+bool RS485SecureStack::isGroupMember(uint8_t groupAddress) const {
+    if (!isGroupAddress(groupAddress)) {
+        return false;
+    }
+    uint8_t groupIndex = groupAddress - RS485_GROUP_ADDRESS_FIRST;
+    return (_groupMembership[groupIndex >> 3] >> (groupIndex & 7)) & 1;
+}
+
+size_t RS485SecureStack::getKnownGroupMembers(uint8_t groupAddress, uint8_t* memberBitmap) const {
+    if (!isGroupAddress(groupAddress)) {
+        memset(memberBitmap, 0, RS485_ADDRESS_BITMAP_SIZE);
+        return 0;
+    }
+    const uint8_t* members = _knownGroupMembers[groupAddress - RS485_GROUP_ADDRESS_FIRST];
+    memcpy(memberBitmap, members, RS485_ADDRESS_BITMAP_SIZE);
+    size_t count = 0;
+    for (int address = 0; address < 256; ++address) {
+        if (rs485BitmapTest(members, address)) count++;
+    }
+    return count;
+}
+
+// Setzt einen neuen Session Key
+bool RS485SecureStack::setSessionKey(uint8_t keyId, const uint8_t* keyData, size_t keyLen) {
+    if (_keyStore != _ownKeyStore) {
+        if (_debug) _debugPrintf("ERR: Gemeinsamer Schlüsselspeicher ist für den Stack nur lesbar.\n");
+        return false;
+    }
+    if (!_ownKeyStore->setSessionKey(keyId, keyData, keyLen)) { // Session Keys müssen 32 Bytes für SHA256 HMAC sein
+        if (_debug) _debugPrintf("ERR: Session Key muss 32 Bytes lang sein.\n");
+        return false;
+    }
+    if (keyId != _currentKeyId) { // Verteilt, aber noch nicht aktiv
+        _hasNextKey = true;
+        _nextKeyId = keyId;
+    }
+    return true;
+}
+
+// Wechselt zur Verwendung eines neuen Schlüssels für ausgehende Nachrichten
+void RS485SecureStack::setCurrentKeyId(uint8_t keyId) {
+    if (keyId >= 256) {
+        if (_debug) _debugPrintf("ERR: Ungültige Key ID.\n");
+        return;
+    }
+    _currentKeyId = keyId;
+    if (_hasNextKey && _nextKeyId == keyId) {
+        _hasNextKey = false;
+    }
+    if (_debug) _debugPrintf("DBG: Aktuelle Key ID auf %d gesetzt.\n", _currentKeyId);
+}
+
+// Setzt die Baudrate der seriellen Schnittstelle
+void RS485SecureStack::setBaudRate(long baudRate) {
+    if (_serial) {
+        _serial->end();
+        _serial->begin(baudRate);
+        _serial->setTimeout(SERIAL_TIMEOUT_MS);
+        _configuredBaudRate = baudRate;
+        if (_debug) _debugPrintf("DBG: Baudrate auf %ld gesetzt.\n", baudRate);
+    }
+}
+
+// Sitzungszustand: Datensatz fester Länge (little endian)
+//   [0..3]    Magic, [4] Version, [5] eigene Adresse, [6..9] Baudrate
+//   [10]      aktuelle Key ID, [11] nächste Key ID, [12] Flags, [13] Hochwassermarke der Sequenz
+//   [14..29]  IV, [30..93] aktueller und nächster Session Key (AES-256-CBC mit dem Master Key)
+//   [94..125] HMAC-SHA256 (Master Key) über alles davor
+static const uint32_t RS485_SESSION_MAGIC = 0x53455352UL; // "RSES"
+static const uint8_t RS485_SESSION_VERSION = 2; // 2: [13] ist die Hochwassermarke
+static const uint8_t RS485_SESSION_FLAG_NEXT_KEY = 0x01;
+static const size_t RS485_SESSION_IV_OFFSET = 14;
+static const size_t RS485_SESSION_KEYS_OFFSET = RS485_SESSION_IV_OFFSET + RS485_IV_LENGTH;
+static const size_t RS485_SESSION_HMAC_OFFSET = RS485_SESSION_KEYS_OFFSET + 2 * RS485KeyStore::KEY_LENGTH;
+static const size_t RS485_SESSION_RECORD_LENGTH = RS485_SESSION_HMAC_OFFSET + RS485_HMAC_LENGTH;
+
+bool RS485SecureStack::saveSession() {
+    if (_sessionStore == nullptr) {
+        return false;
+    }
+    SessionState_t state = _currentSessionState();
+    uint8_t record[RS485_SESSION_RECORD_LENGTH];
+    record[0] = RS485_SESSION_MAGIC & 0xFF;
+    record[1] = (RS485_SESSION_MAGIC >> 8) & 0xFF;
+    record[2] = (RS485_SESSION_MAGIC >> 16) & 0xFF;
+    record[3] = (RS485_SESSION_MAGIC >> 24) & 0xFF;
+    record[4] = RS485_SESSION_VERSION;
+    record[5] = _myAddress;
+    for (int i = 0; i < 4; ++i) record[6 + i] = ((uint32_t)state.baudRate >> (8 * i)) & 0xFF;
+    record[10] = state.currentKeyId;
+    record[11] = state.nextKeyId;
+    record[12] = state.hasNextKey ? RS485_SESSION_FLAG_NEXT_KEY : 0;
+    record[13] = (uint8_t)(_txSequence + RS485_SESSION_SEQUENCE_RESERVE); // Hochwassermarke
+
+    uint8_t kek[RS485KeyStore::KEY_LENGTH]; // Schlüssel zum Verschlüsseln der Session Keys
+    _keyStore->copyMasterKey(kek);
+    uint8_t* keys = &record[RS485_SESSION_KEYS_OFFSET];
+    _generateIV(&record[RS485_SESSION_IV_OFFSET]);
+    _keyStore->copySessionKey(state.currentKeyId, keys);
+    if (state.hasNextKey) {
+        _keyStore->copySessionKey(state.nextKeyId, keys + RS485KeyStore::KEY_LENGTH);
+    } else {
+        memset(keys + RS485KeyStore::KEY_LENGTH, 0, RS485KeyStore::KEY_LENGTH);
+    }
+    _encryptAES(keys, 2 * RS485KeyStore::KEY_LENGTH, kek, &record[RS485_SESSION_IV_OFFSET]);
+    _calculateHMAC(kek, record, RS485_SESSION_HMAC_OFFSET, &record[RS485_SESSION_HMAC_OFFSET]);
+    memset(kek, 0, sizeof(kek));
+
+    if (!_sessionStore->save(record, sizeof(record))) {
+        if (_debug) _debugPrintf("ERR: Sitzungszustand konnte nicht gespeichert werden.\n");
+        _sessionChangeMillis = millis(); // Erneuter Versuch nach RS485_SESSION_SAVE_DELAY_MS
+        return false;
+    }
+    _sessionSaved = state;
+    _sessionChangePending = false;
+    if (_debug) _debugPrintf("DBG: Sitzungszustand gespeichert (%ld Baud, Key ID %d).\n", state.baudRate, state.currentKeyId);
+    return true;
+}
+
+bool RS485SecureStack::restoreSession() {
+    if (_sessionStore == nullptr) {
+        return false;
+    }
+    uint8_t record[RS485_SESSION_RECORD_LENGTH];
+    if (!_sessionStore->load(record, sizeof(record))) {
+        return false;
+    }
+    uint32_t magic = record[0] | (record[1] << 8) | (record[2] << 16) | ((uint32_t)record[3] << 24);
+    if (magic != RS485_SESSION_MAGIC || record[4] != RS485_SESSION_VERSION || record[5] != _myAddress) {
+        if (_debug) _debugPrintf("DBG: Gespeicherter Sitzungszustand passt nicht (Version/Adresse).\n");
+        return false;
+    }
+
+    // Ein anderer Master Key (oder beschädigte Daten) fällt am HMAC auf
+    uint8_t kek[RS485KeyStore::KEY_LENGTH];
+    _keyStore->copyMasterKey(kek);
+    uint8_t calculatedHmac[RS485_HMAC_LENGTH];
+    _calculateHMAC(kek, record, RS485_SESSION_HMAC_OFFSET, calculatedHmac);
+    uint8_t difference = 0;
+    for (size_t i = 0; i < RS485_HMAC_LENGTH; ++i) {
+        difference |= record[RS485_SESSION_HMAC_OFFSET + i] ^ calculatedHmac[i];
+    }
+    if (difference != 0) {
+        memset(kek, 0, sizeof(kek));
+        if (_debug) _debugPrintf("ERR: Gespeicherter Sitzungszustand ungültig (HMAC).\n");
+        return false;
+    }
+
+    SessionState_t state;
+    state.baudRate = (long)(record[6] | (record[7] << 8) | (record[8] << 16) | ((uint32_t)record[9] << 24));
+    state.currentKeyId = record[10];
+    state.nextKeyId = record[11];
+    state.hasNextKey = (record[12] & RS485_SESSION_FLAG_NEXT_KEY) != 0;
+
+    // Session Keys nur in den eigenen Speicher; ein gemeinsamer Speicher wird von der Anwendung befüllt.
+    // Key 0 ist immer der Master Key und wird nicht überschrieben.
+    uint8_t* keys = &record[RS485_SESSION_KEYS_OFFSET];
+    _decryptAES(keys, 2 * RS485KeyStore::KEY_LENGTH, kek, &record[RS485_SESSION_IV_OFFSET]);
+    memset(kek, 0, sizeof(kek));
+    if (_keyStore == _ownKeyStore) {
+        if (state.currentKeyId != 0) {
+            _ownKeyStore->setSessionKey(state.currentKeyId, keys, RS485KeyStore::KEY_LENGTH);
+        }
+        if (state.hasNextKey && state.nextKeyId != 0) {
+            _ownKeyStore->setSessionKey(state.nextKeyId, keys + RS485KeyStore::KEY_LENGTH, RS485KeyStore::KEY_LENGTH);
+        }
+    }
+    memset(keys, 0, 2 * RS485KeyStore::KEY_LENGTH);
+
+    _currentKeyId = state.currentKeyId;
+    _hasNextKey = state.hasNextKey;
+    _nextKeyId = state.nextKeyId;
+    if (state.baudRate > 0 && state.baudRate != _configuredBaudRate) {
+        setBaudRate(state.baudRate);
+    }
+    // An der gesicherten Marke weitermachen: Die Nummern kurz vor dem Sichern kommen so nicht
+    // gleich wieder vor. Die 8-Bit-Sequenz läuft um, und ein Empfänger verwirft ohnehin nur eine
+    // Wiederholung (RS485_FLAG_RETRANSMISSION) der zuletzt gesehenen Nummer als Duplikat.
+    _txSequence = record[13];
+    _sessionSaved = state;
+    _sessionChangePending = false;
+    _sessionRestorePending = true;
+    _sessionRestoreMillis = millis();
+    if (_debug) _debugPrintf("DBG: Sitzungszustand übernommen (%ld Baud, Key ID %d).\n", state.baudRate, state.currentKeyId);
+
+    // Sofort die nächste Reserve sichern, damit auch ein erneuter Neustart hinter der Marke beginnt
+    saveSession();
+    return true;
+}
+
+void RS485SecureStack::clearSession() {
+    if (_sessionStore != nullptr) {
+        _sessionStore->clear();
+    }
+    _sessionChangePending = false;
+    _sessionRestorePending = false;
+}
+
+// Private Hilfsfunktionen
+
+void RS485SecureStack::_resetReceiveBuffer() {
+    _receiveBufferPos = 0;
+    _receiveEscapePending = false;
+    _receiveCrc = 0; // Der Pufferinhalt selbst wird nur bis _receiveBufferPos gelesen
+}
+
+// Prüft, ob ein Byte ein Startbyte ist (DE oder AD)
+bool RS485SecureStack::_isStartByte(uint8_t byte) {
+    return (byte == RS485_START_BYTE_0 || byte == RS485_START_BYTE_1);
+}
+
+// Extrahiert und verarbeitet ein Paket aus dem Empfangspuffer
+// Verarbeitet einen vollständig empfangenen (ent-stufften) Frame im Empfangspuffer.
+// Ohne Pipeline laufen alle Stufen direkt nacheinander, mit Pipeline wird der Frame nach der
+// CRC-Prüfung an die Crypto-Task übergeben (siehe enablePipelinedReceive()).
+bool RS485SecureStack::_extractPacket() {
+    unsigned long rxMicros = micros();
+    bool frameValid = _checkFrame(_receiveBuffer, _receiveBufferPos, _receiveCrc);
+    if (_frameTap) {
+        _frameTap(_frameTapContext, _receiveBuffer, _receiveBufferPos, rxMicros, frameValid ? RS485_TAP_FRAME_VALID : RS485_TAP_FRAME_INVALID);
+    }
+    if (!frameValid) {
+        _noteFrameConsumed(); // Zählt für loop()/poll() mit, sonst liefe eine Störung unbegrenzt
+        return false;
+    }
+    if (_receiveBuffer[TOTAL_LENGTH_INDEX] == RS485_COMPACT_ACK_LENGTH) {
+        // Kompakte ACKs brauchen keine Entschlüsselung und umgehen auch die Pipeline
+        _handleCompactAck(_receiveBuffer, rxMicros);
+        _noteFrameConsumed();
+        return true;
+    }
+    if (_rxPipeline != nullptr) {
+        return _submitToRxPipeline(_receiveBuffer, rxMicros, _rxFrameStartMicros);
+    }
+
+    char payload[RS485_MAX_PAYLOAD_LENGTH + 1];
+    bool hmacVerified = _authenticateFrame(_receiveBuffer, payload);
+    _dispatchFrame(_receiveBuffer, payload, hmacVerified, rxMicros, _rxFrameStartMicros);
+    _noteFrameProcessed(rxMicros);
+    return true; // Paket wurde (versucht zu) verarbeitet, Puffer kann zurückgesetzt werden
+}
+
+// Stufe 1: Header, Länge und CRC16 (beim Empfang mitgeführt, siehe _storeReceivedByte())
+bool RS485SecureStack::_checkFrame(const uint8_t* frame, size_t packetLength, uint16_t calculatedCrc) {
+    // Header-Prüfung
+    if (frame[START_BYTE_0_INDEX] != RS485_START_BYTE_0 ||
+        frame[START_BYTE_1_INDEX] != RS485_START_BYTE_1 ||
+        frame[PROTOCOL_VERSION_INDEX] != RS485_PROTOCOL_VERSION) {
+        if (_debug) _debugPrintf("ERR: Ungültiger Header im Paket.\n");
+        return false;
+    }
+
+    uint8_t totalLength = frame[TOTAL_LENGTH_INDEX];
+    if (totalLength != packetLength) {
+        if (_debug) _debugPrintf("ERR: Deklarierte Länge (%d) stimmt nicht mit empfangener Länge (%d) überein.\n", totalLength, packetLength);
+        return false;
+    }
+
+    // CRC16 prüfen (CRC befindet sich am Ende des Pakets)
+    uint16_t receivedCrc = (frame[totalLength - 2] | (frame[totalLength - 1] << 8));
+
+    if (receivedCrc != calculatedCrc) {
+        if (_debug) _debugPrintf("ERR: CRC16 Fehler. Empfangen: 0x%04X, Berechnet: 0x%04X\n", receivedCrc, calculatedCrc);
+        _linkStats.crcErrors++;
+        return false; // CRC-Fehler, Paket verwerfen
+    }
+
+    if (totalLength == RS485_COMPACT_ACK_LENGTH) {
+        if (frame[MESSAGE_TYPE_INDEX] != MSG_TYPE_ACK_NACK) {
+            if (_debug) _debugPrintf("ERR: Kurzer Frame ist kein ACK/NACK.\n");
+            _linkStats.framingErrors++;
+            return false;
+        }
+        return true;
+    }
+
+    // Header-Erweiterungen müssen in den Frame passen, der verschlüsselte Payload besteht immer aus ganzen AES-Blöcken
+    int extensionLength = _headerExtensionLength(frame);
+    if (extensionLength < 0) {
+        if (_debug) _debugPrintf("ERR: Ungültige Header-Erweiterung.\n");
+        _linkStats.framingErrors++;
+        return false;
+    }
+    if ((totalLength - RS485_MIN_PACKET_LENGTH - extensionLength) % RS485_IV_LENGTH != 0) {
+        if (_debug) _debugPrintf("ERR: Payload-Länge ist kein Vielfaches der AES-Blockgröße.\n");
+        _linkStats.framingErrors++;
+        return false;
+    }
+    return true;
+}
+
+// Stufe 2: HMAC prüfen und Payload entschlüsseln. payloadOut (RS485_MAX_PAYLOAD_LENGTH + 1 Bytes)
+// ist danach nullterminiert, bei HMAC-Fehler leer. Liest nur den Frame und den Schlüsselspeicher
+// und kann daher auch in der Crypto-Task laufen.
+bool RS485SecureStack::_authenticateFrame(const uint8_t* frame, char* payloadOut) {
+    uint8_t totalLength = frame[TOTAL_LENGTH_INDEX];
+    uint8_t keyId = frame[KEY_ID_INDEX];
+    size_t hmacOffset = totalLength - RS485_HMAC_LENGTH - RS485_CRC_LENGTH;
+
+    uint8_t sessionKey[RS485KeyStore::KEY_LENGTH];
+    _keyStore->copySessionKey(keyId, sessionKey);
+
+    uint8_t calculatedHmac[RS485_HMAC_LENGTH];
+    // HMAC über alles bis zum Beginn des HMAC-Feldes
+    _calculateHMAC(sessionKey, frame, hmacOffset, calculatedHmac);
+
+    bool hmacVerified = true;
+    for (size_t i = 0; i < RS485_HMAC_LENGTH; ++i) {
+        if (frame[hmacOffset + i] != calculatedHmac[i]) {
+            hmacVerified = false;
+            break;
+        }
+    }
+
+    size_t ivOffset = RS485_HEADER_LENGTH + _headerExtensionLength(frame); // In Stufe 1 geprüft
+    size_t encryptedPayloadStart = ivOffset + RS485_IV_LENGTH;
+    size_t encryptedPayloadLen = hmacOffset - encryptedPayloadStart;
+
+    // Payload entschlüsseln (nur wenn HMAC_OK ist, sonst wäre Entschlüsselung nutzlos und potenziell gefährlich).
+    // Ein komprimierter Payload bleibt hier gepackt, _dispatchFrame() entpackt ihn.
+    if (hmacVerified) {
+        memcpy(payloadOut, &frame[encryptedPayloadStart], encryptedPayloadLen);
+        _decryptAES((uint8_t*)payloadOut, encryptedPayloadLen, sessionKey, &frame[ivOffset]);
+        payloadOut[encryptedPayloadLen] = '\0'; // Falls der Payload einen AES-Block exakt füllt
+    } else {
+        // Wenn HMAC nicht verifiziert, Payload leer lassen, um keine sensiblen Daten preiszugeben.
+        // Für den Callback geben wir hmacVerified = false mit, er entscheidet über das Paket.
+        payloadOut[0] = '\0';
+    }
+    return hmacVerified;
+}
+
+// Stufe 3: Zustellung (Entpacken, ACK-Wartezustand, Gruppen, Probe, Duplikate, Callback, eigenes ACK).
+// Läuft immer im Kontext von loop() bzw. _waitForAck().
+void RS485SecureStack::_dispatchFrame(const uint8_t* frame, const char* payload, bool hmacVerified, unsigned long rxMicros, unsigned long rxStartMicros) {
+    uint8_t totalLength = frame[TOTAL_LENGTH_INDEX];
+    bool crcVerified = true; // Frames mit CRC-Fehler erreichen diese Stufe nicht
+
+    if (hmacVerified) {
+        _linkStats.framesReceived++;
+        // Erst ein vollständig authentifizierter Frame bestätigt Baudrate und Schlüssel nach
+        // restoreSession(); kompakte ACKs (gekürzter MAC) zählen dafür nicht
+        _sessionRestorePending = false;
+    } else {
+        _linkStats.hmacErrors++;
+        if (_debug) _debugPrintf("ERR: HMAC-Fehler. Paket nicht authentifiziert.\n");
+    }
+
+    // Komprimierter Payload (entschlüsselt, noch gepackt). Nicht entpackbar = leerer Payload,
+    // der Frame wird dann weiter unten verworfen (komprimiert wird nie ein leerer Payload).
+    char unpackedPayload[RS485_MAX_PAYLOAD_LENGTH + 1];
+    if (hmacVerified && (frame[FLAGS_INDEX] & RS485_FLAG_COMPRESSED)) {
+        size_t packedLength = totalLength - RS485_HMAC_LENGTH - RS485_CRC_LENGTH - RS485_HEADER_LENGTH -
+                              _headerExtensionLength(frame) - RS485_IV_LENGTH;
+        if (!_decompressPayload((const uint8_t*)payload, packedLength, unpackedPayload)) {
+            unpackedPayload[0] = '\0';
+        }
+        payload = unpackedPayload;
+    }
+
+    // Packet_t Struktur füllen
+    Packet_t receivedPacket;
+    receivedPacket.totalLength = totalLength;
+    receivedPacket.messageType = (char)frame[MESSAGE_TYPE_INDEX];
+    receivedPacket.destinationAddress = frame[DEST_ADDRESS_INDEX];
+    receivedPacket.senderAddress = frame[SENDER_ADDRESS_INDEX];
+    receivedPacket.keyId = frame[KEY_ID_INDEX];
+    receivedPacket.sequenceNumber = frame[SEQUENCE_INDEX];
+    receivedPacket.payload = String(payload);
+    receivedPacket.rxStartMicros = rxStartMicros;
+    receivedPacket.hasTxTimestamp = false;
+    receivedPacket.txTimestampMicros = 0;
+    if (receivedPacket.messageType == MSG_TYPE_MASTER_HEARTBEAT) {
+        size_t payloadLength = strlen(payload);
+        if (rs485TakeTimestamp(payload, payloadLength, receivedPacket.txTimestampMicros)) {
+            receivedPacket.hasTxTimestamp = true;
+            receivedPacket.payload = String(payload).substring(0, payloadLength);
+        }
+    }
+    receivedPacket.requiresAck = (frame[FLAGS_INDEX] & RS485_FLAG_ACK_REQUESTED) != 0;
+    receivedPacket.isAck = (receivedPacket.messageType == MSG_TYPE_ACK_NACK);
+    receivedPacket.isMulticast = isGroupAddress(receivedPacket.destinationAddress);
+    receivedPacket.hmacVerified = hmacVerified;
+    receivedPacket.crcVerified = crcVerified;
+
+    // Mitgesendeter Heartbeat: gilt für alle Knoten, unabhängig vom Ziel des Frames.
+    // Er wird wie ein eigener Broadcast-Frame mit dem Message Type des Heartbeats zugestellt.
+    uint8_t flags = frame[FLAGS_INDEX];
+    size_t extensionOffset = RS485_HEADER_LENGTH + ((flags & RS485_FLAG_EXT_ACK) ? RS485_EXT_ACK_LENGTH : 0);
+    if (hmacVerified && (flags & RS485_FLAG_EXT_HEARTBEAT) && receivedPacket.senderAddress != _myAddress) {
+        char heartbeatPayload[RS485_EXT_HEARTBEAT_MAX_PAYLOAD + 1];
+        size_t heartbeatLength = frame[extensionOffset + 1];
+        memcpy(heartbeatPayload, &frame[extensionOffset + 2], heartbeatLength);
+        Packet_t heartbeatPacket = receivedPacket;
+        heartbeatPacket.messageType = (char)frame[extensionOffset];
+        heartbeatPacket.hasTxTimestamp = heartbeatPacket.messageType == MSG_TYPE_MASTER_HEARTBEAT &&
+            rs485TakeTimestamp(heartbeatPayload, heartbeatLength, heartbeatPacket.txTimestampMicros);
+        heartbeatPayload[heartbeatLength] = '\0';
+
+        heartbeatPacket.destinationAddress = RS485_BROADCAST_ADDRESS;
+        heartbeatPacket.payload = String(heartbeatPayload);
+        heartbeatPacket.requiresAck = false;
+        heartbeatPacket.isAck = false;
+        heartbeatPacket.isMulticast = false;
+        if (_debug) _debugPrintf("DBG: Heartbeat '%c' von %d mitgesendet.\n", heartbeatPacket.messageType, heartbeatPacket.senderAddress);
+        RxAckContext_t* outerAck = _rxAck;
+        _rxAck = nullptr; // Ein Heartbeat wird nicht bestätigt
+        _deliverPacket(heartbeatPacket);
+        _rxAck = outerAck;
+    }
 
-// NEU: Konstruktor, der den DirectionControl-Zeiger speichert
-RS485SecureStack::RS485SecureStack(RS485DirectionControl* directionControl) 
-    : _directionControl(directionControl), _serial(nullptr), _myAddress(0), _currentKeyId(0) {
-    // Initialisiere Master Key und Session Keys mit Nullen
-    memset(_masterKey, 0, sizeof(_masterKey));
-    for (int i = 0; i < 256; ++i) {
-        memset(_sessionKeys[i], 0, sizeof(_sessionKeys[i]));
+    // Nur Pakete, die für uns sind, Broadcasts oder an eine eigene Gruppe verarbeiten
+    // Und wir dürfen keine ACK/NACKs von uns selbst verarbeiten
+    bool forMe = receivedPacket.destinationAddress == _myAddress ||
+                 receivedPacket.destinationAddress == RS485_BROADCAST_ADDRESS ||
+                 (receivedPacket.isMulticast && isGroupMember(receivedPacket.destinationAddress));
+    if (!forMe || (receivedPacket.isAck && receivedPacket.senderAddress == _myAddress)) {
+        if (_debug) {
+            _debugPrintf("DBG: Paket für andere Adresse (%d), Sender=%d, oder ist eigenes ACK. Verworfen.\n", 
+                          receivedPacket.destinationAddress, receivedPacket.senderAddress);
+        }
+        return;
     }
-}
 
-// Initialisiert den Stack
-void RS485SecureStack::begin(uint8_t myAddress, const char* masterKey, uint8_t initialKeyId, HardwareSerial& serial) {
-    _myAddress = myAddress;
-    _serial = &serial;
-    _serial->begin(RS485_INITIAL_BAUD_RATE); // Startet mit einer bekannten Baudrate
-    _serial->setTimeout(SERIAL_TIMEOUT_MS);
+    if (_debug) {
+        _debugPrintf("RCV: Type='%c', Dest=%d, Sender=%d, KeyID=%d, Len=%d, Payload='%s'\n",
+                      receivedPacket.messageType, receivedPacket.destinationAddress,
+                      receivedPacket.senderAddress, receivedPacket.keyId,
+                      receivedPacket.payload.length(), receivedPacket.payload.c_str());
+        _debugPrintf("HMAC_OK: %s, CRC_OK: %s\n", receivedPacket.hmacVerified ? "YES" : "NO", receivedPacket.crcVerified ? "YES" : "NO");
+    }
 
-    // Initialisiere den Master Key (SHA256 Hash des übergebenen Schlüssels)
-    SHA256 sha256;
-    sha256.reset();
-    sha256.update(masterKey, strlen(masterKey));
-    sha256.finalize(_masterKey, sizeof(_masterKey));
+    // Mitgesendetes ACK/NACK für den Frame, auf dessen Bestätigung wir warten. Der Frame selbst
+    // wird danach normal zugestellt.
+    if (hmacVerified && (flags & RS485_FLAG_EXT_ACK) && receivedPacket.destinationAddress == _myAddress &&
+        _ackWait.active && !_ackWait.done) {
+        const uint8_t* ackExtension = &frame[RS485_HEADER_LENGTH];
+        bool senderMatches = isGroupAddress(_ackWait.peerAddress) || receivedPacket.senderAddress == _ackWait.peerAddress;
+        if (senderMatches && ackExtension[0] == _ackWait.sequence &&
+            memcmp(&ackExtension[2], _ackWait.frameHmac, RS485_EXT_ACK_HMAC_REF_LENGTH) == 0) {
+            _acceptAck(receivedPacket.senderAddress, ackExtension[1], rxMicros, totalLength);
+        }
+    }
 
-    // Initialisiere Session Key 0 mit dem Master Key
-    setSessionKey(0, _masterKey, sizeof(_masterKey));
-    _currentKeyId = initialKeyId; // Setzt die initial zu verwendende Key ID
+    // Komprimierter Payload, der sich nicht entpacken ließ (z.B. unbekanntes Wörterbuch): nicht
+    // zustellen, ein angefordertes ACK wird zum NACK
+    bool compressed = hmacVerified && (flags & RS485_FLAG_COMPRESSED);
+    if (compressed && payload[0] == '\0') {
+        _compressionStats.decodeErrors++;
+        if (_debug) _debugPrintf("ERR: Komprimierter Payload von %d nicht entpackbar, verworfen.\n", receivedPacket.senderAddress);
+        if (receivedPacket.requiresAck && receivedPacket.destinationAddress == _myAddress) {
+            _sendAck(receivedPacket.senderAddress, receivedPacket.keyId, receivedPacket.sequenceNumber,
+                     &frame[totalLength - RS485_CRC_LENGTH - RS485_HMAC_LENGTH], RS485_NACK_UNSUPPORTED,
+                     rxMicros + _piggybackAckDelayMicros);
+        }
+        return;
+    }
+    if (compressed) {
+        _compressionStats.framesDecompressed++;
+    }
 
-    // Wenn ein DirectionControl-Objekt übergeben wurde, initialisiere es
-    if (_directionControl != nullptr) {
-        _directionControl->begin();
+    // Gruppen-Join/-Leave: Mitgliedertabelle pflegen, wird vom Stack gehandhabt
+    if (receivedPacket.messageType == MSG_TYPE_GROUP_MGMT) {
+        if (hmacVerified) {
+            _handleGroupMessage(receivedPacket.senderAddress, receivedPacket.payload);
+        }
+        return;
     }
 
-    _resetReceiveBuffer();
-}
+    // Baudraten-Probe: Ankündigung, Testframes und Rückmeldungen werden vom Stack gehandhabt
+    if (hmacVerified && (receivedPacket.messageType == MSG_TYPE_LINK_TEST ||
+        (receivedPacket.messageType == MSG_TYPE_BAUD_RATE_SET && receivedPacket.payload.startsWith("PROBE:")))) {
+        _handleProbeMessage(receivedPacket);
+        return;
+    }
 
-// Hauptloop-Funktion zum Empfangen von Paketen
-void RS485SecureStack::loop() {
-    while (_serial->available()) {
-        uint8_t incomingByte = _serial->read();
-
-        if (_receiveBufferPos == 0) { // Suchen nach Startbytes
-            if (incomingByte == RS485_START_BYTE_0) {
-                _receiveBuffer[_receiveBufferPos++] = incomingByte;
-            } else {
-                // Falsches Startbyte, verwerfen
-                if (_debug) Serial.printf("DBG: Falsches Startbyte 0x%02X\n", incomingByte);
+    // Duplikaterkennung: Eine Wiederholung mit bereits gesehener Sequenznummer wurde schon
+    // verarbeitet (nur das ACK ging verloren) - nicht erneut zustellen, aber erneut bestätigen.
+    bool duplicate = false;
+    PeerEntry_t* peer = nullptr;
+    if (hmacVerified && receivedPacket.senderAddress != _myAddress) {
+        peer = _findPeer(receivedPacket.senderAddress, true);
+        if (peer) {
+            duplicate = (frame[FLAGS_INDEX] & RS485_FLAG_RETRANSMISSION) && peer->hasRxSequence &&
+                        peer->lastRxSequence == receivedPacket.sequenceNumber;
+            peer->hasRxSequence = true;
+            peer->lastRxSequence = receivedPacket.sequenceNumber;
+            if (duplicate) {
+                peer->stats.duplicatesDropped++;
+                if (_debug) _debugPrintf("DBG: Duplikat von %d (Seq %d) verworfen.\n", receivedPacket.senderAddress, receivedPacket.sequenceNumber);
             }
-        } else if (_receiveBufferPos == 1) {
-            if (incomingByte == RS485_START_BYTE_1) {
-                _receiveBuffer[_receiveBufferPos++] = incomingByte;
-            } else {
-                // Falsches zweites Startbyte, Puffer zurücksetzen
-                if (_debug) Serial.printf("DBG: Falsches zweites Startbyte 0x%02X\n", incomingByte);
-                _resetReceiveBuffer();
-            }
-        } else {
-            // Normale Daten oder Escape-Sequenz
-            if (incomingByte == RS485_START_BYTE_0 || incomingByte == RS485_START_BYTE_1) {
-                // Unerwartetes Startbyte, Puffer zurücksetzen und neu beginnen
-                if (_debug) Serial.println("DBG: Unerwartetes Startbyte im Paket, Puffer reset.");
-                _resetReceiveBuffer();
-                if (incomingByte == RS485_START_BYTE_0) { // Neuen Start erfassen
-                     _receiveBuffer[_receiveBufferPos++] = incomingByte;
-                }
-                continue; // Nächstes Byte lesen
-            }
-            
-            _receiveBuffer[_receiveBufferPos++] = incomingByte;
-
-            // Paketlänge überprüfen (Mindestlänge Header + IV + HMAC + CRC)
-            if (_receiveBufferPos >= TOTAL_LENGTH_INDEX + 1) { // totalLength Byte wurde empfangen
-                uint8_t totalLength = _receiveBuffer[TOTAL_LENGTH_INDEX];
-                
-                // Überprüfen, ob die deklarierte Länge im akzeptablen Bereich liegt
-                // Header (8) + IV (16) + HMAC (32) + CRC (2) = 58 Bytes Mindestlänge für leeres Payload
-                // Maximale Länge = MAX_PACKET_SIZE
-                if (totalLength < (8 + RS485_IV_LENGTH + RS485_HMAC_LENGTH + 2) || totalLength > MAX_PACKET_SIZE) {
-                    if (_debug) Serial.printf("DBG: Ungültige Paketlänge: %d (Pos: %d). Resetting buffer.\n", totalLength, _receiveBufferPos);
-                    _resetReceiveBuffer();
-                    continue; // Beginne neu mit der Suche nach Startbytes
-                }
+        }
+    }
 
-                // Wenn genug Bytes für das gesamte Paket empfangen wurden (inkl. Stuffing!)
-                // Achtung: totalLength ist die LÄNGE des UNgestufften Pakets.
-                // Das gestuffte Paket kann bis zu doppelt so lang sein.
-                // Wir müssen hier auf die LÄNGE des GESTUFFTEN Pakets warten.
-                // Ein einfaches Prüfen auf totalLength reicht hier nicht!
-                // Wir nehmen an, dass der Byte-Stuffing-Prozess das Paket maximal verdoppelt.
-                // Daher ist MAX_PACKET_SIZE * 2 unser maximaler Puffer.
-                // Wir können das Paket nur komplett verarbeiten, wenn _receiveBufferPos >= totalLength ist.
-                // Das Unstuffing passiert danach.
-                if (_receiveBufferPos >= totalLength + 2) { // +2 für Startbytes
-                    // Versuche das Paket zu extrahieren und zu verarbeiten
-                    if (_extractPacket()) {
-                        // Paket wurde erfolgreich verarbeitet, Puffer zurücksetzen
-                        _resetReceiveBuffer();
-                    } else {
-                        // Paketfehler (CRC/HMAC), Puffer zurücksetzen
-                        _resetReceiveBuffer();
-                    }
-                }
-            }
-            // Maximalen Pufferüberlauf verhindern
-            if (_receiveBufferPos >= (MAX_PACKET_SIZE * 2) -1) {
-                if (_debug) Serial.println("DBG: Receive buffer overflow. Resetting.");
-                _resetReceiveBuffer();
+    // Eigenes ACK: Der Callback kann über setAckStatus() ein NACK anfordern (ein Duplikat erhält
+    // denselben Status wie das Original), eine Antwort aus dem Callback nimmt das ACK mit.
+    // Broadcasts und ACK/NACK-Nachrichten werden nicht bestätigt.
+    RxAckContext_t ack;
+    ack.pending = !receivedPacket.isAck && receivedPacket.requiresAck && hmacVerified && crcVerified &&
+                  receivedPacket.destinationAddress != RS485_BROADCAST_ADDRESS;
+    ack.peerAddress = receivedPacket.senderAddress;
+    ack.keyId = receivedPacket.keyId;
+    ack.sequence = receivedPacket.sequenceNumber;
+    ack.status = (duplicate && peer) ? (uint8_t)peer->lastRxAckStatus : (uint8_t)RS485_ACK_OK;
+    memcpy(ack.frameHmac, &frame[totalLength - RS485_CRC_LENGTH - RS485_HMAC_LENGTH], RS485_HMAC_LENGTH);
+
+    RxAckContext_t* outerAck = _rxAck;
+    _rxAck = &ack;
+    if (!duplicate) {
+        _deliverPacket(receivedPacket);
+        if (peer) peer->lastRxAckStatus = ack.status;
+    }
+    _rxAck = outerAck;
+
+    // Nicht mitgenommenes ACK einreihen
+    if (ack.pending) {
+        unsigned long dueMicros = rxMicros; // Zeitschlitze zählen ab Empfangsende des Frames
+        if (receivedPacket.isMulticast) {
+            // Zeitschlitz = Rang der eigenen Adresse unter den bekannten Gruppenmitgliedern,
+            // damit die ACKs der Mitglieder nicht kollidieren
+            const uint8_t* members = _knownGroupMembers[receivedPacket.destinationAddress - RS485_GROUP_ADDRESS_FIRST];
+            unsigned long slot = 0;
+            for (int address = 0; address < _myAddress; ++address) {
+                if (address != receivedPacket.senderAddress && rs485BitmapTest(members, address)) slot++;
             }
+            dueMicros += slot * _multicastAckSlotMicros();
+        } else {
+            dueMicros += _piggybackAckDelayMicros; // Zeit für einen Frame an den Absender, der das ACK mitnimmt
         }
+        _sendAck(ack.peerAddress, ack.keyId, ack.sequence, ack.frameHmac, ack.status, dueMicros);
     }
 }
 
-// Registriert eine Callback-Funktion
-void RS485SecureStack::registerReceiveCallback(PacketReceivedCallback callback) {
-    _packetReceivedCallback = callback;
+void RS485SecureStack::_deliverPacket(const Packet_t& packet) {
+    if (_packetReceivedCallback) {
+        _packetReceivedCallback(packet);
+    }
+    if (_packetReceivedContextCallback) {
+        _packetReceivedContextCallback(_callbackContext, packet);
+    }
 }
 
-// Sendet eine Nachricht
-bool RS458SecureStack::sendMessage(uint8_t destinationAddress, uint8_t senderAddress, char messageType, const String& payload, bool requiresAck) {
-    // Überprüfen, ob Payload zu lang ist
-    if (payload.length() > MAX_PACKET_SIZE - (8 + RS485_IV_LENGTH + RS485_HMAC_LENGTH + 2)) {
-        if (_debug) Serial.println("ERR: Payload zu lang.");
-        return false;
+bool RS485SecureStack::enableCompression(bool enable) {
+    if (enable && _compressionState == nullptr) {
+        _compressionState = new (std::nothrow) RS485CompressionState_t();
+        if (_compressionState == nullptr) {
+            if (_debug) _debugPrintf("ERR: Kein Speicher für die Kompression.\n");
+            return false;
+        }
     }
+    _compressionEnabled = enable;
+    return true;
+}
 
-    // Puffer für verschlüsselten Payload (Payload + Padding)
-    // AES verschlüsselt in 16-Byte-Blöcken
-    size_t paddedPayloadLen = payload.length();
-    if (paddedPayloadLen % RS485_IV_LENGTH != 0) {
-        paddedPayloadLen = ((paddedPayloadLen / RS485_IV_LENGTH) + 1) * RS485_IV_LENGTH;
+bool RS485SecureStack::addCompressionDictionary(uint8_t id, const uint8_t* data, size_t length) {
+    if (id == 0 || data == nullptr || length == 0 || length > RS485_COMPRESSION_MAX_DICTIONARY_LENGTH) {
+        return false;
     }
-    uint8_t encryptedPayloadBuffer[paddedPayloadLen];
-    memset(encryptedPayloadBuffer, 0, paddedPayloadLen);
-    memcpy(encryptedPayloadBuffer, payload.c_str(), payload.length());
-
-    // IV generieren
-    uint8_t iv[RS485_IV_LENGTH];
-    _generateIV(iv);
-
-    // Payload verschlüsseln
-    _encryptAES(encryptedPayloadBuffer, paddedPayloadLen, _sessionKeys[_currentKeyId], iv);
-
-    // Gesamtpaket zusammenbauen (unverschlüsselte Teile + IV + verschlüsselter Payload + HMAC + CRC)
-    // Header (8 Bytes) + IV (16 Bytes) + Encrypted Payload (padded) + HMAC (32 Bytes) + CRC (2 Bytes)
-    size_t packetBodyLength = RS485_IV_LENGTH + paddedPayloadLen + RS485_HMAC_LENGTH + 2;
-    uint8_t rawPacket[8 + packetBodyLength]; // Header + Body
-
-    // Header füllen
-    rawPacket[START_BYTE_0_INDEX] = RS485_START_BYTE_0;
-    rawPacket[START_BYTE_1_INDEX] = RS485_START_BYTE_1;
-    rawPacket[PROTOCOL_VERSION_INDEX] = RS485_PROTOCOL_VERSION;
-    // Gesamtlänge (ab Startbyte 0xDE)
-    rawPacket[TOTAL_LENGTH_INDEX] = (uint8_t)(8 + packetBodyLength); // Gesamtlänge des *un-stuffed* Pakets
-    rawPacket[MESSAGE_TYPE_INDEX] = messageType;
-    rawPacket[DEST_ADDRESS_INDEX] = destinationAddress;
-    rawPacket[SENDER_ADDRESS_INDEX] = senderAddress;
-    rawPacket[KEY_ID_INDEX] = _currentKeyId;
-
-    // IV hinzufügen
-    memcpy(&rawPacket[8], iv, RS485_IV_LENGTH);
-
-    // Verschlüsselten Payload hinzufügen
-    memcpy(&rawPacket[8 + RS485_IV_LENGTH], encryptedPayloadBuffer, paddedPayloadLen);
-
-    // HMAC berechnen und hinzufügen
-    uint8_t hmacResult[RS485_HMAC_LENGTH];
-    // HMAC über Header, IV und verschlüsseltem Payload
-    _calculateHMAC(_sessionKeys[_currentKeyId], rawPacket, 8 + RS485_IV_LENGTH + paddedPayloadLen, hmacResult);
-    memcpy(&rawPacket[8 + RS485_IV_LENGTH + paddedPayloadLen], hmacResult, RS485_HMAC_LENGTH);
-
-    // CRC16 berechnen und hinzufügen (über alles von Startbyte 0 bis HMAC-Ende)
-    uint16_t crc = _calculateCRC16(rawPacket, 8 + RS485_IV_LENGTH + paddedPayloadLen + RS485_HMAC_LENGTH);
-    rawPacket[8 + RS485_IV_LENGTH + paddedPayloadLen + RS485_HMAC_LENGTH] = (uint8_t)(crc & 0xFF);
-    rawPacket[8 + RS485_IV_LENGTH + paddedPayloadLen + RS485_HMAC_LENGTH + 1] = (uint8_t)((crc >> 8) & 0xFF);
-
-    // Byte-Stuffing anwenden
-    size_t stuffedLength = _byteStuff(rawPacket, 8 + packetBodyLength, _stuffedPacketBuffer);
-
-    // NEU: Setze den Transceiver in den Sende-Modus
-    if (_directionControl != nullptr) {
-        _directionControl->setTransmitMode();
-        delayMicroseconds(RS485_TX_ENABLE_DELAY_US); 
+    CompressionDictionary_t* freeEntry = nullptr;
+    for (size_t i = 0; i < RS485_COMPRESSION_MAX_DICTIONARIES; ++i) {
+        CompressionDictionary_t& entry = _compressionDictionaries[i];
+        if (entry.id == id) {
+            freeEntry = &entry; // Gleiche ID ersetzen
+            break;
+        }
+        if (entry.id == 0 && freeEntry == nullptr) {
+            freeEntry = &entry;
+        }
+    }
+    if (freeEntry == nullptr) {
+        return false;
     }
+    freeEntry->data = data;
+    freeEntry->length = length;
+    freeEntry->id = id;
+    return true;
+}
 
-    // Sende das gestuffte Paket
-    _serial->write(_stuffedPacketBuffer, stuffedLength);
-    _serial->flush(); // Warte, bis alle Bytes gesendet wurden
+// Komprimiert ohne und mit jedem Wörterbuch und schreibt das kürzeste Ergebnis samt Kopf
+// (Wörterbuch-ID, Originallänge) nach output. Gibt 0 zurück, wenn kein AES-Block gespart wird.
+// countStats: nur beim ersten Senden einer Nachricht, damit die Statistik je Nachricht zählt.
+size_t RS485SecureStack::_compressPayload(const uint8_t* payload, size_t length, uint8_t* output, bool countStats) {
+    size_t rawBlocks = (length + RS485_IV_LENGTH - 1) / RS485_IV_LENGTH;
+    size_t capacity = (rawBlocks - 1) * RS485_IV_LENGTH - RS485_COMPRESSION_HEADER_LENGTH;
+    uint8_t candidate[RS485_MAX_PAYLOAD_LENGTH];
+    size_t bestLength = 0;
+    for (int i = -1; i < RS485_COMPRESSION_MAX_DICTIONARIES; ++i) {
+        const CompressionDictionary_t* dictionary = i < 0 ? nullptr : &_compressionDictionaries[i];
+        if (dictionary != nullptr && dictionary->id == 0) {
+            continue;
+        }
+        // Nur ein kürzeres Ergebnis als das bisher beste ist interessant
+        size_t limit = bestLength > 0 ? bestLength - 1 : capacity;
+        size_t compressedLength = rs485Compress(*_compressionState, payload, length,
+                                                dictionary ? dictionary->data : nullptr,
+                                                dictionary ? dictionary->length : 0, candidate, limit);
+        if (compressedLength > 0) {
+            bestLength = compressedLength;
+            output[0] = dictionary ? dictionary->id : 0;
+            output[1] = (uint8_t)length;
+            memcpy(&output[RS485_COMPRESSION_HEADER_LENGTH], candidate, compressedLength);
+        }
+    }
 
-    // NEU: Setze den Transceiver sofort nach dem Senden zurück in den Empfangs-Modus
-    if (_directionControl != nullptr) {
-        delayMicroseconds(RS485_TX_DISABLE_DELAY_US); 
-        _directionControl->setReceiveMode();
+    if (bestLength == 0) {
+        if (countStats) {
+            _compressionStats.bytesIn += length;
+            _compressionStats.framesRaw++;
+            _compressionStats.bytesOut += length;
+        }
+        return 0;
     }
-    
-    // Wenn ACK erforderlich, warten und prüfen
-    if (requiresAck) {
-        return _waitForAck(500); // 500ms Timeout für ACK
+    bestLength += RS485_COMPRESSION_HEADER_LENGTH;
+    if (!countStats) {
+        return bestLength;
     }
+    _compressionStats.bytesIn += length;
+    _compressionStats.framesCompressed++;
+    _compressionStats.bytesOut += bestLength;
+    _compressionStats.blocksSaved += rawBlocks - (bestLength + RS485_IV_LENGTH - 1) / RS485_IV_LENGTH;
+    return bestLength;
+}
 
+// Entpackt einen entschlüsselten, komprimierten Payload (inkl. Padding) nach payloadOut.
+// Läuft in _dispatchFrame() im Kontext von loop(): Die Wörterbuch-Tabelle ändert
+// addCompressionDictionary() ohne Sperre, in der Crypto-Task wäre das ein Datenwettlauf.
+bool RS485SecureStack::_decompressPayload(const uint8_t* data, size_t length, char* payloadOut) const {
+    if (length < RS485_COMPRESSION_HEADER_LENGTH) {
+        return false;
+    }
+    uint8_t dictionaryId = data[0];
+    size_t originalLength = data[1];
+    if (originalLength == 0 || originalLength > RS485_MAX_PAYLOAD_LENGTH) {
+        return false;
+    }
+    const CompressionDictionary_t* dictionary = nullptr;
+    if (dictionaryId != 0) {
+        for (size_t i = 0; i < RS485_COMPRESSION_MAX_DICTIONARIES; ++i) {
+            if (_compressionDictionaries[i].id == dictionaryId) {
+                dictionary = &_compressionDictionaries[i];
+                break;
+            }
+        }
+        if (dictionary == nullptr) {
+            return false; // Wörterbuch hier nicht eingerichtet
+        }
+    }
+    if (!rs485Decompress(&data[RS485_COMPRESSION_HEADER_LENGTH], length - RS485_COMPRESSION_HEADER_LENGTH,
+                         dictionary ? dictionary->data : nullptr, dictionary ? dictionary->length : 0,
+                         (uint8_t*)payloadOut, originalLength)) {
+        return false;
+    }
+    payloadOut[originalLength] = '\0';
     return true;
 }
 
-// Setzt einen neuen Session Key
-bool RS485SecureStack::setSessionKey(uint8_t keyId, const uint8_t* keyData, size_t keyLen) {
-    if (keyLen != 32) { // Session Keys müssen 32 Bytes für SHA256 HMAC sein
-        if (_debug) Serial.println("ERR: Session Key muss 32 Bytes lang sein.");
+// Debug-Ausgabe als eine Zeile mit optionaler Instanz-Kennung. Die Zeile wird vorab formatiert und
+// mit einem einzigen Schreibaufruf ausgegeben, damit sich Ausgaben mehrerer Bus-Tasks nicht vermischen.
+void RS485SecureStack::_debugPrintf(const char* format, ...) {
+    char line[192];
+    size_t offset = 0;
+    if (_debugTag != nullptr) {
+        int written = snprintf(line, sizeof(line), "[%s] ", _debugTag);
+        offset = written > 0 ? (size_t)written : 0;
+        if (offset >= sizeof(line)) offset = sizeof(line) - 1;
+    }
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line + offset, sizeof(line) - offset, format, args);
+    va_end(args);
+    Serial.print(line);
+}
+
+// Schaltet den Pipeline-Empfang ein: Puffer-Pool und Warteschlangen werden einmalig angelegt
+bool RS485SecureStack::enablePipelinedReceive(BaseType_t workerCore, UBaseType_t workerPriority) {
+    if (_rxPipeline != nullptr) {
+        return true;
+    }
+    RxPipeline_t* pipeline = new (std::nothrow) RxPipeline_t();
+    if (pipeline == nullptr) {
+        if (_debug) _debugPrintf("ERR: Kein Speicher für den Pipeline-Empfang.\n");
+        return false;
+    }
+    for (uint8_t i = 0; i < RS485_RX_PIPELINE_SLOTS; ++i) {
+        pipeline->freeSlots[i] = i;
+    }
+    pipeline->freeCount = RS485_RX_PIPELINE_SLOTS;
+    pipeline->stats.freeSlots = RS485_RX_PIPELINE_SLOTS;
+    pipeline->stats.minFreeSlots = RS485_RX_PIPELINE_SLOTS;
+    pipeline->owner = this;
+
+    if (xTaskCreatePinnedToCore(_rxCryptoTaskEntry, "rs485_crypto", 6144, pipeline, workerPriority,
+                                &pipeline->cryptoTask, workerCore) != pdPASS) {
+        if (_debug) _debugPrintf("ERR: Crypto-Task konnte nicht gestartet werden.\n");
+        delete pipeline;
         return false;
     }
-    memcpy(_sessionKeys[keyId], keyData, keyLen);
+    _rxPipeline = pipeline; // Erst jetzt: _extractPacket() übergibt ab hier an die Pipeline
     return true;
 }
 
-// Wechselt zur Verwendung eines neuen Schlüssels für ausgehende Nachrichten
-void RS485SecureStack::setCurrentKeyId(uint8_t keyId) {
-    if (keyId >= 256) {
-        if (_debug) Serial.println("ERR: Ungültige Key ID.");
+void RS485SecureStack::disablePipelinedReceive() {
+    _stopRxPipeline(true);
+}
+
+// Beendet die Crypto-Task und gibt die Pipeline frei. Ab dem Zurücksetzen von _rxPipeline
+// verarbeitet _extractPacket() wieder selbst; die Crypto-Task prüft noch die bereits übergebenen
+// Frames und meldet dann "stopped". deliverPending: diese Frames noch zustellen (sonst verwerfen).
+void RS485SecureStack::_stopRxPipeline(bool deliverPending) {
+    RxPipeline_t* pipeline = _rxPipeline;
+    if (pipeline == nullptr) {
         return;
     }
-    _currentKeyId = keyId;
-    if (_debug) Serial.printf("DBG: Aktuelle Key ID auf %d gesetzt.\n", _currentKeyId);
+    _rxPipeline = nullptr;
+    pipeline->stopRequested.store(true, std::memory_order_release);
+    xTaskNotifyGive(pipeline->cryptoTask);
+    while (!pipeline->stopped.load(std::memory_order_acquire)) {
+        vTaskDelay(1);
+    }
+    uint8_t slotIndex;
+    while (deliverPending && pipeline->toApp.pop(slotIndex)) {
+        RxSlot_t& slot = pipeline->slots[slotIndex];
+        _dispatchFrame(slot.frame, slot.payload, slot.hmacVerified, slot.rxMicros, slot.rxStartMicros);
+    }
+    delete pipeline;
 }
 
-// Setzt die Baudrate der seriellen Schnittstelle
-void RS485SecureStack::setBaudRate(long baudRate) {
-    if (_serial) {
-        _serial->end();
-        _serial->begin(baudRate);
-        _serial->setTimeout(SERIAL_TIMEOUT_MS);
-        if (_debug) Serial.printf("DBG: Baudrate auf %ld gesetzt.\n", baudRate);
+bool RS485SecureStack::getRxPipelineStats(RxPipelineStats_t& stats) const {
+    if (_rxPipeline == nullptr) {
+        return false;
     }
+    stats = _rxPipeline->stats;
+    stats.cryptoQueueDepth = _rxPipeline->toCrypto.depth();
+    stats.appQueueDepth = _rxPipeline->toApp.depth();
+    stats.freeSlots = _rxPipeline->freeCount;
+    return true;
 }
 
-// Private Hilfsfunktionen
-
-void RS485SecureStack::_resetReceiveBuffer() {
-    _receiveBufferPos = 0;
-    memset(_receiveBuffer, 0, sizeof(_receiveBuffer)); // Optional: Puffer leeren
+// Lock-freie Warteschlange für genau einen Produzenten und einen Konsumenten (Slot-Indizes).
+// Der Produzent schreibt nur head, der Konsument nur tail; acquire/release ordnet die Slot-Inhalte.
+bool RS485SecureStack::RxRing_t::push(uint8_t slot) {
+    uint8_t h = head.load(std::memory_order_relaxed);
+    uint8_t next = (h + 1) % (RS485_RX_PIPELINE_SLOTS + 1);
+    if (next == tail.load(std::memory_order_acquire)) {
+        return false; // Voll
+    }
+    slots[h] = slot;
+    head.store(next, std::memory_order_release);
+    return true;
 }
 
-// Prüft, ob ein Byte ein Startbyte ist (DE oder AD)
-bool RS485SecureStack::_isStartByte(uint8_t byte) {
-    return (byte == RS485_START_BYTE_0 || byte == RS485_START_BYTE_1);
+bool RS485SecureStack::RxRing_t::pop(uint8_t& slot) {
+    uint8_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+        return false; // Leer
+    }
+    slot = slots[t];
+    tail.store((t + 1) % (RS485_RX_PIPELINE_SLOTS + 1), std::memory_order_release);
+    return true;
 }
 
-// Extrahiert und verarbeitet ein Paket aus dem Empfangspuffer
-bool RS485SecureStack::_extractPacket() {
-    // Unstuffing des empfangenen Puffers
-    size_t unstuffedLength = _byteUnstuff(_receiveBuffer, _receiveBufferPos, _unstuffedPacketBuffer);
+uint8_t RS485SecureStack::RxRing_t::depth() const {
+    uint8_t h = head.load(std::memory_order_acquire);
+    uint8_t t = tail.load(std::memory_order_acquire);
+    return (h + RS485_RX_PIPELINE_SLOTS + 1 - t) % (RS485_RX_PIPELINE_SLOTS + 1);
+}
 
-    // Mindestlänge prüfen: Header (8) + IV (16) + HMAC (32) + CRC (2) = 58 Bytes
-    if (unstuffedLength < (8 + RS485_IV_LENGTH + RS485_HMAC_LENGTH + 2)) {
-        if (_debug) Serial.printf("ERR: Unstuffed Paket zu kurz (%d Bytes).\n", unstuffedLength);
+// Stufe 1 -> 2: CRC-geprüften Frame in einen freien Puffer kopieren und an die Crypto-Task übergeben.
+// Sind alle Puffer belegt, wird der Frame verworfen (Gegendruck, siehe droppedNoSlot).
+bool RS485SecureStack::_submitToRxPipeline(const uint8_t* frame, unsigned long rxMicros, unsigned long rxStartMicros) {
+    RxPipeline_t& pipeline = *_rxPipeline;
+    if (pipeline.freeCount == 0) {
+        pipeline.stats.droppedNoSlot++;
+        if (_debug) _debugPrintf("DBG: Alle Pipeline-Puffer belegt, Frame verworfen.\n");
         return false;
     }
+    uint8_t slotIndex = pipeline.freeSlots[--pipeline.freeCount];
+    if (pipeline.freeCount < pipeline.stats.minFreeSlots) pipeline.stats.minFreeSlots = pipeline.freeCount;
+
+    RxSlot_t& slot = pipeline.slots[slotIndex];
+    memcpy(slot.frame, frame, frame[TOTAL_LENGTH_INDEX]);
+    slot.rxMicros = rxMicros;
+    slot.rxStartMicros = rxStartMicros;
+    pipeline.toCrypto.push(slotIndex); // Kann nicht voll sein: Ring fasst alle Puffer
+    pipeline.stats.framesIn++;
+    uint8_t depth = pipeline.toCrypto.depth();
+    if (depth > pipeline.stats.cryptoQueueMaxDepth) pipeline.stats.cryptoQueueMaxDepth = depth;
+    xTaskNotifyGive(pipeline.cryptoTask);
+    return true;
+}
 
-    // Header-Prüfung
-    if (_unstuffedPacketBuffer[START_BYTE_0_INDEX] != RS485_START_BYTE_0 ||
-        _unstuffedPacketBuffer[START_BYTE_1_INDEX] != RS485_START_BYTE_1 ||
-        _unstuffedPacketBuffer[PROTOCOL_VERSION_INDEX] != RS485_PROTOCOL_VERSION) {
-        if (_debug) Serial.println("ERR: Ungültiger Header im unstuffed Paket.");
-        return false;
+// Stufe 2: Crypto-Task. Prüft HMAC und entschlüsselt, Reihenfolge der Frames bleibt erhalten.
+void RS485SecureStack::_rxCryptoTaskEntry(void* parameter) {
+    RxPipeline_t* pipeline = static_cast<RxPipeline_t*>(parameter);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint8_t slotIndex;
+        while (pipeline->toCrypto.pop(slotIndex)) {
+            RxSlot_t& slot = pipeline->slots[slotIndex];
+            slot.hmacVerified = pipeline->owner->_authenticateFrame(slot.frame, slot.payload);
+            pipeline->toApp.push(slotIndex); // Zähler führt loop() bei der Übernahme, nicht diese Task
+        }
+        if (pipeline->stopRequested.load(std::memory_order_acquire)) {
+            pipeline->stopped.store(true, std::memory_order_release); // Danach kein Zugriff mehr auf pipeline
+            vTaskDelete(nullptr);
+        }
     }
+}
 
-    uint8_t totalLength = _unstuffedPacketBuffer[TOTAL_LENGTH_INDEX];
-    if (totalLength != unstuffedLength) {
-        if (_debug) Serial.printf("ERR: Deklarierte Länge (%d) stimmt nicht mit unstuffed Länge (%d) überein.\n", totalLength, unstuffedLength);
-        return false;
+// Stufe 3: Geprüfte Frames zustellen und Puffer freigeben (im Kontext von loop()/_waitForAck())
+void RS485SecureStack::_serviceRxPipeline(bool limited) {
+    if (_rxPipeline == nullptr) {
+        return;
     }
-
-    // CRC16 prüfen (CRC befindet sich am Ende des unstuffed Pakets)
-    uint16_t receivedCrc = (_unstuffedPacketBuffer[unstuffedLength - 2] | (_unstuffedPacketBuffer[unstuffedLength - 1] << 8));
-    uint16_t calculatedCrc = _calculateCRC16(_unstuffedPacketBuffer, unstuffedLength - 2); // CRC über alles außer den letzten 2 Bytes (CRC selbst)
-
-    bool crcVerified = (receivedCrc == calculatedCrc);
-    if (!crcVerified) {
-        if (_debug) Serial.printf("ERR: CRC16 Fehler. Empfangen: 0x%04X, Berechnet: 0x%04X\n", receivedCrc, calculatedCrc);
-        return false; // CRC-Fehler, Paket verwerfen
+    uint8_t depth = _rxPipeline->toApp.depth();
+    if (depth > _rxPipeline->stats.appQueueMaxDepth) _rxPipeline->stats.appQueueMaxDepth = depth;
+    uint8_t slotIndex;
+    while (_rxPipeline->toApp.depth() > 0) {
+        if (limited && _loopLimitReached()) {
+            _loopLimitHit = true;
+            break;
+        }
+        if (!_rxPipeline->toApp.pop(slotIndex)) {
+            break;
+        }
+        _rxPipeline->stats.framesVerified++;
+        RxSlot_t& slot = _rxPipeline->slots[slotIndex];
+        unsigned long startMicros = micros();
+        _dispatchFrame(slot.frame, slot.payload, slot.hmacVerified, slot.rxMicros, slot.rxStartMicros);
+        _noteFrameProcessed(startMicros);
+        _rxPipeline->freeSlots[_rxPipeline->freeCount++] = slotIndex;
+        _rxPipeline->stats.framesDelivered++;
     }
+}
 
-    uint8_t keyId = _unstuffedPacketBuffer[KEY_ID_INDEX];
-    if (keyId >= 256) {
-        if (_debug) Serial.printf("ERR: Ungültige Key ID (%d) im Header.\n", keyId);
-        return false; // Ungültige Key ID
+// Verarbeitet "JOIN:<gruppe>" / "LEAVE:<gruppe>" anderer Knoten
+void RS485SecureStack::_handleGroupMessage(uint8_t senderAddress, const String& payload) {
+    bool join = payload.startsWith("JOIN:");
+    if (!join && !payload.startsWith("LEAVE:")) {
+        if (_debug) _debugPrintf("ERR: Ungültige Gruppen-Nachricht: '%s'\n", payload.c_str());
+        return;
+    }
+    long groupAddress = payload.substring(payload.indexOf(':') + 1).toInt();
+    if (!isGroupAddress((uint8_t)groupAddress) || groupAddress > 255) {
+        if (_debug) _debugPrintf("ERR: Ungültige Gruppenadresse in Gruppen-Nachricht: %ld\n", groupAddress);
+        return;
     }
+    uint8_t* members = _knownGroupMembers[groupAddress - RS485_GROUP_ADDRESS_FIRST];
+    if (join) {
+        rs485BitmapSet(members, senderAddress);
+    } else {
+        rs485BitmapClear(members, senderAddress);
+    }
+    if (_debug) _debugPrintf("DBG: Node %d %s Gruppe %ld.\n", senderAddress, join ? "tritt bei" : "verlässt", groupAddress);
+}
 
-    uint8_t receivedHmac[RS485_HMAC_LENGTH];
-    memcpy(receivedHmac, &_unstuffedPacketBuffer[totalLength - RS485_HMAC_LENGTH - 2], RS485_HMAC_LENGTH); // -2 für CRC
+// Baudraten-Probe (Knotenseite und Rückmeldungen an den Master)
+void RS485SecureStack::_handleProbeMessage(const Packet_t& packet) {
+    if (packet.messageType == MSG_TYPE_BAUD_RATE_SET) {
+        // "PROBE:<baud>:<fensterMs>": Für die Dauer des Fensters auf die Testbaudrate wechseln
+        int secondColon = packet.payload.indexOf(':', 6);
+        long testBaudRate = packet.payload.substring(6).toInt();
+        long windowMs = secondColon > 0 ? packet.payload.substring(secondColon + 1).toInt() : 0;
+        if (testBaudRate <= 0 || windowMs <= 0) {
+            if (_debug) _debugPrintf("ERR: Ungültige Probe-Ankündigung: '%s'\n", packet.payload.c_str());
+            return;
+        }
+        if (!_probe.active) {
+            _probe.baseBaudRate = getBaudRate();
+        }
+        _probe.active = true;
+        _probe.startMillis = millis();
+        _probe.windowMs = windowMs;
+        _probe.testFramesReceived = 0;
+        _probe.statsAtStart = _linkStats;
+        if (_debug) _debugPrintf("DBG: Baudraten-Probe %ld für %ld ms.\n", testBaudRate, windowMs);
+        setBaudRate(testBaudRate);
+        return;
+    }
 
-    uint8_t calculatedHmac[RS485_HMAC_LENGTH];
-    // HMAC über alles bis zum Beginn des HMAC-Feldes
-    _calculateHMAC(_sessionKeys[keyId], _unstuffedPacketBuffer, totalLength - RS485_HMAC_LENGTH - 2, calculatedHmac);
+    if (packet.payload.equals("T")) {
+        if (_probe.active) _probe.testFramesReceived++;
+    } else if (packet.payload.equals("LQ?") && packet.destinationAddress == _myAddress) {
+        // Eigene Probe-Statistik an den Abfragenden melden
+        String reply = "LQ:";
+        reply += (int)_probe.testFramesReceived;
+        reply += ',';
+        reply += (int)(_linkStats.crcErrors - _probe.statsAtStart.crcErrors);
+        reply += ',';
+        reply += (int)(_linkStats.hmacErrors - _probe.statsAtStart.hmacErrors);
+        sendMessage(packet.senderAddress, _myAddress, MSG_TYPE_LINK_TEST, reply, false);
+    } else if (packet.payload.startsWith("LQ:") && packet.destinationAddress == _myAddress) {
+        int firstComma = packet.payload.indexOf(',');
+        int secondComma = packet.payload.indexOf(',', firstComma + 1);
+        if (firstComma < 0 || secondComma < 0) return;
+        _linkReport.senderAddress = packet.senderAddress;
+        _linkReport.testFramesReceived = packet.payload.substring(3, firstComma).toInt();
+        _linkReport.crcErrors = packet.payload.substring(firstComma + 1, secondComma).toInt();
+        _linkReport.hmacErrors = packet.payload.substring(secondComma + 1).toInt();
+        _linkReportValid = true;
+    }
+}
 
-    bool hmacVerified = true;
-    for (size_t i = 0; i < RS485_HMAC_LENGTH; ++i) {
-        if (receivedHmac[i] != calculatedHmac[i]) {
-            hmacVerified = false;
-            break;
+// Speichert einen geänderten Sitzungszustand, sobald er RS485_SESSION_SAVE_DELAY_MS stabil ist,
+// und kehrt nach einem Neustart ohne gültigen Frame zur Startbaudrate zurück
+void RS485SecureStack::_serviceSession() {
+    if (_sessionStore == nullptr) {
+        return;
+    }
+    if (_sessionRestorePending) {
+        if (millis() - _sessionRestoreMillis >= RS485_SESSION_RESTORE_TIMEOUT_MS) {
+            _sessionRestorePending = false;
+            if (_debug) _debugPrintf("DBG: Kein gültiger Frame nach Wiederherstellung, zurück auf %ld Baud.\n", RS485_INITIAL_BAUD_RATE);
+            setBaudRate(RS485_INITIAL_BAUD_RATE);
+            _sessionSaved.baudRate = RS485_INITIAL_BAUD_RATE; // Rückfall nicht speichern
         }
     }
-
-    if (!hmacVerified) {
-        if (_debug) Serial.println("ERR: HMAC-Fehler. Paket nicht authentifiziert.");
-        // Dennoch könnte das Paket ein ACK/NACK sein, das selbst HMAC-gesichert ist.
-        // Wenn es mein ACK ist und der HMAC nicht stimmt, ist etwas faul.
-        // Für den Callback geben wir hmacVerified = false mit.
-        // Wir verwerfen das Paket nicht komplett hier, sondern lassen den Callback entscheiden.
+    if (_probe.active) {
+        return; // Testbaudrate nur vorübergehend
     }
 
-    // IV und verschlüsselte Payload extrahieren
-    uint8_t iv[RS485_IV_LENGTH];
-    memcpy(iv, &_unstuffedPacketBuffer[8], RS485_IV_LENGTH);
+    SessionState_t state = _currentSessionState();
+    bool changed = state.baudRate != _sessionSaved.baudRate || state.currentKeyId != _sessionSaved.currentKeyId ||
+                   state.hasNextKey != _sessionSaved.hasNextKey || (state.hasNextKey && state.nextKeyId != _sessionSaved.nextKeyId);
+    if (!changed) {
+        _sessionChangePending = false;
+        return;
+    }
+    bool sameAsObserved = _sessionChangePending && state.baudRate == _sessionObserved.baudRate &&
+                          state.currentKeyId == _sessionObserved.currentKeyId && state.hasNextKey == _sessionObserved.hasNextKey &&
+                          state.nextKeyId == _sessionObserved.nextKeyId;
+    if (!sameAsObserved) {
+        _sessionObserved = state;
+        _sessionChangePending = true;
+        _sessionChangeMillis = millis();
+        return;
+    }
+    if (millis() - _sessionChangeMillis >= RS485_SESSION_SAVE_DELAY_MS) {
+        saveSession();
+    }
+}
 
-    size_t encryptedPayloadStart = 8 + RS485_IV_LENGTH;
-    size_t encryptedPayloadLen = totalLength - encryptedPayloadStart - RS485_HMAC_LENGTH - 2; // -2 für CRC
+RS485SecureStack::SessionState_t RS485SecureStack::_currentSessionState() const {
+    SessionState_t state;
+    state.baudRate = _probe.active ? _probe.baseBaudRate : _configuredBaudRate;
+    state.currentKeyId = _currentKeyId;
+    state.nextKeyId = _hasNextKey ? _nextKeyId : 0;
+    state.hasNextKey = _hasNextKey;
+    return state;
+}
 
-    uint8_t decryptedPayloadBuffer[encryptedPayloadLen];
-    memcpy(decryptedPayloadBuffer, &_unstuffedPacketBuffer[encryptedPayloadStart], encryptedPayloadLen);
+// Beendet ein abgelaufenes Probe-Fenster und kehrt zur Basisbaudrate zurück
+void RS485SecureStack::_serviceProbeWindow() {
+    if (_probe.active && millis() - _probe.startMillis >= _probe.windowMs) {
+        _probe.active = false;
+        if (_debug) _debugPrintf("DBG: Probe-Fenster beendet, zurück auf %ld Baud.\n", _probe.baseBaudRate);
+        setBaudRate(_probe.baseBaudRate);
+    }
+}
 
-    // Payload entschlüsseln (nur wenn HMAC_OK ist, sonst wäre Entschlüsselung nutzlos und potenziell gefährlich)
-    if (hmacVerified) {
-        _decryptAES(decryptedPayloadBuffer, encryptedPayloadLen, _sessionKeys[keyId], iv);
-    } else {
-        // Wenn HMAC nicht verifiziert, Payload mit Nullen füllen, um keine sensiblen Daten preiszugeben.
-        // Oder den Callback das leere Payload verarbeiten lassen.
-        memset(decryptedPayloadBuffer, 0, encryptedPayloadLen);
-        if (_debug) Serial.println("DBG: Payload nicht entschlüsselt wegen fehlendem HMAC.");
+bool RS485SecureStack::takeLinkReport(uint8_t senderAddress, LinkReport_t& report) {
+    if (!_linkReportValid || _linkReport.senderAddress != senderAddress) {
+        return false;
     }
-    
-    // Packet_t Struktur füllen
-    Packet_t receivedPacket;
-    receivedPacket.totalLength = totalLength;
-    receivedPacket.messageType = (char)_unstuffedPacketBuffer[MESSAGE_TYPE_INDEX];
-    receivedPacket.destinationAddress = _unstuffedPacketBuffer[DEST_ADDRESS_INDEX];
-    receivedPacket.senderAddress = _unstuffedPacketBuffer[SENDER_ADDRESS_INDEX];
-    receivedPacket.keyId = keyId;
-    receivedPacket.payload = String((char*)decryptedPayloadBuffer); // Konvertierung von uint8_t* zu String
-    receivedPacket.requiresAck = false; // Wird nicht aus Paket gelesen, muss vom Sender bekannt sein
-    receivedPacket.isAck = (receivedPacket.messageType == MSG_TYPE_ACK_NACK);
-    receivedPacket.hmacVerified = hmacVerified;
-    receivedPacket.crcVerified = crcVerified;
+    report = _linkReport;
+    _linkReportValid = false;
+    return true;
+}
 
-    // Nur Pakete, die für uns sind oder Broadcasts, verarbeiten
-    // Und wir dürfen keine ACK/NACKs von uns selbst verarbeiten
-    if ((receivedPacket.destinationAddress == _myAddress || receivedPacket.destinationAddress == 255) && 
-        !(receivedPacket.isAck && receivedPacket.senderAddress == _myAddress)) {
-        
-        if (_debug) {
-            Serial.printf("RCV: Type='%c', Dest=%d, Sender=%d, KeyID=%d, Len=%d, Payload='%s'\n",
-                          receivedPacket.messageType, receivedPacket.destinationAddress,
-                          receivedPacket.senderAddress, receivedPacket.keyId,
-                          receivedPacket.payload.length(), receivedPacket.payload.c_str());
-            Serial.printf("HMAC_OK: %s, CRC_OK: %s\n", receivedPacket.hmacVerified ? "YES" : "NO", receivedPacket.crcVerified ? "YES" : "NO");
-        }
+// Dauer eines Multicast-ACK-Zeitschlitzes: Sendezeit eines ACK-Frames bei der aktuellen
+// Baudrate (mit Stuffing-Reserve) plus Umschaltzeiten und Sicherheitsabstand
+unsigned long RS485SecureStack::_multicastAckSlotMicros() const {
+    size_t ackFrameBytes = RS485_COMPACT_ACK_LENGTH * 5 / 4;
+    return frameAirtimeMicros(ackFrameBytes) + RS485_TX_ENABLE_DELAY_US + RS485_TX_DISABLE_DELAY_US + 1000UL;
+}
+
+// Sendezeit eines Frames: 10 Bit pro Byte (Start, 8 Daten, Stop) bei der aktuellen Baudrate
+unsigned long RS485SecureStack::frameAirtimeMicros(size_t frameLength) const {
+    unsigned long baud = _serial ? _serial->baudRate() : RS485_INITIAL_BAUD_RATE;
+    if (baud == 0) baud = RS485_INITIAL_BAUD_RATE;
+    return (unsigned long)((frameLength * 10ULL * 1000000ULL) / baud);
+}
 
-        if (_packetReceivedCallback) {
-            _packetReceivedCallback(receivedPacket);
+// ACK-Timeout: Sendezeit des ACK-Frames + SRTT + 4 * RTTVAR (Jacobson/Karels), begrenzt
+unsigned long RS485SecureStack::getAckTimeoutMicros(uint8_t peerAddress) {
+    PeerEntry_t* peer = _findPeer(peerAddress, false);
+    if (peer == nullptr || peer->stats.rttSamples == 0) {
+        return RS485_ACK_TIMEOUT_INITIAL_MS * 1000UL;
+    }
+    unsigned long ackAirtime = frameAirtimeMicros(RS485_COMPACT_ACK_LENGTH);
+    unsigned long timeout = ackAirtime + peer->stats.srttMicros + 4UL * peer->stats.rttVarMicros;
+    if (timeout < ackAirtime + RS485_ACK_TIMEOUT_MIN_US) timeout = ackAirtime + RS485_ACK_TIMEOUT_MIN_US;
+    if (timeout > RS485_ACK_TIMEOUT_MAX_US) timeout = RS485_ACK_TIMEOUT_MAX_US;
+    return timeout;
+}
+
+bool RS485SecureStack::getPeerStats(uint8_t peerAddress, PeerStats_t& stats) const {
+    for (size_t i = 0; i < RS485_MAX_PEERS; ++i) {
+        if (_peers[i].used && _peers[i].stats.address == peerAddress) {
+            stats = _peers[i].stats;
+            return true;
         }
+    }
+    return false;
+}
 
-        // Automatisch ACK senden, wenn erforderlich und gültig
-        // Und es ist KEINE ACK/NACK Nachricht
-        if (!receivedPacket.isAck && receivedPacket.requiresAck && receivedPacket.destinationAddress == _myAddress && hmacVerified && crcVerified) {
-             _sendAck(receivedPacket.senderAddress, _myAddress, receivedPacket.keyId);
+// Sucht einen Peer in der Tabelle. Mit create=true wird ein neuer Eintrag angelegt und
+// bei voller Tabelle der am längsten inaktive Eintrag ersetzt.
+RS485SecureStack::PeerEntry_t* RS485SecureStack::_findPeer(uint8_t address, bool create) {
+    PeerEntry_t* freeEntry = nullptr;
+    PeerEntry_t* oldestEntry = nullptr;
+    for (size_t i = 0; i < RS485_MAX_PEERS; ++i) {
+        PeerEntry_t& entry = _peers[i];
+        if (entry.used && entry.stats.address == address) {
+            entry.lastActivityMillis = millis();
+            return &entry;
         }
-    } else {
-        if (_debug) {
-            Serial.printf("DBG: Paket für andere Adresse (%d), Sender=%d, oder ist eigenes ACK. Verworfen.\n", 
-                          receivedPacket.destinationAddress, receivedPacket.senderAddress);
+        if (!entry.used) {
+            if (freeEntry == nullptr) freeEntry = &entry;
+        } else if (oldestEntry == nullptr || millis() - entry.lastActivityMillis > millis() - oldestEntry->lastActivityMillis) {
+            oldestEntry = &entry;
         }
     }
-
-    return true; // Paket wurde (versucht zu) verarbeitet, Puffer kann zurückgesetzt werden
+    if (!create) {
+        return nullptr;
+    }
+    PeerEntry_t* entry = freeEntry ? freeEntry : oldestEntry;
+    memset(entry, 0, sizeof(PeerEntry_t));
+    entry->used = true;
+    entry->stats.address = address;
+    entry->lastActivityMillis = millis();
+    return entry;
 }
 
-// Berechnet CRC16 über gegebene Daten
-uint16_t RS485SecureStack::_calculateCRC16(const uint8_t* data, size_t length) {
-    uint16_t crc = 0x0000; // Initialwert
-    for (size_t i = 0; i < length; ++i) {
-        crc = (crc >> 8) ^ crc16_table[(crc ^ data[i]) & 0xFF];
+// Jacobson/Karels: RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+void RS485SecureStack::_updateRtt(PeerEntry_t& peer, uint32_t sampleMicros) {
+    PeerStats_t& stats = peer.stats;
+    if (stats.rttSamples == 0) {
+        stats.srttMicros = sampleMicros;
+        stats.rttVarMicros = sampleMicros / 2;
+    } else {
+        uint32_t deviation = stats.srttMicros > sampleMicros ? stats.srttMicros - sampleMicros : sampleMicros - stats.srttMicros;
+        stats.rttVarMicros = (3 * stats.rttVarMicros + deviation) / 4;
+        stats.srttMicros = (7 * stats.srttMicros + sampleMicros) / 8;
     }
-    return crc;
+    stats.lastRttMicros = sampleMicros;
+    stats.rttSamples++;
+    if (_debug) _debugPrintf("DBG: RTT zu %d: %lu us (SRTT %lu us, RTTVAR %lu us).\n", stats.address,
+                              (unsigned long)sampleMicros, (unsigned long)stats.srttMicros, (unsigned long)stats.rttVarMicros);
 }
 
 // Generiert einen zufälligen Initialisierungsvektor (IV)
@@ -432,7 +2057,7 @@ void RS485SecureStack::_generateIV(uint8_t* iv) {
 }
 
 // Verschlüsselt Daten mit AES-256 im CBC-Modus
-void RS458SecureStack::_encryptAES(uint8_t* data, size_t len, const uint8_t* key, const uint8_t* iv) {
+void RS485SecureStack::_encryptAES(uint8_t* data, size_t len, const uint8_t* key, const uint8_t* iv) {
     AES256 aes256;
     aes256.setKey(key, aes256.keySize());
     aes256.setIV(iv, aes256.ivSize());
@@ -440,7 +2065,7 @@ void RS458SecureStack::_encryptAES(uint8_t* data, size_t len, const uint8_t* key
 }
 
 // Entschlüsselt Daten mit AES-256 im CBC-Modus
-void RS458SecureStack::_decryptAES(uint8_t* data, size_t len, const uint8_t* key, const uint8_t* iv) {
+void RS485SecureStack::_decryptAES(uint8_t* data, size_t len, const uint8_t* key, const uint8_t* iv) {
     AES256 aes256;
     aes256.setKey(key, aes256.keySize());
     aes256.setIV(iv, aes256.ivSize());
@@ -487,187 +2112,148 @@ void RS485SecureStack::_calculateHMAC(const uint8_t* key, const uint8_t* data, s
     sha256_outer.finalize(hmacResult, 32);
 }
 
-// Wendet Byte-Stuffing an (ersetzt Start- und Escape-Bytes)
-size_t RS485SecureStack::_byteStuff(const uint8_t* source, size_t sourceLen, uint8_t* destination) {
-    size_t destLen = 0;
-    for (size_t i = 0; i < sourceLen; ++i) {
-        if (source[i] == RS485_START_BYTE_0 || source[i] == RS485_START_BYTE_1 || source[i] == RS485_ESCAPE_BYTE) {
-            destination[destLen++] = RS485_ESCAPE_BYTE;
-            destination[destLen++] = source[i] ^ 0x20; // XOR mit 0x20 zum Escaping
-        } else {
-            destination[destLen++] = source[i];
-        }
+// Reiht ein kompaktes ACK/NACK in die ACK-Klasse ein (gesendet frühestens zu notBeforeMicros)
+bool RS485SecureStack::_sendAck(uint8_t destinationAddress, uint8_t keyId, uint8_t sequence, const uint8_t* frameHmac, uint8_t status, unsigned long notBeforeMicros) {
+    TxQueueEntry_t* entry = _allocTxEntry(RS485_TX_CLASS_ACK);
+    if (entry == nullptr) {
+        return false;
+    }
+    entry->destinationAddress = destinationAddress;
+    entry->messageType = MSG_TYPE_ACK_NACK;
+    entry->requiresAck = false; // ACK selbst erfordert kein ACK
+    entry->compactAck = true;
+    entry->cancelled = false;
+    entry->ackSequence = sequence;
+    entry->ackKeyId = keyId;
+    entry->ackStatus = status;
+    entry->notBeforeMicros = notBeforeMicros;
+    memcpy(entry->payload, frameHmac, RS485_HMAC_LENGTH);
+    if (_debug) _debugPrintf("DBG: %s an %d eingereiht (Seq %d)\n", status == RS485_ACK_OK ? "ACK" : "NACK", destinationAddress, sequence);
+    return true;
+}
+
+bool RS485SecureStack::_enqueueTx(RS485TxClass txClass, uint8_t destinationAddress, char messageType, const String& payload, bool requiresAck, unsigned long notBeforeMicros) {
+    if (payload.length() > RS485_MAX_PAYLOAD_LENGTH) {
+        if (_debug) _debugPrintf("ERR: Payload zu lang für die Sendewarteschlange (%d Bytes).\n", payload.length());
+        return false;
     }
-    return destLen;
+    TxQueueEntry_t* entry = _allocTxEntry(txClass);
+    if (entry == nullptr) {
+        return false;
+    }
+    entry->destinationAddress = destinationAddress;
+    entry->messageType = messageType;
+    entry->requiresAck = requiresAck;
+    entry->compactAck = false;
+    entry->cancelled = false;
+    entry->notBeforeMicros = notBeforeMicros;
+    memcpy(entry->payload, payload.c_str(), payload.length());
+    entry->payload[payload.length()] = '\0';
+    return true;
 }
 
-// Entfernt Byte-Stuffing
-size_t RS485SecureStack::_byteUnstuff(const uint8_t* source, size_t sourceLen, uint8_t* destination) {
-    size_t destLen = 0;
-    for (size_t i = 0; i < sourceLen; ++i) {
-        if (source[i] == RS485_ESCAPE_BYTE) {
-            if (i + 1 < sourceLen) {
-                destination[destLen++] = source[++i] ^ 0x20;
-            } else {
-                if (_debug) Serial.println("ERR: Unvollständige Escape-Sequenz.");
-                return 0; // Fehler: Unvollständige Escape-Sequenz
-            }
-        } else {
-            destination[destLen++] = source[i];
+// Belegt den nächsten Eintrag einer Sendeklasse (Verwerfungsstrategie bei voller Warteschlange).
+// Gibt nullptr zurück, wenn die neue Nachricht verworfen wird.
+RS485SecureStack::TxQueueEntry_t* RS485SecureStack::_allocTxEntry(RS485TxClass txClass) {
+    TxQueue_t& queue = _txQueues[txClass];
+    if (queue.count >= queue.depthLimit) {
+        queue.stats.dropped++;
+        if (queue.dropPolicy == RS485_DROP_NEWEST || queue.depthLimit == 0) {
+            if (_debug) _debugPrintf("DBG: Sendeklasse %d voll, Nachricht verworfen.\n", txClass);
+            return nullptr;
         }
+        queue.head = (queue.head + 1) % RS485_TX_QUEUE_DEPTH; // Älteste verwerfen
+        queue.count--;
     }
-    return destLen;
-}
 
-// Sendet eine ACK-Nachricht
-bool RS485SecureStack::_sendAck(uint8_t destinationAddress, uint8_t senderAddress, uint8_t keyId) {
-    if (_debug) Serial.printf("DBG: Sende ACK an %d\n", destinationAddress);
-    return sendMessage(destinationAddress, senderAddress, MSG_TYPE_ACK_NACK, "ACK", false); // ACK selbst erfordert kein ACK
+    TxQueueEntry_t* entry = &queue.entries[(queue.head + queue.count) % RS485_TX_QUEUE_DEPTH];
+    queue.count++;
+    queue.stats.enqueued++;
+    if (queue.count > queue.stats.maxDepth) queue.stats.maxDepth = queue.count;
+    return entry;
 }
 
-// Sendet eine NACK-Nachricht
-bool RS485SecureStack::_sendNack(uint8_t destinationAddress, uint8_t senderAddress, uint8_t keyId, const char* reason) {
-    if (_debug) Serial.printf("DBG: Sende NACK an %d, Grund: %s\n", destinationAddress, reason);
-    String payload = "NACK:";
-    payload += reason;
-    return sendMessage(destinationAddress, senderAddress, MSG_TYPE_ACK_NACK, payload, false); // NACK selbst erfordert kein ACK
-}
+// Sendet den nächsten fälligen Frame aus den Warteschlangen der Klassen in classMask (strikte Priorität).
+// Mit allowAckWait=false werden Frames, die ein ACK erfordern, übersprungen (kein verschachteltes Warten).
+// Gibt true zurück, wenn ein Frame gesendet wurde.
+bool RS485SecureStack::_serviceTxQueue(uint8_t classMask, bool allowAckWait) {
+    for (uint8_t txClass = 0; txClass < RS485_TX_CLASS_COUNT; ++txClass) {
+        TxQueue_t& queue = _txQueues[txClass];
+        // Bereits per Header-Erweiterung mitgesendete Einträge entfernen
+        while (queue.count > 0 && queue.entries[queue.head].cancelled) {
+            queue.head = (queue.head + 1) % RS485_TX_QUEUE_DEPTH;
+            queue.count--;
+        }
+        if (!(classMask & (1 << txClass)) || queue.count == 0) {
+            continue;
+        }
+        const TxQueueEntry_t& head = queue.entries[queue.head];
+        if ((head.requiresAck && (!allowAckWait || !_loopAckWaitFits(head.destinationAddress))) ||
+            (long)(micros() - head.notBeforeMicros) < 0) {
+            continue;
+        }
 
-// Wartet auf ein ACK/NACK
-bool RS485SecureStack::_waitForAck(long timeoutMs) {
-    unsigned long startTime = millis();
-    _resetReceiveBuffer(); // Puffer für ACK leeren
+        // Eintrag vor dem Senden entnehmen: Während des Sendens/ACK-Wartens können neue Einträge entstehen
+        TxQueueEntry_t entry = head;
+        queue.head = (queue.head + 1) % RS485_TX_QUEUE_DEPTH;
+        queue.count--;
 
-    while (millis() - startTime < timeoutMs) {
-        if (_serial->available()) {
-            uint8_t incomingByte = _serial->read();
+        uint32_t latency = micros() - entry.notBeforeMicros;
+        queue.stats.lastLatencyMicros = latency;
+        if (latency > queue.stats.maxLatencyMicros) queue.stats.maxLatencyMicros = latency;
+        if (queue.stats.sent + queue.stats.failed == 0) {
+            queue.stats.avgLatencyMicros = latency;
+        } else {
+            queue.stats.avgLatencyMicros = (7 * queue.stats.avgLatencyMicros + latency) / 8;
+        }
 
-            if (_receiveBufferPos == 0) { // Suchen nach Startbytes
-                if (incomingByte == RS485_START_BYTE_0) {
-                    _receiveBuffer[_receiveBufferPos++] = incomingByte;
-                }
-            } else if (_receiveBufferPos == 1) {
-                if (incomingByte == RS485_START_BYTE_1) {
-                    _receiveBuffer[_receiveBufferPos++] = incomingByte;
-                } else {
-                    _resetReceiveBuffer();
-                }
-            } else {
-                if (incomingByte == RS485_START_BYTE_0 || incomingByte == RS485_START_BYTE_1) {
-                    _resetReceiveBuffer();
-                    if (incomingByte == RS485_START_BYTE_0) { 
-                         _receiveBuffer[_receiveBufferPos++] = incomingByte;
-                    }
-                    continue; 
-                }
-                _receiveBuffer[_receiveBufferPos++] = incomingByte;
-
-                if (_receiveBufferPos >= TOTAL_LENGTH_INDEX + 1) {
-                    uint8_t totalLength = _receiveBuffer[TOTAL_LENGTH_INDEX];
-                    if (totalLength < (8 + RS485_IV_LENGTH + RS485_HMAC_LENGTH + 2) || totalLength > MAX_PACKET_SIZE) {
-                        _resetReceiveBuffer();
-                        continue;
-                    }
-
-                    if (_receiveBufferPos >= totalLength + 2) { // +2 für Startbytes
-                        // Versuche das Paket zu extrahieren und zu verarbeiten
-                        size_t unstuffedLength = _byteUnstuff(_receiveBuffer, _receiveBufferPos, _unstuffedPacketBuffer);
-
-                        if (unstuffedLength < (8 + RS485_IV_LENGTH + RS485_HMAC_LENGTH + 2)) {
-                            _resetReceiveBuffer();
-                            continue;
-                        }
-
-                        if (_unstuffedPacketBuffer[START_BYTE_0_INDEX] != RS485_START_BYTE_0 ||
-                            _unstuffedPacketBuffer[START_BYTE_1_INDEX] != RS485_START_BYTE_1 ||
-                            _unstuffedPacketBuffer[PROTOCOL_VERSION_INDEX] != RS485_PROTOCOL_VERSION) {
-                            _resetReceiveBuffer();
-                            continue;
-                        }
-                        
-                        if (_unstuffedPacketBuffer[TOTAL_LENGTH_INDEX] != unstuffedLength) {
-                            _resetReceiveBuffer();
-                            continue;
-                        }
-
-                        uint16_t receivedCrc = (_unstuffedPacketBuffer[unstuffedLength - 2] | (_unstuffedPacketBuffer[unstuffedLength - 1] << 8));
-                        uint16_t calculatedCrc = _calculateCRC16(_unstuffedPacketBuffer, unstuffedLength - 2);
-
-                        if (receivedCrc != calculatedCrc) {
-                            if (_debug) Serial.println("ERR: ACK/NACK CRC16 Fehler.");
-                            _resetReceiveBuffer();
-                            continue;
-                        }
-
-                        uint8_t keyId = _unstuffedPacketBuffer[KEY_ID_INDEX];
-                        if (keyId >= 256) {
-                            if (_debug) Serial.printf("ERR: Ungültige Key ID (%d) im ACK/NACK Header.\n", keyId);
-                            _resetReceiveBuffer();
-                            continue;
-                        }
-
-                        uint8_t receivedHmac[RS485_HMAC_LENGTH];
-                        memcpy(receivedHmac, &_unstuffedPacketBuffer[unstuffedLength - RS485_HMAC_LENGTH - 2], RS485_HMAC_LENGTH);
-
-                        uint8_t calculatedHmac[RS485_HMAC_LENGTH];
-                        _calculateHMAC(_sessionKeys[keyId], _unstuffedPacketBuffer, unstuffedLength - RS485_HMAC_LENGTH - 2, calculatedHmac);
-
-                        bool hmacVerified = true;
-                        for (size_t i = 0; i < RS485_HMAC_LENGTH; ++i) {
-                            if (receivedHmac[i] != calculatedHmac[i]) {
-                                hmacVerified = false;
-                                break;
-                            }
-                        }
-
-                        if (!hmacVerified) {
-                            if (_debug) Serial.println("ERR: ACK/NACK HMAC-Fehler. Nicht authentifiziert.");
-                            _resetReceiveBuffer();
-                            continue;
-                        }
-
-                        // Entschlüsseln (auch wenn es ein ACK ist, könnte es eine Payload haben, z.B. NACK Reason)
-                        uint8_t iv[RS485_IV_LENGTH];
-                        memcpy(iv, &_unstuffedPacketBuffer[8], RS485_IV_LENGTH);
-                        size_t encryptedPayloadStart = 8 + RS485_IV_LENGTH;
-                        size_t encryptedPayloadLen = unstuffedLength - encryptedPayloadStart - RS485_HMAC_LENGTH - 2;
-
-                        uint8_t decryptedPayloadBuffer[encryptedPayloadLen];
-                        memcpy(decryptedPayloadBuffer, &_unstuffedPacketBuffer[encryptedPayloadStart], encryptedPayloadLen);
-                        _decryptAES(decryptedPayloadBuffer, encryptedPayloadLen, _sessionKeys[keyId], iv);
-                        
-                        // Überprüfen, ob es ein ACK/NACK für UNS ist und vom erwarteten Sender kommt
-                        if ((char)_unstuffedPacketBuffer[MESSAGE_TYPE_INDEX] == MSG_TYPE_ACK_NACK &&
-                            _unstuffedPacketBuffer[DEST_ADDRESS_INDEX] == _myAddress && // Es ist für mich
-                            _unstuffedPacketBuffer[SENDER_ADDRESS_INDEX] == destinationAddress) // Und vom Empfänger der Originalnachricht
-                        {
-                            String ackPayload = String((char*)decryptedPayloadBuffer);
-                            _resetReceiveBuffer();
-                            if (ackPayload.startsWith("ACK")) {
-                                if (_debug) Serial.println("DBG: ACK empfangen.");
-                                return true;
-                            } else if (ackPayload.startsWith("NACK")) {
-                                if (_debug) Serial.printf("DBG: NACK empfangen: %s\n", ackPayload.c_str());
-                                return false; // NACK bedeutet Fehler
-                            }
-                        } else {
-                            if (_debug) Serial.println("DBG: Empfangenes Paket ist kein passendes ACK/NACK.");
-                            // Dies ist kein ACK/NACK für uns, verarbeiten es als normales Paket in der Haupt-Loop.
-                            // Temporär zurück in den Puffer legen und Haupt-Loop verarbeiten lassen
-                            _resetReceiveBuffer(); // Puffer leeren
-                            // Dieses Verhalten ist kompliziert, wenn man im _waitForAck_ ist.
-                            // Die einfachste Lösung ist, es zu verwerfen und davon auszugehen, dass _waitForAck_ nur auf das spezielle ACK/NACK achtet.
-                            // Andere Pakete werden von der Haupt-Loop abgeholt.
-                        }
-                    }
-                }
-            }
-             if (_receiveBufferPos >= (MAX_PACKET_SIZE * 2) -1) { // Pufferüberlauf verhindern
-                if (_debug) Serial.println("DBG: ACK/NACK receive buffer overflow. Resetting.");
-                _resetReceiveBuffer();
-            }
+        bool ok;
+        if (entry.compactAck) {
+            ok = _sendCompactAck(entry);
+        } else if (isGroupAddress(entry.destinationAddress)) {
+            ok = sendMulticast(entry.destinationAddress, entry.messageType, entry.payload, entry.requiresAck);
+        } else {
+            ok = sendMessage(entry.destinationAddress, _myAddress, entry.messageType, entry.payload, entry.requiresAck);
+        }
+        if (ok) {
+            queue.stats.sent++;
+        } else {
+            queue.stats.failed++;
         }
+        return true;
+    }
+    return false;
+}
+
+// Wartet auf ein ACK/NACK. Empfangene Pakete werden dabei normal verarbeitet,
+// das passende ACK/NACK wird in _extractPacket über _ackWait erkannt.
+// Bei einer Gruppenadresse wird gesammelt (_ackWait.ackBitmap), bis expectedAcks erreicht oder der Timeout abgelaufen ist.
+bool RS485SecureStack::_waitForAck(uint8_t peerAddress, unsigned long timeoutMicros, size_t expectedAcks) {
+    if (_ackWait.active) {
+        if (_debug) _debugPrintf("ERR: Verschachteltes Warten auf ACK wird nicht unterstützt.\n");
+        return false;
+    }
+    memset(&_ackWait, 0, sizeof(_ackWait));
+    _ackWait.active = true;
+    _ackWait.peerAddress = peerAddress;
+    _ackWait.expectedAcks = expectedAcks;
+    _ackWait.sequence = _lastTxSequence; // Der zu bestätigende Frame wurde unmittelbar vorher gesendet
+    _ackWait.keyId = _lastTxKeyId;
+    memcpy(_ackWait.frameHmac, _lastTxHmac, RS485_HMAC_LENGTH);
+    _lastAckStatus = RS485_ACK_TIMEOUT;
+
+    unsigned long startTime = micros();
+    while (!_ackWait.done && micros() - startTime < timeoutMicros) {
+        _receiveAvailable();
+        _serviceRxPipeline();
+        _serviceTxQueue(1 << RS485_TX_CLASS_ACK, false);
+        _serviceProbeWindow();
+    }
+    _ackWait.active = false;
+
+    if (!_ackWait.done) {
+        if (_debug && !isGroupAddress(peerAddress)) _debugPrintf("DBG: ACK/NACK Timeout.\n");
+        return false; // Timeout
     }
-    if (_debug) Serial.println("DBG: ACK/NACK Timeout.");
-    return false; // Timeout
+    return _ackWait.acked;
 }
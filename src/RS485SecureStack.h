@@ -9,6 +9,10 @@
 
 // Neu hinzugefügt für die Flussrichtungssteuerung
 #include "RS485DirectionControl.h" 
+#include "RS485KeyStore.h"
+#include "RS485SessionStore.h"
+#include "RS485Compression.h"
+#include <atomic>
 
 // ==============================================================================
 // KONFIGURATION
@@ -21,6 +25,24 @@
 // Standard-Baudrate bei Start und für die Einmessung
 #define RS485_INITIAL_BAUD_RATE 9600L
 
+// Gesicherter Sitzungszustand (siehe setSessionStore()): Geänderte Baudrate bzw. Key IDs werden
+// erst gespeichert, wenn sie so lange unverändert geblieben sind (Probe-Fenster und Einmessung
+// schalten nur vorübergehend um). Kommt nach restoreSession() so lange kein gültiger Frame,
+// kehrt der Knoten zur Startbaudrate zurück, damit ihn die Einmessung des Masters wieder findet.
+#ifndef RS485_SESSION_SAVE_DELAY_MS
+#define RS485_SESSION_SAVE_DELAY_MS 3000UL
+#endif
+#ifndef RS485_SESSION_RESTORE_TIMEOUT_MS
+#define RS485_SESSION_RESTORE_TIMEOUT_MS 15000UL
+#endif
+// Mit Sitzungsspeicher sichert der Stack zusammen mit Baudrate und Key IDs eine Hochwassermarke
+// der Sendesequenz: die aktuelle Sequenz plus so viele Nummern. Nach restoreSession() geht es an
+// der Marke weiter, die jüngsten Nummern vor dem Neustart werden also übersprungen. Wegen der
+// Sendesequenz allein wird nicht geschrieben (Flash), höchstens 128.
+#ifndef RS485_SESSION_SEQUENCE_RESERVE
+#define RS485_SESSION_SEQUENCE_RESERVE 64
+#endif
+
 // Timeout für serielle Lesevorgänge in Millisekunden
 #define SERIAL_TIMEOUT_MS 10 
 
@@ -31,6 +53,60 @@
 #define RS485_TX_ENABLE_DELAY_US  150 // Verzögerung nach DE/RE HIGH, bevor Daten gesendet werden
 #define RS485_TX_DISABLE_DELAY_US 150 // Verzögerung nach letztem Byte, bevor DE/RE LOW gesetzt wird
 
+// Gestreamtes Senden und Empfangen: CRC, Byte-Stuffing und UART-Zugriff laufen in einem Durchgang.
+// Gesendet wird in Blöcken von RS485_TX_CHUNK_SIZE gestufften Bytes, der UART beginnt also schon
+// mit dem Header, während Payload und HMAC noch berechnet werden. Empfangen wird in Blöcken von
+// höchstens RS485_RX_CHUNK_SIZE Bytes, nie über das Ende des aktuellen Frames hinaus.
+#ifndef RS485_TX_CHUNK_SIZE
+#define RS485_TX_CHUNK_SIZE 32
+#endif
+#ifndef RS485_RX_CHUNK_SIZE
+#define RS485_RX_CHUNK_SIZE 64
+#endif
+
+// Optionaler Buszugriff mit Carrier Sense (siehe enableCarrierSense()): Der Bus gilt als frei, wenn
+// seit RS485_CSMA_IDLE_BIT_TIMES Bitzeiten kein Byte empfangen wurde (3,5 Zeichen wie bei Modbus RTU).
+// Ist er belegt, wartet der Sender zufällig 0 bis 2^BE-1 Slots und prüft erneut (BE von MIN bis MAX,
+// höchstens RS485_CSMA_MAX_BACKOFFS Mal). Ein Slot ist RS485_TX_ENABLE_DELAY_US plus
+// RS485_CSMA_SLOT_BIT_TIMES Bitzeiten: Umschaltzeit des Treibers und ein Zeichen bis zur Erkennung.
+#ifndef RS485_CSMA_IDLE_BIT_TIMES
+#define RS485_CSMA_IDLE_BIT_TIMES 35
+#endif
+#ifndef RS485_CSMA_SLOT_BIT_TIMES
+#define RS485_CSMA_SLOT_BIT_TIMES 12
+#endif
+#define RS485_CSMA_MIN_BACKOFF_EXPONENT 2
+#define RS485_CSMA_MAX_BACKOFF_EXPONENT 6
+#define RS485_CSMA_MAX_BACKOFFS         6
+
+// ACK-Timeouts und Wiederholungen (Jacobson/Karels-Schätzung pro Peer)
+// Solange für einen Peer noch keine RTT-Messung vorliegt, gilt der initiale Timeout.
+#define RS485_ACK_TIMEOUT_INITIAL_MS 500
+#define RS485_ACK_TIMEOUT_MIN_US     2000UL    // Untergrenze (zzgl. Sendezeit des ACK-Frames)
+#define RS485_ACK_TIMEOUT_MAX_US     2000000UL // Obergrenze, auch für den Backoff
+#define RS485_ACK_MAX_RETRIES        2         // Wiederholungen nach dem ersten Versuch
+
+// Baudraten-Probe: Wartezeit, bis alle Knoten nach einer Probe-Ankündigung umgeschaltet haben
+#define RS485_PROBE_SETTLE_MS 20
+
+// Sendewarteschlangen: maximale Tiefe je Sendeklasse (Speicher wird für jede Klasse fest reserviert)
+#ifndef RS485_TX_QUEUE_DEPTH
+#define RS485_TX_QUEUE_DEPTH 4
+#endif
+
+// Pipeline-Empfang: Anzahl der Frame-Puffer zwischen Empfangs-, Crypto- und Zustellstufe
+#ifndef RS485_RX_PIPELINE_SLOTS
+#define RS485_RX_PIPELINE_SLOTS 8
+#endif
+
+// Piggyback: So lange wartet ein eigenes ACK bzw. ein eingereihter Heartbeat auf einen ausgehenden
+// Frame, der es als Header-Erweiterung mitnimmt, bevor es einzeln gesendet wird (setPiggybackDelays())
+#define RS485_PIGGYBACK_ACK_DELAY_US       2000UL
+#define RS485_PIGGYBACK_HEARTBEAT_DELAY_MS 200UL
+
+// Anzahl der Peers, für die RTT-Schätzung und Duplikaterkennung geführt werden
+#define RS485_MAX_PEERS 16
+
 
 // ==============================================================================
 // Ende KONFIGURATION
@@ -46,16 +122,93 @@ enum RS485HeaderIndex {
     DEST_ADDRESS_INDEX,     // Zieladresse
     SENDER_ADDRESS_INDEX,   // Absenderadresse
     KEY_ID_INDEX,           // ID des verwendeten Schlüssels
+    FLAGS_INDEX,            // Header-Flags (RS485_FLAG_...)
+    SEQUENCE_INDEX,         // Sequenznummer des Absenders (bei Wiederholungen unverändert)
     // Ab hier beginnt der variabel lange Teil (IV und Payload), Länge wird in TOTAL_LENGTH_INDEX angegeben
     // (Der eigentliche Payload beginnt nach dem IV)
+    RS485_HEADER_LENGTH     // Länge des Headers in Bytes
 };
 
 // Konstanten für feste Werte im Protokoll
 const uint8_t RS485_START_BYTE_0 = 0xDE;
 const uint8_t RS485_START_BYTE_1 = 0xAD;
-const uint8_t RS485_PROTOCOL_VERSION = 0x01;
+const uint8_t RS485_PROTOCOL_VERSION = 0x06; // 0x02: Flags-Byte, 0x03: Sequenznummer im Header, 0x04: kompakte ACKs, 0x05: Header-Erweiterungen, 0x06: Payload-Kompression
 const uint8_t RS485_IV_LENGTH = 16;   // AES Blockgröße
 const uint8_t RS485_HMAC_LENGTH = 32; // SHA256 Output
+const uint8_t RS485_CRC_LENGTH = 2;
+const uint8_t RS485_BROADCAST_ADDRESS = 255;
+
+// Mindestlänge eines Pakets: Header + IV + HMAC + CRC (leerer Payload)
+const uint8_t RS485_MIN_PACKET_LENGTH = RS485_HEADER_LENGTH + RS485_IV_LENGTH + RS485_HMAC_LENGTH + RS485_CRC_LENGTH;
+// Maximale Payload-Länge: Die Gesamtlänge muss in TOTAL_LENGTH_INDEX (1 Byte) passen,
+// der Payload wird auf ganze AES-Blöcke aufgefüllt.
+const uint8_t RS485_MAX_PAYLOAD_LENGTH = ((255 - RS485_MIN_PACKET_LENGTH) / RS485_IV_LENGTH) * RS485_IV_LENGTH;
+
+// Kompakter ACK/NACK-Frame (MSG_TYPE_ACK_NACK, unverschlüsselt, feste Länge 16 Bytes):
+// Header mit SEQUENCE_INDEX = bestätigte Sequenznummer, KEY_ID_INDEX = Key ID des bestätigten Frames
+// und FLAGS_INDEX = Status (RS485AckStatus), danach ein gekürzter MAC und CRC16.
+// Der MAC ist HMAC-SHA256(Session Key, Header + HMAC des bestätigten Frames), gekürzt auf 4 Bytes.
+// Damit passt ein ACK nur zu genau dem Frame (inkl. IV), den der Sender zuletzt übertragen hat.
+const uint8_t RS485_COMPACT_ACK_MAC_LENGTH = 4;
+const uint8_t RS485_COMPACT_ACK_LENGTH = RS485_HEADER_LENGTH + RS485_COMPACT_ACK_MAC_LENGTH + RS485_CRC_LENGTH;
+
+// Header-Flags (FLAGS_INDEX)
+const uint8_t RS485_FLAG_ACK_REQUESTED = 0x01; // Sender erwartet ein ACK/NACK
+const uint8_t RS485_FLAG_RETRANSMISSION = 0x02; // Wiederholung eines Frames (gleiche Sequenznummer)
+const uint8_t RS485_FLAG_EXT_ACK = 0x04;        // Header-Erweiterung: mitgesendetes ACK/NACK
+const uint8_t RS485_FLAG_EXT_HEARTBEAT = 0x08;  // Header-Erweiterung: mitgesendeter Heartbeat
+const uint8_t RS485_FLAG_COMPRESSED = 0x10;     // Payload vor der Verschlüsselung komprimiert
+
+// Header-Erweiterungen liegen unverschlüsselt (aber vom HMAC geschützt) zwischen Header und IV,
+// in der Reihenfolge der Flags:
+// - ACK (6 Bytes): bestätigte Sequenznummer, Status (RS485AckStatus), die ersten 4 Bytes des
+//   HMAC des bestätigten Frames
+// - Heartbeat (2 + n Bytes): Message Type, Payload-Länge n, Payload (n <= RS485_EXT_HEARTBEAT_MAX_PAYLOAD)
+const uint8_t RS485_EXT_ACK_LENGTH = 6;
+const uint8_t RS485_EXT_ACK_HMAC_REF_LENGTH = 4;
+const uint8_t RS485_EXT_HEARTBEAT_MAX_PAYLOAD = 8;
+const uint8_t RS485_MAX_HEADER_EXTENSION_LENGTH = RS485_EXT_ACK_LENGTH + 2 + RS485_EXT_HEARTBEAT_MAX_PAYLOAD;
+
+// Komprimierter Payload (RS485_FLAG_COMPRESSED, siehe enableCompression()): Wörterbuch-ID (0 = keines),
+// Länge des Original-Payloads, LZ-Datenstrom (RS485Compression.h). Dahinter folgt wie immer Null-Padding
+// bis zur AES-Blockgrenze. Empfangen kann jeder Knoten, komprimiert wird nur mit enableCompression().
+const uint8_t RS485_COMPRESSION_HEADER_LENGTH = 2;
+#ifndef RS485_COMPRESSION_MAX_DICTIONARIES
+#define RS485_COMPRESSION_MAX_DICTIONARIES 4
+#endif
+
+// Sendezeitstempel in Master-Heartbeats (siehe enableHeartbeatTimestamps()): am Ende des Payloads
+// '@' und micros() des Senders beim Sendebeginn in 6 Bytes zu je 6 Bit (Bit 7 gesetzt, niederwertige
+// zuerst). Der Empfänger entfernt das Feld und legt den Wert in Packet_t ab.
+const uint8_t RS485_TIMESTAMP_MARKER = '@';
+const uint8_t RS485_TIMESTAMP_FIELD_LENGTH = 7;
+
+// Status im kompakten ACK/NACK-Frame (FLAGS_INDEX)
+enum RS485AckStatus : uint8_t {
+    RS485_ACK_OK = 0,           // Frame angenommen
+    RS485_NACK_REJECTED,        // Von der Anwendung abgelehnt
+    RS485_NACK_BUSY,            // Empfänger ausgelastet (z.B. Warteschlange voll)
+    RS485_NACK_UNSUPPORTED,     // Nachrichtentyp oder Inhalt nicht unterstützt
+    RS485_NACK_APP_FIRST = 0x80, // Ab hier anwendungsdefinierte Gründe
+    RS485_ACK_TIMEOUT = 0xFF    // Nur lokal (getLastAckStatus()): keine Antwort erhalten
+};
+
+// Multicast-Gruppenadressen: Ein Paket an eine Gruppenadresse wird von allen Mitgliedern
+// der Gruppe verarbeitet, ein Frame ersetzt damit N Unicast-Frames.
+// Der Bereich kann vor dem Include überschrieben werden.
+#ifndef RS485_GROUP_ADDRESS_FIRST
+#define RS485_GROUP_ADDRESS_FIRST 0xE0
+#endif
+#ifndef RS485_GROUP_ADDRESS_LAST
+#define RS485_GROUP_ADDRESS_LAST  0xFD
+#endif
+#define RS485_MAX_GROUPS (RS485_GROUP_ADDRESS_LAST - RS485_GROUP_ADDRESS_FIRST + 1)
+
+// Bitmap über alle 256 Adressen (z.B. für Multicast-ACKs und Gruppenmitglieder)
+#define RS485_ADDRESS_BITMAP_SIZE 32
+inline bool rs485BitmapTest(const uint8_t* bitmap, uint8_t address) { return (bitmap[address >> 3] >> (address & 7)) & 1; }
+inline void rs485BitmapSet(uint8_t* bitmap, uint8_t address) { bitmap[address >> 3] |= (1 << (address & 7)); }
+inline void rs485BitmapClear(uint8_t* bitmap, uint8_t address) { bitmap[address >> 3] &= ~(1 << (address & 7)); }
 
 // Anwendungsdefinierte Message Types (Beispiele aus RS485SecureCom App)
 // Können in der Anwendung neu definiert werden oder als Basis dienen
@@ -64,6 +217,31 @@ const uint8_t RS485_HMAC_LENGTH = 32; // SHA256 Output
 #define MSG_TYPE_KEY_UPDATE       'K'
 #define MSG_TYPE_DATA             'D'
 #define MSG_TYPE_ACK_NACK         'A' // Wird automatisch vom Stack gehandhabt bei requiresAck=true
+#define MSG_TYPE_LINK_TEST        'T' // Baudraten-Probe: Testframes, Abfrage "LQ?", Antwort "LQ:<empfangen>,<crc>,<hmac>" (vom Stack gehandhabt)
+#define MSG_TYPE_GROUP_MGMT       'G' // Gruppen-Join/-Leave ("JOIN:<gruppe>", "LEAVE:<gruppe>"), wird vom Stack gehandhabt
+#define MSG_TYPE_TELEMETRY        'S' // Abonnements und Telemetrie-Updates (RS485Telemetry.h)
+
+// Sendeklassen mit strikter Priorität (kleinerer Wert = höhere Priorität)
+enum RS485TxClass : uint8_t {
+    RS485_TX_CLASS_CONTROL = 0, // Safety/Steuerung (z.B. Key-Update, Rogue-Master-Alarm)
+    RS485_TX_CLASS_HEARTBEAT,   // Master-Heartbeat
+    RS485_TX_CLASS_ACK,         // Vom Stack erzeugte ACKs
+    RS485_TX_CLASS_BULK,        // Daten/Telemetrie
+    RS485_TX_CLASS_COUNT
+};
+
+// Verhalten bei voller Sendewarteschlange
+enum RS485DropPolicy : uint8_t {
+    RS485_DROP_NEWEST = 0, // Neue Nachricht ablehnen (queueMessage() liefert false)
+    RS485_DROP_OLDEST      // Älteste wartende Nachricht verwerfen, neue aufnehmen
+};
+
+// Status eines Frames, wie er an den Frame-Mitschnitt übergeben wird (siehe setFrameTap())
+enum RS485FrameTapStatus : uint8_t {
+    RS485_TAP_FRAME_VALID = 0, // Header, Länge und CRC gültig (HMAC ungeprüft)
+    RS485_TAP_FRAME_INVALID,   // Vollständig empfangen, aber Header, Länge oder CRC ungültig
+    RS485_TAP_FRAME_ABORTED    // Abgebrochen (unerwartetes Startbyte, ungültige Länge), nur empfangener Teil
+};
 
 class RS485SecureStack {
 public:
@@ -75,35 +253,207 @@ public:
         uint8_t destinationAddress;
         uint8_t senderAddress;
         uint8_t keyId;
+        uint8_t sequenceNumber;
         String payload;
         bool requiresAck; // Ob diese Nachricht ein ACK erwartet
         bool isAck;       // Ob diese Nachricht selbst ein ACK/NACK ist
+        bool isMulticast; // Ob die Zieladresse eine Gruppenadresse ist
         // Ergänzung für Debugging/Monitoring:
         bool hmacVerified; // True, wenn HMAC korrekt war
         bool crcVerified;  // True, wenn CRC korrekt war
+        // Zeitbezug (siehe RS485TimeSync.h):
+        unsigned long rxStartMicros; // Geschätzter Empfangsbeginn des Startbytes (lokales micros())
+        bool hasTxTimestamp;         // Heartbeat mit Sendezeitstempel
+        uint32_t txTimestampMicros;  // micros() des Senders beim Sendebeginn
+    };
+
+    // RTT-Schätzung und Zähler pro Peer (für Diagnose, siehe getPeerStats())
+    struct PeerStats_t {
+        uint8_t address;
+        uint32_t srttMicros;      // Geglättete Antwortzeit des Peers (ohne Sendezeit des ACK-Frames)
+        uint32_t rttVarMicros;    // Geglättete mittlere Abweichung
+        uint32_t lastRttMicros;   // Letzte Messung
+        uint32_t rttSamples;      // Anzahl der Messungen
+        uint32_t ackTimeouts;     // ACK-Timeouts (je Versuch)
+        uint32_t retransmissions; // Gesendete Wiederholungen
+        uint32_t duplicatesDropped; // Vom Peer empfangene, verworfene Duplikate
+    };
+
+    // Empfangsstatistik der Verbindung (alle Frames, unabhängig vom Empfänger)
+    struct LinkStats_t {
+        uint32_t framesReceived; // Frames mit gültigem CRC und HMAC
+        uint32_t crcErrors;
+        uint32_t hmacErrors;
+        uint32_t framingErrors;  // Ungültige Länge, unerwartetes Startbyte, Pufferüberlauf
+    };
+
+    // Ergebnis einer Baudraten-Probe, wie es ein Knoten auf "LQ?" zurückmeldet
+    struct LinkReport_t {
+        uint8_t senderAddress;
+        uint16_t testFramesReceived;
+        uint16_t crcErrors;
+        uint16_t hmacErrors;
+    };
+
+    // Statistik einer Sendeklasse (siehe getTxClassStats())
+    struct TxClassStats_t {
+        uint32_t enqueued;          // Aufgenommene Nachrichten
+        uint32_t sent;              // Erfolgreich gesendet (bzw. bestätigt)
+        uint32_t failed;            // Senden fehlgeschlagen oder kein ACK
+        uint32_t dropped;           // Wegen voller Warteschlange verworfen
+        uint32_t piggybacked;       // Als Header-Erweiterung eines anderen Frames mitgesendet
+        uint8_t depth;              // Aktuelle Tiefe
+        uint8_t maxDepth;           // Höchste beobachtete Tiefe
+        uint32_t lastLatencyMicros; // Wartezeit vom Einreihen bis zum Sendebeginn
+        uint32_t avgLatencyMicros;  // Geglättet (1/8)
+        uint32_t maxLatencyMicros;
+    };
+
+    // Zähler des Buszugriffs mit Carrier Sense (siehe getMediumAccessStats())
+    struct MediumAccessStats_t {
+        uint32_t immediate;           // Bus frei, sofort gesendet
+        uint32_t deferred;            // Bus belegt, erst nach Backoff gesendet
+        uint32_t backoffs;            // Backoff-Wartezeiten insgesamt (auch vor ACK-Wiederholungen)
+        uint32_t accessFailures;      // Bus nach RS485_CSMA_MAX_BACKOFFS Versuchen noch belegt, nicht gesendet
+        uint32_t suspectedCollisions; // ACK-Timeouts, die auf eine Kollision hindeuten können
+        uint32_t backoffMicrosTotal;  // Summe der Wartezeiten
+        uint32_t maxAccessMicros;     // Längste Zeit bis zum Sendebeginn
+    };
+
+    // Laufzeit und Rückstand von loop()/poll() (siehe getLoopStats())
+    struct LoopStats_t {
+        uint32_t calls;           // Aufrufe von loop() und poll()
+        uint32_t limitedCalls;    // Aufrufe, die wegen Zeitbudget oder Frame-Limit vorzeitig endeten
+        uint32_t lastFrames;      // Im letzten Aufruf verbrauchte Frames (auch CRC-/Framing-Fehler, kompakte ACKs)
+        uint32_t lastCallMicros;  // Dauer des letzten Aufrufs
+        uint32_t maxCallMicros;   // Längster Aufruf
+        uint32_t frameMicros;     // Verarbeitungszeit eines Frames (HMAC, AES, Zustellung), geglättet (1/8)
+        uint32_t maxFrameMicros;  // Längste Verarbeitung eines Frames (inkl. Callback)
+        uint16_t backlogBytes;    // Nach dem letzten Aufruf noch im UART-Puffer
+        uint16_t maxBacklogBytes;
+        uint8_t backlogFrames;    // Nach dem letzten Aufruf noch in der Pipeline wartend
+    };
+
+    // Zähler der Payload-Kompression (siehe getCompressionStats()). Kompressionsrate = bytesOut / bytesIn.
+    struct CompressionStats_t {
+        uint32_t framesCompressed;   // Komprimiert gesendet
+        uint32_t framesRaw;          // Versucht, aber unkomprimiert gesendet (kein AES-Block gespart)
+        uint32_t bytesIn;            // Payload-Bytes aller Versuche
+        uint32_t bytesOut;           // Davon tatsächlich verschlüsselt (komprimiert bzw. roh, ohne Padding)
+        uint32_t blocksSaved;        // Eingesparte AES-Blöcke zu je 16 Bytes
+        uint32_t framesDecompressed; // Komprimiert empfangen
+        uint32_t decodeErrors;       // Nicht entpackbar (z.B. unbekanntes Wörterbuch), mit NACK verworfen
+    };
+
+    // Zähler und Warteschlangentiefen des Pipeline-Empfangs (siehe getRxPipelineStats())
+    struct RxPipelineStats_t {
+        uint32_t framesIn;          // Stufe 1: CRC-gültige Frames an die Crypto-Task übergeben
+        uint32_t droppedNoSlot;     // Stufe 1: verworfen, weil alle Puffer belegt waren
+        uint32_t framesVerified;    // Stufe 2: HMAC geprüft und entschlüsselt (gezählt bei der Übernahme in loop())
+        uint32_t framesDelivered;   // Stufe 3: zugestellt (Callback/ACK-Verarbeitung)
+        uint8_t cryptoQueueDepth;   // Aktuell / maximal vor der Crypto-Task wartend
+        uint8_t cryptoQueueMaxDepth;
+        uint8_t appQueueDepth;      // Aktuell / maximal vor der Zustellung wartend (Maximum je loop()-Aufruf gemessen)
+        uint8_t appQueueMaxDepth;
+        uint8_t freeSlots;          // Aktuell / minimal freie Frame-Puffer
+        uint8_t minFreeSlots;
     };
 
     // Callback-Funktionstyp
     typedef void (*PacketReceivedCallback)(Packet_t packet);
+    // Callback mit Kontextzeiger (z.B. zur Unterscheidung mehrerer Stack-Instanzen/Busse)
+    typedef void (*PacketReceivedContextCallback)(void* context, Packet_t packet);
+    // Frame-Mitschnitt: ent-stuffter Frame (ab Startbyte), Empfangsende in micros(), RS485FrameTapStatus
+    typedef void (*FrameTapCallback)(void* context, const uint8_t* frame, size_t length, unsigned long rxMicros, uint8_t status);
 
     // NEU: Konstruktor, der ein RS485DirectionControl Objekt akzeptiert
     // Der Stack übernimmt die Verwaltung der Flussrichtung
-    RS485SecureStack(RS485DirectionControl* directionControl = nullptr);
+    // sharedKeyStore: gemeinsamer, für den Stack nur lesbarer Schlüsselspeicher (Multi-Bus),
+    // nullptr = eigener Schlüsselspeicher (8 KB auf dem Heap)
+    RS485SecureStack(RS485DirectionControl* directionControl = nullptr, RS485KeyStore* sharedKeyStore = nullptr);
+    // Beendet die Crypto-Task des Pipeline-Empfangs und gibt Pipeline, Kompressor und eigenen Schlüsselspeicher frei
+    ~RS485SecureStack();
 
-    // Initialisiert den Stack
+    // Initialisiert den Stack. Bei gemeinsamem Schlüsselspeicher wird masterKey ignoriert (nullptr zulässig).
     void begin(uint8_t myAddress, const char* masterKey, uint8_t initialKeyId, HardwareSerial& serial);
 
-    // Hauptloop-Funktion zum Empfangen von Paketen
+    // Hauptloop-Funktion zum Empfangen von Paketen. Verarbeitet alles, was im UART-Puffer steht.
     void loop();
 
+    // Wie loop(), aber mit begrenzter Arbeit je Aufruf, damit der übrige Superloop planbar bleibt.
+    // Vor jedem Empfangsblock wird geprüft, ob maxFrames erreicht ist bzw. ein weiterer Frame
+    // (geglättete Verarbeitungszeit, siehe LoopStats_t::frameMicros) das Zeitbudget überschreiten
+    // würde. Der erste Frame eines Aufrufs wird immer verarbeitet, ein einzelner Frame samt Callback
+    // wird nie unterbrochen. Nicht gelesene Bytes bleiben im UART-Puffer, ein angefangener Frame
+    // wird beim nächsten Aufruf fortgesetzt. Ein wegen des Budgets zurückgestelltes Senden kommt
+    // beim nächsten Aufruf zuerst. Jeder verbrauchte Frame zählt, auch CRC-/Framing-Fehler und
+    // kompakte ACKs. Frames mit ACK werden nur gesendet, wenn das restliche Budget den ACK-Timeout
+    // abdeckt. Gibt true zurück, wenn noch Empfangsrückstand besteht.
+    bool loop(unsigned long budgetMicros);
+    bool poll(uint8_t maxFrames);
+
+    // Empfangsrückstand: Bytes im UART-Puffer
+    size_t getRxBacklog() const { return _serial ? (size_t)_serial->available() : 0; }
+
+    const LoopStats_t& getLoopStats() const { return _loopStats; }
+    void resetLoopStats() { memset(&_loopStats, 0, sizeof(_loopStats)); }
+
     // Registriert eine Callback-Funktion, die bei jedem empfangenen und validierten Paket aufgerufen wird
     void registerReceiveCallback(PacketReceivedCallback callback);
+    void registerReceiveCallback(PacketReceivedContextCallback callback, void* context);
+
+    // Registriert einen Mitschnitt, der JEDEN empfangenen Frame vor Adressfilter und HMAC-Prüfung
+    // erhält, auch fehlerhafte und abgebrochene (z.B. für RS485BusCapture). nullptr entfernt ihn.
+    // Der Aufruf erfolgt im Kontext von loop() und darf nicht blockieren.
+    void setFrameTap(FrameTapCallback tap, void* context) { _frameTap = tap; _frameTapContext = context; }
 
     // Sendet eine Nachricht. Gibt true zurück bei Erfolg (oder wenn kein ACK erforderlich ist), false bei Fehler.
-    // Achtung: Bei requiresAck=true wartet diese Funktion auf ein ACK/NACK.
+    // Achtung: Bei requiresAck=true wartet diese Funktion auf ein ACK/NACK. Broadcasts werden nie
+    // bestätigt, an RS485_BROADCAST_ADDRESS wird requiresAck daher ignoriert.
     bool sendMessage(uint8_t destinationAddress, uint8_t senderAddress, char messageType, const String& payload, bool requiresAck);
 
-    // Setzt einen neuen Session Key für eine bestimmte Key ID
+    // Reiht eine Nachricht in die Sendewarteschlange ihrer Klasse ein. Gesendet wird aus loop(),
+    // immer zuerst aus der höchsten nicht leeren Klasse. CONTROL- und HEARTBEAT-Nachrichten ohne
+    // ACK werden auch zwischen den Wiederholungen eines laufenden ACK-Austauschs gesendet.
+    // Gruppenadressen werden per sendMulticast() gesendet. Gibt false zurück, wenn die
+    // Nachricht verworfen wurde (volle Warteschlange mit RS485_DROP_NEWEST, Payload zu lang).
+    bool queueMessage(uint8_t destinationAddress, char messageType, const String& payload, bool requiresAck,
+                      RS485TxClass txClass = RS485_TX_CLASS_BULK);
+
+    // Tiefe (max. RS485_TX_QUEUE_DEPTH) und Verwerfungsstrategie einer Sendeklasse
+    void setTxClassLimit(RS485TxClass txClass, uint8_t depthLimit, RS485DropPolicy dropPolicy);
+
+    // true, wenn queueMessage() in dieser Klasse eine Nachricht annehmen würde (Platz frei oder
+    // RS485_DROP_OLDEST). Zählt im Gegensatz zu einem fehlgeschlagenen queueMessage() nichts als verworfen.
+    bool canQueue(RS485TxClass txClass) const;
+
+    // Eingestellte Tiefe einer Sendeklasse (0 bei ungültiger Klasse). Bei Tiefe 0 nimmt die Klasse nie etwas an.
+    uint8_t getTxClassLimit(RS485TxClass txClass) const;
+
+    // Kopiert die Statistik einer Sendeklasse. Gibt false bei ungültiger Klasse zurück.
+    bool getTxClassStats(RS485TxClass txClass, TxClassStats_t& stats) const;
+
+    // Sendet eine Nachricht an eine Multicast-Gruppe (ein Frame für alle Mitglieder).
+    // Bei collectAcks=true antworten die bekannten Mitglieder zeitversetzt mit einem ACK;
+    // ackBitmap (RS485_ADDRESS_BITMAP_SIZE Bytes, optional) enthält danach die Absender der ACKs.
+    // Gibt true zurück, wenn alle bekannten Mitglieder bestätigt haben (oder kein ACK gefordert war).
+    bool sendMulticast(uint8_t groupAddress, char messageType, const String& payload, bool collectAcks, uint8_t* ackBitmap = nullptr);
+
+    // Tritt einer Multicast-Gruppe bei bzw. verlässt sie und kündigt das per Broadcast an
+    bool joinGroup(uint8_t groupAddress);
+    bool leaveGroup(uint8_t groupAddress);
+    bool isGroupMember(uint8_t groupAddress) const;
+
+    // Kopiert die bekannten Mitglieder einer Gruppe (aus beobachteten Join/Leave-Nachrichten)
+    // in memberBitmap (RS485_ADDRESS_BITMAP_SIZE Bytes). Gibt die Anzahl der Mitglieder zurück.
+    size_t getKnownGroupMembers(uint8_t groupAddress, uint8_t* memberBitmap) const;
+
+    static bool isGroupAddress(uint8_t address) {
+        return address >= RS485_GROUP_ADDRESS_FIRST && address <= RS485_GROUP_ADDRESS_LAST;
+    }
+
+    // Setzt einen neuen Session Key für eine bestimmte Key ID.
+    // Ein Key, der (noch) nicht der aktuelle ist, wird als nächster Key gesichert.
     bool setSessionKey(uint8_t keyId, const uint8_t* keyData, size_t keyLen);
 
     // Wechselt zur Verwendung eines neuen Schlüssels für ausgehende Nachrichten
@@ -118,44 +468,388 @@ public:
     // Gibt die aktuelle Baudrate zurück
     long getBaudRate() const { return _serial->baudRate(); }
 
-    // Debugging: Setzt den Debug-Modus
-    void setDebug(bool debug) { _debug = debug; }
+    // Ablage für den Sitzungszustand (z.B. NvsSessionStore), nullptr = keine Sicherung.
+    // Gesichert werden Baudrate, aktuelle und nächste Key ID samt Session Keys (mit dem Master Key
+    // verschlüsselt) und die Sequenznummer, authentisiert mit einem HMAC über den Master Key.
+    // Nach der Einstellung speichert loop() Änderungen von Baudrate und Key IDs selbst
+    // (verzögert, RS485_SESSION_SAVE_DELAY_MS).
+    void setSessionStore(RS485SessionStore* store) { _sessionStore = store; }
+
+    // Speichert den aktuellen Zustand sofort, z.B. vor einem geplanten Neustart
+    bool saveSession();
+
+    // Nach begin() aufrufen: Übernimmt einen gültigen gespeicherten Zustand (gleiche Adresse,
+    // gleicher Master Key). Der Knoten arbeitet dann sofort mit Baudrate und Schlüssel vor dem
+    // Neustart, statt auf Einmessung und Key-Update des Masters zu warten.
+    // Gibt false zurück, wenn nichts Gültiges gespeichert ist.
+    bool restoreSession();
+
+    // Löscht den gespeicherten Zustand
+    void clearSession();
+
+    // Nur im Empfangs-Callback: Das automatische ACK des gerade zugestellten Pakets wird mit
+    // diesem Status gesendet (z.B. RS485_NACK_BUSY). Ohne Aufruf wird RS485_ACK_OK gesendet.
+    // Vor einer Antwort aus dem Callback aufrufen, falls die Antwort das ACK mitnimmt.
+    void setAckStatus(uint8_t status) { if (_rxAck != nullptr) _rxAck->status = status; }
+
+    // Wartezeit eines eigenen ACKs bzw. eines eingereihten Heartbeats auf einen ausgehenden Frame,
+    // der es als Header-Erweiterung mitnimmt (0 = sofort einzeln senden, sofern kein Frame wartet)
+    void setPiggybackDelays(unsigned long ackDelayMicros, unsigned long heartbeatDelayMillis) {
+        _piggybackAckDelayMicros = ackDelayMicros;
+        _piggybackHeartbeatDelayMicros = heartbeatDelayMillis * 1000UL;
+    }
+
+    // Status der letzten ACK-Wartezeit von sendMessage(): RS485_ACK_OK, ein NACK-Grund
+    // oder RS485_ACK_TIMEOUT
+    uint8_t getLastAckStatus() const { return _lastAckStatus; }
+
+    // Anzahl der Wiederholungen, wenn kein ACK kommt (Default RS485_ACK_MAX_RETRIES)
+    void setAckRetries(uint8_t retries) { _ackMaxRetries = retries; }
+
+    // Aktueller ACK-Timeout für einen Peer (RTT-Schätzung + Sendezeit eines ACK-Frames bei der aktuellen Baudrate)
+    unsigned long getAckTimeoutMicros(uint8_t peerAddress);
+
+    // Kopiert die RTT-Schätzung und Zähler eines Peers. Gibt false zurück, wenn der Peer unbekannt ist.
+    bool getPeerStats(uint8_t peerAddress, PeerStats_t& stats) const;
+
+    // Sendezeit eines (ungestufften) Frames der gegebenen Länge bei der aktuellen Baudrate
+    unsigned long frameAirtimeMicros(size_t frameLength) const;
+
+    // Empfangsstatistik (z.B. für die Erkennung einer verschlechterten Verbindung)
+    const LinkStats_t& getLinkStats() const { return _linkStats; }
+
+    // Buszugriff mit Carrier Sense (Default: aus). Vor jedem Frame wird geprüft, ob seit idleBitTimes
+    // Bitzeiten nichts empfangen wurde; sonst folgt ein zufälliger exponentieller Backoff, während
+    // dessen normal empfangen wird. Kompakte ACKs antworten ohne Prüfung (der Bus gehört nach einem
+    // Frame dem Empfänger). Ein ACK-Timeout gilt als mögliche Kollision, vor der Wiederholung wird
+    // zusätzlich zufällig gewartet, damit die beteiligten Sender nicht erneut gleichzeitig senden.
+    void enableCarrierSense(bool enable, uint16_t idleBitTimes = RS485_CSMA_IDLE_BIT_TIMES) {
+        _csmaEnabled = enable;
+        _csmaIdleBitTimes = idleBitTimes;
+    }
+
+    // Backoff-Exponenten (Wartezeit 0 bis 2^BE-1 Slots) und Anzahl der Backoffs, bevor ein Frame
+    // mit Fehler verworfen wird
+    void setCarrierSenseBackoff(uint8_t minExponent, uint8_t maxExponent, uint8_t maxBackoffs);
+
+    // true, wenn seit der Ruhezeit keine Bytes empfangen wurden und keine im UART-Puffer warten
+    bool isBusIdle();
+
+    const MediumAccessStats_t& getMediumAccessStats() const { return _mediumAccessStats; }
+    void resetMediumAccessStats() { memset(&_mediumAccessStats, 0, sizeof(_mediumAccessStats)); }
+
+    // Master: Jeder gesendete Heartbeat (MSG_TYPE_MASTER_HEARTBEAT) trägt micros() beim Sendebeginn,
+    // auch als Header-Erweiterung. Empfänger werten ihn mit RS485TimeSync aus.
+    void enableHeartbeatTimestamps(bool enable) { _heartbeatTimestamps = enable; }
+
+    // Optionale Kompression vor der Verschlüsselung (LZ, siehe RS485Compression.h). Payloads über
+    // einem AES-Block werden ohne und mit jedem Preset-Wörterbuch komprimiert, gesendet wird das
+    // kürzeste Ergebnis, aber nur, wenn es mindestens einen AES-Block spart, sonst roh. Master-
+    // Heartbeats mit Zeitstempel bleiben roh. Der Arbeitsspeicher (gut 2 KB) wird beim ersten
+    // Einschalten angelegt, gibt false zurück, wenn er nicht verfügbar ist.
+    bool enableCompression(bool enable);
+
+    // Preset-Wörterbuch (id 1..255, höchstens RS485_COMPRESSION_MAX_DICTIONARY_LENGTH Bytes), z.B.
+    // häufige Schlüsselwörter der Statusmeldungen. Alle Knoten brauchen dieselben Wörterbücher unter
+    // derselben ID. Der Speicher muss gültig bleiben. Entpackt wird immer im loop()-Kontext.
+    bool addCompressionDictionary(uint8_t id, const uint8_t* data, size_t length);
+
+    const CompressionStats_t& getCompressionStats() const { return _compressionStats; }
+    void resetCompressionStats() { memset(&_compressionStats, 0, sizeof(_compressionStats)); }
+
+    // Holt die zuletzt empfangene Probe-Rückmeldung ("LQ:...") eines Knotens ab.
+    // Gibt false zurück, wenn (noch) keine Rückmeldung dieses Knotens vorliegt.
+    bool takeLinkReport(uint8_t senderAddress, LinkReport_t& report);
+
+    // Optionaler Pipeline-Empfang (ESP32): loop() erledigt nur Framing, Unstuffing und CRC und
+    // übergibt den Frame an eine Crypto-Task auf workerCore (HMAC, Entschlüsselung). Zustellung
+    // und Callback laufen wieder in loop(). Die Frame-Puffer (RS485_RX_PIPELINE_SLOTS) werden
+    // einmalig angelegt. Gibt false zurück, wenn Speicher oder Task nicht verfügbar sind.
+    // Die Crypto-Task prüft nur HMAC und entschlüsselt; Entpacken, Debug-Ausgaben und Statistik
+    // bleiben in loop().
+    bool enablePipelinedReceive(BaseType_t workerCore = 0, UBaseType_t workerPriority = 3);
+
+    // Schaltet den Pipeline-Empfang ab: wartet, bis die Crypto-Task ihre Frames geprüft und sich
+    // beendet hat, stellt die noch wartenden Frames zu und gibt die Puffer frei. Aus dem
+    // loop()-Kontext aufrufen, nicht aus dem Empfangs-Callback.
+    void disablePipelinedReceive();
+
+    // Kopiert Zähler und Warteschlangentiefen der Pipeline. false, wenn sie nicht aktiv ist.
+    bool getRxPipelineStats(RxPipelineStats_t& stats) const;
+
+    // Debugging: Setzt den Debug-Modus. tag (optional) wird jeder Ausgabezeile vorangestellt,
+    // z.B. der Busname bei mehreren Instanzen; der String muss gültig bleiben.
+    void setDebug(bool debug, const char* tag = nullptr) { _debug = debug; _debugTag = tag; }
 
 private:
     HardwareSerial* _serial;
     uint8_t _myAddress;
-    uint8_t _masterKey[32];      // SHA256-Hash des Master-Schlüssels
-    uint8_t _sessionKeys[256][32]; // 256 mögliche Session Keys (Key ID 0-255)
+    RS485KeyStore* _ownKeyStore; // Eigener Schlüsselspeicher (8 KB, nur ohne gemeinsamen Speicher angelegt)
+    RS485KeyStore* _keyStore;    // Aktiver Schlüsselspeicher
     uint8_t _currentKeyId;       // Aktuell verwendete Key ID
 
     PacketReceivedCallback _packetReceivedCallback = nullptr;
+    PacketReceivedContextCallback _packetReceivedContextCallback = nullptr;
+    void* _callbackContext = nullptr;
+    FrameTapCallback _frameTap = nullptr;
+    void* _frameTapContext = nullptr;
 
-    // Byte-Stuffing Puffer
-    uint8_t _stuffedPacketBuffer[MAX_PACKET_SIZE * 2]; // Worst case 2x Größe für Stuffing
-    uint8_t _unstuffedPacketBuffer[MAX_PACKET_SIZE];
+    // Sendeblock für gestuffte Bytes und laufende CRC des Frames im Versand
+    uint8_t _txChunk[RS485_TX_CHUNK_SIZE];
+    size_t _txChunkPos = 0;
+    uint16_t _txCrc = 0;
 
-    uint8_t _receiveBuffer[MAX_PACKET_SIZE * 2]; // Puffer für eingehende gestuffte Bytes
+    uint8_t _receiveBuffer[MAX_PACKET_SIZE]; // Puffer für eingehende, bereits ent-stuffte Bytes
     size_t _receiveBufferPos = 0;
+    bool _receiveEscapePending = false;      // Letztes Byte war ein Escape-Byte
+    uint16_t _receiveCrc = 0;                // Laufende CRC über die empfangenen Bytes (ohne CRC-Feld)
+
+    // Empfangsbeginn des aktuellen Frames: Lesezeitpunkt des Blocks minus Sendezeit der Bytes,
+    // die ab dem Startbyte schon im UART-Puffer standen
+    unsigned long _rxReadMicros = 0;         // micros() beim letzten available()
+    size_t _rxReadAvailable = 0;             // Damals verfügbare Bytes
+    size_t _rxChunkIndex = 0;                // Position des aktuellen Bytes im gelesenen Block
+    unsigned long _rxFrameStartMicros = 0;
+    void _captureFrameStart();
+
+    bool _heartbeatTimestamps = false;
+
+    // Payload-Kompression: Preset-Wörterbücher (id 0 = frei) und Arbeitsspeicher des Kompressors
+    struct CompressionDictionary_t {
+        uint8_t id;
+        const uint8_t* data;
+        size_t length;
+    };
+    CompressionDictionary_t _compressionDictionaries[RS485_COMPRESSION_MAX_DICTIONARIES];
+    bool _compressionEnabled = false;
+    RS485CompressionState_t* _compressionState = nullptr;
+    CompressionStats_t _compressionStats;
+    size_t _compressPayload(const uint8_t* payload, size_t length, uint8_t* output, bool countStats);
+    bool _decompressPayload(const uint8_t* data, size_t length, char* payloadOut) const;
+
+    // Multicast: eigene Mitgliedschaften und die beobachteten Mitglieder aller Gruppen
+    uint8_t _groupMembership[(RS485_MAX_GROUPS + 7) / 8];
+    uint8_t _knownGroupMembers[RS485_MAX_GROUPS][RS485_ADDRESS_BITMAP_SIZE];
+
+    // Zustand während auf ACK/NACKs gewartet wird (wird in _extractPacket ausgewertet)
+    struct AckWait_t {
+        bool active;
+        bool done;
+        bool acked;
+        uint8_t peerAddress;   // Unicast: erwarteter Absender, Multicast: Gruppenadresse
+        size_t expectedAcks;   // Multicast: Anzahl der erwarteten ACKs
+        size_t ackCount;
+        uint8_t ackBitmap[RS485_ADDRESS_BITMAP_SIZE];
+        uint8_t sequence;      // Sequenznummer, Key ID und HMAC des zu bestätigenden Frames
+        uint8_t keyId;
+        uint8_t frameHmac[RS485_HMAC_LENGTH];
+    } _ackWait;
+
+    // Peer-Tabelle: RTT-Schätzung (Sender) und letzte Sequenznummer (Empfänger, Duplikaterkennung)
+    struct PeerEntry_t {
+        bool used;
+        bool hasRxSequence;
+        uint8_t lastRxSequence;
+        uint8_t lastRxAckStatus; // Status, mit dem lastRxSequence bestätigt wurde (auch für Duplikate)
+        unsigned long lastActivityMillis;
+        PeerStats_t stats;
+    } _peers[RS485_MAX_PEERS];
+
+    LinkStats_t _linkStats;
+
+    // Buszugriff mit Carrier Sense
+    bool _csmaEnabled = false;
+    uint16_t _csmaIdleBitTimes = RS485_CSMA_IDLE_BIT_TIMES;
+    uint8_t _csmaMinExponent = RS485_CSMA_MIN_BACKOFF_EXPONENT;
+    uint8_t _csmaMaxExponent = RS485_CSMA_MAX_BACKOFF_EXPONENT;
+    uint8_t _csmaMaxBackoffs = RS485_CSMA_MAX_BACKOFFS;
+    unsigned long _lastRxActivityMicros = 0; // Zuletzt Bytes vom UART gelesen
+    MediumAccessStats_t _mediumAccessStats;
+    bool _acquireBus();
+
+    // Begrenzte Arbeit je loop()-Aufruf (0 = unbegrenzt). Gilt nur für den Empfang aus
+    // loop()/poll() selbst, nie beim Warten auf ein ACK.
+    unsigned long _loopStartMicros = 0;
+    unsigned long _loopBudgetMicros = 0;
+    uint32_t _loopMaxFrames = 0;
+    uint32_t _loopFramesAtStart = 0;
+    uint32_t _framesProcessed = 0; // Verbrauchte Frames (laufend): zugestellt, fehlerhaft oder kompaktes ACK
+    bool _loopTxDeferred = false;
+    bool _loopLimitHit = false;
+    bool _loopReadStarted = false; // In diesem Aufruf wurde schon ein Block gelesen bzw. zugestellt
+    LoopStats_t _loopStats;
+    bool _runLoop(unsigned long budgetMicros, uint32_t maxFrames);
+    bool _loopLimitReached() const;
+    bool _loopAckWaitFits(uint8_t destinationAddress);
+    void _noteFrameProcessed(unsigned long startMicros);
+    void _noteFrameConsumed() { _framesProcessed++; }
+    void _csmaBackoff(uint8_t exponent);
+
+    // Baudraten-Probe (Knotenseite): Nach "PROBE:<baud>:<fensterMs>" wird für die Dauer des
+    // Fensters auf die Testbaudrate umgeschaltet, danach automatisch zurück auf die Basisrate.
+    struct ProbeState_t {
+        bool active;
+        long baseBaudRate;
+        unsigned long startMillis;
+        unsigned long windowMs;
+        uint16_t testFramesReceived;
+        LinkStats_t statsAtStart;
+    } _probe;
+
+    // Zuletzt empfangene Probe-Rückmeldung (Masterseite)
+    bool _linkReportValid = false;
+    LinkReport_t _linkReport;
+
+    uint8_t _txSequence = 0;                       // Sequenznummer des nächsten eigenen Frames
+
+    // Sitzungszustand (siehe setSessionStore())
+    struct SessionState_t {
+        long baudRate;
+        uint8_t currentKeyId;
+        uint8_t nextKeyId;
+        bool hasNextKey;
+    };
+    RS485SessionStore* _sessionStore = nullptr;
+    long _configuredBaudRate = RS485_INITIAL_BAUD_RATE; // Zuletzt eingestellte (nicht gemessene) Baudrate
+    bool _hasNextKey = false;
+    uint8_t _nextKeyId = 0;
+    SessionState_t _sessionSaved = {};             // Zuletzt gespeicherter bzw. geladener Zustand
+    SessionState_t _sessionObserved = {};          // Zuletzt beobachtete Abweichung davon
+    bool _sessionChangePending = false;
+    unsigned long _sessionChangeMillis = 0;        // Seit wann der Zustand vom gespeicherten abweicht
+    bool _sessionRestorePending = false;           // Wiederhergestellt, noch kein vollständig authentifizierter Frame
+    unsigned long _sessionRestoreMillis = 0;
+    uint8_t _ackMaxRetries = RS485_ACK_MAX_RETRIES;
+    unsigned long _lastTxDoneMicros = 0;          // Ende der letzten eigenen Übertragung
+    unsigned long _lastAckRxMicros = 0;           // Empfangsende des zuletzt erkannten ACKs
+    uint8_t _lastAckLength = 0;                   // Länge des zuletzt erkannten ACK-Frames
+    uint8_t _lastAckStatus = RS485_ACK_OK;        // Status der letzten ACK-Wartezeit
+    unsigned long _piggybackAckDelayMicros = RS485_PIGGYBACK_ACK_DELAY_US;
+    unsigned long _piggybackHeartbeatDelayMicros = RS485_PIGGYBACK_HEARTBEAT_DELAY_MS * 1000UL;
+
+    // ACK des gerade zugestellten Pakets (gültig während des Callbacks, bei verschachtelter
+    // Zustellung das der innersten). Eine Antwort an den Absender nimmt es als Header-Erweiterung mit.
+    struct RxAckContext_t {
+        bool pending;          // ACK erforderlich und noch nicht gesendet
+        uint8_t peerAddress;
+        uint8_t keyId;
+        uint8_t sequence;
+        uint8_t status;
+        uint8_t frameHmac[RS485_HMAC_LENGTH];
+    };
+    RxAckContext_t* _rxAck = nullptr;
+    // Sequenznummer, Key ID und HMAC des zuletzt gesendeten Frames (Bezug für kompakte ACKs)
+    uint8_t _lastTxSequence = 0;
+    uint8_t _lastTxKeyId = 0;
+    uint8_t _lastTxHmac[RS485_HMAC_LENGTH];
+
+    // Sendewarteschlangen (Ringpuffer fester Größe je Klasse). ACKs liegen in der ACK-Klasse,
+    // Multicast-ACKs mit notBeforeMicros = Beginn ihres Zeitschlitzes. Bei kompakten ACKs
+    // enthält payload den HMAC des bestätigten Frames.
+    struct TxQueueEntry_t {
+        uint8_t destinationAddress;
+        char messageType;
+        bool requiresAck;
+        bool compactAck;
+        bool cancelled;        // Per Header-Erweiterung mitgesendet, wird beim Entnehmen übersprungen
+        uint8_t ackSequence;   // Kompaktes ACK: bestätigte Sequenznummer, Key ID und Status
+        uint8_t ackKeyId;
+        uint8_t ackStatus;
+        unsigned long notBeforeMicros; // Frühester Sendezeitpunkt, Bezug für die Wartezeit
+        char payload[RS485_MAX_PAYLOAD_LENGTH + 1];
+    };
+    struct TxQueue_t {
+        TxQueueEntry_t entries[RS485_TX_QUEUE_DEPTH];
+        uint8_t head;
+        uint8_t count;
+        uint8_t depthLimit;
+        RS485DropPolicy dropPolicy;
+        TxClassStats_t stats;
+    } _txQueues[RS485_TX_CLASS_COUNT];
+
+    // Pipeline-Empfang: Frame-Puffer, freie Puffer (nur loop()-Kontext) und zwei lock-freie
+    // Ringe (Empfang -> Crypto-Task, Crypto-Task -> Zustellung) mit Slot-Indizes
+    struct RxSlot_t {
+        uint8_t frame[MAX_PACKET_SIZE];
+        char payload[RS485_MAX_PAYLOAD_LENGTH + 1];
+        bool hmacVerified;
+        unsigned long rxMicros;     // Empfangsende des Frames (Stufe 1)
+        unsigned long rxStartMicros; // Empfangsbeginn (Startbyte)
+    };
+    struct RxRing_t {
+        uint8_t slots[RS485_RX_PIPELINE_SLOTS + 1];
+        std::atomic<uint8_t> head{0}; // Nur vom Produzenten geschrieben
+        std::atomic<uint8_t> tail{0}; // Nur vom Konsumenten geschrieben
+        bool push(uint8_t slot);
+        bool pop(uint8_t& slot);
+        uint8_t depth() const;
+    };
+    struct RxPipeline_t {
+        RxSlot_t slots[RS485_RX_PIPELINE_SLOTS];
+        uint8_t freeSlots[RS485_RX_PIPELINE_SLOTS];
+        uint8_t freeCount;
+        RxRing_t toCrypto;
+        RxRing_t toApp;
+        TaskHandle_t cryptoTask;
+        RS485SecureStack* owner;
+        RxPipelineStats_t stats;
+        std::atomic<bool> stopRequested{false}; // loop() -> Crypto-Task: beenden
+        std::atomic<bool> stopped{false};       // Crypto-Task -> loop(): greift nicht mehr zu
+    };
+    RxPipeline_t* _rxPipeline = nullptr;
 
     // Neu: Zeiger auf das DirectionControl-Objekt
     RS485DirectionControl* _directionControl; 
 
     bool _debug = false; // Debug-Ausgaben aktivieren/deaktivieren
+    const char* _debugTag = nullptr;
 
     // Hilfsfunktionen
+    void _debugPrintf(const char* format, ...);
     void _resetReceiveBuffer();
     bool _isStartByte(uint8_t byte);
+    void _receiveAvailable(bool limited = false);
+    void _processIncomingBytes(const uint8_t* data, size_t length);
+    void _processIncomingByte(uint8_t incomingByte);
+    void _storeReceivedByte(uint8_t byte);
     bool _extractPacket();
-    uint16_t _calculateCRC16(const uint8_t* data, size_t length);
+    bool _checkFrame(const uint8_t* frame, size_t packetLength, uint16_t calculatedCrc);
+    bool _authenticateFrame(const uint8_t* frame, char* payloadOut);
+    void _dispatchFrame(const uint8_t* frame, const char* payload, bool hmacVerified, unsigned long rxMicros, unsigned long rxStartMicros);
+    bool _submitToRxPipeline(const uint8_t* frame, unsigned long rxMicros, unsigned long rxStartMicros);
+    void _serviceRxPipeline(bool limited = false);
+    void _stopRxPipeline(bool deliverPending);
+    static void _rxCryptoTaskEntry(void* parameter);
+    bool _sendFrame(uint8_t destinationAddress, uint8_t senderAddress, char messageType, const String& payload, uint8_t flags, uint8_t sequence);
+    bool _sendCompactAck(const TxQueueEntry_t& entry);
+    void _transmitFrame(const uint8_t* rawPacket, size_t length);
+    void _txBegin();
+    void _txStream(const uint8_t* data, size_t length, bool updateCrc = true);
+    void _txFlushChunk();
+    void _txEnd();
+    void _calculateCompactAckMac(const uint8_t* ackHeader, const uint8_t* ackedFrameHmac, uint8_t* macOut);
+    void _handleCompactAck(const uint8_t* frame, unsigned long rxMicros);
+    void _acceptAck(uint8_t senderAddress, uint8_t status, unsigned long rxMicros, uint8_t frameLength);
+    int _headerExtensionLength(const uint8_t* frame) const;
+    size_t _buildHeaderExtension(uint8_t destinationAddress, char messageType, size_t frameLength, uint8_t& flags, uint8_t* extension, size_t& timestampOffset);
+    void _deliverPacket(const Packet_t& packet);
     void _generateIV(uint8_t* iv);
     void _encryptAES(uint8_t* data, size_t len, const uint8_t* key, const uint8_t* iv);
     void _decryptAES(uint8_t* data, size_t len, const uint8_t* key, const uint8_t* iv);
     void _calculateHMAC(const uint8_t* key, const uint8_t* data, size_t dataLen, uint8_t* hmacResult);
-    size_t _byteStuff(const uint8_t* source, size_t sourceLen, uint8_t* destination);
-    size_t _byteUnstuff(const uint8_t* source, size_t sourceLen, uint8_t* destination);
-    bool _sendAck(uint8_t destinationAddress, uint8_t senderAddress, uint8_t keyId);
-    bool _sendNack(uint8_t destinationAddress, uint8_t senderAddress, uint8_t keyId, const char* reason);
-    bool _waitForAck(long timeoutMs); // Wartet auf ein ACK/NACK
+    bool _sendAck(uint8_t destinationAddress, uint8_t keyId, uint8_t sequence, const uint8_t* frameHmac, uint8_t status, unsigned long notBeforeMicros);
+    TxQueueEntry_t* _allocTxEntry(RS485TxClass txClass);
+    bool _enqueueTx(RS485TxClass txClass, uint8_t destinationAddress, char messageType, const String& payload, bool requiresAck, unsigned long notBeforeMicros);
+    bool _serviceTxQueue(uint8_t classMask, bool allowAckWait);
+    bool _waitForAck(uint8_t peerAddress, unsigned long timeoutMicros, size_t expectedAcks = 1); // Wartet auf ein ACK/NACK von peerAddress (oder Gruppe)
+    PeerEntry_t* _findPeer(uint8_t address, bool create);
+    void _updateRtt(PeerEntry_t& peer, uint32_t sampleMicros);
+    void _handleGroupMessage(uint8_t senderAddress, const String& payload);
+    void _handleProbeMessage(const Packet_t& packet);
+    void _serviceProbeWindow();
+    void _serviceSession();
+    SessionState_t _currentSessionState() const;
+    unsigned long _multicastAckSlotMicros() const;
 };
 
 #endif // RS485_SECURE_STACK_H
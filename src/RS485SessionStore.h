@@ -0,0 +1,19 @@
+#ifndef RS485_SESSION_STORE_H
+#define RS485_SESSION_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ablage für den gesicherten Sitzungszustand von RS485SecureStack (saveSession()/restoreSession()).
+// Der Stack übergibt einen fertigen, authentisierten Datensatz fester Länge; die Ablage speichert
+// ihn nur. Implementierungen: NvsSessionStore (ESP32), FileSessionStore (Datei, z.B. Host).
+class RS485SessionStore {
+public:
+    virtual ~RS485SessionStore() = default;
+    // Liest genau length Bytes. false, wenn nichts oder ein Datensatz anderer Länge gespeichert ist.
+    virtual bool load(uint8_t* data, size_t length) = 0;
+    virtual bool save(const uint8_t* data, size_t length) = 0;
+    virtual void clear() = 0;
+};
+
+#endif // RS485_SESSION_STORE_H
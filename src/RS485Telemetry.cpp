@@ -0,0 +1,461 @@
+#include "RS485Telemetry.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Längster kodierter Eintrag: Punkt-Byte + 32 Bit in 6-Bit-Gruppen
+#define TELEMETRY_MAX_ENTRY_LENGTH 7
+
+// Wert zigzag-kodiert in 6-Bit-Gruppen, jedes Byte mit gesetztem Bit 7 (nie 0x00)
+static size_t telemetryEncodeValue(int32_t raw, char* out) {
+    uint32_t value = ((uint32_t)raw << 1) ^ (uint32_t)(raw >> 31);
+    size_t length = 0;
+    do {
+        uint8_t byte = 0x80 | (value & 0x3F);
+        value >>= 6;
+        if (value != 0) byte |= 0x40;
+        out[length++] = (char)byte;
+    } while (value != 0);
+    return length;
+}
+
+// Gibt die Anzahl gelesener Bytes zurück, 0 bei einem abgeschnittenen oder ungültigen Wert
+static size_t telemetryDecodeValue(const uint8_t* data, size_t length, int32_t& raw) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < length && i < TELEMETRY_MAX_ENTRY_LENGTH - 1; ++i) {
+        if ((data[i] & 0x80) == 0) {
+            return 0;
+        }
+        value |= (uint32_t)(data[i] & 0x3F) << (6 * i);
+        if ((data[i] & 0x40) == 0) {
+            raw = (int32_t)((value >> 1) ^ (~(value & 1) + 1));
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static int32_t telemetryFloatToRaw(float value) {
+    int32_t raw;
+    memcpy(&raw, &value, sizeof(raw));
+    return raw;
+}
+
+static float telemetryRawToFloat(int32_t raw) {
+    float value;
+    memcpy(&value, &raw, sizeof(value));
+    return value;
+}
+
+// ==============================================================================
+// TelemetryPublisher
+// ==============================================================================
+
+TelemetryPublisher::TelemetryPublisher()
+    : _secureStack(nullptr),
+      _myAddress(0),
+      _pointCount(0)
+{
+    memset(_points, 0, sizeof(_points));
+    memset(_subscriptions, 0, sizeof(_subscriptions));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void TelemetryPublisher::begin(RS485SecureStack* secureStackInstance, uint8_t myAddress) {
+    _secureStack = secureStackInstance;
+    _myAddress = myAddress;
+
+    if (!_secureStack) {
+        Serial.println("Warnung: TelemetryPublisher::begin - secureStack ist nullptr!");
+    }
+}
+
+bool TelemetryPublisher::addPoint(uint8_t pointId, TelemetryType type) {
+    if (pointId > TELEMETRY_MAX_POINT_ID) {
+        return false;
+    }
+    Point_t* point = _findPoint(pointId);
+    if (point != nullptr) {
+        point->type = type;
+        return true;
+    }
+    if (_pointCount >= TELEMETRY_MAX_POINTS) {
+        Serial.printf("TelemetryPublisher: Punkt-Tabelle voll, Punkt %d nicht aufgenommen.\n", pointId);
+        return false;
+    }
+    point = &_points[_pointCount++];
+    memset(point, 0, sizeof(*point));
+    point->id = pointId;
+    point->type = type;
+    return true;
+}
+
+void TelemetryPublisher::setValue(uint8_t pointId, int32_t value) {
+    _setRaw(pointId, value);
+}
+
+void TelemetryPublisher::setValue(uint8_t pointId, float value) {
+    _setRaw(pointId, telemetryFloatToRaw(value));
+}
+
+void TelemetryPublisher::setValue(uint8_t pointId, bool value) {
+    _setRaw(pointId, value ? 1 : 0);
+}
+
+void TelemetryPublisher::_setRaw(uint8_t pointId, int32_t raw) {
+    Point_t* point = _findPoint(pointId);
+    if (point != nullptr) {
+        point->raw = raw;
+        point->valid = true;
+    }
+}
+
+void TelemetryPublisher::update() {
+    if (!_secureStack) {
+        return;
+    }
+    unsigned long now = millis();
+    bool handled[TELEMETRY_MAX_SUBSCRIPTIONS] = { false };
+
+    // Je Abonnent ein Frame mit allen fälligen Werten
+    for (size_t i = 0; i < TELEMETRY_MAX_SUBSCRIPTIONS; ++i) {
+        if (!_subscriptions[i].used || handled[i]) {
+            continue;
+        }
+        uint8_t subscriber = _subscriptions[i].subscriber;
+        char payload[RS485_MAX_PAYLOAD_LENGTH + 1];
+        size_t length = 0;
+        payload[length++] = TELEMETRY_UPDATE_MARKER;
+        size_t included[TELEMETRY_MAX_SUBSCRIPTIONS];
+        size_t includedCount = 0;
+
+        for (size_t j = i; j < TELEMETRY_MAX_SUBSCRIPTIONS; ++j) {
+            Subscription_t& subscription = _subscriptions[j];
+            if (!subscription.used || subscription.subscriber != subscriber) {
+                continue;
+            }
+            handled[j] = true;
+            // Passt der Wert nicht mehr in den Frame, wird er beim nächsten Aufruf geprüft
+            if (length + TELEMETRY_MAX_ENTRY_LENGTH > RS485_MAX_PAYLOAD_LENGTH || !_isDue(subscription, now)) {
+                continue;
+            }
+            const Point_t& point = _points[subscription.pointIndex];
+            payload[length++] = (char)(0x80 | point.id);
+            length += telemetryEncodeValue(point.raw, &payload[length]);
+            included[includedCount++] = j;
+        }
+        if (includedCount == 0) {
+            continue;
+        }
+
+        payload[length] = '\0';
+        if (!_secureStack->sendMessage(subscriber, _myAddress, MSG_TYPE_TELEMETRY, payload, false)) {
+            continue; // Bleibt fällig und wird beim nächsten Aufruf erneut gesendet
+        }
+        _stats.updateFrames++;
+        _stats.valuesSent += includedCount;
+        for (size_t k = 0; k < includedCount; ++k) {
+            Subscription_t& subscription = _subscriptions[included[k]];
+            subscription.sent = true;
+            subscription.lastSentRaw = _points[subscription.pointIndex].raw;
+            subscription.lastSentMillis = now;
+            subscription.lastCheckMillis = now;
+        }
+    }
+}
+
+// Fällig ist ein Wert, der noch nie gesendet wurde, dessen maximales Intervall abgelaufen ist oder
+// der sich um mehr als das Deadband geändert hat. Geprüft wird höchstens einmal je Periode.
+bool TelemetryPublisher::_isDue(Subscription_t& subscription, unsigned long now) {
+    const Point_t& point = _points[subscription.pointIndex];
+    if (!point.valid) {
+        return false;
+    }
+    if (!subscription.sent) {
+        return true;
+    }
+    if (now - subscription.lastCheckMillis < subscription.periodMs) {
+        return false;
+    }
+    subscription.lastCheckMillis = now;
+    if (now - subscription.lastSentMillis >= subscription.maxIntervalMs) {
+        return true;
+    }
+
+    bool changed;
+    switch (point.type) {
+        case TELEMETRY_TYPE_FLOAT:
+            changed = fabsf(telemetryRawToFloat(point.raw) - telemetryRawToFloat(subscription.lastSentRaw)) > subscription.deadband;
+            break;
+        case TELEMETRY_TYPE_INT:
+            changed = fabs((double)point.raw - (double)subscription.lastSentRaw) > subscription.deadband;
+            break;
+        default:
+            changed = point.raw != subscription.lastSentRaw;
+            break;
+    }
+    if (!changed) {
+        _stats.valuesSuppressed++;
+    }
+    return changed;
+}
+
+bool TelemetryPublisher::handlePacket(const RS485SecureStack::Packet_t& packet) {
+    if (packet.messageType != MSG_TYPE_TELEMETRY || packet.destinationAddress != _myAddress ||
+        !packet.hmacVerified || !packet.crcVerified) {
+        return false;
+    }
+    const char* payload = packet.payload.c_str();
+    if (strncmp(payload, TELEMETRY_SUBSCRIBE_PREFIX, strlen(TELEMETRY_SUBSCRIBE_PREFIX)) == 0) {
+        _handleSubscribe(packet.senderAddress, payload + strlen(TELEMETRY_SUBSCRIBE_PREFIX));
+        return true;
+    }
+    if (strncmp(payload, TELEMETRY_UNSUBSCRIBE_PREFIX, strlen(TELEMETRY_UNSUBSCRIBE_PREFIX)) == 0) {
+        _handleUnsubscribe(packet.senderAddress, payload + strlen(TELEMETRY_UNSUBSCRIBE_PREFIX));
+        return true;
+    }
+    return false;
+}
+
+// "<punkt>,<typ>,<periodeMs>,<maxIntervallMs>,<deadband>". Ein bestehendes Abonnement desselben
+// Abonnenten wird überschrieben und sofort mit dem aktuellen Wert beantwortet.
+void TelemetryPublisher::_handleSubscribe(uint8_t subscriber, const char* arguments) {
+    char* end;
+    long pointId = strtol(arguments, &end, 10);
+    long type = (*end == ',') ? strtol(end + 1, &end, 10) : -1;
+    unsigned long periodMs = (*end == ',') ? strtoul(end + 1, &end, 10) : 0;
+    unsigned long maxIntervalMs = (*end == ',') ? strtoul(end + 1, &end, 10) : 0;
+    bool complete = (*end == ',');
+    float deadband = complete ? (float)strtod(end + 1, &end) : 0.0f;
+
+    size_t pointIndex;
+    Point_t* point = (complete && pointId >= 0 && pointId <= TELEMETRY_MAX_POINT_ID) ? _findPoint((uint8_t)pointId, &pointIndex) : nullptr;
+    if (point == nullptr || point->type != type) {
+        _stats.subscriptionsRejected++;
+        _secureStack->setAckStatus(RS485_NACK_UNSUPPORTED);
+        return;
+    }
+
+    Subscription_t* slot = nullptr;
+    for (size_t i = 0; i < TELEMETRY_MAX_SUBSCRIPTIONS; ++i) {
+        Subscription_t& subscription = _subscriptions[i];
+        if (subscription.used && subscription.subscriber == subscriber && subscription.pointIndex == pointIndex) {
+            slot = &subscription;
+            break;
+        }
+        if (!subscription.used && slot == nullptr) {
+            slot = &subscription;
+        }
+    }
+    if (slot == nullptr) {
+        _stats.subscriptionsRejected++;
+        _secureStack->setAckStatus(RS485_NACK_BUSY);
+        return;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    slot->subscriber = subscriber;
+    slot->pointIndex = (uint8_t)pointIndex;
+    slot->periodMs = periodMs;
+    slot->maxIntervalMs = maxIntervalMs;
+    slot->deadband = deadband < 0.0f ? 0.0f : deadband;
+}
+
+// "<punkt>" oder "*" für alle Abonnements des Absenders
+void TelemetryPublisher::_handleUnsubscribe(uint8_t subscriber, const char* arguments) {
+    bool all = (arguments[0] == '*');
+    long pointId = all ? -1 : strtol(arguments, nullptr, 10);
+    for (size_t i = 0; i < TELEMETRY_MAX_SUBSCRIPTIONS; ++i) {
+        Subscription_t& subscription = _subscriptions[i];
+        if (subscription.used && subscription.subscriber == subscriber &&
+            (all || _points[subscription.pointIndex].id == pointId)) {
+            subscription.used = false;
+        }
+    }
+}
+
+size_t TelemetryPublisher::getSubscriptionCount() const {
+    size_t count = 0;
+    for (size_t i = 0; i < TELEMETRY_MAX_SUBSCRIPTIONS; ++i) {
+        if (_subscriptions[i].used) count++;
+    }
+    return count;
+}
+
+TelemetryPublisher::Point_t* TelemetryPublisher::_findPoint(uint8_t pointId, size_t* index) {
+    for (size_t i = 0; i < _pointCount; ++i) {
+        if (_points[i].id == pointId) {
+            if (index != nullptr) *index = i;
+            return &_points[i];
+        }
+    }
+    return nullptr;
+}
+
+// ==============================================================================
+// TelemetrySubscriber
+// ==============================================================================
+
+float TelemetrySubscriber::Point_t::asFloat() const {
+    if (type == TELEMETRY_TYPE_FLOAT) {
+        return telemetryRawToFloat(raw);
+    }
+    return (float)raw;
+}
+
+TelemetrySubscriber::TelemetrySubscriber()
+    : _secureStack(nullptr),
+      _myAddress(0),
+      _callback(nullptr),
+      _callbackContext(nullptr),
+      _nextServiceIndex(0)
+{
+    memset(_points, 0, sizeof(_points));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void TelemetrySubscriber::begin(RS485SecureStack* secureStackInstance, uint8_t myAddress) {
+    _secureStack = secureStackInstance;
+    _myAddress = myAddress;
+
+    if (!_secureStack) {
+        Serial.println("Warnung: TelemetrySubscriber::begin - secureStack ist nullptr!");
+    }
+}
+
+bool TelemetrySubscriber::subscribe(uint8_t node, uint8_t pointId, TelemetryType type, unsigned long periodMs,
+                                    unsigned long maxIntervalMs, float deadband) {
+    if (!_secureStack || pointId > TELEMETRY_MAX_POINT_ID) {
+        return false;
+    }
+    Point_t* point = _findPoint(node, pointId);
+    if (point == nullptr) {
+        for (size_t i = 0; i < TELEMETRY_MAX_TRACKED_POINTS; ++i) {
+            if (!_points[i].used) {
+                point = &_points[i];
+                break;
+            }
+        }
+    }
+    if (point == nullptr) {
+        Serial.printf("TelemetrySubscriber: Tabelle voll, Punkt %d von %d nicht abonniert.\n", pointId, node);
+        return false;
+    }
+
+    memset(point, 0, sizeof(*point));
+    point->used = true;
+    point->node = node;
+    point->pointId = pointId;
+    point->type = type;
+    point->periodMs = periodMs;
+    point->maxIntervalMs = maxIntervalMs;
+    point->deadband = deadband;
+    return _sendSubscribe(*point);
+}
+
+bool TelemetrySubscriber::unsubscribe(uint8_t node, uint8_t pointId) {
+    Point_t* point = _findPoint(node, pointId);
+    if (!_secureStack || point == nullptr) {
+        return false;
+    }
+    point->used = false;
+    char payload[16];
+    snprintf(payload, sizeof(payload), TELEMETRY_UNSUBSCRIBE_PREFIX "%u", pointId);
+    return _secureStack->sendMessage(node, _myAddress, MSG_TYPE_TELEMETRY, payload, true);
+}
+
+void TelemetrySubscriber::update() {
+    if (!_secureStack) {
+        return;
+    }
+    unsigned long now = millis();
+    for (size_t n = 0; n < TELEMETRY_MAX_TRACKED_POINTS; ++n) {
+        Point_t& point = _points[_nextServiceIndex];
+        _nextServiceIndex = (_nextServiceIndex + 1) % TELEMETRY_MAX_TRACKED_POINTS;
+        if (!point.used) {
+            continue;
+        }
+
+        // Ohne Update über mehrere maximale Intervalle hat der Knoten das Abonnement vermutlich verloren
+        unsigned long lastHeard = point.valid ? point.lastUpdateMillis : point.lastRequestMillis;
+        if (point.confirmed && point.maxIntervalMs > 0 &&
+            now - lastHeard > TELEMETRY_STALE_AFTER_INTERVALS * point.maxIntervalMs) {
+            point.stale = true;
+            point.confirmed = false;
+            point.lastRequestMillis = now - TELEMETRY_RESUBSCRIBE_INTERVAL_MS;
+        }
+
+        if (!point.confirmed && now - point.lastRequestMillis >= TELEMETRY_RESUBSCRIBE_INTERVAL_MS) {
+            _stats.resubscriptions++;
+            _sendSubscribe(point);
+            return; // Höchstens eine Bestellung (mit ACK-Wartezeit) je Aufruf
+        }
+    }
+}
+
+bool TelemetrySubscriber::handlePacket(const RS485SecureStack::Packet_t& packet) {
+    if (packet.messageType != MSG_TYPE_TELEMETRY || packet.destinationAddress != _myAddress ||
+        !packet.hmacVerified || !packet.crcVerified || packet.payload.length() == 0 ||
+        packet.payload[0] != TELEMETRY_UPDATE_MARKER) {
+        return false;
+    }
+    const uint8_t* data = (const uint8_t*)packet.payload.c_str();
+    size_t length = packet.payload.length();
+    unsigned long now = millis();
+    _stats.updateFrames++;
+    _stats.bytesReceived += length;
+
+    size_t pos = 1;
+    while (pos < length) {
+        uint8_t pointId = data[pos] & 0x7F;
+        int32_t raw;
+        size_t valueLength = ((data[pos] & 0x80) != 0) ? telemetryDecodeValue(&data[pos + 1], length - pos - 1, raw) : 0;
+        if (valueLength == 0) {
+            _stats.decodeErrors++;
+            break;
+        }
+        pos += 1 + valueLength;
+
+        Point_t* point = _findPoint(packet.senderAddress, pointId);
+        if (point == nullptr) {
+            continue; // Inzwischen abbestellt
+        }
+        _stats.valuesReceived++;
+        point->raw = raw;
+        point->valid = true;
+        point->stale = false;
+        point->confirmed = true; // Auch wenn nur das ACK der Bestellung verloren ging
+        point->lastUpdateMillis = now;
+        point->updates++;
+        if (_callback != nullptr) {
+            _callback(_callbackContext, *point);
+        }
+    }
+    return true;
+}
+
+const TelemetrySubscriber::Point_t* TelemetrySubscriber::getPoint(uint8_t node, uint8_t pointId) const {
+    for (size_t i = 0; i < TELEMETRY_MAX_TRACKED_POINTS; ++i) {
+        if (_points[i].used && _points[i].node == node && _points[i].pointId == pointId) {
+            return &_points[i];
+        }
+    }
+    return nullptr;
+}
+
+TelemetrySubscriber::Point_t* TelemetrySubscriber::_findPoint(uint8_t node, uint8_t pointId) {
+    return const_cast<Point_t*>(static_cast<const TelemetrySubscriber*>(this)->getPoint(node, pointId));
+}
+
+bool TelemetrySubscriber::_sendSubscribe(Point_t& point) {
+    char payload[64];
+    snprintf(payload, sizeof(payload), TELEMETRY_SUBSCRIBE_PREFIX "%u,%u,%lu,%lu,%.3f", point.pointId, point.type,
+             point.periodMs, point.maxIntervalMs, (double)point.deadband);
+    point.lastRequestMillis = millis();
+    point.confirmed = _secureStack->sendMessage(point.node, _myAddress, MSG_TYPE_TELEMETRY, payload, true);
+    if (!point.confirmed) {
+        Serial.printf("TelemetrySubscriber: Punkt %d von %d nicht bestätigt (Status %d).\n", point.pointId, point.node,
+                      _secureStack->getLastAckStatus());
+    }
+    return point.confirmed;
+}
@@ -0,0 +1,188 @@
+#ifndef RS485_TELEMETRY_H
+#define RS485_TELEMETRY_H
+
+#include <Arduino.h>
+#include "RS485SecureStack.h"
+
+// Feste Tabellengrößen (kein Heap)
+#ifndef TELEMETRY_MAX_POINTS
+#define TELEMETRY_MAX_POINTS 16          // Datenpunkte eines Knotens
+#endif
+#ifndef TELEMETRY_MAX_SUBSCRIPTIONS
+#define TELEMETRY_MAX_SUBSCRIPTIONS 16   // Abonnements eines Knotens (alle Abonnenten zusammen)
+#endif
+#ifndef TELEMETRY_MAX_TRACKED_POINTS
+#define TELEMETRY_MAX_TRACKED_POINTS 64  // Abonnierte Datenpunkte beim Abonnenten (alle Knoten zusammen)
+#endif
+
+// Punkt-IDs 0..127 (ein Byte mit gesetztem Bit 7 im Update)
+#define TELEMETRY_MAX_POINT_ID 127
+
+// Abonnent: Kommt so viele maximale Intervalle lang kein Update, gilt das Abonnement als verloren
+// (z.B. Knoten neu gestartet) und wird erneuert. Unbestätigte Abonnements werden im Abstand von
+// TELEMETRY_RESUBSCRIBE_INTERVAL_MS wiederholt.
+#define TELEMETRY_STALE_AFTER_INTERVALS 3
+#define TELEMETRY_RESUBSCRIBE_INTERVAL_MS 5000UL
+
+// Nachrichten (MSG_TYPE_TELEMETRY):
+//   Abonnent -> Knoten: "SUB:<punkt>,<typ>,<periodeMs>,<maxIntervallMs>,<deadband>" (mit ACK),
+//                       "UNSUB:<punkt>", "UNSUB:*"
+//   Knoten -> Abonnent: 'U', dann je Datenpunkt ein Byte 0x80|punkt und der Wert (zigzag-kodiert,
+//                       6 Bit je Byte, niederwertige zuerst; Bit 7 immer gesetzt, Bit 6 = weiteres
+//                       Byte folgt). Der Payload enthält so nie ein Nullbyte.
+#define TELEMETRY_SUBSCRIBE_PREFIX   "SUB:"
+#define TELEMETRY_UNSUBSCRIBE_PREFIX "UNSUB:"
+#define TELEMETRY_UPDATE_MARKER      'U'
+
+// Typ eines Datenpunkts. Übertragen wird immer ein 32-Bit-Rohwert (bei FLOAT das Bitmuster).
+enum TelemetryType : uint8_t {
+    TELEMETRY_TYPE_BOOL = 0,
+    TELEMETRY_TYPE_INT = 1,   // int32_t, z.B. Temperatur in 0,1 °C
+    TELEMETRY_TYPE_FLOAT = 2,
+};
+
+// Knotenseite: hält die Datenpunkte und die Abonnements und sendet je Abonnent gebündelte Updates,
+// aber nur für Werte, die sich seit dem letzten Update um mehr als das Deadband geändert haben,
+// oder wenn das maximale Intervall abgelaufen ist.
+class TelemetryPublisher {
+public:
+    struct Stats_t {
+        uint32_t updateFrames;          // Gesendete Update-Frames
+        uint32_t valuesSent;            // Darin enthaltene Werte
+        uint32_t valuesSuppressed;      // Fällige Prüfungen ohne Update (Wert innerhalb des Deadbands)
+        uint32_t subscriptionsRejected; // Unbekannter Punkt, falscher Typ oder Tabelle voll
+    };
+
+    TelemetryPublisher();
+
+    void begin(RS485SecureStack* secureStackInstance, uint8_t myAddress);
+
+    // Legt einen Datenpunkt an. Gibt false zurück, wenn die ID ungültig oder die Tabelle voll ist.
+    bool addPoint(uint8_t pointId, TelemetryType type);
+
+    // Aktueller Messwert. Gesendet wird erst in update(), je nach Abonnement.
+    void setValue(uint8_t pointId, int32_t value);
+    void setValue(uint8_t pointId, float value);
+    void setValue(uint8_t pointId, bool value);
+
+    // Muss regelmäßig im Loop aufgerufen werden. Sendet höchstens einen Frame je Abonnent.
+    void update();
+
+    // Muss aus dem Empfangs-Callback aufgerufen werden. Gibt true zurück, wenn das Paket
+    // ein (Ab-)Bestellen war und verarbeitet wurde.
+    bool handlePacket(const RS485SecureStack::Packet_t& packet);
+
+    size_t getSubscriptionCount() const;
+    const Stats_t& getStats() const { return _stats; }
+
+private:
+    struct Point_t {
+        uint8_t id;
+        TelemetryType type;
+        bool valid;      // Schon ein Wert gesetzt
+        int32_t raw;
+    };
+    struct Subscription_t {
+        bool used;
+        bool sent;       // Schon ein Update gesendet (sonst beim nächsten update() sofort)
+        uint8_t subscriber;
+        uint8_t pointIndex;
+        unsigned long periodMs;
+        unsigned long maxIntervalMs;
+        float deadband;
+        int32_t lastSentRaw;
+        unsigned long lastSentMillis;
+        unsigned long lastCheckMillis;
+    };
+
+    RS485SecureStack* _secureStack;
+    uint8_t _myAddress;
+    Point_t _points[TELEMETRY_MAX_POINTS];
+    size_t _pointCount;
+    Subscription_t _subscriptions[TELEMETRY_MAX_SUBSCRIPTIONS];
+    Stats_t _stats;
+
+    Point_t* _findPoint(uint8_t pointId, size_t* index = nullptr);
+    void _setRaw(uint8_t pointId, int32_t raw);
+    bool _isDue(Subscription_t& subscription, unsigned long now);
+    void _handleSubscribe(uint8_t subscriber, const char* arguments);
+    void _handleUnsubscribe(uint8_t subscriber, const char* arguments);
+};
+
+// Abonnentenseite (Master, Submaster oder Gateway): bestellt Datenpunkte bei den Knoten,
+// übernimmt die Updates und erneuert verlorene Abonnements.
+class TelemetrySubscriber {
+public:
+    struct Point_t {
+        bool used;
+        bool confirmed;       // Knoten hat das Abonnement bestätigt
+        bool valid;           // Schon ein Wert empfangen
+        bool stale;           // Länger als TELEMETRY_STALE_AFTER_INTERVALS maximale Intervalle ohne Update
+        uint8_t node;
+        uint8_t pointId;
+        TelemetryType type;
+        int32_t raw;
+        unsigned long periodMs;
+        unsigned long maxIntervalMs;
+        float deadband;
+        unsigned long lastUpdateMillis;
+        unsigned long lastRequestMillis;
+        uint32_t updates;
+
+        int32_t asInt() const { return raw; }
+        bool asBool() const { return raw != 0; }
+        float asFloat() const;
+    };
+
+    struct Stats_t {
+        uint32_t updateFrames;      // Empfangene Update-Frames
+        uint32_t valuesReceived;    // Darin enthaltene Werte
+        uint32_t bytesReceived;     // Payload-Bytes der Update-Frames
+        uint32_t resubscriptions;   // Erneuerte Abonnements (unbestätigt oder veraltet)
+        uint32_t decodeErrors;      // Fehlerhaft kodierte Updates
+    };
+
+    typedef void (*UpdateCallback)(void* context, const Point_t& point);
+
+    TelemetrySubscriber();
+
+    void begin(RS485SecureStack* secureStackInstance, uint8_t myAddress);
+
+    // Bestellt einen Datenpunkt: Der Knoten prüft ihn alle periodMs und sendet ein Update, wenn er
+    // sich um mehr als deadband geändert hat, spätestens aber nach maxIntervalMs. Sendet sofort
+    // (mit ACK). Auch ohne Bestätigung bleibt der Eintrag stehen und update() wiederholt die
+    // Bestellung. Gibt false zurück, wenn die Tabelle voll ist oder der Knoten nicht bestätigt hat.
+    bool subscribe(uint8_t node, uint8_t pointId, TelemetryType type, unsigned long periodMs,
+                   unsigned long maxIntervalMs, float deadband = 0.0f);
+
+    // Bestellt einen Datenpunkt ab und entfernt ihn aus der Tabelle
+    bool unsubscribe(uint8_t node, uint8_t pointId);
+
+    // Muss regelmäßig im Loop aufgerufen werden. Erneuert höchstens ein Abonnement je Aufruf
+    // (sendMessage() wartet auf das ACK).
+    void update();
+
+    // Muss aus dem Empfangs-Callback aufgerufen werden. Gibt true zurück, wenn das Paket
+    // ein Update war und verarbeitet wurde.
+    bool handlePacket(const RS485SecureStack::Packet_t& packet);
+
+    // Wird für jeden empfangenen Wert aufgerufen
+    void setUpdateCallback(UpdateCallback callback, void* context) { _callback = callback; _callbackContext = context; }
+
+    const Point_t* getPoint(uint8_t node, uint8_t pointId) const;
+    const Stats_t& getStats() const { return _stats; }
+
+private:
+    RS485SecureStack* _secureStack;
+    uint8_t _myAddress;
+    Point_t _points[TELEMETRY_MAX_TRACKED_POINTS];
+    Stats_t _stats;
+    UpdateCallback _callback;
+    void* _callbackContext;
+    size_t _nextServiceIndex;
+
+    Point_t* _findPoint(uint8_t node, uint8_t pointId);
+    bool _sendSubscribe(Point_t& point);
+};
+
+#endif // RS485_TELEMETRY_H
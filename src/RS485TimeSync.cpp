@@ -0,0 +1,158 @@
+#include "RS485TimeSync.h"
+#include <math.h>
+
+// Begrenzung der geschätzten Gangabweichung (Quarze liegen weit darunter)
+#define RS485_TIMESYNC_MAX_DRIFT_PPM 500.0
+
+// Differenz zweier micros()-Werte mit Überlauf, auch wo unsigned long 64 Bit hat
+static inline int32_t timeSyncDiff(unsigned long a, unsigned long b) {
+    return (int32_t)(uint32_t)(a - b);
+}
+
+RS485TimeSync::RS485TimeSync()
+    : _secureStack(nullptr),
+      _isMaster(false),
+      _sampleCount(0),
+      _sampleHead(0),
+      _outliersInRow(0),
+      _refLocalMicros(0),
+      _refBusMicros(0),
+      _rate(1.0)
+{
+    memset(&_status, 0, sizeof(_status));
+    memset(_samples, 0, sizeof(_samples));
+}
+
+void RS485TimeSync::begin(RS485SecureStack* secureStackInstance, bool isMaster) {
+    _secureStack = secureStackInstance;
+    _isMaster = isMaster;
+    _reset();
+
+    if (!_secureStack) {
+        Serial.println("Warnung: RS485TimeSync::begin - secureStack ist nullptr!");
+        return;
+    }
+    if (_isMaster) {
+        // Die eigene Uhr ist die Buszeit
+        _secureStack->enableHeartbeatTimestamps(true);
+        _refLocalMicros = micros();
+        _refBusMicros = _refLocalMicros;
+        _status.synchronized = true;
+    }
+}
+
+void RS485TimeSync::_reset() {
+    _sampleCount = 0;
+    _sampleHead = 0;
+    _outliersInRow = 0;
+    _rate = 1.0;
+    _status.synchronized = _isMaster;
+    _status.driftPpm = 0.0f;
+    _status.syncErrorMicros = 0;
+}
+
+bool RS485TimeSync::handlePacket(const RS485SecureStack::Packet_t& packet) {
+    if (_isMaster || packet.messageType != MSG_TYPE_MASTER_HEARTBEAT || !packet.hasTxTimestamp ||
+        !packet.hmacVerified || !packet.crcVerified) {
+        return false;
+    }
+    unsigned long localMicros = packet.rxStartMicros;
+    unsigned long busTime = packet.txTimestampMicros;
+
+    // Abweichung von der Vorhersage: negativ = später gelesen als erwartet
+    if (_sampleCount >= RS485_TIMESYNC_MIN_SAMPLES) {
+        int32_t residual = timeSyncDiff(busTime, toBusMicros(localMicros));
+        _status.lastResidualMicros = residual;
+        if (residual < -RS485_TIMESYNC_OUTLIER_MICROS || residual > RS485_TIMESYNC_OUTLIER_MICROS) {
+            _status.outliers++;
+            if (++_outliersInRow < RS485_TIMESYNC_MAX_OUTLIERS) {
+                return true;
+            }
+            // Die Master-Zeit ist gesprungen (Neustart), neu beginnen
+            _status.resets++;
+            _reset();
+        } else {
+            _outliersInRow = 0;
+            uint32_t error = (uint32_t)(residual < 0 ? -residual : residual);
+            _status.syncErrorMicros = _status.syncErrorMicros - _status.syncErrorMicros / 8 + error / 8;
+        }
+    }
+
+    Sample_t& sample = _samples[_sampleHead];
+    sample.localMicros = localMicros;
+    sample.busMicros = busTime;
+    _sampleHead = (_sampleHead + 1) % RS485_TIMESYNC_WINDOW;
+    if (_sampleCount < RS485_TIMESYNC_WINDOW) _sampleCount++;
+    _status.samples++;
+    _status.lastSyncMillis = millis();
+    _fit();
+    if (_sampleCount >= RS485_TIMESYNC_MIN_SAMPLES) {
+        _status.synchronized = true;
+    }
+    return true;
+}
+
+// Drift aus der Ausgleichsgeraden über das Fenster, Offset aus dem am wenigsten verzögerten
+// Heartbeat, bezogen auf den jüngsten
+void RS485TimeSync::_fit() {
+    const Sample_t& newest = _samples[(_sampleHead + RS485_TIMESYNC_WINDOW - 1) % RS485_TIMESYNC_WINDOW];
+
+    double rate = 1.0;
+    if (_sampleCount >= 2) {
+        double sumX = 0, sumY = 0;
+        for (uint8_t i = 0; i < _sampleCount; ++i) {
+            sumX += timeSyncDiff(_samples[i].localMicros, newest.localMicros);
+            sumY += timeSyncDiff(_samples[i].busMicros, newest.busMicros);
+        }
+        double meanX = sumX / _sampleCount, meanY = sumY / _sampleCount;
+        double sxx = 0, sxy = 0;
+        for (uint8_t i = 0; i < _sampleCount; ++i) {
+            double dx = timeSyncDiff(_samples[i].localMicros, newest.localMicros) - meanX;
+            double dy = timeSyncDiff(_samples[i].busMicros, newest.busMicros) - meanY;
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+        if (sxx > 0) {
+            rate = sxy / sxx;
+        }
+        double limit = RS485_TIMESYNC_MAX_DRIFT_PPM * 1e-6;
+        if (rate > 1.0 + limit) rate = 1.0 + limit;
+        if (rate < 1.0 - limit) rate = 1.0 - limit;
+    }
+
+    // Jeder Heartbeat liefert eine Buszeit für den Empfang des jüngsten. Verzögerungen beim Lesen
+    // machen sie nur kleiner, der größte Wert ist der beste.
+    double best = 0;
+    for (uint8_t i = 0; i < _sampleCount; ++i) {
+        double candidate = timeSyncDiff(_samples[i].busMicros, newest.busMicros) -
+                           timeSyncDiff(_samples[i].localMicros, newest.localMicros) * rate;
+        if (candidate > best) best = candidate;
+    }
+
+    _rate = rate;
+    _refLocalMicros = newest.localMicros;
+    _refBusMicros = (uint32_t)(newest.busMicros + (uint32_t)(int32_t)lround(best));
+    _status.driftPpm = (float)((1.0 - rate) * 1e6);
+}
+
+void RS485TimeSync::update() {
+    if (_isMaster) {
+        // Bezugspunkt mitführen, damit die Umrechnung nie über den Überlauf hinaus rechnet
+        _refLocalMicros = micros();
+        _refBusMicros = _refLocalMicros;
+        return;
+    }
+    if (_status.synchronized && millis() - _status.lastSyncMillis > RS485_TIMESYNC_TIMEOUT_MS) {
+        _status.synchronized = false;
+    }
+}
+
+unsigned long RS485TimeSync::toBusMicros(unsigned long localMicros) const {
+    double elapsed = timeSyncDiff(localMicros, _refLocalMicros) * _rate;
+    return (uint32_t)(_refBusMicros + (uint32_t)(int32_t)lround(elapsed));
+}
+
+unsigned long RS485TimeSync::toLocalMicros(unsigned long busTime) const {
+    double elapsed = timeSyncDiff(busTime, _refBusMicros) / _rate;
+    return (uint32_t)(_refLocalMicros + (uint32_t)(int32_t)lround(elapsed));
+}
@@ -0,0 +1,103 @@
+#ifndef RS485_TIME_SYNC_H
+#define RS485_TIME_SYNC_H
+
+#include <Arduino.h>
+#include "RS485SecureStack.h"
+
+// Anzahl der Heartbeats, über die Offset und Drift geschätzt werden (feste Tabelle)
+#ifndef RS485_TIMESYNC_WINDOW
+#define RS485_TIMESYNC_WINDOW 8
+#endif
+
+// Ab so vielen Heartbeats im Fenster gilt die Uhr als synchronisiert (Drift braucht mindestens zwei)
+#define RS485_TIMESYNC_MIN_SAMPLES 3
+
+// Ein Heartbeat, der mehr als so viel später als erwartet ankommt, wurde verspätet gelesen und
+// zählt nicht (Ausreißer). Nach RS485_TIMESYNC_MAX_OUTLIERS Ausreißern in Folge (z.B. Neustart
+// des Masters) beginnt die Schätzung neu.
+#define RS485_TIMESYNC_OUTLIER_MICROS 2000L
+#define RS485_TIMESYNC_MAX_OUTLIERS 4
+
+// Ohne Heartbeat so lange gilt die Uhr nicht mehr als synchronisiert
+#ifndef RS485_TIMESYNC_TIMEOUT_MS
+#define RS485_TIMESYNC_TIMEOUT_MS 10000UL
+#endif
+
+// Gemeinsame Buszeit aller Knoten: micros() des Masters. Sie läuft wie micros() nach gut
+// 71 Minuten über, Zeitpunkte werden daher wie gewohnt über Differenzen verglichen.
+// Der Master stempelt jeden Heartbeat beim Sendebeginn (enableHeartbeatTimestamps()), die Knoten
+// schätzen den Empfangsbeginn des Startbytes (Packet_t::rxStartMicros) und führen daraus Offset
+// und Drift ihrer lokalen Uhr nach.
+//
+// Zeitstempel beim Empfang werden immer zu spät, nie zu früh geschätzt (der Frame wird erst beim
+// nächsten loop() gelesen). Als Offset gilt daher der am wenigsten verzögerte Heartbeat des
+// Fensters, die Drift ergibt sich aus der Ausgleichsgeraden über das Fenster.
+class RS485TimeSync {
+public:
+    struct Status_t {
+        bool synchronized;
+        uint32_t samples;            // Ausgewertete Heartbeats
+        uint32_t outliers;           // Verworfene (verspätet gelesene) Heartbeats
+        uint32_t resets;             // Neubeginn der Schätzung (Sprung der Master-Zeit)
+        int32_t lastResidualMicros;  // Abweichung des letzten Heartbeats von der Vorhersage
+        uint32_t syncErrorMicros;    // Geglätteter Betrag der Abweichung (1/8)
+        float driftPpm;              // Gangabweichung der lokalen Uhr gegenüber dem Master (positiv = geht vor)
+        unsigned long lastSyncMillis;
+    };
+
+    RS485TimeSync();
+
+    // isMaster: Die eigene Uhr ist die Buszeit, Heartbeats werden gestempelt
+    void begin(RS485SecureStack* secureStackInstance, bool isMaster);
+
+    // Muss aus dem Empfangs-Callback aufgerufen werden. Gibt true zurück, wenn das Paket ein
+    // gestempelter Master-Heartbeat war. Das Paket wird trotzdem normal weiterverarbeitet.
+    bool handlePacket(const RS485SecureStack::Packet_t& packet);
+
+    // Muss regelmäßig im Loop aufgerufen werden
+    void update();
+
+    bool isSynchronized() const { return _status.synchronized; }
+
+    // Aktuelle Buszeit bzw. Umrechnung eines lokalen micros()-Werts (z.B. Packet_t::rxStartMicros).
+    // Der lokale Wert darf höchstens 35 Minuten vom letzten Heartbeat entfernt sein.
+    unsigned long busMicros() const { return toBusMicros(micros()); }
+    unsigned long toBusMicros(unsigned long localMicros) const;
+
+    // Lokaler micros()-Wert zu einer Buszeit, z.B. für Sendezeitschlitze
+    unsigned long toLocalMicros(unsigned long busTime) const;
+
+    // Laufzeit eines Frames, der beim Sender zur Buszeit sentBusMicros abging und hier bei
+    // rxLocalMicros (lokal, z.B. Packet_t::rxStartMicros) ankam
+    int32_t oneWayLatencyMicros(unsigned long sentBusMicros, unsigned long rxLocalMicros) const {
+        return (int32_t)(uint32_t)(toBusMicros(rxLocalMicros) - sentBusMicros);
+    }
+
+    const Status_t& getStatus() const { return _status; }
+
+private:
+    struct Sample_t {
+        unsigned long localMicros; // Empfangsbeginn (lokal)
+        unsigned long busMicros;   // Sendezeitstempel des Masters
+    };
+
+    RS485SecureStack* _secureStack;
+    bool _isMaster;
+    Status_t _status;
+
+    // Fenster der letzten Heartbeats (Ring)
+    Sample_t _samples[RS485_TIMESYNC_WINDOW];
+    uint8_t _sampleCount;
+    uint8_t _sampleHead;
+    uint8_t _outliersInRow;
+
+    // Modell: Buszeit = _refBusMicros + (lokal - _refLocalMicros) * _rate
+    unsigned long _refLocalMicros;
+    unsigned long _refBusMicros;
+    double _rate;
+
+    void _reset();
+    void _fit();
+};
+
+#endif // RS485_TIME_SYNC_H
@@ -0,0 +1,252 @@
+#include "SubmasterRelay.h"
+
+// Default-Werte
+#define DEFAULT_POLL_INTERVAL_MS 2000UL      // Abfragezyklus der Clients
+#define DEFAULT_RESPONSE_TIMEOUT_MS 200UL    // Zeit, die ein Client für seine Antwort hat (zzgl. Zeitschlitz)
+
+SubmasterRelay::SubmasterRelay()
+    : _secureStack(nullptr),
+      _myAddress(0),
+      _masterAddress(0),
+      _clientGroupAddress(0),
+      _clientCount(0),
+      _pollIntervalMs(DEFAULT_POLL_INTERVAL_MS),
+      _responseTimeoutMs(DEFAULT_RESPONSE_TIMEOUT_MS),
+      _lastPollCycleMillis(0),
+      _requestSentMillis(0),
+      _requestWindowMs(0),
+      _pollInProgress(false),
+      _unicastIndex(0),
+      _reportRequested(false),
+      _reportsSent(0)
+{
+    memset(_clients, 0, sizeof(_clients));
+}
+
+void SubmasterRelay::begin(RS485SecureStack* secureStackInstance, uint8_t myAddress, uint8_t masterAddress, uint8_t clientGroupAddress) {
+    _secureStack = secureStackInstance;
+    _myAddress = myAddress;
+    _masterAddress = masterAddress;
+    _clientGroupAddress = RS485SecureStack::isGroupAddress(clientGroupAddress) ? clientGroupAddress : 0;
+    _lastPollCycleMillis = millis();
+
+    if (!_secureStack) {
+        Serial.println("Warnung: SubmasterRelay::begin - secureStack ist nullptr!");
+    }
+}
+
+bool SubmasterRelay::addClient(uint8_t clientAddress) {
+    if (_findClient(clientAddress) != nullptr) {
+        return true;
+    }
+    if (_clientCount >= SUBMASTER_RELAY_MAX_CLIENTS) {
+        Serial.printf("SubmasterRelay: Client-Tabelle voll, Client %d nicht aufgenommen.\n", clientAddress);
+        return false;
+    }
+    ClientEntry_t& client = _clients[_clientCount++];
+    memset(&client, 0, sizeof(client));
+    client.address = clientAddress;
+    return true;
+}
+
+void SubmasterRelay::update() {
+    if (!_secureStack || _clientCount == 0) {
+        return;
+    }
+
+    if (_pollInProgress) {
+        _checkTimeouts();
+    } else if (millis() - _lastPollCycleMillis >= _pollIntervalMs) {
+        _lastPollCycleMillis = millis();
+        _startPollCycle();
+    }
+
+    // Der Bericht wird nur auf Anforderung des Masters gesendet (Master-Zeitplan),
+    // aber nicht mitten in einer laufenden Abfrage, um keine Client-Antworten zu überlagern.
+    if (_reportRequested && !_pollInProgress) {
+        _reportRequested = false;
+        _sendReport();
+    }
+}
+
+bool SubmasterRelay::handlePacket(const RS485SecureStack::Packet_t& packet) {
+    if (packet.messageType != MSG_TYPE_DATA || packet.destinationAddress != _myAddress ||
+        !packet.hmacVerified || !packet.crcVerified) {
+        return false;
+    }
+    ClientEntry_t* client = _findClient(packet.senderAddress);
+    if (client == nullptr) {
+        return false;
+    }
+
+    // Neuen Messwert nur übernehmen (und als geändert markieren), wenn er sich unterscheidet
+    char reading[SUBMASTER_RELAY_MAX_READING_LENGTH + 1];
+    strncpy(reading, packet.payload.c_str(), SUBMASTER_RELAY_MAX_READING_LENGTH);
+    reading[SUBMASTER_RELAY_MAX_READING_LENGTH] = '\0';
+    if (!client->online || strcmp(reading, client->reading) != 0) {
+        memcpy(client->reading, reading, sizeof(reading));
+        client->dirty = true;
+    }
+    client->online = true;
+    client->lastUpdateMillis = millis();
+    if (client->awaitingResponse) {
+        _finishRequest(*client, true);
+    }
+    return true;
+}
+
+const SubmasterRelay::ClientEntry_t* SubmasterRelay::getClient(uint8_t clientAddress) const {
+    for (size_t i = 0; i < _clientCount; ++i) {
+        if (_clients[i].address == clientAddress) {
+            return &_clients[i];
+        }
+    }
+    return nullptr;
+}
+
+unsigned long SubmasterRelay::replySlotMillis(long baudRate) {
+    if (baudRate <= 0) baudRate = RS485_INITIAL_BAUD_RATE;
+    // Antwort-Frame mit maximal langem Messwert, 10 Bit pro Byte, 25% Stuffing-Reserve, 2ms Umschaltreserve
+    unsigned long frameBytes = (RS485_MIN_PACKET_LENGTH + SUBMASTER_RELAY_MAX_READING_LENGTH + RS485_IV_LENGTH) * 5 / 4;
+    return (frameBytes * 10UL * 1000UL) / baudRate + 2;
+}
+
+unsigned long SubmasterRelay::replyDelayMillis(const RS485SecureStack& stack, uint8_t clientGroupAddress, uint8_t myAddress) {
+    uint8_t members[RS485_ADDRESS_BITMAP_SIZE];
+    stack.getKnownGroupMembers(clientGroupAddress, members);
+    unsigned long rank = 0;
+    for (int address = 0; address < myAddress; ++address) {
+        if (rs485BitmapTest(members, address)) rank++;
+    }
+    return rank * replySlotMillis(stack.getBaudRate());
+}
+
+// Private Methoden
+
+SubmasterRelay::ClientEntry_t* SubmasterRelay::_findClient(uint8_t clientAddress) {
+    for (size_t i = 0; i < _clientCount; ++i) {
+        if (_clients[i].address == clientAddress) {
+            return &_clients[i];
+        }
+    }
+    return nullptr;
+}
+
+void SubmasterRelay::_startPollCycle() {
+    if (_clientGroupAddress != 0) {
+        // Ein Multicast-Frame fragt alle Clients gleichzeitig ab, die Antworten kommen in Zeitschlitzen
+        for (size_t i = 0; i < _clientCount; ++i) {
+            _clients[i].awaitingResponse = true;
+        }
+        _requestWindowMs = _clientCount * replySlotMillis(_secureStack->getBaudRate()) + _responseTimeoutMs;
+        _requestSentMillis = millis();
+        _pollInProgress = true;
+        if (!_secureStack->sendMulticast(_clientGroupAddress, MSG_TYPE_DATA, "GET_STATUS", false)) {
+            Serial.println("SubmasterRelay: Fehler beim Senden der Multicast-Abfrage.");
+        }
+        return;
+    }
+
+    // Unicast: Clients nacheinander, ohne ACK (die Antwort selbst ist die Bestätigung)
+    _unicastIndex = 0;
+    _pollInProgress = _pollNextUnicastClient();
+}
+
+bool SubmasterRelay::_pollNextUnicastClient() {
+    if (_unicastIndex >= _clientCount) {
+        return false;
+    }
+    ClientEntry_t& client = _clients[_unicastIndex];
+    client.awaitingResponse = true;
+    _requestWindowMs = _responseTimeoutMs;
+    _requestSentMillis = millis();
+    if (!_secureStack->sendMessage(client.address, _myAddress, MSG_TYPE_DATA, "GET_STATUS", false)) {
+        Serial.printf("SubmasterRelay: Fehler beim Senden der Abfrage an Client %d.\n", client.address);
+    }
+    return true;
+}
+
+void SubmasterRelay::_finishRequest(ClientEntry_t& client, bool answered) {
+    client.awaitingResponse = false;
+    if (answered) {
+        client.missedPolls = 0;
+    } else if (client.missedPolls < 255 && ++client.missedPolls >= SUBMASTER_RELAY_OFFLINE_AFTER_MISSES && client.online) {
+        client.online = false;
+        client.dirty = true; // Offline-Status muss an den Master gemeldet werden
+        Serial.printf("SubmasterRelay: Client %d ist offline (%d Abfragen unbeantwortet).\n", client.address, client.missedPolls);
+    }
+
+    if (_clientGroupAddress == 0) {
+        // Unicast: nächsten Client sofort abfragen, nicht erst beim nächsten Zyklus
+        _unicastIndex++;
+        _pollInProgress = _pollNextUnicastClient();
+        return;
+    }
+
+    for (size_t i = 0; i < _clientCount; ++i) {
+        if (_clients[i].awaitingResponse) return;
+    }
+    _pollInProgress = false; // Alle Clients haben geantwortet
+}
+
+void SubmasterRelay::_checkTimeouts() {
+    if (millis() - _requestSentMillis < _requestWindowMs) {
+        return;
+    }
+    if (_clientGroupAddress == 0) {
+        if (_unicastIndex < _clientCount) {
+            _finishRequest(_clients[_unicastIndex], false);
+        }
+        return;
+    }
+    for (size_t i = 0; i < _clientCount; ++i) {
+        if (_clients[i].awaitingResponse) {
+            _finishRequest(_clients[i], false);
+        }
+    }
+    _pollInProgress = false;
+}
+
+void SubmasterRelay::_sendReport() {
+    bool fullReport = (_reportsSent % SUBMASTER_RELAY_FULL_REPORT_EVERY) == 0;
+
+    // Passt der Bericht nicht in einen Frame, geht er in mehreren Frames mit je eigenem Präfix
+    // hinaus. Jeder Frame wird mit ACK gesendet: Einträge gelten erst als gemeldet, wenn der Master
+    // ihren Frame bestätigt hat. Geht ein Frame verloren, bleiben die übrigen "dirty" und gehen mit
+    // dem nächsten Bericht, statt bis zum nächsten Vollbericht veraltet zu bleiben.
+    size_t next = 0;
+    bool anySent = false;
+    do {
+        String payload = SUBMASTER_RELAY_REPORT_PREFIX;
+        payload += fullReport ? 'F' : 'D';
+        bool included[SUBMASTER_RELAY_MAX_CLIENTS] = {false};
+        for (; next < _clientCount; ++next) {
+            const ClientEntry_t& client = _clients[next];
+            if (!fullReport && !client.dirty) {
+                continue;
+            }
+            String entry = "|";
+            entry += (int)client.address;
+            entry += '=';
+            entry += client.online ? client.reading : "!";
+            if (payload.length() + entry.length() > RS485_MAX_PAYLOAD_LENGTH) {
+                break; // Frame voll, Rest im nächsten Frame
+            }
+            payload += entry;
+            included[next] = true;
+        }
+
+        if (!_secureStack->sendMessage(_masterAddress, _myAddress, MSG_TYPE_DATA, payload, true)) {
+            Serial.println("SubmasterRelay: Bericht vom Master nicht bestätigt.");
+            break;
+        }
+        anySent = true;
+        for (size_t i = 0; i < _clientCount; ++i) {
+            if (included[i]) _clients[i].dirty = false;
+        }
+    } while (next < _clientCount);
+
+    if (anySent) {
+        _reportsSent++;
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef SUBMASTER_RELAY_H
+#define SUBMASTER_RELAY_H
+
+#include <Arduino.h>
+#include "RS485SecureStack.h"
+
+// Maximale Anzahl Clients pro Submaster (feste Tabellengröße, kein Heap)
+#ifndef SUBMASTER_RELAY_MAX_CLIENTS
+#define SUBMASTER_RELAY_MAX_CLIENTS 16
+#endif
+
+// Maximale Länge eines zwischengespeicherten Client-Messwerts (Payload der Client-Antwort)
+#ifndef SUBMASTER_RELAY_MAX_READING_LENGTH
+#define SUBMASTER_RELAY_MAX_READING_LENGTH 40
+#endif
+
+// Nach so vielen unbeantworteten Abfragen gilt ein Client als offline
+#define SUBMASTER_RELAY_OFFLINE_AFTER_MISSES 3
+
+// Jeder n-te Bericht an den Master ist ein Vollbericht (alle Clients), sonst nur Änderungen
+#define SUBMASTER_RELAY_FULL_REPORT_EVERY 10
+
+// Präfix des aggregierten Berichts: "AGG:<F|D>|<adresse>=<messwert>|<adresse>=!|..."
+// F = Vollbericht, D = nur geänderte Einträge, "!" = Client offline
+#define SUBMASTER_RELAY_REPORT_PREFIX "AGG:"
+
+// Submaster-Rolle als Bibliotheksbaustein:
+// - fragt die zugeordneten Clients nicht-blockierend ab (bei gesetzter Client-Gruppe mit
+//   einem einzigen Multicast-Frame, die Clients antworten in Zeitschlitzen),
+// - hält die letzten Messwerte in einer Tabelle fester Größe,
+// - sendet pro Zyklus EINEN aggregierten, delta-kodierten Bericht an den Master (bei vielen
+//   Clients auf mehrere Frames verteilt),
+//   und zwar erst, wenn der Master dazu auffordert (requestReport(), z.B. bei PERMISSION_TO_SEND).
+class SubmasterRelay {
+public:
+    struct ClientEntry_t {
+        uint8_t address;
+        bool online;
+        bool dirty;            // Geändert seit dem letzten vom Master bestätigten Bericht
+        bool awaitingResponse; // Abfrage läuft
+        uint8_t missedPolls;
+        unsigned long lastUpdateMillis;
+        char reading[SUBMASTER_RELAY_MAX_READING_LENGTH + 1];
+    };
+
+    SubmasterRelay();
+
+    // clientGroupAddress: Multicast-Gruppe der Clients (0 = Clients einzeln per Unicast abfragen)
+    void begin(RS485SecureStack* secureStackInstance, uint8_t myAddress, uint8_t masterAddress, uint8_t clientGroupAddress = 0);
+
+    // Registriert einen Client. Gibt false zurück, wenn die Tabelle voll ist.
+    bool addClient(uint8_t clientAddress);
+
+    // Muss regelmäßig im Loop aufgerufen werden (Abfragezyklus, Timeouts, Bericht an den Master)
+    void update();
+
+    // Muss aus dem Empfangs-Callback aufgerufen werden. Gibt true zurück, wenn das Paket
+    // eine Client-Antwort war und vom Relay verarbeitet wurde.
+    bool handlePacket(const RS485SecureStack::Packet_t& packet);
+
+    // Master-Zeitplan: Der nächste update()-Aufruf sendet den aggregierten Bericht
+    void requestReport() { _reportRequested = true; }
+
+    void setPollInterval(unsigned long intervalMs) { _pollIntervalMs = intervalMs; }
+    void setResponseTimeout(unsigned long timeoutMs) { _responseTimeoutMs = timeoutMs; }
+
+    const ClientEntry_t* getClient(uint8_t clientAddress) const;
+    size_t getClientCount() const { return _clientCount; }
+    unsigned long getReportsSent() const { return _reportsSent; }
+
+    // Länge eines Antwort-Zeitschlitzes für Multicast-Abfragen bei der gegebenen Baudrate
+    static unsigned long replySlotMillis(long baudRate);
+
+    // Für Clients: Verzögerung, nach der auf eine Multicast-Abfrage geantwortet werden soll
+    // (Rang der eigenen Adresse unter den bekannten Gruppenmitgliedern * Zeitschlitz)
+    static unsigned long replyDelayMillis(const RS485SecureStack& stack, uint8_t clientGroupAddress, uint8_t myAddress);
+
+private:
+    RS485SecureStack* _secureStack;
+    uint8_t _myAddress;
+    uint8_t _masterAddress;
+    uint8_t _clientGroupAddress;
+
+    ClientEntry_t _clients[SUBMASTER_RELAY_MAX_CLIENTS];
+    size_t _clientCount;
+
+    unsigned long _pollIntervalMs;
+    unsigned long _responseTimeoutMs;
+    unsigned long _lastPollCycleMillis;
+    unsigned long _requestSentMillis;
+    unsigned long _requestWindowMs;
+    bool _pollInProgress;
+    size_t _unicastIndex;     // Unicast-Modus: aktuell abgefragter Client
+
+    bool _reportRequested;
+    unsigned long _reportsSent;
+
+    ClientEntry_t* _findClient(uint8_t clientAddress);
+    void _startPollCycle();
+    bool _pollNextUnicastClient();
+    void _finishRequest(ClientEntry_t& client, bool answered);
+    void _checkTimeouts();
+    void _sendReport();
+};
+
+#endif // SUBMASTER_RELAY_H
@@ -0,0 +1,627 @@
+// Offline-Auswertung eines Bus-Mitschnitts von RS485BusCapture (pcap, Linktyp 147).
+//
+// Prüft jeden Frame (CRC16, HMAC-SHA256, kompakte ACKs), entschlüsselt die Payload mit dem
+// Schlüsselmaterial, folgt Key-Updates des Masters und gibt Statistiken je Knoten aus:
+// Verkehr, Fehler, Wiederholungen und ACK-Latenzen.
+//
+// Bauen und Aufruf: siehe README.md in diesem Verzeichnis.
+//
+// Die Protokollkonstanten unten müssen zu src/RS485SecureStack.h passen.
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+#include "RS485Compression.h" // Entpacken (ohne Arduino, aus src/)
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// ==============================================================================
+// Protokoll (siehe src/RS485SecureStack.h und src/RS485BusCapture.h)
+// ==============================================================================
+enum HeaderIndex {
+    START_BYTE_0_INDEX = 0,
+    START_BYTE_1_INDEX,
+    PROTOCOL_VERSION_INDEX,
+    TOTAL_LENGTH_INDEX,
+    MESSAGE_TYPE_INDEX,
+    DEST_ADDRESS_INDEX,
+    SENDER_ADDRESS_INDEX,
+    KEY_ID_INDEX,
+    FLAGS_INDEX,
+    SEQUENCE_INDEX,
+    HEADER_LENGTH
+};
+
+const uint8_t START_BYTE_0 = 0xDE;
+const uint8_t START_BYTE_1 = 0xAD;
+const uint8_t PROTOCOL_VERSION = 0x06;
+const size_t IV_LENGTH = 16;
+const size_t HMAC_LENGTH = 32;
+const size_t CRC_LENGTH = 2;
+const size_t KEY_LENGTH = 32;
+const size_t MIN_PACKET_LENGTH = HEADER_LENGTH + IV_LENGTH + HMAC_LENGTH + CRC_LENGTH;
+const size_t COMPACT_ACK_MAC_LENGTH = 4;
+const size_t COMPACT_ACK_LENGTH = HEADER_LENGTH + COMPACT_ACK_MAC_LENGTH + CRC_LENGTH;
+const uint8_t BROADCAST_ADDRESS = 255;
+const uint8_t GROUP_ADDRESS_FIRST = 0xE0;
+const uint8_t GROUP_ADDRESS_LAST = 0xFD;
+
+const uint8_t FLAG_ACK_REQUESTED = 0x01;
+const uint8_t FLAG_RETRANSMISSION = 0x02;
+const uint8_t FLAG_EXT_ACK = 0x04;
+const uint8_t FLAG_EXT_HEARTBEAT = 0x08;
+const uint8_t FLAG_COMPRESSED = 0x10;
+const size_t COMPRESSION_HEADER_LENGTH = 2; // Wörterbuch-ID, Originallänge
+const size_t EXT_ACK_LENGTH = 6;
+const size_t EXT_ACK_HMAC_REF_LENGTH = 4;
+const size_t EXT_HEARTBEAT_MAX_PAYLOAD = 8;
+
+const char MSG_TYPE_KEY_UPDATE = 'K';
+const char MSG_TYPE_ACK_NACK = 'A';
+const uint8_t ACK_OK = 0;
+
+const uint32_t PCAP_MAGIC_MICROS = 0xA1B2C3D4UL;
+const uint32_t CAPTURE_LINKTYPE = 147;
+const size_t PSEUDO_HEADER_LENGTH = 8;
+
+enum FrameTapStatus { TAP_FRAME_VALID = 0, TAP_FRAME_INVALID, TAP_FRAME_ABORTED };
+
+// Anfragen ohne ACK gelten nach dieser Zeit als unbeantwortet
+const uint64_t PENDING_REQUEST_TIMEOUT_US = 2000000ULL;
+
+// CRC16-Tabelle unverändert aus RS485SecureStack.cpp (enthält einzelne Abweichungen von
+// CRC-16/ARC, die Prüfsumme muss aber bitgenau mit dem Stack übereinstimmen)
+const uint16_t crc16_table[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F81, 0xEF40, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B81, 0xAB40, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5001, 0x90C0, 0x9180, 0x5141, 0x9300, 0x53C1, 0x5281, 0x9240,
+    0x9600, 0x56C1, 0x5781, 0x9740, 0x5501, 0x95C0, 0x9481, 0x5440,
+    0x9C00, 0x5CC1, 0x5D81, 0x9D40, 0x5F01, 0x9FC0, 0x9E80, 0x5E41,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+uint16_t calculateCrc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0x0000;
+    for (size_t i = 0; i < length; ++i) {
+        crc = (crc >> 8) ^ crc16_table[(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+bool isGroupAddress(uint8_t address) {
+    return address >= GROUP_ADDRESS_FIRST && address <= GROUP_ADDRESS_LAST;
+}
+
+// ==============================================================================
+// Krypto (OpenSSL), identisch zu RS485SecureStack: HMAC-SHA256, AES-256-CBC ohne Padding
+// ==============================================================================
+void calculateHmac(const uint8_t* key, const uint8_t* data, size_t length, uint8_t* out) {
+    unsigned int outLength = HMAC_LENGTH;
+    HMAC(EVP_sha256(), key, KEY_LENGTH, data, length, out, &outLength);
+}
+
+bool decryptCbc(const uint8_t* key, const uint8_t* iv, uint8_t* data, size_t length) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx == nullptr) {
+        return false;
+    }
+    int outLength = 0;
+    int finalLength = 0;
+    bool ok = EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key, iv) == 1 &&
+              EVP_CIPHER_CTX_set_padding(ctx, 0) == 1 &&
+              EVP_DecryptUpdate(ctx, data, &outLength, data, (int)length) == 1 &&
+              EVP_DecryptFinal_ex(ctx, data + outLength, &finalLength) == 1;
+    EVP_CIPHER_CTX_free(ctx);
+    return ok;
+}
+
+bool parseHex(const std::string& hex, uint8_t* out, size_t length) {
+    if (hex.size() != length * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        char byteText[3] = { hex[i * 2], hex[i * 2 + 1], '\0' };
+        char* end = nullptr;
+        out[i] = (uint8_t)strtol(byteText, &end, 16);
+        if (end != byteText + 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ==============================================================================
+// Auswertung
+// ==============================================================================
+struct LatencyStats {
+    uint32_t samples = 0;
+    uint64_t sumMicros = 0;
+    uint64_t minMicros = UINT64_MAX;
+    uint64_t maxMicros = 0;
+
+    void add(uint64_t micros) {
+        samples++;
+        sumMicros += micros;
+        if (micros < minMicros) minMicros = micros;
+        if (micros > maxMicros) maxMicros = micros;
+    }
+};
+
+struct NodeStats {
+    uint32_t framesSent = 0;
+    uint64_t bytesSent = 0;
+    uint32_t hmacErrors = 0;     // Frames dieses (angeblichen) Absenders mit HMAC-Fehler
+    uint32_t unknownKey = 0;     // Frames mit einer Key ID ohne bekannten Schlüssel
+    uint32_t retransmissions = 0;
+    uint32_t acksRequested = 0;
+    uint32_t compactAcksSent = 0;
+    uint32_t piggybackedAcks = 0;
+    uint32_t piggybackedHeartbeats = 0;
+    uint32_t nacksSent = 0;
+    uint32_t unansweredRequests = 0; // Anfragen mit ACK-Wunsch ohne ACK im Mitschnitt
+    std::map<char, uint32_t> framesByType;
+    LatencyStats ackLatency;     // Als Antwortender: Empfangsende Anfrage bis Empfangsende ACK
+};
+
+// Anfrage mit ACK-Wunsch, auf deren ACK noch gewartet wird
+struct PendingRequest {
+    uint8_t sender;
+    uint8_t destination;
+    uint8_t sequence;
+    uint8_t keyId;
+    uint8_t frameHmac[HMAC_LENGTH];
+    uint64_t timestampMicros;
+    bool retransmitted;          // Karn: Latenz nach einer Wiederholung nicht eindeutig
+};
+
+struct Decoder {
+    bool verbose = false;
+    bool haveMasterKey = false;
+    uint8_t masterKey[KEY_LENGTH];
+    std::map<uint8_t, std::vector<uint8_t>> sessionKeys;
+
+    std::map<uint8_t, NodeStats> nodes;
+    std::vector<PendingRequest> pending;
+    uint64_t firstTimestamp = 0;
+    uint64_t lastTimestamp = 0;
+    uint32_t records = 0;
+    uint32_t captureDrops = 0;
+    uint32_t framesValid = 0;
+    uint32_t crcErrors = 0;
+    uint32_t headerErrors = 0;
+    uint32_t abortedFrames = 0;
+    uint32_t macErrors = 0;      // Kompakte ACKs mit falschem MAC
+    uint32_t orphanAcks = 0;     // Kompakte ACKs ohne passende Anfrage im Mitschnitt
+    uint32_t keyUpdates = 0;
+
+    void setMasterKey(const std::string& text) {
+        SHA256((const unsigned char*)text.data(), text.size(), masterKey);
+        haveMasterKey = true;
+        sessionKeys[0] = std::vector<uint8_t>(masterKey, masterKey + KEY_LENGTH); // Key 0 = Master Key
+    }
+
+    const uint8_t* key(uint8_t keyId) const {
+        auto it = sessionKeys.find(keyId);
+        return it == sessionKeys.end() ? nullptr : it->second.data();
+    }
+
+    void processRecord(uint64_t timestamp, const uint8_t* data, size_t length);
+    void processFrame(uint64_t timestamp, const uint8_t* frame, size_t length);
+    void processCompactAck(uint64_t timestamp, const uint8_t* frame);
+    void matchAck(uint64_t timestamp, uint8_t ackSender, uint8_t ackDestination, uint8_t sequence,
+                  uint8_t status, const uint8_t* mac, const uint8_t* hmacRef, const uint8_t* ackHeader);
+    void followKeyUpdate(const std::string& payload);
+    void expirePending(uint64_t now);
+    void printSummary() const;
+};
+
+void Decoder::processRecord(uint64_t timestamp, const uint8_t* data, size_t length) {
+    records++;
+    if (firstTimestamp == 0) firstTimestamp = timestamp;
+    lastTimestamp = timestamp;
+    if (length < PSEUDO_HEADER_LENGTH) {
+        headerErrors++;
+        return;
+    }
+    uint8_t status = data[1];
+    captureDrops += data[2] | (data[3] << 8);
+    uint32_t baudRate = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+    const uint8_t* frame = data + PSEUDO_HEADER_LENGTH;
+    size_t frameLength = length - PSEUDO_HEADER_LENGTH;
+    expirePending(timestamp);
+
+    if (status == TAP_FRAME_ABORTED) {
+        abortedFrames++;
+        if (verbose) printf("%12.6f  abgebrochen nach %zu Bytes (%u Baud)\n", timestamp / 1e6, frameLength, baudRate);
+        return;
+    }
+    processFrame(timestamp, frame, frameLength);
+}
+
+void Decoder::processFrame(uint64_t timestamp, const uint8_t* frame, size_t length) {
+    if (length < HEADER_LENGTH + CRC_LENGTH || frame[START_BYTE_0_INDEX] != START_BYTE_0 ||
+        frame[START_BYTE_1_INDEX] != START_BYTE_1 || frame[PROTOCOL_VERSION_INDEX] != PROTOCOL_VERSION ||
+        frame[TOTAL_LENGTH_INDEX] != length) {
+        headerErrors++;
+        if (verbose) printf("%12.6f  ungültiger Header (%zu Bytes)\n", timestamp / 1e6, length);
+        return;
+    }
+    uint16_t receivedCrc = frame[length - 2] | (frame[length - 1] << 8);
+    if (receivedCrc != calculateCrc16(frame, length - CRC_LENGTH)) {
+        crcErrors++;
+        if (verbose) printf("%12.6f  CRC-Fehler (%zu Bytes)\n", timestamp / 1e6, length);
+        return;
+    }
+    framesValid++;
+
+    uint8_t sender = frame[SENDER_ADDRESS_INDEX];
+    uint8_t destination = frame[DEST_ADDRESS_INDEX];
+    char type = (char)frame[MESSAGE_TYPE_INDEX];
+    uint8_t flags = frame[FLAGS_INDEX];
+    NodeStats& node = nodes[sender];
+    node.framesSent++;
+    node.bytesSent += length;
+    node.framesByType[type]++;
+
+    if (length == COMPACT_ACK_LENGTH) {
+        processCompactAck(timestamp, frame);
+        return;
+    }
+
+    // Header-Erweiterungen
+    size_t extensionLength = 0;
+    const uint8_t* ackExtension = nullptr;
+    if (flags & FLAG_EXT_ACK) {
+        ackExtension = &frame[HEADER_LENGTH];
+        extensionLength += EXT_ACK_LENGTH;
+    }
+    std::string heartbeat;
+    if (flags & FLAG_EXT_HEARTBEAT) {
+        if (HEADER_LENGTH + extensionLength + 2 > length) {
+            headerErrors++;
+            return;
+        }
+        const uint8_t* ext = &frame[HEADER_LENGTH + extensionLength];
+        if (ext[1] > EXT_HEARTBEAT_MAX_PAYLOAD) {
+            headerErrors++;
+            return;
+        }
+        heartbeat = std::string(1, (char)ext[0]) + ":" + std::string((const char*)&ext[2], ext[1]);
+        extensionLength += 2 + ext[1];
+        node.piggybackedHeartbeats++;
+    }
+    if (length < MIN_PACKET_LENGTH + extensionLength ||
+        (length - MIN_PACKET_LENGTH - extensionLength) % IV_LENGTH != 0) {
+        headerErrors++;
+        return;
+    }
+
+    size_t ivOffset = HEADER_LENGTH + extensionLength;
+    size_t hmacOffset = length - CRC_LENGTH - HMAC_LENGTH;
+    const uint8_t* sessionKey = key(frame[KEY_ID_INDEX]);
+    bool hmacOk = false;
+    std::string payload;
+    if (sessionKey == nullptr) {
+        node.unknownKey++;
+    } else {
+        uint8_t hmac[HMAC_LENGTH];
+        calculateHmac(sessionKey, frame, hmacOffset, hmac);
+        hmacOk = memcmp(hmac, &frame[hmacOffset], HMAC_LENGTH) == 0;
+        if (hmacOk) {
+            size_t encryptedLength = hmacOffset - ivOffset - IV_LENGTH;
+            std::vector<uint8_t> plain(&frame[ivOffset + IV_LENGTH], &frame[hmacOffset]);
+            if (decryptCbc(sessionKey, &frame[ivOffset], plain.data(), encryptedLength)) {
+                if (!(flags & FLAG_COMPRESSED)) {
+                    payload.assign((const char*)plain.data(), strnlen((const char*)plain.data(), encryptedLength));
+                } else if (plain[0] != 0) {
+                    // Preset-Wörterbücher kennt das Werkzeug nicht
+                    payload = "(komprimiert, Wörterbuch " + std::to_string(plain[0]) + ")";
+                } else {
+                    std::vector<uint8_t> original(plain[1]);
+                    if (rs485Decompress(&plain[COMPRESSION_HEADER_LENGTH], encryptedLength - COMPRESSION_HEADER_LENGTH,
+                                        nullptr, 0, original.data(), original.size())) {
+                        payload.assign((const char*)original.data(), original.size());
+                    } else {
+                        payload = "(komprimiert, fehlerhaft)";
+                    }
+                }
+            }
+        } else {
+            node.hmacErrors++;
+        }
+    }
+
+    if (verbose) {
+        printf("%12.6f  %3u -> %3u  '%c' Seq %3u Key %u Len %3zu%s%s%s%s%s  %s",
+               timestamp / 1e6, sender, destination, type, frame[SEQUENCE_INDEX], frame[KEY_ID_INDEX], length,
+               (flags & FLAG_ACK_REQUESTED) ? " ACK?" : "", (flags & FLAG_RETRANSMISSION) ? " WDH" : "",
+               (flags & FLAG_COMPRESSED) ? " LZ" : "",
+               ackExtension ? " +ACK" : "", heartbeat.empty() ? "" : " +HB",
+               sessionKey == nullptr ? "(Schlüssel unbekannt)" : (hmacOk ? "" : "(HMAC-Fehler)"));
+        if (hmacOk) printf("'%s'", payload.c_str());
+        if (!heartbeat.empty()) printf("  Heartbeat %s", heartbeat.c_str());
+        printf("\n");
+    }
+    if (!hmacOk) {
+        return;
+    }
+
+    if (ackExtension != nullptr) {
+        node.piggybackedAcks++;
+        matchAck(timestamp, sender, destination, ackExtension[0], ackExtension[1], nullptr, &ackExtension[2], nullptr);
+    }
+    if (flags & FLAG_RETRANSMISSION) {
+        node.retransmissions++;
+    }
+    if ((flags & FLAG_ACK_REQUESTED) && destination != BROADCAST_ADDRESS && type != MSG_TYPE_ACK_NACK) {
+        node.acksRequested++;
+        // Eine Wiederholung ersetzt die offene Anfrage (neues IV, neuer HMAC)
+        for (auto it = pending.begin(); it != pending.end(); ++it) {
+            if (it->sender == sender && it->destination == destination && it->sequence == frame[SEQUENCE_INDEX]) {
+                pending.erase(it);
+                break;
+            }
+        }
+        PendingRequest request;
+        request.sender = sender;
+        request.destination = destination;
+        request.sequence = frame[SEQUENCE_INDEX];
+        request.keyId = frame[KEY_ID_INDEX];
+        memcpy(request.frameHmac, &frame[hmacOffset], HMAC_LENGTH);
+        request.timestampMicros = timestamp;
+        request.retransmitted = (flags & FLAG_RETRANSMISSION) != 0;
+        pending.push_back(request);
+    }
+    if (type == MSG_TYPE_KEY_UPDATE) {
+        followKeyUpdate(payload);
+    }
+}
+
+void Decoder::processCompactAck(uint64_t timestamp, const uint8_t* frame) {
+    uint8_t sender = frame[SENDER_ADDRESS_INDEX];
+    uint8_t destination = frame[DEST_ADDRESS_INDEX];
+    uint8_t status = frame[FLAGS_INDEX];
+    NodeStats& node = nodes[sender];
+    node.compactAcksSent++;
+    if (status != ACK_OK) node.nacksSent++;
+    if (verbose) {
+        printf("%12.6f  %3u -> %3u  %s Seq %3u Status %u\n", timestamp / 1e6, sender, destination,
+               status == ACK_OK ? "ACK " : "NACK", frame[SEQUENCE_INDEX], status);
+    }
+    matchAck(timestamp, sender, destination, frame[SEQUENCE_INDEX], status, &frame[HEADER_LENGTH], nullptr, frame);
+}
+
+// Ordnet ein ACK (kompakt: mac + ackHeader, mitgesendet: hmacRef) der offenen Anfrage zu
+void Decoder::matchAck(uint64_t timestamp, uint8_t ackSender, uint8_t ackDestination, uint8_t sequence,
+                       uint8_t status, const uint8_t* mac, const uint8_t* hmacRef, const uint8_t* ackHeader) {
+    NodeStats& node = nodes[ackSender];
+    if (status != ACK_OK && hmacRef != nullptr) node.nacksSent++;
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+        if (it->sender != ackDestination || it->sequence != sequence ||
+            (it->destination != ackSender && !isGroupAddress(it->destination))) {
+            continue;
+        }
+        if (hmacRef != nullptr && memcmp(hmacRef, it->frameHmac, EXT_ACK_HMAC_REF_LENGTH) != 0) {
+            continue;
+        }
+        if (mac != nullptr) {
+            const uint8_t* sessionKey = key(ackHeader[KEY_ID_INDEX]);
+            if (sessionKey == nullptr) {
+                continue;
+            }
+            uint8_t macInput[HEADER_LENGTH + HMAC_LENGTH];
+            memcpy(macInput, ackHeader, HEADER_LENGTH);
+            memcpy(&macInput[HEADER_LENGTH], it->frameHmac, HMAC_LENGTH);
+            uint8_t expected[HMAC_LENGTH];
+            calculateHmac(sessionKey, macInput, sizeof(macInput), expected);
+            if (memcmp(expected, mac, COMPACT_ACK_MAC_LENGTH) != 0) {
+                macErrors++;
+                continue;
+            }
+        }
+        if (!it->retransmitted) {
+            node.ackLatency.add(timestamp - it->timestampMicros);
+        }
+        if (!isGroupAddress(it->destination)) {
+            pending.erase(it);
+        }
+        return;
+    }
+    orphanAcks++;
+}
+
+// Key-Update des Masters: {"keyID":n,"sessionKey":"<hex>","iv":"<hex>"}, Session Key mit dem
+// gehashten Master Key AES-256-CBC verschlüsselt
+void Decoder::followKeyUpdate(const std::string& payload) {
+    if (!haveMasterKey) {
+        return;
+    }
+    size_t keyIdPos = payload.find("\"keyID\":");
+    size_t keyPos = payload.find("\"sessionKey\":\"");
+    size_t ivPos = payload.find("\"iv\":\"");
+    if (keyIdPos == std::string::npos || keyPos == std::string::npos || ivPos == std::string::npos) {
+        return;
+    }
+    uint8_t keyId = (uint8_t)atoi(payload.c_str() + keyIdPos + 8);
+    std::string keyHex = payload.substr(keyPos + 14, payload.find('"', keyPos + 14) - (keyPos + 14));
+    std::string ivHex = payload.substr(ivPos + 6, payload.find('"', ivPos + 6) - (ivPos + 6));
+    uint8_t sessionKey[KEY_LENGTH];
+    uint8_t iv[IV_LENGTH];
+    if (!parseHex(keyHex, sessionKey, KEY_LENGTH) || !parseHex(ivHex, iv, IV_LENGTH) ||
+        !decryptCbc(masterKey, iv, sessionKey, KEY_LENGTH)) {
+        return;
+    }
+    sessionKeys[keyId] = std::vector<uint8_t>(sessionKey, sessionKey + KEY_LENGTH);
+    keyUpdates++;
+    if (verbose) printf("              Key-Update: Key ID %u übernommen\n", keyId);
+}
+
+void Decoder::expirePending(uint64_t now) {
+    for (auto it = pending.begin(); it != pending.end();) {
+        if (now - it->timestampMicros > PENDING_REQUEST_TIMEOUT_US) {
+            if (!isGroupAddress(it->destination)) nodes[it->destination].unansweredRequests++;
+            it = pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Decoder::printSummary() const {
+    double seconds = (lastTimestamp - firstTimestamp) / 1e6;
+    printf("\n=== Mitschnitt ===\n");
+    printf("Records: %u, Dauer: %.3f s, im Gerät verworfen: %u\n", records, seconds, captureDrops);
+    printf("Gültige Frames: %u, CRC-Fehler: %u, Header-/Längenfehler: %u, abgebrochen: %u\n",
+           framesValid, crcErrors, headerErrors, abortedFrames);
+    printf("Kompakte ACKs mit MAC-Fehler: %u, ACKs ohne passende Anfrage: %u, Key-Updates: %u\n",
+           macErrors, orphanAcks, keyUpdates);
+
+    printf("\n=== Knoten (als Absender) ===\n");
+    printf("Knoten  Frames   Bytes  B/s   HMAC  ?Key  WDH  ACK?  ACKs  +ACK  +HB  NACK  ohneACK  Latenz min/avg/max [us]\n");
+    for (const auto& entry : nodes) {
+        const NodeStats& node = entry.second;
+        printf("%6u %7u %7llu %5.0f %5u %5u %4u %5u %5u %5u %4u %5u %8u",
+               entry.first, node.framesSent, (unsigned long long)node.bytesSent,
+               seconds > 0 ? node.bytesSent / seconds : 0.0, node.hmacErrors, node.unknownKey,
+               node.retransmissions, node.acksRequested, node.compactAcksSent, node.piggybackedAcks,
+               node.piggybackedHeartbeats, node.nacksSent, node.unansweredRequests);
+        if (node.ackLatency.samples > 0) {
+            printf("  %llu/%llu/%llu (%u)", (unsigned long long)node.ackLatency.minMicros,
+                   (unsigned long long)(node.ackLatency.sumMicros / node.ackLatency.samples),
+                   (unsigned long long)node.ackLatency.maxMicros, node.ackLatency.samples);
+        }
+        printf("\n        Typen:");
+        for (const auto& type : node.framesByType) {
+            printf(" '%c'=%u", type.first, type.second);
+        }
+        printf("\n");
+    }
+}
+
+uint32_t readLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "Aufruf: %s [-m <master-key>] [-k <key-id>:<hex64>]... [-v] <mitschnitt.pcap|->\n"
+            "  -m  Master Key wie in credentials.h (Key ID 0, entschlüsselt Key-Updates)\n"
+            "  -k  Session Key direkt vorgeben (64 Hex-Zeichen)\n"
+            "  -v  Jeden Frame ausgeben\n", name);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Decoder decoder;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-v") {
+            decoder.verbose = true;
+        } else if (arg == "-m" && i + 1 < argc) {
+            decoder.setMasterKey(argv[++i]);
+        } else if (arg == "-k" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t colon = spec.find(':');
+            uint8_t keyData[KEY_LENGTH];
+            if (colon == std::string::npos || !parseHex(spec.substr(colon + 1), keyData, KEY_LENGTH)) {
+                usage(argv[0]);
+                return 2;
+            }
+            decoder.sessionKeys[(uint8_t)atoi(spec.substr(0, colon).c_str())] = std::vector<uint8_t>(keyData, keyData + KEY_LENGTH);
+        } else if (path == nullptr) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path == nullptr) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == nullptr) {
+        perror(path);
+        return 1;
+    }
+
+    // Bytes vor dem pcap-Dateikopf (z.B. Boot-Meldungen des ESP32) überspringen
+    uint8_t header[24];
+    size_t have = 0;
+    int c;
+    while (have < 4 && (c = fgetc(file)) != EOF) {
+        header[have++] = (uint8_t)c;
+        if (have == 4 && readLe32(header) != PCAP_MAGIC_MICROS) {
+            memmove(header, header + 1, 3);
+            have = 3;
+        }
+    }
+    if (have < 4 || fread(header + 4, 1, 20, file) != 20) {
+        fprintf(stderr, "Kein pcap-Dateikopf gefunden.\n");
+        return 1;
+    }
+    if (readLe32(header + 20) != CAPTURE_LINKTYPE) {
+        fprintf(stderr, "Unerwarteter Linktyp %u (erwartet %u).\n", readLe32(header + 20), CAPTURE_LINKTYPE);
+        return 1;
+    }
+
+    uint8_t recordHeader[16];
+    std::vector<uint8_t> data;
+    while (fread(recordHeader, 1, sizeof(recordHeader), file) == sizeof(recordHeader)) {
+        uint64_t timestamp = (uint64_t)readLe32(recordHeader) * 1000000ULL + readLe32(recordHeader + 4);
+        uint32_t capturedLength = readLe32(recordHeader + 8);
+        if (capturedLength > 65536) {
+            fprintf(stderr, "Ungültige Record-Länge %u, Abbruch.\n", capturedLength);
+            break;
+        }
+        data.resize(capturedLength);
+        if (fread(data.data(), 1, capturedLength, file) != capturedLength) {
+            fprintf(stderr, "Mitschnitt endet mitten in einem Record.\n");
+            break;
+        }
+        decoder.processRecord(timestamp, data.data(), capturedLength);
+    }
+    if (file != stdin) fclose(file);
+
+    decoder.expirePending(UINT64_MAX);
+    decoder.printSummary();
+    return 0;
+}
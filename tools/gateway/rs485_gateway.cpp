@@ -0,0 +1,780 @@
+// RS485-Gateway für Linux: betreibt einen RS485SecureStack-Endpunkt (standardmäßig den Master,
+// Adresse 0) an einer seriellen Schnittstelle oder PTY und reicht die entschlüsselten Nachrichten
+// über einen lokalen TCP- oder Unix-Socket weiter.
+//
+// Protokoll auf dem Socket: längenpräfixierte Binär-Records, mehrere Busnachrichten je
+// Schreibvorgang. Befehle vom Socket gehen über eine begrenzte Warteschlange auf den Bus,
+// ist sie voll, liest das Gateway nicht weiter vom Socket (Rückstau über TCP). Für Tests ohne
+// Hardware simuliert --simulate einen Bus mit Client-Knoten im selben Prozess.
+//
+// Bauen, Protokoll und Aufruf: siehe README.md in diesem Verzeichnis.
+
+#include "RS485SecureStack.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// ==============================================================================
+// Socket-Protokoll (Little Endian): u16 Länge (Typ + Inhalt), u8 Typ, Inhalt
+// ==============================================================================
+const uint8_t GATEWAY_PROTOCOL_VERSION = 1;
+
+const uint8_t RECORD_HELLO = 0x01;   // u8 Version, u8 Adresse des Gateways, u8 max. Payload, u32 Baudrate
+const uint8_t RECORD_MESSAGE = 0x02; // u32 millis(), u8 Absender, u8 Ziel, u8 Typ, u8 Flags, u8 Key ID, u8 Sequenz, Payload
+const uint8_t RECORD_RESULT = 0x03;  // u16 Auftrag, u8 Ergebnis (GatewayResult), u8 ACK-Status (RS485AckStatus)
+const uint8_t RECORD_DROPPED = 0x04; // u32 für diesen Client verworfene Nachrichten seit dem letzten DROPPED
+const uint8_t RECORD_SEND = 0x10;    // u16 Auftrag, u8 Ziel, u8 Typ, u8 Optionen, Payload
+
+const uint8_t MESSAGE_FLAG_REQUIRES_ACK = 0x01;
+const uint8_t MESSAGE_FLAG_MULTICAST = 0x02;
+const uint8_t MESSAGE_FLAG_HMAC_VERIFIED = 0x04;
+
+const uint8_t SEND_OPTION_REQUIRES_ACK = 0x01;
+
+enum GatewayResult : uint8_t {
+    GATEWAY_RESULT_OK = 0,       // Gesendet (und ggf. bestätigt)
+    GATEWAY_RESULT_FAILED = 1,   // NACK, kein ACK oder Senden fehlgeschlagen
+    GATEWAY_RESULT_REJECTED = 2  // Ungültiger Auftrag (Payload zu lang oder mit Nullbyte)
+};
+
+const size_t GATEWAY_MAX_CLIENTS = 8;
+const size_t GATEWAY_COMMAND_QUEUE = 64;
+
+// ==============================================================================
+// Serielle Schnittstelle (termios, nicht blockierend)
+// ==============================================================================
+speed_t speedForBaudRate(unsigned long baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+#ifdef B460800
+        case 460800: return B460800;
+        case 500000: return B500000;
+        case 921600: return B921600;
+        case 1000000: return B1000000;
+        case 2000000: return B2000000;
+#endif
+        default: return 0;
+    }
+}
+
+class PosixSerial : public HardwareSerial {
+public:
+    ~PosixSerial() {
+        if (_fd >= 0) close(_fd);
+    }
+
+    bool open(const char* path) {
+        _fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (_fd < 0) {
+            perror(path);
+            return false;
+        }
+        termios tio;
+        if (tcgetattr(_fd, &tio) != 0) {
+            perror(path);
+            return false;
+        }
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(_fd, TCSANOW, &tio);
+        return true;
+    }
+
+    int fd() const { return _fd; }
+
+    void begin(unsigned long baud, uint32_t config = 0, int8_t rxPin = -1, int8_t txPin = -1) override {
+        (void)config; (void)rxPin; (void)txPin;
+        speed_t speed = speedForBaudRate(baud);
+        termios tio;
+        if (_fd < 0 || tcgetattr(_fd, &tio) != 0) {
+            return;
+        }
+        if (speed == 0) {
+            fprintf(stderr, "Baudrate %lu wird von termios nicht unterstützt, bleibt bei %lu.\n", baud, (unsigned long)_baudRate);
+            return;
+        }
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tcsetattr(_fd, TCSADRAIN, &tio);
+        _baudRate = baud;
+    }
+
+    int available() override {
+        _fill();
+        return (int)_rxCount;
+    }
+    int read() override {
+        if (_rxCount == 0) _fill();
+        if (_rxCount == 0) return -1;
+        uint8_t value = _rx[_rxHead];
+        _rxHead = (_rxHead + 1) % sizeof(_rx);
+        _rxCount--;
+        return value;
+    }
+    int peek() override {
+        if (_rxCount == 0) _fill();
+        return _rxCount > 0 ? _rx[_rxHead] : -1;
+    }
+
+    // Blockiert, bis alles an den Treiber übergeben ist (wie HardwareSerial auf dem ESP32)
+    size_t write(const uint8_t* data, size_t length) override {
+        size_t written = 0;
+        while (written < length) {
+            ssize_t n = ::write(_fd, data + written, length - written);
+            if (n > 0) {
+                written += (size_t)n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                pollfd pfd = { _fd, POLLOUT, 0 };
+                poll(&pfd, 1, 100);
+            } else {
+                break;
+            }
+        }
+        return written;
+    }
+    size_t write(uint8_t b) override {
+        return write(&b, 1);
+    }
+    void flush() override {
+        tcdrain(_fd); // Der Stack schaltet danach die Richtung um
+    }
+
+private:
+    int _fd = -1;
+    uint8_t _rx[4096];
+    size_t _rxHead = 0;
+    size_t _rxCount = 0;
+
+    void _fill() {
+        while (_rxCount < sizeof(_rx)) {
+            size_t tail = (_rxHead + _rxCount) % sizeof(_rx);
+            size_t room = tail >= _rxHead ? sizeof(_rx) - tail : _rxHead - tail;
+            if (room > sizeof(_rx) - _rxCount) room = sizeof(_rx) - _rxCount;
+            ssize_t n = ::read(_fd, &_rx[tail], room);
+            if (n <= 0) break;
+            _rxCount += (size_t)n;
+        }
+    }
+};
+
+// ==============================================================================
+// Simulierter Bus: was ein Knoten schreibt, empfangen alle anderen (ohne Laufzeit und Kollisionen)
+// ==============================================================================
+class SimBus {
+public:
+    size_t attach() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _rx.emplace_back();
+        return _rx.size() - 1;
+    }
+    void transmit(size_t port, const uint8_t* data, size_t length) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < _rx.size(); ++i) {
+            if (i != port) _rx[i].insert(_rx[i].end(), data, data + length);
+        }
+    }
+    int available(size_t port) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return (int)_rx[port].size();
+    }
+    int read(size_t port, bool remove) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_rx[port].empty()) return -1;
+        uint8_t value = _rx[port].front();
+        if (remove) _rx[port].pop_front();
+        return value;
+    }
+
+private:
+    std::mutex _mutex;
+    std::deque<std::deque<uint8_t>> _rx;
+};
+
+class SimBusSerial : public HardwareSerial {
+public:
+    SimBusSerial(SimBus& bus) : _bus(bus), _port(bus.attach()) {}
+
+    int available() override { return _bus.available(_port); }
+    int read() override { return _bus.read(_port, true); }
+    int peek() override { return _bus.read(_port, false); }
+    size_t write(const uint8_t* data, size_t length) override {
+        _bus.transmit(_port, data, length);
+        return length;
+    }
+    size_t write(uint8_t b) override {
+        return write(&b, 1);
+    }
+
+private:
+    SimBus& _bus;
+    size_t _port;
+};
+
+// Client-Knoten des simulierten Busses: senden zyklisch Messwerte an den Master und
+// beantworten Datennachrichten des Masters mit einem Echo
+struct SimNode {
+    std::unique_ptr<SimBusSerial> serial;
+    std::unique_ptr<RS485SecureStack> stack;
+    uint8_t address = 0;
+    uint8_t masterAddress = 0;
+    unsigned long nextReportMillis = 0;
+    uint32_t reports = 0;
+};
+
+void onSimPacket(void* context, RS485SecureStack::Packet_t packet) {
+    SimNode* node = static_cast<SimNode*>(context);
+    if (packet.senderAddress == node->masterAddress && packet.messageType == MSG_TYPE_DATA &&
+        packet.destinationAddress == node->address) {
+        String reply = "ECHO:";
+        reply += packet.payload;
+        node->stack->sendMessage(node->masterAddress, node->address, MSG_TYPE_DATA,
+                                 reply.substring(0, RS485_MAX_PAYLOAD_LENGTH), false);
+    }
+}
+
+void runSimulation(std::vector<std::unique_ptr<SimNode>>* nodes, unsigned long intervalMs, const std::atomic<bool>* running) {
+    randomSeed(0x5133);
+    while (running->load()) {
+        unsigned long now = millis();
+        for (auto& node : *nodes) {
+            node->stack->loop();
+            if (intervalMs > 0 && (long)(now - node->nextReportMillis) >= 0) {
+                node->nextReportMillis = now + intervalMs;
+                char payload[64];
+                snprintf(payload, sizeof(payload), "SIM:%u,N:%lu,T:%lu", node->address, (unsigned long)node->reports++, now);
+                node->stack->sendMessage(node->masterAddress, node->address, MSG_TYPE_DATA, payload, false);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+// ==============================================================================
+// Gateway
+// ==============================================================================
+struct GatewayOptions {
+    const char* device = nullptr;
+    int simulatedNodes = 0;
+    unsigned long simIntervalMs = 100;
+    const char* masterKey = nullptr;
+    uint8_t address = 0;
+    uint8_t keyId = 0;
+    long baudRate = 0;
+    const char* tcpHost = "127.0.0.1";
+    int tcpPort = 5485;
+    const char* unixPath = nullptr;
+    unsigned long batchDelayMicros = 2000;
+    size_t batchBytes = 4096;
+    size_t clientBufferLimit = 256 * 1024;
+    unsigned long statsIntervalMs = 0;
+    bool debug = false;
+};
+
+struct GatewayStats {
+    uint64_t messagesUp = 0;    // An die Clients verteilte Busnachrichten
+    uint64_t socketWrites = 0;  // send()-Aufrufe mit Nutzdaten
+    uint64_t bytesUp = 0;
+    uint64_t commands = 0;      // Ausgeführte Sendeaufträge
+    uint64_t commandsFailed = 0;
+    uint64_t commandsRejected = 0;
+    uint64_t dropped = 0;       // Wegen vollem Client-Puffer verworfene Nachrichten
+    uint64_t backPressureMillis = 0; // Zeit, in der die Befehlswarteschlange voll war
+};
+
+struct Client {
+    int fd = -1;
+    uint32_t id = 0;
+    std::vector<uint8_t> out;   // Ungesendete Records, ab outSent
+    size_t outSent = 0;
+    unsigned long batchStartMicros = 0; // Ältester ungesendeter Record
+    uint32_t dropped = 0;       // Noch nicht gemeldete verworfene Nachrichten
+    std::vector<uint8_t> in;    // Empfangene, noch nicht vollständige Records
+};
+
+struct Command {
+    uint32_t clientId;
+    uint16_t requestId;
+    uint8_t destination;
+    char messageType;
+    bool requiresAck;
+    std::string payload;
+};
+
+void appendLe16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back((uint8_t)value);
+    out.push_back((uint8_t)(value >> 8));
+}
+
+void appendLe32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+class Gateway {
+public:
+    Gateway(const GatewayOptions& options, RS485SecureStack& stack) : _options(options), _stack(stack) {}
+
+    bool listen() {
+        if (_options.unixPath != nullptr) {
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (strlen(_options.unixPath) >= sizeof(addr.sun_path)) {
+                fprintf(stderr, "Socket-Pfad zu lang: %s\n", _options.unixPath);
+                return false;
+            }
+            strcpy(addr.sun_path, _options.unixPath);
+            unlink(_options.unixPath);
+            _listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (_listenFd < 0 || bind(_listenFd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+                perror(_options.unixPath);
+                return false;
+            }
+        } else {
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons((uint16_t)_options.tcpPort);
+            if (inet_pton(AF_INET, _options.tcpHost, &addr.sin_addr) != 1) {
+                fprintf(stderr, "Ungültige Adresse: %s\n", _options.tcpHost);
+                return false;
+            }
+            _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+            int reuse = 1;
+            setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if (_listenFd < 0 || bind(_listenFd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+                perror("bind");
+                return false;
+            }
+        }
+        fcntl(_listenFd, F_SETFL, O_NONBLOCK);
+        if (::listen(_listenFd, 4) != 0) {
+            perror("listen");
+            return false;
+        }
+        return true;
+    }
+
+    // Ein Durchlauf: Sockets bedienen, Bus bedienen, höchstens einen Auftrag senden, Batches schreiben
+    void step(int serialFd) {
+        std::vector<pollfd> pfds;
+        pfds.push_back({ _listenFd, POLLIN, 0 });
+        bool queueFull = _commands.size() >= GATEWAY_COMMAND_QUEUE;
+        for (Client& client : _clients) {
+            short events = 0;
+            if (!queueFull) events |= POLLIN; // Rückstau: volle Warteschlange, nichts mehr lesen
+            if (client.out.size() > client.outSent) events |= POLLOUT;
+            pfds.push_back({ client.fd, events, 0 });
+        }
+        if (serialFd >= 0) pfds.push_back({ serialFd, POLLIN, 0 });
+        poll(pfds.data(), pfds.size(), 1);
+
+        unsigned long now = millis();
+        if (queueFull) _stats.backPressureMillis += now - _lastStepMillis;
+        _lastStepMillis = now;
+
+        size_t polledClients = _clients.size();
+        for (size_t i = 0; i < polledClients; ++i) {
+            if (pfds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) _readClient(_clients[i]);
+        }
+        if (pfds[0].revents & POLLIN) _accept();
+
+        _stack.loop();
+        bool executed = false;
+        if (!_commands.empty()) {
+            _execute(_commands.front());
+            _commands.pop_front();
+            executed = true;
+        }
+        for (Client& client : _clients) {
+            _parseClient(client); // Zurückgestaute Records nachholen, sobald Platz ist
+            // Nach einem Auftrag sofort schreiben: der nächste kann wieder auf ein ACK warten
+            _flushClient(client, executed);
+        }
+        _removeClosed();
+    }
+
+    void onPacket(const RS485SecureStack::Packet_t& packet) {
+        size_t payloadLength = packet.payload.length();
+        uint8_t flags = 0;
+        if (packet.requiresAck) flags |= MESSAGE_FLAG_REQUIRES_ACK;
+        if (packet.isMulticast) flags |= MESSAGE_FLAG_MULTICAST;
+        if (packet.hmacVerified) flags |= MESSAGE_FLAG_HMAC_VERIFIED;
+        for (Client& client : _clients) {
+            if (client.out.size() - client.outSent > _options.clientBufferLimit) {
+                client.dropped++;
+                _stats.dropped++;
+                continue;
+            }
+            if (client.dropped > 0) {
+                _beginRecord(client, RECORD_DROPPED, 4);
+                appendLe32(client.out, client.dropped);
+                client.dropped = 0;
+            }
+            _beginRecord(client, RECORD_MESSAGE, 10 + payloadLength);
+            appendLe32(client.out, (uint32_t)millis());
+            client.out.push_back(packet.senderAddress);
+            client.out.push_back(packet.destinationAddress);
+            client.out.push_back((uint8_t)packet.messageType);
+            client.out.push_back(flags);
+            client.out.push_back(packet.keyId);
+            client.out.push_back(packet.sequenceNumber);
+            client.out.insert(client.out.end(), packet.payload.c_str(), packet.payload.c_str() + payloadLength);
+        }
+        _stats.messagesUp++;
+    }
+
+    void flushAll() {
+        for (Client& client : _clients) _flushClient(client, true);
+    }
+
+    const GatewayStats& stats() const { return _stats; }
+    size_t clientCount() const { return _clients.size(); }
+    size_t queuedCommands() const { return _commands.size(); }
+
+private:
+    const GatewayOptions& _options;
+    RS485SecureStack& _stack;
+    int _listenFd = -1;
+    std::vector<Client> _clients;
+    std::deque<Command> _commands;
+    uint32_t _nextClientId = 1;
+    unsigned long _lastStepMillis = 0;
+    GatewayStats _stats;
+
+    void _accept() {
+        int fd;
+        while ((fd = accept(_listenFd, nullptr, nullptr)) >= 0) {
+            if (_clients.size() >= GATEWAY_MAX_CLIENTS) {
+                close(fd);
+                continue;
+            }
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)); // Das Gateway bündelt selbst
+            Client client;
+            client.fd = fd;
+            client.id = _nextClientId++;
+            _beginRecord(client, RECORD_HELLO, 7);
+            client.out.push_back(GATEWAY_PROTOCOL_VERSION);
+            client.out.push_back(_options.address);
+            client.out.push_back(RS485_MAX_PAYLOAD_LENGTH);
+            appendLe32(client.out, (uint32_t)_stack.getBaudRate());
+            _flushClient(client, true);
+            _clients.push_back(std::move(client));
+        }
+    }
+
+    void _readClient(Client& client) {
+        uint8_t buffer[4096];
+        ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            client.in.insert(client.in.end(), buffer, buffer + n);
+            _parseClient(client);
+        } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            _closeClient(client);
+        }
+    }
+
+    void _parseClient(Client& client) {
+        size_t pos = 0;
+        while (client.fd >= 0 && _commands.size() < GATEWAY_COMMAND_QUEUE && client.in.size() - pos >= 2) {
+            size_t length = client.in[pos] | (client.in[pos + 1] << 8);
+            if (client.in.size() - pos < 2 + length) {
+                break;
+            }
+            const uint8_t* record = &client.in[pos + 2];
+            if (length >= 6 && record[0] == RECORD_SEND) {
+                Command command;
+                command.clientId = client.id;
+                command.requestId = (uint16_t)(record[1] | (record[2] << 8));
+                command.destination = record[3];
+                command.messageType = (char)record[4];
+                command.requiresAck = (record[5] & SEND_OPTION_REQUIRES_ACK) != 0;
+                command.payload.assign((const char*)&record[6], length - 6);
+                _commands.push_back(std::move(command));
+            } else {
+                fprintf(stderr, "Client %u: unbekannter Record (Typ 0x%02X, %zu Bytes), Verbindung getrennt.\n",
+                        client.id, length > 0 ? record[0] : 0, length);
+                _closeClient(client);
+            }
+            pos += 2 + length;
+        }
+        client.in.erase(client.in.begin(), client.in.begin() + (client.fd >= 0 ? pos : client.in.size()));
+    }
+
+    void _execute(const Command& command) {
+        uint8_t result = GATEWAY_RESULT_OK;
+        uint8_t ackStatus = RS485_ACK_OK;
+        if (command.payload.size() > RS485_MAX_PAYLOAD_LENGTH || command.payload.find('\0') != std::string::npos) {
+            result = GATEWAY_RESULT_REJECTED;
+            _stats.commandsRejected++;
+        } else {
+            String payload(command.payload.c_str());
+            bool sent;
+            if (RS485SecureStack::isGroupAddress(command.destination)) {
+                sent = _stack.sendMulticast(command.destination, command.messageType, payload, command.requiresAck);
+            } else {
+                sent = _stack.sendMessage(command.destination, _options.address, command.messageType, payload, command.requiresAck);
+                if (command.requiresAck) ackStatus = _stack.getLastAckStatus();
+            }
+            if (!sent) {
+                result = GATEWAY_RESULT_FAILED;
+                _stats.commandsFailed++;
+            }
+            _stats.commands++;
+        }
+        for (Client& client : _clients) {
+            if (client.id == command.clientId && client.fd >= 0) {
+                _beginRecord(client, RECORD_RESULT, 4);
+                appendLe16(client.out, command.requestId);
+                client.out.push_back(result);
+                client.out.push_back(ackStatus);
+            }
+        }
+    }
+
+    void _beginRecord(Client& client, uint8_t type, size_t bodyLength) {
+        if (client.out.size() == client.outSent) client.batchStartMicros = micros();
+        appendLe16(client.out, (uint16_t)(1 + bodyLength));
+        client.out.push_back(type);
+    }
+
+    // Schreibt alle gesammelten Records mit einem send(), sobald der Batch groß oder alt genug ist
+    void _flushClient(Client& client, bool force) {
+        size_t pending = client.out.size() - client.outSent;
+        if (client.fd < 0 || pending == 0) {
+            return;
+        }
+        if (!force && pending < _options.batchBytes && micros() - client.batchStartMicros < _options.batchDelayMicros) {
+            return;
+        }
+        ssize_t n = send(client.fd, &client.out[client.outSent], pending, MSG_NOSIGNAL);
+        if (n > 0) {
+            client.outSent += (size_t)n;
+            _stats.socketWrites++;
+            _stats.bytesUp += (uint64_t)n;
+        } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            _closeClient(client);
+            return;
+        }
+        if (client.outSent == client.out.size()) {
+            client.out.clear();
+            client.outSent = 0;
+        } else if (client.outSent > _options.clientBufferLimit) {
+            client.out.erase(client.out.begin(), client.out.begin() + client.outSent);
+            client.outSent = 0;
+        }
+    }
+
+    void _closeClient(Client& client) {
+        if (client.fd >= 0) {
+            close(client.fd);
+            client.fd = -1;
+        }
+    }
+
+    void _removeClosed() {
+        for (size_t i = 0; i < _clients.size();) {
+            if (_clients[i].fd < 0) {
+                uint32_t id = _clients[i].id;
+                _clients.erase(_clients.begin() + i);
+                for (auto it = _commands.begin(); it != _commands.end();) {
+                    it = it->clientId == id ? _commands.erase(it) : it + 1;
+                }
+            } else {
+                ++i;
+            }
+        }
+    }
+};
+
+void onGatewayPacket(void* context, RS485SecureStack::Packet_t packet) {
+    static_cast<Gateway*>(context)->onPacket(packet);
+}
+
+void printStats(const Gateway& gateway) {
+    const GatewayStats& stats = gateway.stats();
+    double perWrite = stats.socketWrites > 0 ? (double)stats.messagesUp / stats.socketWrites : 0;
+    fprintf(stderr, "Clients %zu | Nachrichten %llu, Bytes %llu, Schreibvorgänge %llu (%.1f Nachrichten je Schreibvorgang), "
+                    "verworfen %llu | Aufträge %llu, fehlgeschlagen %llu, abgelehnt %llu, wartend %zu, Rückstau %llu ms\n",
+            gateway.clientCount(), (unsigned long long)stats.messagesUp, (unsigned long long)stats.bytesUp,
+            (unsigned long long)stats.socketWrites, perWrite, (unsigned long long)stats.dropped,
+            (unsigned long long)stats.commands, (unsigned long long)stats.commandsFailed,
+            (unsigned long long)stats.commandsRejected, gateway.queuedCommands(),
+            (unsigned long long)stats.backPressureMillis);
+}
+
+std::atomic<bool> running(true);
+
+void onSignal(int) {
+    running = false;
+}
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "Aufruf: %s -k <master_key> (-D <gerät> | --simulate <n>) [Optionen]\n"
+            "  -D <gerät>       Serielle Schnittstelle oder PTY (z.B. /dev/ttyUSB0)\n"
+            "  --simulate <n>   Simulierter Bus mit n Client-Knoten (Adressen 11, 12, ...)\n"
+            "  --sim-interval <ms>  Sendeabstand der simulierten Knoten (Standard: 100, 0 = nur Echo)\n"
+            "  -k <key>         Master Key\n"
+            "  -a <adresse>     Adresse des Gateways auf dem Bus (Standard: 0, Master)\n"
+            "  -K <id>          Key ID (Standard: 0)\n"
+            "  -b <baud>        Baudrate nach dem Start (Standard: RS485_INITIAL_BAUD_RATE)\n"
+            "  -l <ip:port>     TCP-Socket (Standard: 127.0.0.1:5485)\n"
+            "  -u <pfad>        Unix-Socket statt TCP\n"
+            "  -w <us>          Höchstes Alter eines Batches (Standard: 2000)\n"
+            "  -B <bytes>       Batch sofort schreiben ab dieser Größe (Standard: 4096)\n"
+            "  -q <KiB>         Puffergrenze je Client, darüber werden Nachrichten verworfen (Standard: 256)\n"
+            "  -i <s>           Statistik alle s Sekunden ausgeben\n"
+            "  -d               Debug-Ausgaben des Stacks\n",
+            name);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    GatewayOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-D" && hasValue) {
+            options.device = argv[++i];
+        } else if (arg == "--simulate" && hasValue) {
+            options.simulatedNodes = atoi(argv[++i]);
+        } else if (arg == "--sim-interval" && hasValue) {
+            options.simIntervalMs = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-k" && hasValue) {
+            options.masterKey = argv[++i];
+        } else if (arg == "-a" && hasValue) {
+            options.address = (uint8_t)atoi(argv[++i]);
+        } else if (arg == "-K" && hasValue) {
+            options.keyId = (uint8_t)atoi(argv[++i]);
+        } else if (arg == "-b" && hasValue) {
+            options.baudRate = atol(argv[++i]);
+        } else if (arg == "-l" && hasValue) {
+            std::string value = argv[++i];
+            size_t colon = value.rfind(':');
+            if (colon == std::string::npos) {
+                usage(argv[0]);
+                return 2;
+            }
+            static std::string host;
+            host = value.substr(0, colon);
+            options.tcpHost = host.c_str();
+            options.tcpPort = atoi(value.c_str() + colon + 1);
+        } else if (arg == "-u" && hasValue) {
+            options.unixPath = argv[++i];
+        } else if (arg == "-w" && hasValue) {
+            options.batchDelayMicros = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-B" && hasValue) {
+            options.batchBytes = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-q" && hasValue) {
+            options.clientBufferLimit = strtoul(argv[++i], nullptr, 10) * 1024;
+        } else if (arg == "-i" && hasValue) {
+            options.statsIntervalMs = strtoul(argv[++i], nullptr, 10) * 1000;
+        } else if (arg == "-d") {
+            options.debug = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.masterKey == nullptr || (options.device == nullptr) == (options.simulatedNodes <= 0)) {
+        usage(argv[0]);
+        return 2;
+    }
+    hostSetSerialOutput(options.debug);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    randomSeed((unsigned long)time(nullptr) ^ ((unsigned long)getpid() << 16));
+
+    // Bus: echte Schnittstelle oder simulierter Bus mit Client-Knoten
+    PosixSerial posixSerial;
+    SimBus simBus;
+    std::unique_ptr<SimBusSerial> simSerial;
+    std::vector<std::unique_ptr<SimNode>> simNodes;
+    HardwareSerial* serial = &posixSerial;
+    if (options.device != nullptr) {
+        if (!posixSerial.open(options.device)) {
+            return 1;
+        }
+    } else {
+        simSerial.reset(new SimBusSerial(simBus));
+        serial = simSerial.get();
+        for (int i = 0; i < options.simulatedNodes; ++i) {
+            std::unique_ptr<SimNode> node(new SimNode());
+            node->address = (uint8_t)(11 + i);
+            node->masterAddress = options.address;
+            node->serial.reset(new SimBusSerial(simBus));
+            node->stack.reset(new RS485SecureStack());
+            node->stack->begin(node->address, options.masterKey, options.keyId, *node->serial);
+            node->stack->registerReceiveCallback(onSimPacket, node.get());
+            node->nextReportMillis = millis() + 10 * i; // Sendezeitpunkte etwas verteilen
+            simNodes.push_back(std::move(node));
+        }
+    }
+
+    RS485SecureStack stack;
+    stack.begin(options.address, options.masterKey, options.keyId, *serial);
+    stack.setDebug(options.debug);
+    if (options.baudRate > 0) {
+        stack.setBaudRate(options.baudRate);
+    }
+    Gateway gateway(options, stack);
+    stack.registerReceiveCallback(onGatewayPacket, &gateway);
+    if (!gateway.listen()) {
+        return 1;
+    }
+    if (options.unixPath != nullptr) {
+        fprintf(stderr, "Gateway (Adresse %u) wartet auf %s\n", options.address, options.unixPath);
+    } else {
+        fprintf(stderr, "Gateway (Adresse %u) wartet auf %s:%d\n", options.address, options.tcpHost, options.tcpPort);
+    }
+
+    std::thread simThread;
+    if (!simNodes.empty()) {
+        simThread = std::thread(runSimulation, &simNodes, options.simIntervalMs, &running);
+    }
+
+    int serialFd = options.device != nullptr ? posixSerial.fd() : -1;
+    unsigned long lastStatsMillis = millis();
+    while (running) {
+        gateway.step(serialFd);
+        if (options.statsIntervalMs > 0 && millis() - lastStatsMillis >= options.statsIntervalMs) {
+            lastStatsMillis = millis();
+            printStats(gateway);
+        }
+    }
+    gateway.flushAll();
+    if (simThread.joinable()) simThread.join();
+    printStats(gateway);
+    if (options.unixPath != nullptr) unlink(options.unixPath);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef RS485_HOST_AES_H
+#define RS485_HOST_AES_H
+
+#include <cstddef>
+#include <cstdint>
+
+// AES-256-CBC ohne Padding mit der vom Stack benutzten Schnittstelle, umgesetzt mit OpenSSL
+class AES256 {
+public:
+    size_t keySize() const { return 32; }
+    size_t ivSize() const { return 16; }
+    bool setKey(const uint8_t* key, size_t length);
+    void setIV(const uint8_t* iv, size_t length);
+    void encryptCBC(uint8_t* data, size_t length);
+    void decryptCBC(uint8_t* data, size_t length);
+
+private:
+    uint8_t _key[32];
+    uint8_t _iv[16];
+    void _crypt(uint8_t* data, size_t length, bool encrypt);
+};
+
+#endif // RS485_HOST_AES_H
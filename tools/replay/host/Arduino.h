@@ -0,0 +1,169 @@
+// Minimale Arduino-Umgebung für den Host (Linux), gerade genug für RS485SecureStack.
+// Nur für tools/replay, nicht für den Mikrocontroller.
+#ifndef RS485_HOST_ARDUINO_H
+#define RS485_HOST_ARDUINO_H
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define IRAM_ATTR
+
+// Zeit seit Programmstart (steady_clock)
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Deterministischer Pseudo-Zufall (reproduzierbare IVs und Korpora)
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int analogRead(int) { return 0; }
+
+class String {
+public:
+    String() {}
+    String(const char* text) : _s(text ? text : "") {}
+    String(const std::string& text) : _s(text) {}
+    String(char c) : _s(1, c) {}
+    String(int value) : _s(std::to_string(value)) {}
+    String(unsigned int value) : _s(std::to_string(value)) {}
+    String(long value) : _s(std::to_string(value)) {}
+    String(unsigned long value) : _s(std::to_string(value)) {}
+
+    unsigned int length() const { return (unsigned int)_s.size(); }
+    const char* c_str() const { return _s.c_str(); }
+    bool reserve(unsigned int size) { _s.reserve(size); return true; }
+    char charAt(unsigned int index) const { return index < _s.size() ? _s[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    bool equals(const String& other) const { return _s == other._s; }
+    bool operator==(const String& other) const { return _s == other._s; }
+    bool operator!=(const String& other) const { return _s != other._s; }
+    bool startsWith(const String& prefix) const { return _s.compare(0, prefix._s.size(), prefix._s) == 0; }
+    bool endsWith(const String& suffix) const {
+        return _s.size() >= suffix._s.size() && _s.compare(_s.size() - suffix._s.size(), suffix._s.size(), suffix._s) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const { return _find(_s.find(c, from)); }
+    int indexOf(const String& text, unsigned int from = 0) const { return _find(_s.find(text._s, from)); }
+    int lastIndexOf(char c) const { return _find(_s.rfind(c)); }
+    String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        return from < to && from < _s.size() ? String(_s.substr(from, to - from)) : String();
+    }
+    long toInt() const { return atol(_s.c_str()); }
+    void trim() {
+        size_t first = _s.find_first_not_of(" \t\r\n");
+        size_t last = _s.find_last_not_of(" \t\r\n");
+        _s = first == std::string::npos ? std::string() : _s.substr(first, last - first + 1);
+    }
+
+    bool concat(const char* text, unsigned int length) { _s.append(text, length); return true; }
+    bool concat(const String& other) { _s += other._s; return true; }
+    bool concat(char c) { _s += c; return true; }
+    String& operator+=(const String& other) { _s += other._s; return *this; }
+    String& operator+=(const char* text) { _s += text; return *this; }
+    String& operator+=(char c) { _s += c; return *this; }
+    String& operator+=(int value) { _s += std::to_string(value); return *this; }
+    String& operator+=(unsigned int value) { _s += std::to_string(value); return *this; }
+    String& operator+=(long value) { _s += std::to_string(value); return *this; }
+    String& operator+=(unsigned long value) { _s += std::to_string(value); return *this; }
+
+    friend String operator+(const String& a, const String& b) { return String(a._s + b._s); }
+
+private:
+    std::string _s;
+    static int _find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* data, size_t length) {
+        size_t written = 0;
+        while (written < length && write(data[written])) written++;
+        return written;
+    }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t print(const String& text) { return print(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return print(String(value)); }
+    size_t print(unsigned int value) { return print(String(value)); }
+    size_t print(long value) { return print(String(value)); }
+    size_t print(unsigned long value) { return print(String(value)); }
+    size_t print(double value, int digits = 2) { char text[32]; snprintf(text, sizeof(text), "%.*f", digits, value); return print(text); }
+    size_t println() { return print("\n"); }
+    template <typename T> size_t println(T value) { return print(value) + println(); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    // Liest ohne Wartezeit, was vorhanden ist (der Stack fordert nie mehr als available() an)
+    size_t readBytes(uint8_t* buffer, size_t length) {
+        size_t count = 0;
+        int value;
+        while (count < length && (value = read()) >= 0) {
+            buffer[count++] = (uint8_t)value;
+        }
+        return count;
+    }
+
+protected:
+    unsigned long _timeout = 1000;
+};
+
+#include "HardwareSerial.h"
+
+// Serial schreibt nach stdout (Debug-Ausgaben des Stacks), ist aber standardmäßig stumm,
+// damit die Ausgabe die Messung nicht verfälscht (siehe hostSetSerialOutput())
+extern HardwareSerial Serial;
+void hostSetSerialOutput(bool enabled);
+
+// FreeRTOS ist auf dem Host nicht vorhanden: Tasks lassen sich nicht anlegen (der
+// Pipeline-Empfang meldet daher einen Fehler), kritische Abschnitte sind leer.
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void* QueueHandle_t;
+struct portMUX_TYPE { int unused; };
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+inline BaseType_t xTaskCreatePinnedToCore(void (*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, BaseType_t) { return pdFAIL; }
+inline void xTaskNotifyGive(TaskHandle_t) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskDelay(TickType_t ticks) { delay(ticks); }
+inline TickType_t xTaskGetTickCount() { return (TickType_t)millis(); }
+
+#endif // RS485_HOST_ARDUINO_H
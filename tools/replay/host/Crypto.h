@@ -0,0 +1,4 @@
+#ifndef RS485_HOST_CRYPTO_H
+#define RS485_HOST_CRYPTO_H
+// Auf dem Host stellen SHA256.h und AES.h die Krypto-Klassen über OpenSSL bereit
+#endif // RS485_HOST_CRYPTO_H
@@ -0,0 +1,25 @@
+#ifndef RS485_HOST_HARDWARE_SERIAL_H
+#define RS485_HOST_HARDWARE_SERIAL_H
+
+#include "Arduino.h"
+
+// Basis für die simulierten UARTs des Hosts. Ohne Überschreibung schreibt sie nach stdout.
+class HardwareSerial : public Stream {
+public:
+    virtual void begin(unsigned long baud, uint32_t config = 0, int8_t rxPin = -1, int8_t txPin = -1) {
+        (void)config; (void)rxPin; (void)txPin;
+        _baudRate = baud;
+    }
+    virtual void end() {}
+    virtual uint32_t baudRate() { return _baudRate; }
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t* data, size_t length) override;
+    int availableForWrite() override { return 4096; }
+    operator bool() const { return true; }
+    using Print::write;
+
+protected:
+    uint32_t _baudRate = 9600;
+};
+
+#endif // RS485_HOST_HARDWARE_SERIAL_H
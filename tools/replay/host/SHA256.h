@@ -0,0 +1,22 @@
+#ifndef RS485_HOST_SHA256_H
+#define RS485_HOST_SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 mit der vom Stack benutzten Schnittstelle, umgesetzt mit OpenSSL
+class SHA256 {
+public:
+    SHA256();
+    ~SHA256();
+    size_t hashSize() const { return 32; }
+    size_t blockSize() const { return 64; }
+    void reset();
+    void update(const void* data, size_t length);
+    void finalize(void* hash, size_t length);
+
+private:
+    void* _ctx; // EVP_MD_CTX
+};
+
+#endif // RS485_HOST_SHA256_H
@@ -0,0 +1,120 @@
+// Implementierung der Host-Umgebung (Zeit, Zufall, Serial, Krypto über OpenSSL)
+#include "Arduino.h"
+#include "AES.h"
+#include "SHA256.h"
+
+#include <openssl/evp.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+namespace {
+const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+thread_local std::mt19937 randomGenerator(1); // Je Thread, deterministisch ab randomSeed()
+bool serialOutput = false;
+}
+
+unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+long random(long max) {
+    return max <= 0 ? 0 : (long)(randomGenerator() % (unsigned long)max);
+}
+
+long random(long min, long max) {
+    return max <= min ? min : min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) {
+    randomGenerator.seed((std::mt19937::result_type)seed);
+}
+
+size_t Print::printf(const char* format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0) return 0;
+    return write((const uint8_t*)text, (size_t)length < sizeof(text) ? (size_t)length : sizeof(text) - 1);
+}
+
+HardwareSerial Serial;
+
+void hostSetSerialOutput(bool enabled) {
+    serialOutput = enabled;
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+    return write(&b, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t length) {
+    if (serialOutput) fwrite(data, 1, length, stdout);
+    return length;
+}
+
+SHA256::SHA256() : _ctx(EVP_MD_CTX_new()) {
+    reset();
+}
+
+SHA256::~SHA256() {
+    EVP_MD_CTX_free(static_cast<EVP_MD_CTX*>(_ctx));
+}
+
+void SHA256::reset() {
+    EVP_DigestInit_ex(static_cast<EVP_MD_CTX*>(_ctx), EVP_sha256(), nullptr);
+}
+
+void SHA256::update(const void* data, size_t length) {
+    EVP_DigestUpdate(static_cast<EVP_MD_CTX*>(_ctx), data, length);
+}
+
+void SHA256::finalize(void* hash, size_t length) {
+    uint8_t digest[32];
+    unsigned int digestLength = 0;
+    EVP_DigestFinal_ex(static_cast<EVP_MD_CTX*>(_ctx), digest, &digestLength);
+    memcpy(hash, digest, length < sizeof(digest) ? length : sizeof(digest));
+}
+
+bool AES256::setKey(const uint8_t* key, size_t length) {
+    if (length != sizeof(_key)) return false;
+    memcpy(_key, key, sizeof(_key));
+    return true;
+}
+
+void AES256::setIV(const uint8_t* iv, size_t length) {
+    memcpy(_iv, iv, length < sizeof(_iv) ? length : sizeof(_iv));
+}
+
+void AES256::encryptCBC(uint8_t* data, size_t length) {
+    _crypt(data, length, true);
+}
+
+void AES256::decryptCBC(uint8_t* data, size_t length) {
+    _crypt(data, length, false);
+}
+
+void AES256::_crypt(uint8_t* data, size_t length, bool encrypt) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int outLength = 0;
+    EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), nullptr, _key, _iv, encrypt ? 1 : 0);
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    EVP_CipherUpdate(ctx, data, &outLength, data, (int)length);
+    EVP_CipherFinal_ex(ctx, data + outLength, &outLength);
+    EVP_CIPHER_CTX_free(ctx);
+}
@@ -0,0 +1,698 @@
+// Replay-Messplatz für den Empfangspfad von RS485SecureStack auf dem Host (Linux).
+//
+// Spielt einen Bus-Mitschnitt (pcap von RS485BusCapture) über eine simulierte UART in
+// RS485SecureStack::loop() ein, entweder mit dem ursprünglichen Byte-Timing oder so schnell
+// wie möglich, und misst Durchsatz, Verarbeitungszeit je Frame, Fehlerklassen und die Latenz
+// bis zum Empfangs-Callback. Außerdem erzeugt das Werkzeug synthetische Korpora.
+//
+// Bauen und Aufruf: siehe README.md in diesem Verzeichnis.
+
+#include "RS485SecureStack.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// ==============================================================================
+// Mitschnitt (Format siehe src/RS485BusCapture.h)
+// ==============================================================================
+const uint32_t PCAP_MAGIC_MICROS = 0xA1B2C3D4UL;
+const uint32_t CAPTURE_LINKTYPE = 147;
+const size_t PSEUDO_HEADER_LENGTH = 8;
+const uint8_t ESCAPE_BYTE = 0x7D; // Wie RS485_ESCAPE_BYTE in RS485SecureStack.cpp
+
+struct Record {
+    uint64_t timestampMicros; // Empfangsende des Frames
+    uint8_t status;           // RS485FrameTapStatus beim Mitschnitt
+    uint32_t baudRate;
+    std::vector<uint8_t> frame; // Ent-stufft, ab Startbyte 0xDE
+};
+
+uint32_t readLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void appendLe32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+bool loadCapture(const char* path, std::vector<Record>& records) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        perror(path);
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + n);
+    fclose(file);
+
+    // Bytes vor dem pcap-Dateikopf (z.B. Boot-Meldungen) überspringen
+    size_t pos = 0;
+    while (pos + 24 <= data.size() && readLe32(&data[pos]) != PCAP_MAGIC_MICROS) pos++;
+    if (pos + 24 > data.size()) {
+        fprintf(stderr, "%s: kein pcap-Dateikopf gefunden.\n", path);
+        return false;
+    }
+    if (readLe32(&data[pos + 20]) != CAPTURE_LINKTYPE) {
+        fprintf(stderr, "%s: unerwarteter Linktyp %u.\n", path, readLe32(&data[pos + 20]));
+        return false;
+    }
+    pos += 24;
+    while (pos + 16 <= data.size()) {
+        uint32_t capturedLength = readLe32(&data[pos + 8]);
+        if (capturedLength < PSEUDO_HEADER_LENGTH || pos + 16 + capturedLength > data.size()) {
+            break;
+        }
+        const uint8_t* p = &data[pos + 16];
+        Record record;
+        record.timestampMicros = (uint64_t)readLe32(&data[pos]) * 1000000ULL + readLe32(&data[pos + 4]);
+        record.status = p[1];
+        record.baudRate = readLe32(p + 4);
+        record.frame.assign(p + PSEUDO_HEADER_LENGTH, p + capturedLength);
+        records.push_back(record);
+        pos += 16 + capturedLength;
+    }
+    return !records.empty();
+}
+
+bool saveCapture(const char* path, const std::vector<Record>& records) {
+    std::vector<uint8_t> out;
+    appendLe32(out, PCAP_MAGIC_MICROS);
+    out.push_back(2); out.push_back(0); out.push_back(4); out.push_back(0);
+    appendLe32(out, 0);
+    appendLe32(out, 0);
+    appendLe32(out, PSEUDO_HEADER_LENGTH + MAX_PACKET_SIZE);
+    appendLe32(out, CAPTURE_LINKTYPE);
+    for (const Record& record : records) {
+        uint32_t capturedLength = PSEUDO_HEADER_LENGTH + record.frame.size();
+        appendLe32(out, (uint32_t)(record.timestampMicros / 1000000ULL));
+        appendLe32(out, (uint32_t)(record.timestampMicros % 1000000ULL));
+        appendLe32(out, capturedLength);
+        appendLe32(out, capturedLength);
+        out.push_back(1); // Version des Pseudo-Headers
+        out.push_back(record.status);
+        out.push_back(0);
+        out.push_back(0);
+        appendLe32(out, record.baudRate);
+        out.insert(out.end(), record.frame.begin(), record.frame.end());
+    }
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr || fwrite(out.data(), 1, out.size(), file) != out.size()) {
+        perror(path);
+        if (file) fclose(file);
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+// Byte-Stuffing wie RS485SecureStack::_transmitFrame(): Die Startbytes bleiben ungestufft
+void stuffFrame(const std::vector<uint8_t>& frame, std::vector<uint8_t>& out) {
+    for (size_t i = 0; i < frame.size(); ++i) {
+        uint8_t b = frame[i];
+        if (i >= PROTOCOL_VERSION_INDEX && (b == RS485_START_BYTE_0 || b == RS485_START_BYTE_1 || b == ESCAPE_BYTE)) {
+            out.push_back(ESCAPE_BYTE);
+            out.push_back(b ^ 0x20);
+        } else {
+            out.push_back(b);
+        }
+    }
+}
+
+std::vector<uint8_t> unstuffFrame(const uint8_t* data, size_t length) {
+    std::vector<uint8_t> frame;
+    for (size_t i = 0; i < length; ++i) {
+        if (i >= PROTOCOL_VERSION_INDEX && data[i] == ESCAPE_BYTE && i + 1 < length) {
+            frame.push_back(data[++i] ^ 0x20);
+        } else {
+            frame.push_back(data[i]);
+        }
+    }
+    return frame;
+}
+
+// ==============================================================================
+// Simulierte UART
+// ==============================================================================
+typedef std::chrono::steady_clock Clock;
+
+int64_t nanosSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+// Liefert die Bytes des Mitschnitts: im Echtzeitbetrieb erst ab ihrem Ankunftszeitpunkt,
+// sonst bis zur vom Messplatz gesetzten Grenze (ein Record je loop()-Aufruf).
+// Gesendete Bytes (ACKs des Stacks) werden nur gezählt.
+class ReplaySerial : public HardwareSerial {
+public:
+    std::vector<uint8_t> bytes;
+    std::vector<int64_t> arrivalNanos; // Ankunft je Byte relativ zum Start, nur im Echtzeitbetrieb
+    size_t limit = 0;
+    size_t position = 0;
+    bool realTime = false;
+    Clock::time_point start;
+    uint32_t replayBaudRate = 9600;
+    uint64_t bytesWritten = 0;
+
+    int available() override {
+        size_t end = limit;
+        if (realTime) {
+            int64_t now = nanosSince(start);
+            while (end < bytes.size() && arrivalNanos[end] <= now) end++;
+            limit = end;
+        }
+        return (int)(end - position);
+    }
+    int read() override {
+        return position < limit ? bytes[position++] : -1;
+    }
+    int peek() override {
+        return position < limit ? bytes[position] : -1;
+    }
+    size_t write(const uint8_t* data, size_t length) override {
+        (void)data;
+        bytesWritten += length;
+        return length;
+    }
+    size_t write(uint8_t b) override {
+        return write(&b, 1);
+    }
+    uint32_t baudRate() override { return replayBaudRate; }
+};
+
+// Zeichnet gesendete Frames des Korpus-Generators auf. Der Stack schreibt einen Frame in
+// mehreren Blöcken und ruft danach flush() auf, das den Frame abschließt.
+class RecordingSerial : public HardwareSerial {
+public:
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<uint8_t> pending;
+    uint32_t recordBaudRate = 250000;
+
+    size_t write(const uint8_t* data, size_t length) override {
+        pending.insert(pending.end(), data, data + length);
+        return length;
+    }
+    void flush() override {
+        if (!pending.empty()) {
+            frames.push_back(unstuffFrame(pending.data(), pending.size()));
+            pending.clear();
+        }
+    }
+    size_t write(uint8_t b) override {
+        return write(&b, 1);
+    }
+    uint32_t baudRate() override { return recordBaudRate; }
+};
+
+// ==============================================================================
+// Key-Updates (wie processKeyUpdate() im Submaster-Beispiel)
+// ==============================================================================
+bool applyKeyUpdate(RS485SecureStack& stack, const char* masterKey, const String& payload) {
+    int keyIdIndex = payload.indexOf("\"keyID\":");
+    int sessionKeyIndex = payload.indexOf("\"sessionKey\":\"");
+    int ivIndex = payload.indexOf("\"iv\":\"");
+    if (keyIdIndex == -1 || sessionKeyIndex == -1 || ivIndex == -1) {
+        return false;
+    }
+    uint8_t keyId = (uint8_t)payload.substring(keyIdIndex + 8).toInt();
+    String keyHex = payload.substring(sessionKeyIndex + 14, payload.indexOf('"', sessionKeyIndex + 14));
+    String ivHex = payload.substring(ivIndex + 6, payload.indexOf('"', ivIndex + 6));
+    if (keyHex.length() != 64 || ivHex.length() != 32) {
+        return false;
+    }
+    uint8_t sessionKey[32];
+    uint8_t iv[16];
+    for (int i = 0; i < 32; ++i) sessionKey[i] = (uint8_t)strtol(keyHex.substring(i * 2, i * 2 + 2).c_str(), nullptr, 16);
+    for (int i = 0; i < 16; ++i) iv[i] = (uint8_t)strtol(ivHex.substring(i * 2, i * 2 + 2).c_str(), nullptr, 16);
+
+    uint8_t masterKeyHash[32];
+    SHA256 sha256;
+    sha256.reset();
+    sha256.update(masterKey, strlen(masterKey));
+    sha256.finalize(masterKeyHash, sizeof(masterKeyHash));
+    AES256 aes256;
+    aes256.setKey(masterKeyHash, aes256.keySize());
+    aes256.setIV(iv, aes256.ivSize());
+    aes256.decryptCBC(sessionKey, sizeof(sessionKey));
+    return stack.setSessionKey(keyId, sessionKey, sizeof(sessionKey));
+}
+
+String makeKeyUpdatePayload(const char* masterKey, uint8_t keyId, const uint8_t* sessionKey) {
+    uint8_t masterKeyHash[32];
+    SHA256 sha256;
+    sha256.reset();
+    sha256.update(masterKey, strlen(masterKey));
+    sha256.finalize(masterKeyHash, sizeof(masterKeyHash));
+    uint8_t iv[16];
+    uint8_t encrypted[32];
+    for (int i = 0; i < 16; ++i) iv[i] = random(256);
+    memcpy(encrypted, sessionKey, sizeof(encrypted));
+    AES256 aes256;
+    aes256.setKey(masterKeyHash, aes256.keySize());
+    aes256.setIV(iv, aes256.ivSize());
+    aes256.encryptCBC(encrypted, sizeof(encrypted));
+
+    char text[160];
+    int pos = snprintf(text, sizeof(text), "{\"keyID\":%d,\"sessionKey\":\"", keyId);
+    for (int i = 0; i < 32; ++i) pos += snprintf(text + pos, sizeof(text) - pos, "%02X", encrypted[i]);
+    pos += snprintf(text + pos, sizeof(text) - pos, "\",\"iv\":\"");
+    for (int i = 0; i < 16; ++i) pos += snprintf(text + pos, sizeof(text) - pos, "%02X", iv[i]);
+    snprintf(text + pos, sizeof(text) - pos, "\"}");
+    return String(text);
+}
+
+// ==============================================================================
+// Messung
+// ==============================================================================
+struct Distribution {
+    std::vector<int64_t> samples; // Nanosekunden
+
+    void add(int64_t nanos) { samples.push_back(nanos); }
+    double percentileMicros(double p) {
+        if (samples.empty()) return 0;
+        std::sort(samples.begin(), samples.end());
+        size_t index = (size_t)(p * (samples.size() - 1) + 0.5);
+        return samples[index] / 1000.0;
+    }
+    double averageMicros() const {
+        if (samples.empty()) return 0;
+        int64_t sum = 0;
+        for (int64_t s : samples) sum += s;
+        return sum / 1000.0 / samples.size();
+    }
+};
+
+struct ReplayOptions {
+    const char* masterKey = "replay-master-key";
+    uint8_t address = 1;
+    bool realTime = false;
+    double speed = 1.0;
+    int repeat = 1;
+    bool pipelined = false;
+    bool csv = false;
+    bool debug = false;
+};
+
+struct ReplayResult {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    int64_t busyNanos = 0;     // Zeit in loop()
+    int64_t wallNanos = 0;     // Gesamtdauer des Durchlaufs
+    Distribution frameTime;    // loop()-Zeit je Frame
+    Distribution callbackLatency; // Letztes Byte verfügbar bis Callback
+    uint64_t tapStatus[3] = { 0, 0, 0 };
+    uint64_t statusMismatch = 0; // Status weicht vom Mitschnitt ab
+    uint64_t delivered = 0;
+    uint64_t keyUpdates = 0;
+    uint64_t bytesWritten = 0;
+    RS485SecureStack::LinkStats_t linkStats = {};
+};
+
+// Zustand eines Durchlaufs, für Tap und Callback erreichbar
+struct ReplayRun {
+    RS485SecureStack* stack;
+    const ReplayOptions* options;
+    ReplayResult* result;
+    ReplaySerial* serial;
+    const std::vector<Record>* records;
+    std::vector<size_t> recordEnd;       // Index hinter dem letzten Byte jedes Records
+    std::vector<bool> tapped;            // Record hat einen Frame-Mitschnitt ausgelöst
+    size_t currentRecord = 0;
+    size_t framesInCall = 0;             // Im laufenden loop()-Aufruf abgeschlossene Frames
+    int64_t availableNanos = 0;          // Letztes Byte des zuletzt abgeschlossenen Frames verfügbar
+};
+
+void onFrameTap(void* context, const uint8_t* frame, size_t length, unsigned long rxMicros, uint8_t status) {
+    (void)frame; (void)length; (void)rxMicros;
+    ReplayRun* run = static_cast<ReplayRun*>(context);
+    if (status <= RS485_TAP_FRAME_ABORTED) run->result->tapStatus[status]++;
+    run->framesInCall++;
+
+    // Record des zuletzt gelesenen Bytes. Einen abgebrochenen Frame erkennt der Stack oft erst
+    // am Startbyte des nächsten Records, der Abbruch gehört dann zum vorherigen. Weil der Stack
+    // blockweise liest, kann der Lesezeiger dabei schon weiter im nächsten Record stehen.
+    size_t lastByte = run->serial->position - 1;
+    while (run->currentRecord + 1 < run->recordEnd.size() && run->recordEnd[run->currentRecord] <= lastByte) {
+        run->currentRecord++;
+    }
+    size_t index = run->currentRecord;
+    if (status == RS485_TAP_FRAME_ABORTED && index > 0 && !run->tapped[index - 1]) {
+        index--;
+    }
+    if (!run->tapped[index]) {
+        run->tapped[index] = true;
+        if ((*run->records)[index].status != status) run->result->statusMismatch++;
+    }
+    if (run->options->realTime) {
+        run->availableNanos = run->serial->arrivalNanos[lastByte];
+    }
+}
+
+void onPacket(void* context, RS485SecureStack::Packet_t packet) {
+    ReplayRun* run = static_cast<ReplayRun*>(context);
+    run->result->delivered++;
+    run->result->callbackLatency.add(nanosSince(run->serial->start) - run->availableNanos);
+    if (packet.messageType == MSG_TYPE_KEY_UPDATE && packet.senderAddress == 0 &&
+        applyKeyUpdate(*run->stack, run->options->masterKey, packet.payload)) {
+        run->result->keyUpdates++;
+    }
+}
+
+void replayOnce(const std::vector<Record>& records, const ReplayOptions& options, ReplayResult& result) {
+    ReplaySerial serial;
+    std::unique_ptr<RS485SecureStack> stack(new RS485SecureStack());
+    ReplayRun run;
+    run.stack = stack.get();
+    run.options = &options;
+    run.result = &result;
+    run.serial = &serial;
+    run.records = &records;
+
+    // Bytefolge und Ankunftszeiten: das letzte Byte eines Records kommt zu seinem Zeitstempel an,
+    // die übrigen im Abstand einer Zeichenzeit (10 Bit) davor
+    uint64_t firstTimestamp = records.front().timestampMicros;
+    for (const Record& record : records) {
+        size_t begin = serial.bytes.size();
+        stuffFrame(record.frame, serial.bytes);
+        size_t count = serial.bytes.size() - begin;
+        double byteNanos = 10e9 / (record.baudRate ? record.baudRate : 250000);
+        double endNanos = (record.timestampMicros - firstTimestamp) * 1000.0 / options.speed;
+        for (size_t i = 0; i < count; ++i) {
+            serial.arrivalNanos.push_back((int64_t)(endNanos - (count - 1 - i) * byteNanos / options.speed));
+        }
+        run.recordEnd.push_back(serial.bytes.size());
+    }
+    run.tapped.assign(records.size(), false);
+    serial.replayBaudRate = records.front().baudRate;
+    serial.realTime = options.realTime;
+
+    stack->begin(options.address, options.masterKey, 0, serial);
+    stack->setDebug(options.debug);
+    stack->setFrameTap(onFrameTap, &run);
+    stack->registerReceiveCallback(onPacket, &run);
+    if (options.pipelined && !stack->enablePipelinedReceive(0, 1)) {
+        fprintf(stderr, "Hinweis: Pipeline-Empfang auf dem Host nicht verfügbar (kein FreeRTOS).\n");
+    }
+
+    serial.start = Clock::now();
+    int64_t pendingBusy = 0;
+    size_t recordIndex = 0;
+    while (serial.position < serial.bytes.size()) {
+        if (!options.realTime) {
+            // Ein Record je loop()-Aufruf: die loop()-Zeit gehört genau zu diesem Frame
+            serial.limit = run.recordEnd[recordIndex++];
+            run.availableNanos = nanosSince(serial.start);
+        } else if (serial.available() == 0) {
+            continue; // Auf das nächste Byte warten (aktiv, wie eine Loop auf dem Mikrocontroller)
+        }
+        run.framesInCall = 0;
+        Clock::time_point before = Clock::now();
+        stack->loop();
+        int64_t busy = nanosSince(before);
+        result.busyNanos += busy;
+        pendingBusy += busy;
+        if (run.framesInCall > 0) {
+            for (size_t i = 0; i < run.framesInCall; ++i) result.frameTime.add(pendingBusy / (int64_t)run.framesInCall);
+            pendingBusy = 0;
+        }
+    }
+    stack->loop(); // Abschließend gepufferte Frames zustellen
+    for (bool tapped : run.tapped) {
+        if (!tapped) result.statusMismatch++; // Record hat keinen Frame ergeben
+    }
+    result.wallNanos += nanosSince(serial.start);
+    result.frames += records.size();
+    result.bytes += serial.bytes.size();
+    result.bytesWritten += serial.bytesWritten;
+
+    const RS485SecureStack::LinkStats_t& link = stack->getLinkStats();
+    result.linkStats.framesReceived += link.framesReceived;
+    result.linkStats.crcErrors += link.crcErrors;
+    result.linkStats.hmacErrors += link.hmacErrors;
+    result.linkStats.framingErrors += link.framingErrors;
+}
+
+void printResult(const char* name, const ReplayOptions& options, ReplayResult& result) {
+    double busySeconds = result.busyNanos / 1e9;
+    double throughput = busySeconds > 0 ? result.bytes / busySeconds : 0;
+    double frameRate = busySeconds > 0 ? result.frames / busySeconds : 0;
+    if (options.csv) {
+        printf("%s,%s,%d,%llu,%llu,%.0f,%.0f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%llu,%llu,%llu,%u,%u,%u,%u,%llu,%llu\n",
+               name, options.realTime ? "timed" : "fast", options.repeat,
+               (unsigned long long)result.frames, (unsigned long long)result.bytes, throughput, frameRate,
+               result.frameTime.percentileMicros(0.5), result.frameTime.percentileMicros(0.99),
+               result.frameTime.percentileMicros(1.0), result.callbackLatency.percentileMicros(0.5),
+               result.callbackLatency.percentileMicros(0.99), result.callbackLatency.percentileMicros(1.0),
+               (unsigned long long)result.tapStatus[RS485_TAP_FRAME_VALID],
+               (unsigned long long)result.tapStatus[RS485_TAP_FRAME_INVALID],
+               (unsigned long long)result.tapStatus[RS485_TAP_FRAME_ABORTED],
+               result.linkStats.framesReceived, result.linkStats.crcErrors, result.linkStats.hmacErrors,
+               result.linkStats.framingErrors, (unsigned long long)result.delivered,
+               (unsigned long long)result.statusMismatch);
+        return;
+    }
+    printf("=== %s (%s, %d Durchläufe) ===\n", name, options.realTime ? "Original-Timing" : "so schnell wie möglich", options.repeat);
+    printf("Records: %llu, Bytes: %llu, gesendet (ACKs): %llu\n", (unsigned long long)result.frames,
+           (unsigned long long)result.bytes, (unsigned long long)result.bytesWritten);
+    printf("Zeit in loop(): %.3f ms, Durchsatz: %.0f Bytes/s, %.0f Frames/s", result.busyNanos / 1e6, throughput, frameRate);
+    if (options.realTime) printf(", Dauer: %.3f s, CPU-Anteil: %.1f %%", result.wallNanos / 1e9, 100.0 * result.busyNanos / result.wallNanos);
+    printf("\n");
+    printf("Verarbeitungszeit je Frame [us]:  avg %.2f  p50 %.2f  p99 %.2f  max %.2f\n",
+           result.frameTime.averageMicros(), result.frameTime.percentileMicros(0.5),
+           result.frameTime.percentileMicros(0.99), result.frameTime.percentileMicros(1.0));
+    printf("Latenz bis Callback [us]:         avg %.2f  p50 %.2f  p99 %.2f  max %.2f  (%llu Pakete)\n",
+           result.callbackLatency.averageMicros(), result.callbackLatency.percentileMicros(0.5),
+           result.callbackLatency.percentileMicros(0.99), result.callbackLatency.percentileMicros(1.0),
+           (unsigned long long)result.delivered);
+    printf("Frames: gültig %llu, ungültig %llu, abgebrochen %llu, Status abweichend vom Mitschnitt %llu\n",
+           (unsigned long long)result.tapStatus[RS485_TAP_FRAME_VALID],
+           (unsigned long long)result.tapStatus[RS485_TAP_FRAME_INVALID],
+           (unsigned long long)result.tapStatus[RS485_TAP_FRAME_ABORTED], (unsigned long long)result.statusMismatch);
+    printf("Stack: angenommen %u, CRC-Fehler %u, HMAC-Fehler %u, Framing-Fehler %u, Key-Updates %llu\n\n",
+           result.linkStats.framesReceived, result.linkStats.crcErrors, result.linkStats.hmacErrors,
+           result.linkStats.framingErrors, (unsigned long long)result.keyUpdates);
+}
+
+// ==============================================================================
+// Synthetische Korpora
+// ==============================================================================
+// Erzeugt Frames mit einer zweiten Stack-Instanz, damit der Korpus immer dem aktuellen
+// Sendepfad entspricht. Zeitstempel sind virtuell: Sendezeit bei recordBaudRate plus Pause.
+class CorpusBuilder {
+public:
+    CorpusBuilder(const char* masterKey, uint32_t baudRate, uint32_t seed) : _masterKey(masterKey) {
+        randomSeed(seed);
+        _serial.recordBaudRate = baudRate;
+        _stack.begin(0, masterKey, 0, _serial);
+    }
+
+    void send(uint8_t destination, uint8_t sender, char type, const String& payload, uint32_t gapMicros, uint8_t keyId = 0) {
+        _stack.setCurrentKeyId(keyId);
+        _stack.sendMessage(destination, sender, type, payload, false);
+        if (_serial.frames.empty()) return;
+        Record record;
+        record.frame = _serial.frames.back();
+        _serial.frames.clear();
+        record.status = RS485_TAP_FRAME_VALID;
+        record.baudRate = _serial.recordBaudRate;
+        std::vector<uint8_t> stuffed;
+        stuffFrame(record.frame, stuffed);
+        _time += gapMicros + stuffed.size() * 10000000ULL / _serial.recordBaudRate;
+        record.timestampMicros = _time;
+        records.push_back(record);
+    }
+
+    void addSessionKey(uint8_t keyId, const uint8_t* key) { _stack.setSessionKey(keyId, key, 32); }
+    String keyUpdate(uint8_t keyId, const uint8_t* key) { return makeKeyUpdatePayload(_masterKey, keyId, key); }
+
+    // Verfälscht den letzten Frame so, wie ihn ein gestörter Empfänger gesehen hätte:
+    // 0 = Bitfehler (CRC-Fehler), 1 = abgebrochen
+    void corruptLast(int kind) {
+        Record& record = records.back();
+        std::vector<uint8_t>& frame = record.frame;
+        if (kind == 0) { // Bitfehler im Frame: CRC-Fehler
+            frame[MESSAGE_TYPE_INDEX + random(frame.size() - MESSAGE_TYPE_INDEX)] ^= (uint8_t)(1 << random(8));
+            record.status = RS485_TAP_FRAME_INVALID;
+        } else { // Abgebrochen (z.B. Sender mitten im Frame zurückgesetzt)
+            frame.resize(SEQUENCE_INDEX + random(frame.size() - SEQUENCE_INDEX - 1));
+            record.status = RS485_TAP_FRAME_ABORTED;
+        }
+    }
+
+    std::vector<Record> records;
+
+private:
+    const char* _masterKey;
+    RecordingSerial _serial;
+    RS485SecureStack _stack;
+    uint64_t _time = 1000000;
+};
+
+String telemetryPayload(uint8_t node, int index) {
+    char text[96];
+    int extra = random(4);
+    snprintf(text, sizeof(text), "N%u;T:%d.%d;H:%d;P:%d%s", node, 18 + (index % 9), index % 10, 35 + (index % 30),
+             990 + (index % 40), extra == 0 ? ";STATUS:OK;UPTIME:123456;FW:1.4.2" : "");
+    return String(text);
+}
+
+// Key ID, deren Schlüssel nur der Generator kennt (Frames eines Angreifers ohne gültigen Schlüssel)
+const uint8_t FORGED_KEY_ID = 7;
+
+bool generateCorpus(const std::string& kind, const char* path, int frames, uint32_t baudRate, const char* masterKey) {
+    CorpusBuilder builder(masterKey, baudRate, 0x5EED);
+    const uint8_t nodes[] = { 1, 2, 3, 4, 5 };
+    uint8_t keyId = 0;
+    uint8_t key1[32];
+    uint8_t key2[32];
+    uint8_t forgedKey[32];
+    for (int i = 0; i < 32; ++i) { key1[i] = random(256); key2[i] = random(256); forgedKey[i] = random(256); }
+    builder.addSessionKey(FORGED_KEY_ID, forgedKey);
+
+    for (int i = 0; i < frames; ++i) {
+        if (i % 25 == 0) {
+            builder.send(RS485_BROADCAST_ADDRESS, 0, MSG_TYPE_MASTER_HEARTBEAT, "HB", 500, keyId);
+            continue;
+        }
+        uint8_t node = nodes[random(5)];
+        if (kind == "broadcast") {
+            // Dichter Broadcast-Verkehr mit großen Payloads und minimalen Pausen
+            String payload = telemetryPayload(node, i);
+            while (payload.length() < 150) payload += ";PAD:0123456789";
+            builder.send(RS485_BROADCAST_ADDRESS, node, MSG_TYPE_DATA, payload, 50 + random(100), keyId);
+            continue;
+        }
+        if (kind == "rekey" && i == frames / 3) {
+            builder.addSessionKey(1, key1);
+            builder.send(RS485_BROADCAST_ADDRESS, 0, MSG_TYPE_KEY_UPDATE, builder.keyUpdate(1, key1), 500, keyId);
+            keyId = 1;
+            continue;
+        }
+        if (kind == "rekey" && i == 2 * frames / 3) {
+            // Ein Knoten wechselt vorzeitig auf Key 2: Bis zum Key-Update schlägt sein HMAC fehl
+            builder.addSessionKey(2, key2);
+            for (int early = 0; early < 3; ++early) {
+                builder.send(0, 4, MSG_TYPE_DATA, telemetryPayload(4, i), 800, 2);
+            }
+            builder.send(RS485_BROADCAST_ADDRESS, 0, MSG_TYPE_KEY_UPDATE, builder.keyUpdate(2, key2), 500, keyId);
+            keyId = 2;
+            continue;
+        }
+        // Abfrage durch den Master und Antwort des Knotens; Abfragen an Knoten 1 erreichen den Replay-Knoten
+        uint8_t senderKey = keyId;
+        if (kind == "rekey" && keyId > 0 && random(10) == 0) senderKey = keyId - 1; // Nachzügler mit altem Key
+        if (i % 2 == 1) {
+            builder.send(node, 0, MSG_TYPE_DATA, "REQ", 300 + random(300), keyId);
+        } else {
+            builder.send(0, node, MSG_TYPE_DATA, telemetryPayload(node, i), 300 + random(300), senderKey);
+        }
+        if (kind == "noisy") {
+            int roll = random(100);
+            if (roll < 5) builder.corruptLast(0);
+            else if (roll < 7) builder.corruptLast(1);
+            else if (roll < 8) builder.send(0, node, MSG_TYPE_DATA, "FORGED", 300, FORGED_KEY_ID); // CRC gültig, HMAC falsch
+        }
+    }
+    if (!saveCapture(path, builder.records)) return false;
+    printf("%s: %zu Records (%s) geschrieben.\n", path, builder.records.size(), kind.c_str());
+    return true;
+}
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "Aufruf: %s [Optionen] <mitschnitt.pcap>...\n"
+            "        %s --generate clean|noisy|broadcast|rekey <ausgabe.pcap> [-n frames] [-b baud] [-m key]\n"
+            "  -m <key>     Master Key (Standard: replay-master-key, passend zu den mitgelieferten Korpora)\n"
+            "  -a <adresse> Adresse des Replay-Knotens (Standard: 1)\n"
+            "  -t           Original-Timing statt so schnell wie möglich\n"
+            "  -s <faktor>  Zeitraffer für -t (2 = doppelt so schnell)\n"
+            "  -r <n>       n Durchläufe (je mit neuem Stack), Ergebnisse zusammengefasst\n"
+            "  -p           Pipeline-Empfang anfordern (nur auf dem Mikrocontroller verfügbar)\n"
+            "  -d           Debug-Ausgaben des Stacks\n"
+            "  --csv        Eine CSV-Zeile je Mitschnitt (zum Vergleich zwischen Commits)\n", name, name);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    std::vector<const char*> inputs;
+    std::string generateKind;
+    const char* generatePath = nullptr;
+    int generateFrames = 500;
+    uint32_t generateBaud = 250000;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--generate" && i + 2 < argc) {
+            generateKind = argv[++i];
+            generatePath = argv[++i];
+        } else if (arg == "-n" && hasValue) {
+            generateFrames = atoi(argv[++i]);
+        } else if (arg == "-b" && hasValue) {
+            generateBaud = (uint32_t)atol(argv[++i]);
+        } else if (arg == "-m" && hasValue) {
+            options.masterKey = argv[++i];
+        } else if (arg == "-a" && hasValue) {
+            options.address = (uint8_t)atoi(argv[++i]);
+        } else if (arg == "-t") {
+            options.realTime = true;
+        } else if (arg == "-s" && hasValue) {
+            options.speed = atof(argv[++i]);
+        } else if (arg == "-r" && hasValue) {
+            options.repeat = atoi(argv[++i]);
+        } else if (arg == "-p") {
+            options.pipelined = true;
+        } else if (arg == "-d") {
+            options.debug = true;
+        } else if (arg == "--csv") {
+            options.csv = true;
+        } else if (arg[0] != '-') {
+            inputs.push_back(argv[i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (generatePath != nullptr) {
+        if (generateKind != "clean" && generateKind != "noisy" && generateKind != "broadcast" && generateKind != "rekey") {
+            usage(argv[0]);
+            return 2;
+        }
+        return generateCorpus(generateKind, generatePath, generateFrames, generateBaud, options.masterKey) ? 0 : 1;
+    }
+    if (inputs.empty() || options.repeat < 1 || options.speed <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    hostSetSerialOutput(options.debug);
+
+    if (options.csv) {
+        printf("corpus,mode,runs,records,bytes,bytes_per_s,frames_per_s,frame_p50_us,frame_p99_us,frame_max_us,"
+               "callback_p50_us,callback_p99_us,callback_max_us,valid,invalid,aborted,accepted,crc_errors,"
+               "hmac_errors,framing_errors,delivered,status_mismatch\n");
+    }
+    int exitCode = 0;
+    for (const char* input : inputs) {
+        std::vector<Record> records;
+        if (!loadCapture(input, records)) {
+            exitCode = 1;
+            continue;
+        }
+        ReplayResult result;
+        for (int run = 0; run < options.repeat; ++run) {
+            replayOnce(records, options, result);
+        }
+        const char* name = strrchr(input, '/') ? strrchr(input, '/') + 1 : input;
+        printResult(name, options, result);
+    }
+    return exitCode;
+}